@@ -0,0 +1,544 @@
+#include "arrow.hpp"
+#include "wad.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Arrow metadata constants (Schema.fbs, Message.fbs)
+constexpr int16_t  kMetadataV5   = 4;
+constexpr uint8_t  kHeaderSchema = 1;
+constexpr uint8_t  kHeaderBatch  = 3;
+constexpr uint8_t  kTypeInt      = 2;
+constexpr uint8_t  kTypeUtf8     = 5;
+constexpr char     kMagic[]      = "ARROW1";
+constexpr uint8_t  kPadding[8]   = {};
+constexpr uint32_t kContinuation = 0xFFFFFFFF;
+
+// Append an integer as size little-endian bytes
+void appendLE(std::vector<uint8_t> &out, uint64_t value, std::size_t size) {
+  for (std::size_t k = 0; k < size; k++) {
+    out.push_back(static_cast<uint8_t>(value >> (8 * k)));
+  }
+}
+
+/**
+ * Minimal FlatBuffers builder for the Arrow metadata. Like the reference
+ * builder it fills the buffer back to front, so objects only refer to
+ * objects built before them, and tables are built one at a time: strings,
+ * vectors and child tables first, then start(), the fields and end().
+ * References are positions counted from the end of the buffer.
+ */
+class FlatBuilder {
+public:
+  using Ref = uint32_t;
+
+  Ref string(std::string_view s) {
+    align(s.size() + 1, 4);
+    bytes_.push_back(0);
+    for (std::size_t i = s.size(); i-- > 0;) {
+      bytes_.push_back(static_cast<uint8_t>(s[i]));
+    }
+    push(s.size(), 4);
+    return size();
+  }
+
+  // Vector of structs, given as their little-endian bytes
+  Ref structs(const std::vector<uint8_t> &data, std::size_t count,
+              std::size_t alignment) {
+    align(data.size(), std::max<std::size_t>(alignment, 4));
+    for (std::size_t i = data.size(); i-- > 0;) {
+      bytes_.push_back(data[i]);
+    }
+    push(count, 4);
+    return size();
+  }
+
+  // Vector of tables
+  Ref tables(const std::vector<Ref> &refs) {
+    align(refs.size() * 4, 4);
+    for (std::size_t i = refs.size(); i-- > 0;) {
+      pushRef(refs[i]);
+    }
+    push(refs.size(), 4);
+    return size();
+  }
+
+  void start() {
+    fields_.clear();
+    start_ = size();
+  }
+
+  template <typename T> void add(int id, T value) {
+    align(sizeof(T), sizeof(T));
+    push(static_cast<uint64_t>(value), sizeof(T));
+    fields_.emplace_back(id, size());
+  }
+
+  void addRef(int id, Ref ref) {
+    align(4, 4);
+    pushRef(ref);
+    fields_.emplace_back(id, size());
+  }
+
+  // Close the table: its vtable goes right before it
+  Ref end() {
+    align(4, 4);
+    push(0, 4);
+    Ref table = size();
+
+    int count = 0;
+    for (const auto &field : fields_) {
+      count = std::max(count, field.first + 1);
+    }
+    for (int id = count; id-- > 0;) {
+      Ref offset = 0;
+      for (const auto &field : fields_) {
+        if (field.first == id) {
+          offset = table - field.second;
+        }
+      }
+      push(offset, 2);
+    }
+    push(table - start_, 2);
+    push(4 + 2 * count, 2);
+
+    // The table starts with the signed distance back to its vtable
+    uint32_t distance = size() - table;
+    for (std::size_t k = 0; k < 4; k++) {
+      bytes_[table - 1 - k] = static_cast<uint8_t>(distance >> (8 * k));
+    }
+    return table;
+  }
+
+  // Buffer with root as its root table
+  std::vector<uint8_t> finish(Ref root) {
+    align(4, minAlign_);
+    pushRef(root);
+    return std::vector<uint8_t>(bytes_.rbegin(), bytes_.rend());
+  }
+
+private:
+  std::vector<uint8_t>             bytes_;  // Reversed
+  std::vector<std::pair<int, Ref>> fields_;
+  Ref                              start_    = 0;
+  std::size_t                      minAlign_ = 1;
+
+  Ref size() const { return static_cast<Ref>(bytes_.size()); }
+
+  // Pad so that the next size bytes end on an alignment boundary
+  void align(std::size_t size, std::size_t alignment) {
+    minAlign_ = std::max(minAlign_, alignment);
+    while ((bytes_.size() + size) % alignment != 0) {
+      bytes_.push_back(0);
+    }
+  }
+
+  void push(uint64_t value, std::size_t size) {
+    for (std::size_t k = size; k-- > 0;) {
+      bytes_.push_back(static_cast<uint8_t>(value >> (8 * k)));
+    }
+  }
+
+  // Offsets point forward, from where they are stored to the object
+  void pushRef(Ref ref) { push(size() + 4 - ref, 4); }
+};
+
+// Schema table of the fields
+FlatBuilder::Ref schema(FlatBuilder                   &fb,
+                        const std::vector<ArrowField> &fields) {
+  std::vector<FlatBuilder::Ref> refs;
+  for (const ArrowField &field : fields) {
+    FlatBuilder::Ref name     = fb.string(field.name);
+    FlatBuilder::Ref children = fb.tables({});
+    fb.start();
+    if (field.bits > 0) {
+      fb.add<int32_t>(0, field.bits);
+      fb.add<uint8_t>(1, field.isSigned);
+    }
+    FlatBuilder::Ref type = fb.end();
+
+    fb.start();
+    fb.addRef(0, name);
+    fb.addRef(3, type);
+    fb.addRef(5, children);
+    fb.add<uint8_t>(1, 0);  // Not nullable
+    fb.add<uint8_t>(2, field.bits > 0 ? kTypeInt : kTypeUtf8);
+    refs.push_back(fb.end());
+  }
+  FlatBuilder::Ref list = fb.tables(refs);
+  fb.start();
+  fb.addRef(1, list);
+  fb.add<int16_t>(0, 0);  // Little endian
+  return fb.end();
+}
+
+// Message wrapping a schema or record batch header
+std::vector<uint8_t> messageMetadata(FlatBuilder &fb, uint8_t type,
+                                     FlatBuilder::Ref header,
+                                     uint64_t         bodyLength) {
+  fb.start();
+  fb.add<int64_t>(3, static_cast<int64_t>(bodyLength));
+  fb.addRef(2, header);
+  fb.add<int16_t>(0, kMetadataV5);
+  fb.add<uint8_t>(1, type);
+  return fb.finish(fb.end());
+}
+
+// Lump-style name, up to its first NUL
+std::string_view fixedName(const char *name) {
+  return std::string_view(name, strnlen(name, 8));
+}
+
+// Bytes of a buffer, padded to 8, go to the body; (offset, length) to the
+// buffer list of the batch
+void addBuffer(std::vector<uint8_t> &body, std::vector<uint8_t> &buffers,
+               const void *data, std::size_t size) {
+  appendLE(buffers, body.size(), 8);
+  appendLE(buffers, size, 8);
+  const auto *bytes = static_cast<const uint8_t *>(data);
+  body.insert(body.end(), bytes, bytes + size);
+  body.resize((body.size() + 7) / 8 * 8, 0);
+}
+
+}  // namespace
+
+ArrowBatch::ArrowBatch(const std::vector<ArrowField> &fields)
+    : fields_(fields), values_(fields.size()), offsets_(fields.size()) {
+  for (std::size_t c = 0; c < fields_.size(); c++) {
+    if (fields_[c].bits == 0) {
+      offsets_[c].push_back(0);
+    }
+  }
+}
+
+void ArrowBatch::integer(std::size_t column, int64_t value) {
+  appendLE(values_[column], static_cast<uint64_t>(value),
+           static_cast<std::size_t>(fields_[column].bits / 8));
+}
+
+void ArrowBatch::string(std::size_t column, std::string_view value) {
+  values_[column].insert(values_[column].end(), value.begin(), value.end());
+  offsets_[column].push_back(static_cast<int32_t>(values_[column].size()));
+}
+
+std::size_t ArrowBatch::rows() const {
+  if (fields_.empty()) {
+    return 0;
+  }
+  return fields_[0].bits > 0 ? values_[0].size() / (fields_[0].bits / 8)
+                             : offsets_[0].size() - 1;
+}
+
+/**
+ * @brief Create the file and write the schema
+ * @param path Output file
+ * @param fields Columns of the table
+ * @throws std::runtime_error if the file cannot be written
+ */
+ArrowWriter::ArrowWriter(const std::string      &path,
+                         std::vector<ArrowField> fields)
+    : path_(path), fields_(std::move(fields)), file_(path, std::ios::binary) {
+  if (!file_) {
+    throw std::runtime_error("Unable to open output file: " + path_);
+  }
+  append(kMagic, 6);
+  append(kPadding, 2);
+
+  FlatBuilder      fb;
+  FlatBuilder::Ref header = schema(fb, fields_);
+  message(messageMetadata(fb, kHeaderSchema, header, 0), {});
+}
+
+void ArrowWriter::append(const void *data, std::size_t size) {
+  file_.write(static_cast<const char *>(data),
+              static_cast<std::streamsize>(size));
+  if (!file_) {
+    throw std::runtime_error("Unable to write output file: " + path_);
+  }
+  position_ += size;
+}
+
+/**
+ * @brief Write an encapsulated message: continuation marker, metadata length,
+ *        metadata padded to 8 bytes, then the body
+ * @param metadata FlatBuffers Message
+ * @param body Message body, a multiple of 8 bytes long
+ * @return Length of everything before the body
+ */
+uint32_t ArrowWriter::message(const std::vector<uint8_t> &metadata,
+                              const std::vector<uint8_t> &body) {
+  auto padded = static_cast<uint32_t>((metadata.size() + 7) / 8 * 8);
+
+  std::vector<uint8_t> prefix;
+  appendLE(prefix, kContinuation, 4);
+  appendLE(prefix, padded, 4);
+  append(prefix.data(), prefix.size());
+  append(metadata.data(), metadata.size());
+  append(kPadding, padded - metadata.size());
+  append(body.data(), body.size());
+  return 8 + padded;
+}
+
+/**
+ * @brief Write a record batch
+ * @param batch Rows, built over fields()
+ * @throws std::runtime_error if the columns have different lengths or the
+ *         file cannot be written
+ */
+void ArrowWriter::write(const ArrowBatch &batch) {
+  std::size_t rows = batch.rows();
+  for (std::size_t c = 0; c < fields_.size(); c++) {
+    std::size_t length = fields_[c].bits > 0
+                             ? batch.values_[c].size() / (fields_[c].bits / 8)
+                             : batch.offsets_[c].size() - 1;
+    if (length != rows) {
+      throw std::runtime_error("Arrow column " + fields_[c].name + " has " +
+                               std::to_string(length) + " rows instead of " +
+                               std::to_string(rows));
+    }
+  }
+
+  // Every column: no validity bitmap, then its offsets (strings) and values
+  std::vector<uint8_t> body, nodes, buffers;
+  for (std::size_t c = 0; c < fields_.size(); c++) {
+    appendLE(nodes, rows, 8);
+    appendLE(nodes, 0, 8);
+    addBuffer(body, buffers, nullptr, 0);
+    if (fields_[c].bits == 0) {
+      addBuffer(body, buffers, batch.offsets_[c].data(),
+                batch.offsets_[c].size() * sizeof(int32_t));
+    }
+    addBuffer(body, buffers, batch.values_[c].data(), batch.values_[c].size());
+  }
+
+  FlatBuilder      fb;
+  FlatBuilder::Ref nodeList   = fb.structs(nodes, nodes.size() / 16, 8);
+  FlatBuilder::Ref bufferList = fb.structs(buffers, buffers.size() / 16, 8);
+  fb.start();
+  fb.add<int64_t>(0, static_cast<int64_t>(rows));
+  fb.addRef(1, nodeList);
+  fb.addRef(2, bufferList);
+  FlatBuilder::Ref header = fb.end();
+
+  uint64_t offset = position_;
+  uint32_t length =
+      message(messageMetadata(fb, kHeaderBatch, header, body.size()), body);
+  blocks_.push_back({offset, length, body.size()});
+}
+
+/**
+ * @brief Write the footer and close the file
+ * @return Size of the file
+ * @throws std::runtime_error if the file cannot be written
+ */
+std::size_t ArrowWriter::finish() {
+  // End of stream marker, then the footer
+  std::vector<uint8_t> eos;
+  appendLE(eos, kContinuation, 4);
+  appendLE(eos, 0, 4);
+  append(eos.data(), eos.size());
+
+  std::vector<uint8_t> blocks;
+  for (const Block &block : blocks_) {
+    appendLE(blocks, block.offset, 8);
+    appendLE(blocks, block.metadataLength, 4);
+    appendLE(blocks, 0, 4);
+    appendLE(blocks, block.bodyLength, 8);
+  }
+  FlatBuilder      fb;
+  FlatBuilder::Ref header       = schema(fb, fields_);
+  FlatBuilder::Ref dictionaries = fb.structs({}, 0, 8);
+  FlatBuilder::Ref batches      = fb.structs(blocks, blocks_.size(), 8);
+  fb.start();
+  fb.addRef(1, header);
+  fb.addRef(2, dictionaries);
+  fb.addRef(3, batches);
+  fb.add<int16_t>(0, kMetadataV5);
+  std::vector<uint8_t> footer = fb.finish(fb.end());
+
+  appendLE(footer, footer.size(), 4);
+  append(footer.data(), footer.size());
+  append(kMagic, 6);
+  file_.close();
+  if (!file_) {
+    throw std::runtime_error("Unable to write output file: " + path_);
+  }
+  return static_cast<std::size_t>(position_);
+}
+
+/**
+ * @brief Write the levels of a WAD as Arrow IPC files, one per table
+ * @param wad WAD with its levels loaded (or imported)
+ * @param path Output file, which gets the levels table; the vertices,
+ *        linedefs, sidedefs, sectors and things tables go next to it as
+ *        <stem>-<table>.arrow
+ * @return Tables, rows and bytes written
+ * @throws std::runtime_error if a file cannot be written
+ * @note Every table starts with the wad (file name) and level columns and,
+ *       but for the levels table, the index of the row in its lump; each
+ *       level is one record batch.
+ */
+ArrowStats writeArrowTables(const WAD &wad, const std::string &path) {
+  std::filesystem::path levelsPath(path);
+  auto                  tablePath = [&](const char *table) {
+    std::string file = levelsPath.stem().string() + "-" + table + ".arrow";
+    return (levelsPath.parent_path() / file).string();
+  };
+  // Every table but the levels one starts with the wad, level and index
+  auto keyed = [](std::vector<ArrowField> fields) {
+    fields.insert(fields.begin(),
+                  {ArrowField{"wad"}, ArrowField{"level"},
+                   ArrowField{"index", 32, false}});
+    return fields;
+  };
+
+  ArrowWriter levels(path, {{"wad"},
+                            {"level"},
+                            {"format"},
+                            {"vertices", 32, false},
+                            {"linedefs", 32, false},
+                            {"sidedefs", 32, false},
+                            {"sectors", 32, false},
+                            {"things", 32, false}});
+  ArrowWriter vertices(tablePath("vertices"),
+                       keyed({{"x", 16, true}, {"y", 16, true}}));
+  ArrowWriter linedefs(tablePath("linedefs"),
+                       keyed({{"start_vertex", 16, false},
+                              {"end_vertex", 16, false},
+                              {"flags", 16, false},
+                              {"line_type", 16, false},
+                              {"sector_tag", 16, false},
+                              {"right_sidedef", 16, false},
+                              {"left_sidedef", 16, false}}));
+  ArrowWriter sidedefs(tablePath("sidedefs"), keyed({{"x_offset", 16, true},
+                                                     {"y_offset", 16, true},
+                                                     {"upper_texture"},
+                                                     {"lower_texture"},
+                                                     {"middle_texture"},
+                                                     {"sector", 16, false}}));
+  ArrowWriter sectors(tablePath("sectors"),
+                      keyed({{"floor_height", 16, true},
+                             {"ceiling_height", 16, true},
+                             {"floor_texture"},
+                             {"ceiling_texture"},
+                             {"light_level", 16, false},
+                             {"type", 16, false},
+                             {"tag", 16, false}}));
+  ArrowWriter things(tablePath("things"), keyed({{"x", 16, true},
+                                                 {"y", 16, true},
+                                                 {"angle", 16, false},
+                                                 {"type", 16, false},
+                                                 {"flags", 16, false}}));
+
+  std::string wadName =
+      std::filesystem::path(wad.filepath()).filename().string();
+  ArrowStats stats;
+  auto       flush = [&](ArrowWriter &writer, const ArrowBatch &batch) {
+    if (batch.rows() > 0) {
+      writer.write(batch);
+      stats.rows += batch.rows();
+    }
+  };
+
+  // One record batch per level and table
+  for (const WAD::Level &level : wad.levels()) {
+    std::string_view name = fixedName(level.name);
+    auto             keys = [&](ArrowBatch &batch, std::size_t index) {
+      batch.string(0, wadName);
+      batch.string(1, name);
+      batch.integer(2, static_cast<int64_t>(index));
+    };
+
+    ArrowBatch summary(levels.fields());
+    summary.string(0, wadName);
+    summary.string(1, name);
+    summary.string(2, level.format == WAD::LevelFormat::Doom    ? "doom"
+                      : level.format == WAD::LevelFormat::Hexen ? "hexen"
+                                                                : "udmf");
+    summary.integer(3, static_cast<int64_t>(level.vertices.size()));
+    summary.integer(4, static_cast<int64_t>(level.linedefs.size()));
+    summary.integer(5, static_cast<int64_t>(level.sidedefs.size()));
+    summary.integer(6, static_cast<int64_t>(level.sectors.size()));
+    summary.integer(7, static_cast<int64_t>(level.things.size()));
+    flush(levels, summary);
+
+    ArrowBatch vertexRows(vertices.fields());
+    for (std::size_t i = 0; i < level.vertices.size(); i++) {
+      const WAD::Vertex &v = level.vertices[i];
+      keys(vertexRows, i);
+      vertexRows.integer(3, v.x);
+      vertexRows.integer(4, v.y);
+    }
+    flush(vertices, vertexRows);
+
+    ArrowBatch linedefRows(linedefs.fields());
+    for (std::size_t i = 0; i < level.linedefs.size(); i++) {
+      const WAD::Linedef &l = level.linedefs[i];
+      keys(linedefRows, i);
+      linedefRows.integer(3, l.start_vertex);
+      linedefRows.integer(4, l.end_vertex);
+      linedefRows.integer(5, l.flags);
+      linedefRows.integer(6, l.line_type);
+      linedefRows.integer(7, l.sector_tag);
+      linedefRows.integer(8, l.right_sidedef);
+      linedefRows.integer(9, l.left_sidedef);
+    }
+    flush(linedefs, linedefRows);
+
+    ArrowBatch sidedefRows(sidedefs.fields());
+    for (std::size_t i = 0; i < level.sidedefs.size(); i++) {
+      const WAD::Sidedef &s = level.sidedefs[i];
+      keys(sidedefRows, i);
+      sidedefRows.integer(3, s.x_offset);
+      sidedefRows.integer(4, s.y_offset);
+      sidedefRows.string(5, fixedName(s.upper_texture));
+      sidedefRows.string(6, fixedName(s.lower_texture));
+      sidedefRows.string(7, fixedName(s.middle_texture));
+      sidedefRows.integer(8, s.sector);
+    }
+    flush(sidedefs, sidedefRows);
+
+    ArrowBatch sectorRows(sectors.fields());
+    for (std::size_t i = 0; i < level.sectors.size(); i++) {
+      const WAD::Sector &s = level.sectors[i];
+      keys(sectorRows, i);
+      sectorRows.integer(3, s.floor_height);
+      sectorRows.integer(4, s.ceiling_height);
+      sectorRows.string(5, fixedName(s.floor_texture));
+      sectorRows.string(6, fixedName(s.ceiling_texture));
+      sectorRows.integer(7, s.light_level);
+      sectorRows.integer(8, s.type);
+      sectorRows.integer(9, s.tag);
+    }
+    flush(sectors, sectorRows);
+
+    ArrowBatch thingRows(things.fields());
+    for (std::size_t i = 0; i < level.things.size(); i++) {
+      const WAD::Thing &t = level.things[i];
+      keys(thingRows, i);
+      thingRows.integer(3, t.x);
+      thingRows.integer(4, t.y);
+      thingRows.integer(5, t.angle);
+      thingRows.integer(6, t.type);
+      thingRows.integer(7, t.flags);
+    }
+    flush(things, thingRows);
+  }
+
+  for (ArrowWriter *writer :
+       {&levels, &vertices, &linedefs, &sidedefs, &sectors, &things}) {
+    stats.bytes += writer->finish();
+    stats.tables++;
+  }
+  return stats;
+}
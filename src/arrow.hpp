@@ -0,0 +1,92 @@
+#ifndef ARROW_HPP
+#define ARROW_HPP
+
+#include "wad.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Column of an Arrow table: an integer of 8, 16, 32 or 64 bits, or a UTF-8
+// string when bits is 0. Columns are never null.
+struct ArrowField {
+  std::string name;
+  int         bits     = 0;
+  bool        isSigned = false;
+};
+
+/**
+ * Rows of one Arrow record batch, built column by column: every row appends
+ * one value to each column, integers with integer() and strings with
+ * string(), in any column order.
+ */
+class ArrowBatch {
+public:
+  explicit ArrowBatch(const std::vector<ArrowField> &fields);
+
+  void integer(std::size_t column, int64_t value);
+  void string(std::size_t column, std::string_view value);
+
+  // Rows appended so far, counted on the first column
+  std::size_t rows() const;
+
+private:
+  friend class ArrowWriter;
+
+  const std::vector<ArrowField>    &fields_;
+  std::vector<std::vector<uint8_t>> values_;   // Integers or string bytes
+  std::vector<std::vector<int32_t>> offsets_;  // String columns only
+};
+
+/**
+ * Writes a table in the Arrow IPC file format: the schema, then each batch
+ * as it is written, then the footer indexing the batches on finish(). The
+ * FlatBuffers metadata is encoded in-tree, there is no Arrow dependency.
+ * Buffers are aligned to 8 bytes so readers can memory-map the file and use
+ * the columns in place.
+ */
+class ArrowWriter {
+public:
+  // Create the file and write the schema
+  ArrowWriter(const std::string &path, std::vector<ArrowField> fields);
+
+  const std::vector<ArrowField> &fields() const { return fields_; }
+
+  // Write a record batch, built over fields()
+  void write(const ArrowBatch &batch);
+
+  // Write the footer and close the file; returns the file size
+  std::size_t finish();
+
+private:
+  // Where a record batch is in the file (the Block struct of the footer)
+  struct Block {
+    uint64_t offset;
+    uint32_t metadataLength;
+    uint64_t bodyLength;
+  };
+
+  std::string             path_;
+  std::vector<ArrowField> fields_;
+  std::ofstream           file_;
+  uint64_t                position_ = 0;
+  std::vector<Block>      blocks_;
+
+  void     append(const void *data, std::size_t size);
+  uint32_t message(const std::vector<uint8_t> &metadata,
+                   const std::vector<uint8_t> &body);
+};
+
+// What writeArrowTables wrote
+struct ArrowStats {
+  std::size_t tables = 0;  // Files written
+  std::size_t rows   = 0;  // Rows in every table
+  std::size_t bytes  = 0;  // Size of every file
+};
+
+// Write the levels of a WAD as Arrow IPC files, one per table
+ArrowStats writeArrowTables(const WAD &wad, const std::string &path);
+
+#endif  // ARROW_HPP
@@ -0,0 +1,114 @@
+#ifndef ASSETCACHE_HPP
+#define ASSETCACHE_HPP
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+/**
+ * Thread-safe LRU cache for decoded assets (patches, flats), bounded by an
+ * approximate byte budget. Assets are loaded on first use through the loader
+ * passed to get(); when the cached total goes over the budget the least
+ * recently used entries are dropped. Callers hold shared pointers, so an
+ * evicted asset stays valid for whoever is still using it and is freed when
+ * the last user lets go. A budget of 0 means unlimited. Assets are keyed by
+ * name, either as a string or as a packed NameKey (see names.hpp).
+ */
+template <typename T, typename Key = std::string>
+class AssetCache {
+public:
+  explicit AssetCache(std::size_t budget = 0) : budget_(budget) {}
+
+  void        setBudget(std::size_t budget) { budget_ = budget; }
+  std::size_t budget() const { return budget_; }
+
+  /**
+   * @brief Get an asset, loading it if it is not cached
+   * @param key Asset name or key
+   * @param loader Callable returning the asset (T) on a cache miss
+   * @param sizeOf Callable returning the approximate size of an asset in bytes
+   * @return Shared pointer to the asset
+   * @note The loader runs outside the lock, so two threads missing the same
+   *       key at once may both load it; the first one stored wins.
+   */
+  template <typename Loader, typename SizeOf>
+  std::shared_ptr<const T> get(const Key &key, Loader &&loader,
+                               SizeOf &&sizeOf) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto                        it = entries_.find(key);
+      if (it != entries_.end()) {
+        // Move to the front of the LRU list
+        lru_.splice(lru_.begin(), lru_, it->second.position);
+        hits_++;
+        return it->second.asset;
+      }
+    }
+
+    auto        asset = std::make_shared<const T>(loader());
+    std::size_t bytes = sizeOf(*asset);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto                        it = entries_.find(key);
+    if (it != entries_.end()) {
+      return it->second.asset;
+    }
+    misses_++;
+    lru_.push_front(key);
+    entries_.emplace(key, Entry{asset, bytes, lru_.begin()});
+    bytes_ += bytes;
+    evict();
+    return asset;
+  }
+
+  std::size_t bytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytes_;
+  }
+  std::size_t hits() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return hits_;
+  }
+  std::size_t misses() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return misses_;
+  }
+  std::size_t evictions() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return evictions_;
+  }
+
+private:
+  struct Entry {
+    std::shared_ptr<const T>         asset;
+    std::size_t                      bytes;
+    typename std::list<Key>::iterator position;
+  };
+
+  // Drop least recently used entries until the cache fits the budget. The
+  // most recent entry is always kept, even if it alone is over budget.
+  void evict() {
+    while (budget_ > 0 && bytes_ > budget_ && lru_.size() > 1) {
+      auto it = entries_.find(lru_.back());
+      bytes_ -= it->second.bytes;
+      entries_.erase(it);
+      lru_.pop_back();
+      evictions_++;
+    }
+  }
+
+  std::size_t                            budget_;
+  std::size_t                            bytes_     = 0;
+  std::size_t                            hits_      = 0;
+  std::size_t                            misses_    = 0;
+  std::size_t                            evictions_ = 0;
+  std::list<Key>                         lru_;
+  std::unordered_map<Key, Entry>         entries_;
+  mutable std::mutex                     mutex_;
+};
+
+#endif  // ASSETCACHE_HPP
@@ -0,0 +1,518 @@
+#include "atlas.hpp"
+#include "names.hpp"
+#include "parallel.hpp"
+#include "png.hpp"
+#include "shade.hpp"
+#include "wad.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <nlohmann/json.hpp>
+#include <numeric>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// A texture ready to be packed: its RGBA pixels
+struct Image {
+  NameKey              name;
+  bool                 flat;
+  uint32_t             width;
+  uint32_t             height;
+  std::vector<uint8_t> rgba;
+};
+
+uint32_t nextPowerOfTwo(uint32_t value) {
+  uint32_t power = 1;
+  while (power < value) {
+    power <<= 1;
+  }
+  return power;
+}
+
+Image flatImage(const WAD::FlatData &flat, const LightTable &lights,
+                int lightLevel) {
+  Image image{packName(flat.name), true, 64, 64, {}};
+  image.rgba.assign(64 * 64 * 4, 0);
+  std::size_t pixels = std::min<std::size_t>(flat.data.size(), 64 * 64);
+  lights.shade(flat.data.data(), pixels, lightLevel, image.rgba.data());
+  return image;
+}
+
+/**
+ * @brief Compose a wall texture from its patches
+ * @param complete Set to false when a patch cannot be decoded; that patch is
+ *        left out and the rest of the texture still composed
+ * @return The texture, transparent where no patch covers it
+ * @note Patches hold palette indices, with a clear mask bit for the holes
+ *       between their posts; later patches are drawn over earlier ones. The
+ *       indices and mask are composed first and resolved to colours in one
+ *       pass.
+ */
+Image wallImage(const WAD &wad, const WAD::Assets &assets,
+                const WAD::TextureDef &texture, const LightTable &lights,
+                int lightLevel, bool &complete) {
+  Image image{packName(texture.name), false, texture.width, texture.height,
+              {}};
+  std::size_t pixels = static_cast<std::size_t>(image.width) * image.height;
+
+  std::vector<uint8_t> indices(pixels, 0);
+  std::vector<uint8_t> mask((pixels + 7) / 8, 0);
+
+  for (const WAD::PatchInTexture &placed : texture.patches) {
+    if (placed.patch_num >= assets.patch_names.size()) {
+      continue;
+    }
+    std::shared_ptr<const WAD::PatchData> patch;
+    try {
+      patch = wad.getPatch(packName(assets.patch_names[placed.patch_num]));
+    } catch (const std::runtime_error &) {
+      complete = false;
+      continue;
+    }
+    if (!patch) {
+      continue;
+    }
+    for (int py = 0; py < patch->height; py++) {
+      int y = placed.origin_y + py;
+      if (y < 0 || y >= static_cast<int>(image.height)) {
+        continue;
+      }
+      for (int px = 0; px < patch->width; px++) {
+        int x = placed.origin_x + px;
+        if (x < 0 || x >= static_cast<int>(image.width)) {
+          continue;
+        }
+        std::size_t src = static_cast<std::size_t>(py) * patch->width + px;
+        if (patch->opaque(src)) {
+          std::size_t dest = static_cast<std::size_t>(y) * image.width + x;
+          indices[dest]    = patch->pixels[src];
+          mask[dest >> 3]  |= static_cast<uint8_t>(1 << (dest & 7));
+        }
+      }
+    }
+  }
+  image.rgba.resize(pixels * 4);
+  lights.shadeMasked(indices.data(), mask.data(), pixels, lightLevel,
+                     image.rgba.data());
+  return image;
+}
+
+/**
+ * Skyline bottom-left rectangle packer. The skyline is the top edge of
+ * what was placed so far, as horizontal segments; each rectangle goes where
+ * its top ends lowest, leftmost on ties.
+ */
+class SkylinePacker {
+public:
+  SkylinePacker(uint32_t width, uint32_t height)
+      : width_(width), height_(height), skyline_{{0, 0, width}} {}
+
+  bool insert(uint32_t width, uint32_t height, uint32_t &x, uint32_t &y) {
+    std::size_t bestIndex = skyline_.size();
+    uint32_t    bestTop   = UINT32_MAX;
+    for (std::size_t i = 0; i < skyline_.size(); i++) {
+      uint32_t top;
+      if (fits(i, width, height, top) && top + height < bestTop) {
+        bestIndex = i;
+        bestTop   = top + height;
+      }
+    }
+    if (bestIndex == skyline_.size()) {
+      return false;
+    }
+
+    x = skyline_[bestIndex].x;
+    y = bestTop - height;
+    place(bestIndex, x, bestTop, width);
+    usedHeight_ = std::max(usedHeight_, bestTop);
+    return true;
+  }
+
+  uint32_t usedHeight() const { return usedHeight_; }
+
+private:
+  struct Segment {
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+  };
+
+  uint32_t             width_;
+  uint32_t             height_;
+  uint32_t             usedHeight_ = 0;
+  std::vector<Segment> skyline_;
+
+  // Height at which a rectangle starting at segment i would rest
+  bool fits(std::size_t i, uint32_t width, uint32_t height,
+            uint32_t &top) const {
+    uint32_t x = skyline_[i].x;
+    if (x + width > width_) {
+      return false;
+    }
+    top                = 0;
+    uint32_t remaining = width;
+    for (std::size_t j = i; remaining > 0; j++) {
+      top = std::max(top, skyline_[j].y);
+      if (top + height > height_) {
+        return false;
+      }
+      remaining -= std::min(remaining, skyline_[j].width);
+    }
+    return true;
+  }
+
+  void place(std::size_t i, uint32_t x, uint32_t top, uint32_t width) {
+    skyline_.insert(skyline_.begin() + i, {x, top, width});
+
+    // Cut the segments now under the new one
+    std::size_t j = i + 1;
+    while (j < skyline_.size()) {
+      Segment &segment = skyline_[j];
+      uint32_t end     = x + width;
+      if (segment.x >= end) {
+        break;
+      }
+      uint32_t shrink = std::min(segment.width, end - segment.x);
+      segment.x += shrink;
+      segment.width -= shrink;
+      if (segment.width > 0) {
+        break;
+      }
+      skyline_.erase(skyline_.begin() + j);
+    }
+
+    // Merge neighbours at the same height
+    for (std::size_t k = 0; k + 1 < skyline_.size();) {
+      if (skyline_[k].y == skyline_[k + 1].y) {
+        skyline_[k].width += skyline_[k + 1].width;
+        skyline_.erase(skyline_.begin() + k + 1);
+      } else {
+        k++;
+      }
+    }
+  }
+};
+
+// Position of a packed image in its page
+struct Placement {
+  std::size_t image;
+  uint32_t    x, y;  // Top-left corner of the padded slot
+};
+
+/**
+ * @brief Pack as many images as fit in a page of the given size
+ * @return Placements, in the order of the images given
+ */
+std::vector<Placement> packPage(const std::vector<Image>       &images,
+                                const std::vector<std::size_t> &order,
+                                uint32_t width, uint32_t height,
+                                uint32_t padding, uint32_t &usedHeight) {
+  SkylinePacker          packer(width, height);
+  std::vector<Placement> placements;
+  for (std::size_t index : order) {
+    const Image &image = images[index];
+    uint32_t     x, y;
+    if (packer.insert(image.width + 2 * padding, image.height + 2 * padding,
+                      x, y)) {
+      placements.push_back({index, x, y});
+    }
+  }
+  usedHeight = packer.usedHeight();
+  return placements;
+}
+
+// Copy an image into a page with its padding wrapped from the other edges
+void blit(const Image &image, uint32_t padding, const Placement &placement,
+          AtlasPage &page) {
+  const int32_t pad = static_cast<int32_t>(padding);
+  const int32_t w   = static_cast<int32_t>(image.width);
+  const int32_t h   = static_cast<int32_t>(image.height);
+  for (int32_t y = -pad; y < h + pad; y++) {
+    int32_t  sy   = ((y % h) + h) % h;
+    uint8_t *dest = &page.rgba[(static_cast<std::size_t>(placement.y + pad +
+                                                         y) *
+                                    page.width +
+                                placement.x) *
+                               4];
+    for (int32_t x = -pad; x < w + pad; x++) {
+      int32_t sx = ((x % w) + w) % w;
+      std::memcpy(dest + (x + pad) * 4,
+                  &image.rgba[(static_cast<std::size_t>(sy) * w + sx) * 4], 4);
+    }
+  }
+}
+
+}  // namespace
+
+/**
+ * @brief Pack the flats and wall textures of a level into atlas pages
+ * @param wad WAD the level comes from, for its patches
+ * @param level Level, with its flats, texture definitions and palette
+ * @param options Page size limit and padding
+ * @return The pages and the position of every texture
+ * @note Wall textures are composed from the patches of their TextureDef.
+ *       Textures are packed tallest first with a skyline bottom-left packer
+ *       into the smallest power-of-two page that holds them all; once pages
+ *       reach the size limit, the textures left over go to further pages.
+ *       The padding repeats the opposite edge of the texture, as DOOM
+ *       textures tile, so filtering at the edges samples the right texels.
+ *       With a light level, texels go through its COLORMAP map (see
+ *       shade.hpp) as DOOM draws them in a sector of that light.
+ */
+Atlas buildAtlas(const WAD &wad, const WAD::Level &level,
+                 const AtlasOptions &options) {
+  Atlas atlas;
+
+  // Imported levels have no assets: their flats and walls come out missing
+  static const WAD::Assets noAssets;
+  const WAD::Assets       &assets = level.assets ? *level.assets : noAssets;
+
+  // Images to pack: every flat of the level, then the wall textures its
+  // sidedefs use, composed from their patches
+  // Unshaded atlases use the palette as is
+  bool       shaded = options.lightLevel >= 0;
+  LightTable lights(assets.palette,
+                    shaded ? assets.colormap : std::vector<uint8_t>());
+  int        lightLevel = shaded ? options.lightLevel : 255;
+
+  std::vector<Image> images;
+  for (const WAD::FlatData &flat : level.flats) {
+    images.push_back(flatImage(flat, lights, lightLevel));
+  }
+
+  std::unordered_map<NameKey, const WAD::TextureDef *> definitions;
+  for (const WAD::TextureDef &texture : assets.texture_defs) {
+    definitions.emplace(packName(texture.name), &texture);
+  }
+  constexpr NameKey noTexture = packName("-");
+  std::set<NameKey> walls;
+  for (const WAD::Sidedef &side : level.sidedefs) {
+    for (const char *name :
+         {side.upper_texture, side.lower_texture, side.middle_texture}) {
+      NameKey key = packName(name);
+      if (key != 0 && key != noTexture) {
+        walls.insert(key);
+      }
+    }
+  }
+  for (NameKey name : walls) {
+    auto found = definitions.find(name);
+    if (found == definitions.end() || found->second->width == 0 ||
+        found->second->height == 0) {
+      atlas.missing.emplace_back(unpackName(name).view());
+      continue;
+    }
+    bool complete = true;
+    images.push_back(
+        wallImage(wad, assets, *found->second, lights, lightLevel, complete));
+    if (!complete) {
+      atlas.missing.emplace_back(unpackName(name).view());
+    }
+  }
+  if (images.empty()) {
+    return atlas;
+  }
+
+  // Tallest first, then widest, then by name so the layout is stable
+  const uint32_t           padding = options.padding;
+  const uint32_t           maxSize = nextPowerOfTwo(options.maxPageSize);
+  std::vector<std::size_t> order(images.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+    const Image &ia = images[a];
+    const Image &ib = images[b];
+    if (ia.height != ib.height) {
+      return ia.height > ib.height;
+    }
+    if (ia.width != ib.width) {
+      return ia.width > ib.width;
+    }
+    return std::make_pair(ia.flat, ia.name) < std::make_pair(ib.flat, ib.name);
+  });
+
+  auto addPage = [&](uint32_t width, uint32_t height,
+                     const std::vector<Placement> &placements) {
+    AtlasPage page{width, height, {}};
+    page.rgba.assign(static_cast<std::size_t>(width) * height * 4, 0);
+    for (const Placement &placement : placements) {
+      const Image &image = images[placement.image];
+      blit(image, padding, placement, page);
+      atlas.entries.push_back(
+          {std::string(unpackName(image.name).view()), image.flat,
+           static_cast<uint32_t>(atlas.pages.size()), placement.x + padding,
+           placement.y + padding, image.width, image.height});
+    }
+    atlas.pages.push_back(std::move(page));
+  };
+
+  // Textures larger than a page get a page of their own
+  std::vector<std::size_t> remaining;
+  for (std::size_t index : order) {
+    const Image &image = images[index];
+    if (image.width + 2 * padding > maxSize ||
+        image.height + 2 * padding > maxSize) {
+      addPage(nextPowerOfTwo(image.width + 2 * padding),
+              nextPowerOfTwo(image.height + 2 * padding), {{index, 0, 0}});
+    } else {
+      remaining.push_back(index);
+    }
+  }
+
+  while (!remaining.empty()) {
+    // Start from the smallest square page with room for the total area,
+    // then grow one side at a time up to the limit
+    std::size_t area = 0;
+    for (std::size_t index : remaining) {
+      area += static_cast<std::size_t>(images[index].width + 2 * padding) *
+              (images[index].height + 2 * padding);
+    }
+    uint32_t side = 1;
+    while (side < maxSize && static_cast<std::size_t>(side) * side < area) {
+      side <<= 1;
+    }
+    uint32_t width = side, height = side, usedHeight = 0;
+
+    std::vector<Placement> placements;
+    for (;;) {
+      placements =
+          packPage(images, remaining, width, height, padding, usedHeight);
+      if (placements.size() == remaining.size() ||
+          (width == maxSize && height == maxSize)) {
+        break;
+      }
+      if (width <= height) {
+        width <<= 1;
+      } else {
+        height <<= 1;
+      }
+    }
+
+    // Trim the unused bottom of the page, keeping a power of two
+    height = std::min(height, nextPowerOfTwo(usedHeight));
+    addPage(width, height, placements);
+
+    std::vector<bool> placed(images.size(), false);
+    for (const Placement &placement : placements) {
+      placed[placement.image] = true;
+    }
+    remaining.erase(std::remove_if(remaining.begin(), remaining.end(),
+                                   [&](std::size_t i) { return placed[i]; }),
+                    remaining.end());
+  }
+
+  return atlas;
+}
+
+/**
+ * @brief Write one atlas per level: PNG pages and a UV lookup table
+ * @param wad WAD with its levels loaded
+ * @param path JSON lookup table; pages are written next to it, as
+ *        <name>-<level>-<page>.png
+ * @param options Page size limit and padding
+ * @return Counts and sizes of what was written
+ * @throws std::runtime_error if a file cannot be written
+ * @note Levels are packed and encoded in parallel. The table gives, for each
+ *       level, its page files and, by texture name, the page, pixel
+ *       rectangle and UVs of every flat and wall texture, so a renderer can
+ *       bind one atlas per level.
+ */
+AtlasStats writeAtlases(const WAD &wad, const std::string &path,
+                        const AtlasOptions &options) {
+  const std::vector<WAD::Level> &levels = wad.levels();
+  std::filesystem::path          table(path);
+  std::string                    stem = table.stem().string();
+
+  std::vector<nlohmann::json> levelTables(levels.size());
+  std::vector<std::size_t>    pageBytes(levels.size(), 0);
+  std::vector<std::size_t>    pageCounts(levels.size(), 0);
+  std::vector<std::size_t>    entryCounts(levels.size(), 0);
+  parallelFor(levels.size(), [&](std::size_t l) {
+    const WAD::Level &level = levels[l];
+    std::string       name(level.name, strnlen(level.name, 8));
+    Atlas             atlas = buildAtlas(wad, level, options);
+
+    nlohmann::json pages = nlohmann::json::array();
+    for (std::size_t p = 0; p < atlas.pages.size(); p++) {
+      const AtlasPage      &page = atlas.pages[p];
+      std::string           file = stem + "-" + name + "-" +
+                                   std::to_string(p) + ".png";
+      std::vector<uint8_t>  png =
+          encodePNG(page.rgba.data(), page.width, page.height);
+      std::filesystem::path pagePath = table.parent_path() / file;
+      std::ofstream         out(pagePath, std::ios::binary);
+      out.write(reinterpret_cast<const char *>(png.data()),
+                static_cast<std::streamsize>(png.size()));
+      if (!out) {
+        throw std::runtime_error("Unable to write output file: " +
+                                 pagePath.string());
+      }
+      pageBytes[l] += png.size();
+      pages.push_back(
+          {{"file", file}, {"width", page.width}, {"height", page.height}});
+    }
+
+    nlohmann::json flats    = nlohmann::json::object();
+    nlohmann::json textures = nlohmann::json::object();
+    for (const AtlasEntry &entry : atlas.entries) {
+      const AtlasPage &page = atlas.pages[entry.page];
+      double           w    = page.width;
+      double           h    = page.height;
+      (entry.flat ? flats : textures)[entry.name] = {
+          {"page", entry.page},
+          {"x", entry.x},
+          {"y", entry.y},
+          {"width", entry.width},
+          {"height", entry.height},
+          {"uv",
+           {entry.x / w, entry.y / h, (entry.x + entry.width) / w,
+            (entry.y + entry.height) / h}}};
+    }
+
+    nlohmann::json &levelTable = levelTables[l];
+    levelTable["name"]         = name;
+    levelTable["pages"]        = pages;
+    levelTable["flats"]        = flats;
+    levelTable["textures"]     = textures;
+    if (!atlas.missing.empty()) {
+      levelTable["missing"] = atlas.missing;
+    }
+    pageCounts[l]  = atlas.pages.size();
+    entryCounts[l] = atlas.entries.size();
+  });
+
+  nlohmann::json document;
+  document["wad"] = std::filesystem::path(wad.filepath()).filename().string();
+  document["padding"] = options.padding;
+  if (options.lightLevel >= 0) {
+    document["light"] = options.lightLevel;
+  }
+  document["levels"]  = levelTables;
+
+  std::ofstream file(path, std::ios::binary);
+  if (!file) {
+    throw std::runtime_error("Unable to open output file: " + path);
+  }
+  file << document.dump(1) << "\n";
+  if (!file) {
+    throw std::runtime_error("Unable to write output file: " + path);
+  }
+
+  AtlasStats stats;
+  stats.levels = levels.size();
+  for (std::size_t l = 0; l < levels.size(); l++) {
+    stats.pages += pageCounts[l];
+    stats.textures += entryCounts[l];
+    stats.bytes += pageBytes[l];
+  }
+  return stats;
+}
@@ -0,0 +1,58 @@
+#ifndef ATLAS_HPP
+#define ATLAS_HPP
+
+#include "wad.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Packing options of the texture atlases
+struct AtlasOptions {
+  uint32_t maxPageSize = 2048;  // Largest page side, a power of two
+  uint32_t padding     = 2;     // Border around every texture, for filtering
+  int      lightLevel  = -1;    // Sector light to shade with, -1 for none
+};
+
+// Where a texture landed in an atlas
+struct AtlasEntry {
+  std::string name;
+  bool        flat;    // Floor/ceiling flat, or wall texture
+  uint32_t    page;    // Index of the page holding it
+  uint32_t    x, y;    // Top-left corner in the page, padding excluded
+  uint32_t    width;
+  uint32_t    height;
+};
+
+// One atlas page, RGBA pixels with power-of-two sides
+struct AtlasPage {
+  uint32_t             width;
+  uint32_t             height;
+  std::vector<uint8_t> rgba;
+};
+
+// The textures of a level packed into pages
+struct Atlas {
+  std::vector<AtlasPage>   pages;
+  std::vector<AtlasEntry>  entries;
+  std::vector<std::string> missing;  // Wall textures with no definition or
+                                     // with a patch that cannot be decoded
+};
+
+// Pack the flats and wall textures of a level into atlas pages
+Atlas buildAtlas(const WAD &wad, const WAD::Level &level,
+                 const AtlasOptions &options = {});
+
+// What writeAtlases() wrote
+struct AtlasStats {
+  std::size_t levels   = 0;
+  std::size_t pages    = 0;
+  std::size_t textures = 0;
+  std::size_t bytes    = 0;  // Size of the PNG pages
+};
+
+// Write one atlas per level: PNG pages and a UV lookup table
+AtlasStats writeAtlases(const WAD &wad, const std::string &path,
+                        const AtlasOptions &options = {});
+
+#endif  // ATLAS_HPP
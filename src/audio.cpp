@@ -0,0 +1,577 @@
+#include "audio.hpp"
+#include "lump.hpp"
+#include "names.hpp"
+#include "parallel.hpp"
+#include "wad.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <fcntl.h>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+/**
+ * Output file written through a small fixed buffer. Large blocks bypass the
+ * buffer and go to the file directly, and a 32-bit field can be patched in
+ * place once its value is known.
+ */
+class FileSink {
+public:
+  explicit FileSink(const std::string &path) : path_(path) {
+    fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd_ < 0) {
+      throw std::runtime_error("Unable to open output file: " + path);
+    }
+  }
+
+  ~FileSink() {
+    if (fd_ >= 0) {
+      ::close(fd_);
+    }
+  }
+
+  FileSink(const FileSink &)            = delete;
+  FileSink &operator=(const FileSink &) = delete;
+
+  void byte(uint8_t value) {
+    if (used_ == sizeof(buffer_)) {
+      flush();
+    }
+    buffer_[used_++] = value;
+  }
+
+  void bytes(const uint8_t *data, std::size_t size) {
+    if (size > sizeof(buffer_) - used_) {
+      flush();
+      if (size >= sizeof(buffer_)) {
+        writeFully(data, size);
+        return;
+      }
+    }
+    std::memcpy(buffer_ + used_, data, size);
+    used_ += size;
+  }
+
+  void u16LE(uint16_t value) {
+    byte(static_cast<uint8_t>(value));
+    byte(static_cast<uint8_t>(value >> 8));
+  }
+
+  void u32LE(uint32_t value) {
+    u16LE(static_cast<uint16_t>(value));
+    u16LE(static_cast<uint16_t>(value >> 16));
+  }
+
+  void u32BE(uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+      byte(static_cast<uint8_t>(value >> shift));
+    }
+  }
+
+  // Bytes written so far
+  std::size_t size() const { return written_ + used_; }
+
+  // A write failed; errors thrown otherwise come from the conversion
+  bool failed() const { return failed_; }
+
+  // Overwrite a big-endian 32-bit field written earlier
+  void patchU32BE(std::size_t offset, uint32_t value) {
+    flush();
+    uint8_t field[4] = {
+        static_cast<uint8_t>(value >> 24), static_cast<uint8_t>(value >> 16),
+        static_cast<uint8_t>(value >> 8), static_cast<uint8_t>(value)};
+    if (pwrite(fd_, field, 4, static_cast<off_t>(offset)) != 4) {
+      fail();
+    }
+  }
+
+  // Flush and close the file
+  std::size_t close() {
+    flush();
+    int fd = fd_;
+    fd_    = -1;
+    if (::close(fd) != 0) {
+      fail();
+    }
+    return written_;
+  }
+
+private:
+  std::string path_;
+  int         fd_;
+  uint8_t     buffer_[16384];
+  std::size_t used_    = 0;
+  std::size_t written_ = 0;
+  bool        failed_  = false;
+
+  [[noreturn]] void fail() {
+    failed_ = true;
+    throw std::runtime_error("Unable to write output file: " + path_);
+  }
+
+  void flush() {
+    writeFully(buffer_, used_);
+    used_ = 0;
+  }
+
+  void writeFully(const uint8_t *data, std::size_t size) {
+    while (size > 0) {
+      ssize_t count = write(fd_, data, size);
+      if (count < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        fail();
+      }
+      data += count;
+      size -= static_cast<std::size_t>(count);
+      written_ += static_cast<std::size_t>(count);
+    }
+  }
+};
+
+// MUS event types, from bits 4-6 of the event byte
+enum MUSEvent : uint8_t {
+  kReleaseNote = 0,
+  kPlayNote    = 1,
+  kPitchBend   = 2,
+  kSystem      = 3,
+  kController  = 4,
+  kMeasureEnd  = 5,
+  kScoreEnd    = 6,
+};
+
+// MIDI controller of MUS controllers 1-9 and system events 10-14
+constexpr uint8_t kMIDIControllers[15] = {
+    0,    // 0: instrument, a program change in MIDI
+    0,    // 1: bank select
+    1,    // 2: modulation
+    7,    // 3: volume
+    10,   // 4: pan
+    11,   // 5: expression
+    91,   // 6: reverb depth
+    93,   // 7: chorus depth
+    64,   // 8: sustain pedal
+    67,   // 9: soft pedal
+    120,  // 10: all sounds off
+    123,  // 11: all notes off
+    126,  // 12: mono
+    127,  // 13: poly
+    121,  // 14: reset all controllers
+};
+
+constexpr uint8_t kMUSPercussion  = 15;
+constexpr uint8_t kMIDIPercussion = 9;
+
+/**
+ * MUS to MIDI event translation. MUS delays come after an event and apply to
+ * the next one, MIDI delta times come before; the pending delay is written
+ * in front of the next MIDI event.
+ */
+class MIDITrack {
+public:
+  explicit MIDITrack(FileSink &out) : out_(out) {
+    std::fill(std::begin(channels_), std::end(channels_), -1);
+    std::fill(std::begin(volumes_), std::end(volumes_), 127);
+  }
+
+  void delay(uint32_t ticks) { delay_ += ticks; }
+
+  void releaseNote(uint8_t channel, uint8_t note) {
+    event(0x80, channel);
+    out_.byte(note & 0x7F);
+    out_.byte(0);
+  }
+
+  void playNote(uint8_t channel, uint8_t note, int volume) {
+    if (volume >= 0) {
+      volumes_[channel] = static_cast<uint8_t>(std::min(volume, 127));
+    }
+    event(0x90, channel);
+    out_.byte(note & 0x7F);
+    out_.byte(volumes_[channel]);
+  }
+
+  // MUS bends are 0-255 around 128, MIDI bends 14 bits around 8192
+  void pitchBend(uint8_t channel, uint8_t bend) {
+    uint16_t value = static_cast<uint16_t>(bend) << 6;
+    event(0xE0, channel);
+    out_.byte(value & 0x7F);
+    out_.byte((value >> 7) & 0x7F);
+  }
+
+  void controller(uint8_t channel, uint8_t controller, uint8_t value) {
+    if (controller == 0) {
+      event(0xC0, channel);
+      out_.byte(value & 0x7F);
+      return;
+    }
+    event(0xB0, channel);
+    out_.byte(kMIDIControllers[controller]);
+    out_.byte(std::min<uint8_t>(value, 127));
+  }
+
+  void end() {
+    deltaTime();
+    out_.byte(0xFF);
+    out_.byte(0x2F);
+    out_.byte(0x00);
+  }
+
+private:
+  FileSink &out_;
+  uint32_t  delay_ = 0;
+  int       channels_[16];  // MIDI channel of each MUS channel, -1 if unused
+  int       nextChannel_ = 0;
+  uint8_t   volumes_[16];  // Last note volume of each MUS channel
+
+  void deltaTime() {
+    // Variable-length quantity, 7 bits per byte, most significant first
+    uint8_t bytes[5];
+    int     count = 0;
+    do {
+      bytes[count++] = delay_ & 0x7F;
+      delay_ >>= 7;
+    } while (delay_ > 0);
+    while (count > 1) {
+      out_.byte(bytes[--count] | 0x80);
+    }
+    out_.byte(bytes[0]);
+  }
+
+  // Delta time and status byte of an event on a MUS channel
+  void event(uint8_t status, uint8_t channel) {
+    int midiChannel = channels_[channel];
+    if (midiChannel < 0) {
+      if (channel == kMUSPercussion) {
+        midiChannel = kMIDIPercussion;
+      } else {
+        if (nextChannel_ == kMIDIPercussion) {
+          nextChannel_++;
+        }
+        midiChannel = nextChannel_++ & 0x0F;
+      }
+      channels_[channel] = midiChannel;
+
+      // Start the channel with all notes off, as the game's player does
+      deltaTime();
+      out_.byte(static_cast<uint8_t>(0xB0 | midiChannel));
+      out_.byte(123);
+      out_.byte(0);
+    }
+    deltaTime();
+    out_.byte(static_cast<uint8_t>(status | midiChannel));
+  }
+};
+
+// Lump is a standard MIDI file
+bool isMIDI(const std::vector<uint8_t> &data) {
+  return data.size() >= 14 && std::memcmp(data.data(), "MThd", 4) == 0;
+}
+
+// Lump is a DMX digitized sound (format 3; format 0 is PC speaker)
+bool isDMX(const std::vector<uint8_t> &data) {
+  return data.size() >= 8 && data[0] == 3 && data[1] == 0;
+}
+
+// File name for a lump: its name, with characters that are not safe in
+// file names replaced
+std::string fileName(const char (&name)[8], const char *extension) {
+  std::string file(name, strnlen(name, 8));
+  for (char &c : file) {
+    bool safe = (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') ||
+                (c >= '0' && c <= '9') || c == '_' || c == '-';
+    if (!safe) {
+      c = '_';
+    }
+  }
+  return file + extension;
+}
+
+// Translate a MUS lump into a MIDI file
+void writeMIDI(const uint8_t *mus, std::size_t size, FileSink &out) {
+  LumpBytes bytes(mus, size, "MUS");
+  bytes.require(0, 16);
+  if (std::memcmp(mus, "MUS\x1A", 4) != 0) {
+    throw std::runtime_error("Malformed MUS lump: bad signature");
+  }
+  std::size_t scoreLength = bytes.u16(4);
+  std::size_t scoreStart  = bytes.u16(6);
+  bytes.require(scoreStart, scoreLength);
+  std::size_t pos = scoreStart;
+  std::size_t end = scoreStart + scoreLength;
+  auto        next = [&]() {
+    if (pos >= end) {
+      throw std::runtime_error("Malformed MUS lump: score ends in an event");
+    }
+    return mus[pos++];
+  };
+
+  out.bytes(reinterpret_cast<const uint8_t *>("MThd"), 4);
+  out.u32BE(6);
+  out.byte(0);  // Format 0: a single track
+  out.byte(0);
+  out.byte(0);  // One track
+  out.byte(1);
+  out.byte(0);  // 70 ticks per quarter note, 140 ticks per second
+  out.byte(70);
+  out.bytes(reinterpret_cast<const uint8_t *>("MTrk"), 4);
+  std::size_t lengthOffset = out.size();
+  out.u32BE(0);  // Track length, patched at the end
+
+  MIDITrack track(out);
+  bool      scoreEnd = false;
+  while (!scoreEnd && pos < end) {
+    uint8_t descriptor = next();
+    uint8_t channel    = descriptor & 0x0F;
+    switch ((descriptor >> 4) & 0x07) {
+      case kReleaseNote:
+        track.releaseNote(channel, next());
+        break;
+      case kPlayNote: {
+        uint8_t note = next();
+        track.playNote(channel, note, (note & 0x80) ? next() & 0x7F : -1);
+        break;
+      }
+      case kPitchBend:
+        track.pitchBend(channel, next());
+        break;
+      case kSystem: {
+        uint8_t event = next();
+        if (event < 10 || event > 14) {
+          throw std::runtime_error("Malformed MUS lump: unknown system event " +
+                                   std::to_string(event));
+        }
+        track.controller(channel, event, 0);
+        break;
+      }
+      case kController: {
+        uint8_t controller = next();
+        uint8_t value      = next();
+        if (controller > 9) {
+          throw std::runtime_error("Malformed MUS lump: unknown controller " +
+                                   std::to_string(controller));
+        }
+        track.controller(channel, controller, value);
+        break;
+      }
+      case kMeasureEnd:
+        break;
+      case kScoreEnd:
+        scoreEnd = true;
+        break;
+      default:
+        throw std::runtime_error("Malformed MUS lump: unknown event type");
+    }
+
+    if (!scoreEnd && (descriptor & 0x80) != 0) {
+      uint32_t ticks = 0;
+      uint8_t  byte;
+      do {
+        byte  = next();
+        ticks = (ticks << 7) | (byte & 0x7F);
+      } while ((byte & 0x80) != 0);
+      track.delay(ticks);
+    }
+  }
+  track.end();
+
+  std::size_t trackStart = lengthOffset + 4;
+  out.patchU32BE(lengthOffset,
+                 static_cast<uint32_t>(out.size() - trackStart));
+}
+
+// Write a DMX sound lump as a WAV file
+void writeWAV(const uint8_t *dmx, std::size_t size, FileSink &out) {
+  LumpBytes bytes(dmx, size, "DMX sound");
+  bytes.require(0, 8);
+  if (bytes.u16(0) != 3) {
+    throw std::runtime_error("Malformed DMX sound lump: not a digitized "
+                             "sound");
+  }
+  uint32_t rate    = bytes.u16(2);
+  uint32_t samples = bytes.u32(4);
+  bytes.require(8, samples);
+
+  // The game skips the 16 padding samples at each end
+  const uint8_t *data = dmx + 8;
+  if (samples >= 32) {
+    data += 16;
+    samples -= 32;
+  }
+
+  out.bytes(reinterpret_cast<const uint8_t *>("RIFF"), 4);
+  out.u32LE(36 + samples);
+  out.bytes(reinterpret_cast<const uint8_t *>("WAVEfmt "), 8);
+  out.u32LE(16);    // Format chunk size
+  out.u16LE(1);     // PCM
+  out.u16LE(1);     // Mono
+  out.u32LE(rate);  // Samples per second
+  out.u32LE(rate);  // Bytes per second
+  out.u16LE(1);     // Bytes per sample
+  out.u16LE(8);     // Bits per sample
+  out.bytes(reinterpret_cast<const uint8_t *>("data"), 4);
+  out.u32LE(samples);
+  out.bytes(data, samples);
+  if (samples % 2 != 0) {
+    out.byte(0);  // Chunks are padded to an even size
+  }
+}
+
+}  // namespace
+
+/**
+ * @brief Convert a MUS music lump to a standard MIDI file
+ * @param mus Lump bytes
+ * @param size Lump size
+ * @param path Output .mid file
+ * @return Size of the written file
+ * @throws std::runtime_error if the lump is not valid MUS or the file cannot
+ *         be written
+ * @note Events are translated as they are read and go straight to the file
+ *       through a small fixed buffer; the track length is patched in at the
+ *       end. MUS channel 15 becomes the MIDI percussion channel 9, the others
+ *       get MIDI channels in order of first use. MUS ticks are 1/140 s, so
+ *       the file uses 70 ticks per quarter note at the default tempo.
+ */
+std::size_t convertMUS(const uint8_t *mus, std::size_t size,
+                       const std::string &path) {
+  FileSink out(path);
+  writeMIDI(mus, size, out);
+  return out.close();
+}
+
+/**
+ * @brief Convert a DMX digitized sound lump to a WAV file
+ * @param dmx Lump bytes
+ * @param size Lump size
+ * @param path Output .wav file
+ * @return Size of the written file
+ * @throws std::runtime_error if the lump is not a DMX sound or the file
+ *         cannot be written
+ * @note DMX samples are 8-bit unsigned mono, as in WAV, so the samples are
+ *       written from the lump bytes as they are, after a WAV header. The 16
+ *       padding samples DMX keeps at both ends are dropped.
+ */
+std::size_t convertDMX(const uint8_t *dmx, std::size_t size,
+                       const std::string &path) {
+  FileSink out(path);
+  writeWAV(dmx, size, out);
+  return out.close();
+}
+
+/**
+ * @brief Convert every music and sound lump of a WAD into a directory
+ * @param wad WAD with its directory read
+ * @param directory Output directory, created if needed
+ * @return Counts and sizes of what was converted
+ * @throws std::runtime_error if a file cannot be written
+ * @note Music is the D_* lumps, in MUS format or already in MIDI (copied
+ *       as is); sounds are the DS* lumps, in DMX format. When a name appears
+ *       more than once the last lump wins, as in the game. Files are named
+ *       after their lump (<NAME>.mid, <NAME>.wav) and lumps are converted in
+ *       parallel. Malformed lumps are skipped, with a warning.
+ */
+AudioStats extractAudio(const WAD &wad, const std::string &directory) {
+  const std::vector<WAD::Directory> &lumps = wad.directory();
+
+  // Music (D_*) and sound (DS*) lumps, the last lump of a name replacing
+  // the earlier ones
+  std::unordered_map<NameKey, std::size_t> byName;
+  std::vector<std::size_t>                 candidates;
+  for (std::size_t i = 0; i < lumps.size(); i++) {
+    const char *name = lumps[i].name;
+    if (name[0] != 'D' || (name[1] != '_' && name[1] != 'S') ||
+        lumps[i].size == 0) {
+      continue;
+    }
+    auto [found, added] = byName.emplace(packName(name), candidates.size());
+    if (added) {
+      candidates.push_back(i);
+    } else {
+      candidates[found->second] = i;
+    }
+  }
+
+  std::filesystem::create_directories(directory);
+  std::filesystem::path dir(directory);
+
+  enum Kind : uint8_t { kNone, kMusic, kMIDI, kSound, kSkipped };
+  std::vector<Kind>        kinds(candidates.size(), kNone);
+  std::vector<std::size_t> outputs(candidates.size(), 0);
+  std::vector<std::string> errors(candidates.size());
+  parallelFor(candidates.size(), [&](std::size_t c) {
+    const WAD::Directory &lump  = lumps[candidates[c]];
+    std::vector<uint8_t>  data  = wad.lumpData(candidates[c]);
+    bool                  music = lump.name[1] == '_';
+    Kind                  kind  = kNone;
+    if (music) {
+      kind = isMIDI(data) ? kMIDI : kMusic;
+    } else if (isDMX(data)) {
+      kind = kSound;
+    } else {
+      return;  // PC speaker sound effects (DP*) are not extracted
+    }
+
+    std::filesystem::path path =
+        dir / fileName(lump.name, kind == kSound ? ".wav" : ".mid");
+    FileSink out(path.string());
+    try {
+      if (kind == kMIDI) {
+        out.bytes(data.data(), data.size());
+      } else if (kind == kMusic) {
+        writeMIDI(data.data(), data.size(), out);
+      } else {
+        writeWAV(data.data(), data.size(), out);
+      }
+      outputs[c] = out.close();
+      kinds[c]   = kind;
+    } catch (const std::runtime_error &e) {
+      if (out.failed()) {
+        throw;
+      }
+      // Malformed lump: drop what was written of it
+      out.close();
+      std::filesystem::remove(path);
+      kinds[c]  = kSkipped;
+      errors[c] = e.what();
+    }
+  });
+
+  AudioStats stats;
+  for (std::size_t c = 0; c < candidates.size(); c++) {
+    const WAD::Directory &lump = lumps[candidates[c]];
+    switch (kinds[c]) {
+      case kMusic:
+        stats.music++;
+        break;
+      case kMIDI:
+        stats.midi++;
+        break;
+      case kSound:
+        stats.sounds++;
+        break;
+      case kSkipped:
+        stats.skipped++;
+        stats.warnings.push_back("Skipping '" +
+                                 std::string(lump.name,
+                                             strnlen(lump.name, 8)) +
+                                 "': " + errors[c]);
+        continue;
+      default:
+        continue;
+    }
+    stats.inputBytes += lump.size;
+    stats.outputBytes += outputs[c];
+  }
+  return stats;
+}
@@ -0,0 +1,32 @@
+#ifndef AUDIO_HPP
+#define AUDIO_HPP
+
+#include "wad.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Convert a MUS music lump to a MIDI file and return its size
+std::size_t convertMUS(const uint8_t *mus, std::size_t size,
+                       const std::string &path);
+
+// Convert a DMX sound lump to a WAV file and return its size
+std::size_t convertDMX(const uint8_t *dmx, std::size_t size,
+                       const std::string &path);
+
+// What extractAudio() converted
+struct AudioStats {
+  std::size_t              music       = 0;  // MUS lumps written as MIDI
+  std::size_t              midi        = 0;  // MIDI lumps, copied as is
+  std::size_t              sounds      = 0;  // DMX sounds written as WAV
+  std::size_t              skipped     = 0;  // Lumps that were not converted
+  std::size_t              inputBytes  = 0;  // Size of the converted lumps
+  std::size_t              outputBytes = 0;  // Size of the written files
+  std::vector<std::string> warnings;         // Why lumps were skipped
+};
+
+// Convert every music and sound lump of a WAD into a directory
+AudioStats extractAudio(const WAD &wad, const std::string &directory);
+
+#endif  // AUDIO_HPP
@@ -0,0 +1,240 @@
+#include "bench.hpp"
+#include "emitter.hpp"
+#include "importer.hpp"
+#include "shade.hpp"
+#include "things.hpp"
+#include "wad.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <iomanip>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Number of runs per measurement, the fastest one is reported
+static constexpr int kRuns = 5;
+
+/**
+ * Memory resource that forwards to new/delete and counts what goes through
+ * it, used to compare how many allocations level loading makes with and
+ * without the per-level arenas.
+ */
+class CountingResource : public std::pmr::memory_resource {
+public:
+  std::size_t allocations = 0;
+  std::size_t bytes       = 0;
+
+private:
+  void *do_allocate(std::size_t size, std::size_t alignment) override {
+    allocations++;
+    bytes += size;
+    return std::pmr::new_delete_resource()->allocate(size, alignment);
+  }
+
+  void do_deallocate(void *p, std::size_t size,
+                     std::size_t alignment) override {
+    std::pmr::new_delete_resource()->deallocate(p, size, alignment);
+  }
+
+  bool do_is_equal(const std::pmr::memory_resource &other) const noexcept
+      override {
+    return this == &other;
+  }
+};
+
+// Best wall time of fn() over kRuns runs, in milliseconds
+template <typename Fn>
+static double bestOf(Fn &&fn) {
+  double best = std::numeric_limits<double>::max();
+  for (int run = 0; run < kRuns; run++) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    best = std::min(best, std::chrono::duration<double, std::milli>(
+                              std::chrono::steady_clock::now() - start)
+                              .count());
+  }
+  return best;
+}
+
+// Throughput in MB/s for a number of bytes processed in ms milliseconds
+static double megabytesPerSecond(std::size_t bytes, double ms) {
+  return ms > 0.0 ? (static_cast<double>(bytes) / (1024.0 * 1024.0)) /
+                        (ms / 1000.0)
+                  : 0.0;
+}
+
+// Convert levels to a whole document with the emitter of a format
+static std::string emitAll(WADFormat                      format,
+                           const std::vector<WAD::Level> &levels) {
+  std::unique_ptr<Emitter> emitter = makeEmitter(format);
+  std::string              text    = emitter->begin();
+  for (const WAD::Level &level : levels) {
+    text += emitter->level(level);
+  }
+  text += emitter->end();
+  return text;
+}
+
+// Brief DSL written through std::ostringstream, the way DSLEmitter used to.
+// Kept as the baseline the buffered DSL writer is measured against.
+static std::string streamDSL(const std::vector<WAD::Level> &levels) {
+  std::string text;
+  for (const WAD::Level &level : levels) {
+    std::ostringstream out;
+    std::string_view   name(level.name, strnlen(level.name, 8));
+    out << "LEVEL " << name << " START\n\n";
+    out << "VERTICES:\n";
+    for (const WAD::Vertex &v : level.vertices) {
+      out << "(" << v.x << ", " << v.y << ")\n";
+    }
+    out << "\nLINEDEFS:\n";
+    for (const WAD::Linedef &l : level.linedefs) {
+      out << l.start_vertex << " -> " << l.end_vertex
+          << " | flags: " << l.flags << " | type: " << l.line_type
+          << " | tag: " << l.sector_tag << " | right: " << l.right_sidedef
+          << " | left: " << l.left_sidedef << "\n";
+    }
+    out << "\nSECTORS:\n";
+    for (const WAD::Sector &s : level.sectors) {
+      out << "floor: " << s.floor_height << " | ceil: " << s.ceiling_height
+          << " | light: " << s.light_level << " | floor_tex: "
+          << std::string(s.floor_texture, strnlen(s.floor_texture, 8))
+          << " | ceil_tex: "
+          << std::string(s.ceiling_texture, strnlen(s.ceiling_texture, 8))
+          << "\n";
+    }
+    out << "\nTHINGS:\n";
+    for (const WAD::Thing &t : level.things) {
+      const ThingInfo *info = thingInfo(t.type);
+      out << (info ? info->name : "Thing") << " at (" << t.x << ", " << t.y
+          << ")" << " | angle: " << t.angle << " | type: " << t.type << "\n";
+    }
+    out << "\nLEVEL " << name << " END\n\n";
+    text += out.str();
+  }
+  return text;
+}
+
+/**
+ * @brief Run the benchmark suite over a WAD
+ * @param wad WAD with its directory read (assets are loaded here)
+ * @return Plain text report, one measurement per line
+ * @note Each measurement is repeated a few times and the best run is kept.
+ */
+std::string runBenchmarks(WAD &wad) {
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(3);
+
+  auto start = std::chrono::steady_clock::now();
+  wad.processAssets();
+  out << "assets: "
+      << std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+             .count()
+      << " ms\n";
+
+  std::vector<size_t> markers = wad.levelMarkers();
+  out << "levels: " << markers.size() << "\n";
+
+  // Level loading, geometry allocated per-level arena vs. directly. The
+  // counters are declared first so they outlive the levels allocated from
+  // them.
+  CountingResource        counters[2];
+  std::vector<WAD::Level> levels;
+  for (bool useArena : {false, true}) {
+    CountingResource &counter = counters[useArena ? 1 : 0];
+    double            ms      = bestOf([&]() {
+      counter.allocations = 0;
+      counter.bytes       = 0;
+      levels.clear();
+      for (size_t marker : markers) {
+        levels.push_back(wad.loadLevel(marker, &counter, useArena));
+      }
+    });
+    out << "load (" << (useArena ? "arena" : "no arena") << "): " << ms
+        << " ms, " << counter.allocations << " allocations, " << counter.bytes
+        << " bytes\n";
+  }
+
+  // Patches: memory of the indices and opacity masks against 4 bytes per
+  // pixel, and expansion to RGBA through the palette
+  if (!levels.empty() && levels[0].assets &&
+      !levels[0].assets->patches.empty()) {
+    const std::vector<WAD::PatchData> &patches = levels[0].assets->patches;
+
+    LightTable  palette(levels[0].assets->palette, {});
+    std::size_t pixels = 0, stored = 0, largest = 0;
+    for (const WAD::PatchData &patch : patches) {
+      std::size_t count = static_cast<std::size_t>(patch.width) * patch.height;
+      pixels  += count;
+      stored  += patch.pixels.size() + patch.mask.size();
+      largest = std::max(largest, count);
+    }
+    out << "patches: " << patches.size() << ", " << pixels << " pixels, "
+        << stored << " bytes (" << pixels * 4 << " as RGBA)\n";
+
+    std::vector<uint8_t> rgba(largest * 4);
+    double               ms = bestOf([&]() {
+      for (const WAD::PatchData &patch : patches) {
+        palette.shadeMasked(patch.pixels.data(), patch.mask.data(),
+                            patch.pixels.size(), 255, rgba.data());
+      }
+    });
+    out << "expand patches: " << ms << " ms, "
+        << megabytesPerSecond(pixels * 4, ms) << " MB/s of RGBA\n";
+  }
+
+  // Serialization, one emitter per format
+  const std::pair<const char *, WADFormat> formats[] = {
+      {"json", WADFormat::JSON},
+      {"jsonverbose", WADFormat::JSON_VERBOSE},
+      {"jsoncolumnar", WADFormat::JSON_COLUMNAR},
+      {"dsl", WADFormat::DSL},
+      {"dslverbose", WADFormat::DSL_VERBOSE}};
+  for (const auto &format : formats) {
+    std::size_t outputSize = 0;
+    double      ms         = bestOf(
+        [&]() { outputSize = emitAll(format.second, levels).size(); });
+    out << "serialize " << format.first << ": " << ms << " ms, " << outputSize
+        << " bytes, " << megabytesPerSecond(outputSize, ms) << " MB/s\n";
+  }
+
+  // The DSL through std::ostringstream, for comparison with the emitter
+  std::string streamed;
+  double      streamMs = bestOf([&]() { streamed = streamDSL(levels); });
+  out << "serialize dsl (ostringstream): " << streamMs << " ms, "
+      << streamed.size() << " bytes, "
+      << megabytesPerSecond(streamed.size(), streamMs) << " MB/s, output "
+      << (streamed == emitAll(WADFormat::DSL, levels) ? "same" : "DIFFERENT")
+      << "\n";
+
+  // Import, and check the imported levels convert back to the same text
+  const std::pair<const char *, WADFormat> imports[] = {
+      {"json", WADFormat::JSON},
+      {"jsonverbose", WADFormat::JSON_VERBOSE},
+      {"dsl", WADFormat::DSL},
+      {"dslverbose", WADFormat::DSL_VERBOSE}};
+  for (const auto &format : imports) {
+    std::string             text = emitAll(format.second, levels);
+    std::vector<WAD::Level> imported;
+    double                  ms   = bestOf([&]() {
+      std::istringstream in(text);
+      imported = format.second == WADFormat::DSL ||
+                         format.second == WADFormat::DSL_VERBOSE
+                     ? importDSL(in)
+                     : importJSON(in);
+    });
+    bool roundTrip = emitAll(format.second, imported) == text;
+    out << "import " << format.first << ": " << ms << " ms, "
+        << megabytesPerSecond(text.size(), ms) << " MB/s, round-trip "
+        << (roundTrip ? "ok" : "MISMATCH") << "\n";
+  }
+
+  return out.str();
+}
@@ -0,0 +1,10 @@
+#ifndef BENCH_HPP
+#define BENCH_HPP
+
+#include "wad.hpp"
+#include <string>
+
+// Run the benchmark suite over a WAD and return its plain text report
+std::string runBenchmarks(WAD &wad);
+
+#endif  // BENCH_HPP
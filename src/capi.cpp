@@ -0,0 +1,221 @@
+#include "names.hpp"
+#include "wad.hpp"
+#include "wadconvert.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// The C records are handed out as views of the C++ ones: same size and
+// field offsets, checked here once
+#define WC_SAME_LAYOUT(C, CPP, FIRST, LAST)                                   \
+  static_assert(sizeof(C) == sizeof(CPP) &&                                   \
+                    offsetof(C, FIRST) == offsetof(CPP, FIRST) &&             \
+                    offsetof(C, LAST) == offsetof(CPP, LAST) &&               \
+                    std::is_standard_layout_v<CPP>,                           \
+                #C " does not match " #CPP)
+
+WC_SAME_LAYOUT(wc_vertex, WAD::Vertex, x, y);
+WC_SAME_LAYOUT(wc_linedef, WAD::Linedef, start_vertex, left_sidedef);
+WC_SAME_LAYOUT(wc_sidedef, WAD::Sidedef, x_offset, sector);
+WC_SAME_LAYOUT(wc_sector, WAD::Sector, floor_height, tag);
+WC_SAME_LAYOUT(wc_thing, WAD::Thing, x, flags);
+WC_SAME_LAYOUT(wc_thing_args, WAD::ThingArgs, hexen_flags, args);
+WC_SAME_LAYOUT(wc_linedef_args, WAD::LinedefArgs, args, args);
+
+#undef WC_SAME_LAYOUT
+
+struct wc_wad {
+  std::unique_ptr<WAD> wad;
+  std::vector<size_t>  markers;  // Directory index of each level marker
+  std::vector<char>    names;    // Level names, 9 bytes each, terminated
+};
+
+struct wc_level {
+  WAD::Level level;
+  char       name[9];
+};
+
+namespace {
+
+thread_local std::string lastError;
+
+wc_status fail(wc_status status, const std::string &message) {
+  lastError = message;
+  return status;
+}
+
+/**
+ * @brief Run a C API call, turning exceptions into status codes
+ * @param body Call body, returning its status
+ * @return Status of the call; the message goes to wc_last_error()
+ */
+template <typename Body>
+wc_status guarded(Body body) {
+  try {
+    lastError.clear();
+    return body();
+  } catch (const std::bad_alloc &) {
+    return fail(WC_ERROR_NO_MEMORY, "Out of memory");
+  } catch (const std::exception &e) {
+    return fail(WC_ERROR_WAD, e.what());
+  }
+}
+
+// Finish opening a WAD: index its levels
+wc_status open(std::unique_ptr<WAD> wad, wc_wad **out) {
+  auto handle = std::make_unique<wc_wad>();
+  wad->setQuiet(true);
+  handle->markers = wad->levelMarkers();
+  handle->names.assign(handle->markers.size() * 9, '\0');
+  for (size_t i = 0; i < handle->markers.size(); i++) {
+    std::memcpy(&handle->names[i * 9],
+                wad->directory()[handle->markers[i]].name, 8);
+  }
+  handle->wad = std::move(wad);
+  *out        = handle.release();
+  return WC_OK;
+}
+
+template <typename C, typename T>
+const C *view(const std::pmr::vector<T> &records, size_t *count) {
+  if (count != nullptr) {
+    *count = records.size();
+  }
+  return records.empty() ? nullptr
+                         : reinterpret_cast<const C *>(records.data());
+}
+
+}  // namespace
+
+uint32_t wc_api_version(void) { return WC_API_VERSION; }
+
+const char *wc_last_error(void) { return lastError.c_str(); }
+
+wc_status wc_open_file(const char *path, wc_wad **wad) {
+  if (path == nullptr || wad == nullptr) {
+    return fail(WC_ERROR_ARGUMENT, "Null argument");
+  }
+  *wad = nullptr;
+  return guarded([&]() { return open(std::make_unique<WAD>(path), wad); });
+}
+
+wc_status wc_open_memory(const void *data, size_t size, wc_wad **wad) {
+  if ((data == nullptr && size > 0) || wad == nullptr) {
+    return fail(WC_ERROR_ARGUMENT, "Null argument");
+  }
+  *wad = nullptr;
+  return guarded([&]() {
+    const uint8_t       *bytes = static_cast<const uint8_t *>(data);
+    std::vector<uint8_t> copy(bytes, bytes + size);
+    return open(std::make_unique<WAD>(std::move(copy), "<memory>"), wad);
+  });
+}
+
+void wc_close(wc_wad *wad) { delete wad; }
+
+size_t wc_level_count(const wc_wad *wad) {
+  return wad != nullptr ? wad->markers.size() : 0;
+}
+
+const char *wc_level_name(const wc_wad *wad, size_t index) {
+  if (wad == nullptr || index >= wad->markers.size()) {
+    return nullptr;
+  }
+  return &wad->names[index * 9];
+}
+
+wc_status wc_find_level(const wc_wad *wad, const char *name, size_t *index) {
+  if (wad == nullptr || name == nullptr || index == nullptr) {
+    return fail(WC_ERROR_ARGUMENT, "Null argument");
+  }
+  NameKey key = packName(name, std::strlen(name));
+  for (size_t i = 0; i < wad->markers.size(); i++) {
+    if (packName(&wad->names[i * 9]) == key) {
+      *index = i;
+      return WC_OK;
+    }
+  }
+  return fail(WC_ERROR_NOT_FOUND, std::string("Level not found: ") + name);
+}
+
+wc_status wc_load_level(const wc_wad *wad, size_t index, wc_level **level) {
+  if (wad == nullptr || level == nullptr) {
+    return fail(WC_ERROR_ARGUMENT, "Null argument");
+  }
+  *level = nullptr;
+  if (index >= wad->markers.size()) {
+    return fail(WC_ERROR_ARGUMENT, "Level index out of range");
+  }
+  return guarded([&]() {
+    auto handle = std::unique_ptr<wc_level>(
+        new wc_level{wad->wad->loadLevel(wad->markers[index]), {}});
+    std::memcpy(handle->name, &wad->names[index * 9], 9);
+    *level = handle.release();
+    return WC_OK;
+  });
+}
+
+void wc_free_level(wc_level *level) { delete level; }
+
+const char *wc_level_get_name(const wc_level *level) {
+  return level != nullptr ? level->name : nullptr;
+}
+
+wc_level_format wc_level_get_format(const wc_level *level) {
+  if (level == nullptr) {
+    return WC_FORMAT_DOOM;
+  }
+  switch (level->level.format) {
+    case WAD::LevelFormat::Hexen:
+      return WC_FORMAT_HEXEN;
+    case WAD::LevelFormat::UDMF:
+      return WC_FORMAT_UDMF;
+    default:
+      return WC_FORMAT_DOOM;
+  }
+}
+
+const wc_vertex *wc_level_vertices(const wc_level *level, size_t *count) {
+  static const std::pmr::vector<WAD::Vertex> none;
+  return view<wc_vertex>(level ? level->level.vertices : none, count);
+}
+
+const wc_linedef *wc_level_linedefs(const wc_level *level, size_t *count) {
+  static const std::pmr::vector<WAD::Linedef> none;
+  return view<wc_linedef>(level ? level->level.linedefs : none, count);
+}
+
+const wc_sidedef *wc_level_sidedefs(const wc_level *level, size_t *count) {
+  static const std::pmr::vector<WAD::Sidedef> none;
+  return view<wc_sidedef>(level ? level->level.sidedefs : none, count);
+}
+
+const wc_sector *wc_level_sectors(const wc_level *level, size_t *count) {
+  static const std::pmr::vector<WAD::Sector> none;
+  return view<wc_sector>(level ? level->level.sectors : none, count);
+}
+
+const wc_thing *wc_level_things(const wc_level *level, size_t *count) {
+  static const std::pmr::vector<WAD::Thing> none;
+  return view<wc_thing>(level ? level->level.things : none, count);
+}
+
+const wc_thing_args *wc_level_thing_args(const wc_level *level,
+                                         size_t         *count) {
+  static const std::pmr::vector<WAD::ThingArgs> none;
+  return view<wc_thing_args>(level ? level->level.thing_args : none, count);
+}
+
+const wc_linedef_args *wc_level_linedef_args(const wc_level *level,
+                                             size_t         *count) {
+  static const std::pmr::vector<WAD::LinedefArgs> none;
+  return view<wc_linedef_args>(level ? level->level.linedef_args : none,
+                               count);
+}
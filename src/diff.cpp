@@ -0,0 +1,644 @@
+#include "diff.hpp"
+#include "lump.hpp"
+#include "names.hpp"
+#include "parallel.hpp"
+#include "things.hpp"
+#include "udmf.hpp"
+#include "wad.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <iterator>
+#include <nlohmann/json.hpp>
+#include <set>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+// Lumps that belong to the level marker before them: the binary DOOM and
+// Hexen lumps, and the UDMF ones from TEXTMAP to ENDMAP
+constexpr NameKey kLevelLumps[] = {
+    packName("THINGS"),   packName("LINEDEFS"), packName("SIDEDEFS"),
+    packName("VERTEXES"), packName("SEGS"),     packName("SSECTORS"),
+    packName("NODES"),    packName("SECTORS"),  packName("REJECT"),
+    packName("BLOCKMAP"), packName("BEHAVIOR"), packName("SCRIPTS"),
+    packName("TEXTMAP"),  packName("ZNODES"),   packName("DIALOGUE"),
+    packName("ENDMAP")};
+
+bool isLevelLump(NameKey name) {
+  return std::find(std::begin(kLevelLumps), std::end(kLevelLumps), name) !=
+         std::end(kLevelLumps);
+}
+
+// Name, size and hash of a lump; equal fingerprints mean equal lumps
+struct LumpPrint {
+  NameKey  name;
+  uint32_t size;
+  uint64_t hash;
+
+  bool operator==(const LumpPrint &other) const {
+    return name == other.name && size == other.size && hash == other.hash;
+  }
+  bool operator!=(const LumpPrint &other) const { return !(*this == other); }
+};
+
+// A level: its marker and the level lumps following it
+struct LevelLumps {
+  NameKey name;
+  size_t  marker;  // Directory index of the marker
+  size_t  end;     // One past the last lump of the level
+};
+
+// Fingerprint of a whole WAD, split into levels and other lumps
+struct WADPrint {
+  std::vector<LumpPrint>  lumps;  // One per directory entry
+  std::vector<LevelLumps> levels;
+  std::vector<size_t>     others;  // Directory indices outside any level
+};
+
+std::string nameString(NameKey name) {
+  return std::string(unpackName(name).view());
+}
+
+/**
+ * @brief Hash every lump of a WAD and find its levels
+ * @param wad WAD with its directory read
+ * @return Fingerprint of the WAD
+ * @note Lumps are read and hashed in parallel, each read on its own stream.
+ */
+WADPrint fingerprint(const WAD &wad) {
+  const std::vector<WAD::Directory> &directory = wad.directory();
+
+  WADPrint print;
+  print.lumps.resize(directory.size());
+  parallelFor(directory.size(), [&](size_t i) {
+    std::vector<uint8_t> data = wad.lumpData(i);
+    print.lumps[i] = {packName(directory[i].name), directory[i].size,
+                      hashLump(data.data(), data.size())};
+  });
+
+  size_t next = 0;  // First directory index not assigned yet
+  for (size_t marker : wad.levelMarkers()) {
+    for (; next < marker; next++) {
+      print.others.push_back(next);
+    }
+    size_t end = marker + 1;
+    while (end < directory.size() && isLevelLump(print.lumps[end].name)) {
+      end++;
+    }
+    print.levels.push_back({print.lumps[marker].name, marker, end});
+    next = end;
+  }
+  for (; next < directory.size(); next++) {
+    print.others.push_back(next);
+  }
+
+  return print;
+}
+
+// Directory index of a lump inside a level, or the level end if missing
+size_t findInLevel(const WADPrint &print, const LevelLumps &level,
+                   NameKey name) {
+  for (size_t i = level.marker + 1; i < level.end; i++) {
+    if (print.lumps[i].name == name) {
+      return i;
+    }
+  }
+  return level.end;
+}
+
+// True when two levels have exactly the same lumps
+bool sameLevel(const WADPrint &oldPrint, const LevelLumps &oldLevel,
+               const WADPrint &newPrint, const LevelLumps &newLevel) {
+  if (oldLevel.end - oldLevel.marker != newLevel.end - newLevel.marker) {
+    return false;
+  }
+  for (size_t i = 1; i < oldLevel.end - oldLevel.marker; i++) {
+    if (oldPrint.lumps[oldLevel.marker + i] !=
+        newPrint.lumps[newLevel.marker + i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+nlohmann::json recordJSON(const WAD::Vertex &v) {
+  return {{"x", v.x}, {"y", v.y}};
+}
+
+nlohmann::json recordJSON(const WAD::Linedef &l) {
+  return {{"start", l.start_vertex},    {"end", l.end_vertex},
+          {"flags", l.flags},           {"type", l.line_type},
+          {"tag", l.sector_tag},        {"right_sidedef", l.right_sidedef},
+          {"left_sidedef", l.left_sidedef}};
+}
+
+nlohmann::json recordJSON(const WAD::Sidedef &s) {
+  return {{"x_offset", s.x_offset},
+          {"y_offset", s.y_offset},
+          {"upper_texture", nameString(packName(s.upper_texture))},
+          {"lower_texture", nameString(packName(s.lower_texture))},
+          {"middle_texture", nameString(packName(s.middle_texture))},
+          {"sector", s.sector}};
+}
+
+nlohmann::json recordJSON(const WAD::Sector &s) {
+  return {{"floor_height", s.floor_height},
+          {"ceiling_height", s.ceiling_height},
+          {"floor_texture", nameString(packName(s.floor_texture))},
+          {"ceiling_texture", nameString(packName(s.ceiling_texture))},
+          {"light_level", s.light_level},
+          {"type", s.type},
+          {"tag", s.tag}};
+}
+
+// Thing types are named after the DOOM things; the Hexen and UDMF DoomEd
+// numbers mean other things, so they are left as numbers
+nlohmann::json recordJSON(const WAD::Thing &t, bool named = true) {
+  const ThingInfo *info = named ? thingInfo(t.type) : nullptr;
+  return {{"x", t.x},
+          {"y", t.y},
+          {"angle", t.angle},
+          {"type", info ? nlohmann::json(info->name) : nlohmann::json(t.type)},
+          {"flags", t.flags}};
+}
+
+nlohmann::json recordJSON(const WAD::HexenLinedef &l) {
+  return {{"start", l.start_vertex},    {"end", l.end_vertex},
+          {"flags", l.flags},           {"type", l.special},
+          {"args", l.args},             {"right_sidedef", l.right_sidedef},
+          {"left_sidedef", l.left_sidedef}};
+}
+
+nlohmann::json recordJSON(const WAD::HexenThing &t) {
+  nlohmann::json thing =
+      recordJSON(WAD::Thing{t.x, t.y, t.angle, t.type, t.flags}, false);
+  thing["tid"]     = t.tid;
+  thing["z"]       = t.z;
+  thing["special"] = t.special;
+  thing["args"]    = t.args;
+  return thing;
+}
+
+/**
+ * @brief Compare two lists of records, record by record
+ * @param oldCount Records in the original list
+ * @param newCount Records in the changed list
+ * @param changed Whether the record at an index of both lists differs
+ * @param oldJSON JSON of a record of the original list, by index
+ * @param newJSON JSON of a record of the changed list, by index
+ * @return {"added": [...], "removed": [...], "modified": [...]}, with only
+ *         the non-empty lists, so an empty object when nothing changed
+ */
+template <typename Changed, typename OldJSON, typename NewJSON>
+nlohmann::json diffLists(size_t oldCount, size_t newCount, Changed changed,
+                         OldJSON oldJSON, NewJSON newJSON) {
+  size_t common = std::min(oldCount, newCount);
+
+  nlohmann::json added    = nlohmann::json::array();
+  nlohmann::json removed  = nlohmann::json::array();
+  nlohmann::json modified = nlohmann::json::array();
+  for (size_t i = 0; i < common; i++) {
+    if (changed(i)) {
+      modified.push_back(
+          {{"index", i}, {"old", oldJSON(i)}, {"new", newJSON(i)}});
+    }
+  }
+  for (size_t i = common; i < newCount; i++) {
+    nlohmann::json record = newJSON(i);
+    record["index"]       = i;
+    added.push_back(record);
+  }
+  for (size_t i = common; i < oldCount; i++) {
+    nlohmann::json record = oldJSON(i);
+    record["index"]       = i;
+    removed.push_back(record);
+  }
+
+  nlohmann::json diff = nlohmann::json::object();
+  if (!added.empty()) {
+    diff["added"] = added;
+  }
+  if (!removed.empty()) {
+    diff["removed"] = removed;
+  }
+  if (!modified.empty()) {
+    diff["modified"] = modified;
+  }
+  return diff;
+}
+
+/**
+ * @brief Compare two versions of a record lump, record by record
+ * @param oldData Original lump
+ * @param newData Changed lump
+ * @param what Lump name, for error messages
+ * @return The record diff (see diffLists)
+ * @note Records are compared as raw bytes and only decoded when they differ.
+ */
+template <typename T>
+nlohmann::json diffRecords(const std::vector<uint8_t> &oldData,
+                           const std::vector<uint8_t> &newData,
+                           const char                 *what) {
+  constexpr size_t size = LumpRecord<T>::size;
+  LumpView<T>      oldRecords(LumpBytes(oldData.data(), oldData.size(), what));
+  LumpView<T>      newRecords(LumpBytes(newData.data(), newData.size(), what));
+  return diffLists(
+      oldRecords.size(), newRecords.size(),
+      [&](size_t i) {
+        return std::memcmp(oldData.data() + i * size,
+                           newData.data() + i * size, size) != 0;
+      },
+      [&](size_t i) { return recordJSON(oldRecords[i]); },
+      [&](size_t i) { return recordJSON(newRecords[i]); });
+}
+
+// Records of a UDMF level as JSON, one list per table; linedefs and things
+// in the shape of the Hexen records, with their special arguments
+struct UDMFRecords {
+  std::vector<nlohmann::json> vertices, linedefs, sidedefs, sectors, things;
+};
+
+UDMFRecords udmfRecords(const WAD::Level &level) {
+  UDMFRecords records;
+  for (const WAD::Vertex &v : level.vertices) {
+    records.vertices.push_back(recordJSON(v));
+  }
+  for (size_t i = 0; i < level.linedefs.size(); i++) {
+    nlohmann::json linedef = recordJSON(level.linedefs[i]);
+    if (i < level.linedef_args.size()) {
+      linedef["args"] = level.linedef_args[i].args;
+    }
+    records.linedefs.push_back(linedef);
+  }
+  for (const WAD::Sidedef &s : level.sidedefs) {
+    records.sidedefs.push_back(recordJSON(s));
+  }
+  for (const WAD::Sector &s : level.sectors) {
+    records.sectors.push_back(recordJSON(s));
+  }
+  for (size_t i = 0; i < level.things.size(); i++) {
+    nlohmann::json thing = recordJSON(level.things[i], false);
+    if (i < level.thing_args.size()) {
+      const WAD::ThingArgs &a = level.thing_args[i];
+      thing["tid"]            = a.tid;
+      thing["z"]              = a.z;
+      thing["special"]        = a.special;
+      thing["hexen_flags"]    = a.hexen_flags;
+      thing["args"]           = a.args;
+    }
+    records.things.push_back(thing);
+  }
+  return records;
+}
+
+// Compare two lists of record JSON
+nlohmann::json diffJSON(const std::vector<nlohmann::json> &oldRecords,
+                        const std::vector<nlohmann::json> &newRecords) {
+  return diffLists(
+      oldRecords.size(), newRecords.size(),
+      [&](size_t i) { return oldRecords[i] != newRecords[i]; },
+      [&](size_t i) { return oldRecords[i]; },
+      [&](size_t i) { return newRecords[i]; });
+}
+
+/**
+ * @brief Parse a TEXTMAP lump for the diff
+ * @param text Lump data
+ * @return The level: geometry, things and their specials
+ * @throws std::runtime_error if the text is not valid UDMF
+ */
+WAD::Level parseTextmap(const std::vector<uint8_t> &text) {
+  WAD::Level level;
+  parseUDMF(std::string_view(reinterpret_cast<const char *>(text.data()),
+                             text.size()),
+            level);
+  return level;
+}
+
+// Wall textures and flats used by a level, from its sidedefs and sectors:
+// lump views, or the vectors of a parsed level
+template <typename Sidedefs, typename Sectors>
+std::set<NameKey> usedTextures(const Sidedefs &sides, const Sectors &sects) {
+  constexpr NameKey noTexture = packName("-");
+  std::set<NameKey> names;
+  auto              add = [&](const char *name) {
+    NameKey key = packName(name);
+    if (key != 0 && key != noTexture) {
+      names.insert(key);
+    }
+  };
+
+  for (size_t i = 0; i < sides.size(); i++) {
+    WAD::Sidedef side = sides[i];
+    add(side.upper_texture);
+    add(side.lower_texture);
+    add(side.middle_texture);
+  }
+  for (size_t i = 0; i < sects.size(); i++) {
+    WAD::Sector sector = sects[i];
+    add(sector.floor_texture);
+    add(sector.ceiling_texture);
+  }
+  return names;
+}
+
+std::set<NameKey> usedTextures(const std::vector<uint8_t> &sidedefs,
+                               const std::vector<uint8_t> &sectors) {
+  return usedTextures(
+      LumpView<WAD::Sidedef>(
+          LumpBytes(sidedefs.data(), sidedefs.size(), "SIDEDEFS")),
+      LumpView<WAD::Sector>(
+          LumpBytes(sectors.data(), sectors.size(), "SECTORS")));
+}
+
+// The "textures" entry of a level diff: names added and removed, if any
+void addTextureChanges(const std::set<NameKey> &oldNames,
+                       const std::set<NameKey> &newNames,
+                       nlohmann::json          &level) {
+  nlohmann::json added   = nlohmann::json::array();
+  nlohmann::json removed = nlohmann::json::array();
+  for (NameKey name : newNames) {
+    if (oldNames.count(name) == 0) {
+      added.push_back(nameString(name));
+    }
+  }
+  for (NameKey name : oldNames) {
+    if (newNames.count(name) == 0) {
+      removed.push_back(nameString(name));
+    }
+  }
+  if (!added.empty() || !removed.empty()) {
+    level["textures"] = {{"added", added}, {"removed", removed}};
+  }
+}
+
+/**
+ * @brief Structural diff of two versions of a level
+ * @return Level name, changed lumps and the per-table record diffs
+ */
+nlohmann::json diffLevel(const WAD &oldWad, const WADPrint &oldPrint,
+                         const LevelLumps &oldLevel, const WAD &newWad,
+                         const WADPrint &newPrint, const LevelLumps &newLevel) {
+  nlohmann::json level;
+  level["name"] = nameString(oldLevel.name);
+  if (newLevel.name != oldLevel.name) {
+    level["new_name"] = nameString(newLevel.name);
+  }
+
+  // Level lumps that were added, removed or changed
+  nlohmann::json lumps = nlohmann::json::array();
+  for (NameKey name : kLevelLumps) {
+    size_t oldIndex = findInLevel(oldPrint, oldLevel, name);
+    size_t newIndex = findInLevel(newPrint, newLevel, name);
+    bool   inOld    = oldIndex != oldLevel.end;
+    bool   inNew    = newIndex != newLevel.end;
+    if (inOld != inNew ||
+        (inOld && oldPrint.lumps[oldIndex] != newPrint.lumps[newIndex])) {
+      lumps.push_back(nameString(name));
+    }
+  }
+  level["lumps"] = lumps;
+
+  // Read a level lump of both versions (empty where it is missing), or
+  // return false if it did not change
+  auto read = [&](NameKey name, std::vector<uint8_t> &oldData,
+                  std::vector<uint8_t> &newData) {
+    oldData.clear();
+    newData.clear();
+    size_t oldIndex = findInLevel(oldPrint, oldLevel, name);
+    size_t newIndex = findInLevel(newPrint, newLevel, name);
+    bool   inOld    = oldIndex != oldLevel.end;
+    bool   inNew    = newIndex != newLevel.end;
+    if (inOld && inNew &&
+        oldPrint.lumps[oldIndex] == newPrint.lumps[newIndex]) {
+      return false;
+    }
+    if (inOld) {
+      oldData = oldWad.lumpData(oldIndex);
+    }
+    if (inNew) {
+      newData = newWad.lumpData(newIndex);
+    }
+    return true;
+  };
+
+  std::vector<uint8_t> oldData, newData;
+  auto addTable = [&](const char *key, const nlohmann::json &diff) {
+    if (!diff.empty()) {
+      level[key] = diff;
+    }
+  };
+
+  // UDMF levels: both TEXTMAP lumps are parsed and compared record by
+  // record, as the binary lumps are
+  constexpr NameKey textmap = packName("TEXTMAP");
+  bool oldUDMF = findInLevel(oldPrint, oldLevel, textmap) != oldLevel.end;
+  bool newUDMF = findInLevel(newPrint, newLevel, textmap) != newLevel.end;
+  if (oldUDMF != newUDMF) {
+    level["format_changed"] = true;
+    return level;
+  }
+  if (oldUDMF) {
+    if (read(textmap, oldData, newData)) {
+      WAD::Level  oldMap  = parseTextmap(oldData);
+      WAD::Level  newMap  = parseTextmap(newData);
+      UDMFRecords oldRecs = udmfRecords(oldMap);
+      UDMFRecords newRecs = udmfRecords(newMap);
+      addTable("vertices", diffJSON(oldRecs.vertices, newRecs.vertices));
+      addTable("linedefs", diffJSON(oldRecs.linedefs, newRecs.linedefs));
+      addTable("things", diffJSON(oldRecs.things, newRecs.things));
+      addTable("sidedefs", diffJSON(oldRecs.sidedefs, newRecs.sidedefs));
+      addTable("sectors", diffJSON(oldRecs.sectors, newRecs.sectors));
+      addTextureChanges(usedTextures(oldMap.sidedefs, oldMap.sectors),
+                        usedTextures(newMap.sidedefs, newMap.sectors), level);
+    }
+    return level;
+  }
+  if (read(packName("VERTEXES"), oldData, newData)) {
+    addTable("vertices",
+             diffRecords<WAD::Vertex>(oldData, newData, "VERTEXES"));
+  }
+
+  // Hexen levels have their own things and linedefs; when a level changed
+  // format those two lumps cannot be compared record by record
+  constexpr NameKey behavior = packName("BEHAVIOR");
+  bool oldHexen = findInLevel(oldPrint, oldLevel, behavior) != oldLevel.end;
+  bool newHexen = findInLevel(newPrint, newLevel, behavior) != newLevel.end;
+  if (oldHexen != newHexen) {
+    level["format_changed"] = true;
+  } else if (oldHexen) {
+    if (read(packName("LINEDEFS"), oldData, newData)) {
+      addTable("linedefs",
+               diffRecords<WAD::HexenLinedef>(oldData, newData, "LINEDEFS"));
+    }
+    if (read(packName("THINGS"), oldData, newData)) {
+      addTable("things",
+               diffRecords<WAD::HexenThing>(oldData, newData, "THINGS"));
+    }
+  } else {
+    if (read(packName("LINEDEFS"), oldData, newData)) {
+      addTable("linedefs",
+               diffRecords<WAD::Linedef>(oldData, newData, "LINEDEFS"));
+    }
+    if (read(packName("THINGS"), oldData, newData)) {
+      addTable("things", diffRecords<WAD::Thing>(oldData, newData, "THINGS"));
+    }
+  }
+
+  // Sidedefs and sectors also give the textures in use
+  std::vector<uint8_t> oldSides, newSides, oldSectors, newSectors;
+  bool sidesChanged   = read(packName("SIDEDEFS"), oldSides, newSides);
+  bool sectorsChanged = read(packName("SECTORS"), oldSectors, newSectors);
+  if (sidesChanged) {
+    addTable("sidedefs",
+             diffRecords<WAD::Sidedef>(oldSides, newSides, "SIDEDEFS"));
+  }
+  if (sectorsChanged) {
+    addTable("sectors",
+             diffRecords<WAD::Sector>(oldSectors, newSectors, "SECTORS"));
+  }
+  if (sidesChanged || sectorsChanged) {
+    // An unchanged lump was not read, the other version is the same data
+    if (!sidesChanged) {
+      size_t index = findInLevel(oldPrint, oldLevel, packName("SIDEDEFS"));
+      if (index != oldLevel.end) {
+        oldSides = newSides = oldWad.lumpData(index);
+      }
+    }
+    if (!sectorsChanged) {
+      size_t index = findInLevel(oldPrint, oldLevel, packName("SECTORS"));
+      if (index != oldLevel.end) {
+        oldSectors = newSectors = oldWad.lumpData(index);
+      }
+    }
+
+    addTextureChanges(usedTextures(oldSides, oldSectors),
+                      usedTextures(newSides, newSectors), level);
+  }
+
+  return level;
+}
+
+/**
+ * @brief Compare the lumps outside of levels
+ * @return {"added": [...], "removed": [...], "modified": [...]} lump names
+ * @note Lumps are paired by name; a name used several times (markers, for
+ *       instance) is paired occurrence by occurrence.
+ */
+nlohmann::json diffOtherLumps(const WADPrint &oldPrint,
+                              const WADPrint &newPrint) {
+  std::unordered_map<NameKey, std::vector<size_t>> newByName;
+  for (size_t i : newPrint.others) {
+    newByName[newPrint.lumps[i].name].push_back(i);
+  }
+
+  nlohmann::json added    = nlohmann::json::array();
+  nlohmann::json removed  = nlohmann::json::array();
+  nlohmann::json modified = nlohmann::json::array();
+
+  std::unordered_map<NameKey, size_t> oldCount;
+  for (size_t i : oldPrint.others) {
+    const LumpPrint &lump       = oldPrint.lumps[i];
+    size_t           occurrence = oldCount[lump.name]++;
+    auto             found      = newByName.find(lump.name);
+    if (found == newByName.end() || occurrence >= found->second.size()) {
+      removed.push_back(nameString(lump.name));
+    } else if (newPrint.lumps[found->second[occurrence]] != lump) {
+      modified.push_back(nameString(lump.name));
+    }
+  }
+
+  std::unordered_map<NameKey, size_t> newCount;
+  for (size_t i : newPrint.others) {
+    NameKey name = newPrint.lumps[i].name;
+    if (newCount[name]++ >= oldCount[name]) {
+      added.push_back(nameString(name));
+    }
+  }
+
+  return {{"added", added}, {"removed", removed}, {"modified", modified}};
+}
+
+}  // namespace
+
+/**
+ * @brief Compare two WADs, lump by lump and level by level
+ * @param oldWad Original WAD, with its directory read
+ * @param newWad Changed WAD, with its directory read
+ * @return JSON document describing the differences
+ * @throws std::runtime_error if a lump cannot be read
+ * @note Every lump is hashed first. Levels whose lumps all hash the same are
+ *       only counted as unchanged; the others get a structural diff of their
+ *       vertices, linedefs, sidedefs, sectors and things (by record index, the
+ *       way the lumps reference each other) and of the textures they use.
+ *       Levels are paired by name, or with each other when both WADs hold a
+ *       single level. Other lumps are paired by name and reported as added,
+ *       removed or modified. Hexen levels are compared with their own
+ *       things and linedefs, UDMF levels by parsing both TEXTMAP lumps;
+ *       their thing types are left as numbers.
+ */
+nlohmann::json diffWADs(const WAD &oldWad, const WAD &newWad) {
+  WADPrint oldPrint = fingerprint(oldWad);
+  WADPrint newPrint = fingerprint(newWad);
+
+  nlohmann::json diff;
+  diff["old"] = std::filesystem::path(oldWad.filepath()).filename().string();
+  diff["new"] = std::filesystem::path(newWad.filepath()).filename().string();
+  diff["lumps"] = diffOtherLumps(oldPrint, newPrint);
+
+  nlohmann::json added     = nlohmann::json::array();
+  nlohmann::json removed   = nlohmann::json::array();
+  nlohmann::json modified  = nlohmann::json::array();
+  size_t         unchanged = 0;
+
+  auto compare = [&](const LevelLumps &oldLevel, const LevelLumps &newLevel) {
+    if (oldLevel.name == newLevel.name &&
+        sameLevel(oldPrint, oldLevel, newPrint, newLevel)) {
+      unchanged++;
+    } else {
+      modified.push_back(diffLevel(oldWad, oldPrint, oldLevel, newWad,
+                                   newPrint, newLevel));
+    }
+  };
+
+  if (oldPrint.levels.size() == 1 && newPrint.levels.size() == 1) {
+    // Two versions of a single level, whatever their names
+    compare(oldPrint.levels[0], newPrint.levels[0]);
+  } else {
+    // Paired by name, occurrence by occurrence if a name is used twice
+    std::unordered_map<NameKey, std::vector<size_t>> newByName;
+    for (size_t i = 0; i < newPrint.levels.size(); i++) {
+      newByName[newPrint.levels[i].name].push_back(i);
+    }
+    std::unordered_map<NameKey, size_t> oldCount;
+    std::vector<bool>                   paired(newPrint.levels.size(), false);
+    for (const LevelLumps &oldLevel : oldPrint.levels) {
+      size_t occurrence = oldCount[oldLevel.name]++;
+      auto   found      = newByName.find(oldLevel.name);
+      if (found == newByName.end() || occurrence >= found->second.size()) {
+        removed.push_back(nameString(oldLevel.name));
+        continue;
+      }
+      size_t index  = found->second[occurrence];
+      paired[index] = true;
+      compare(oldLevel, newPrint.levels[index]);
+    }
+    for (size_t i = 0; i < newPrint.levels.size(); i++) {
+      if (!paired[i]) {
+        added.push_back(nameString(newPrint.levels[i].name));
+      }
+    }
+  }
+
+  diff["levels"] = {{"unchanged", unchanged},
+                    {"added", added},
+                    {"removed", removed},
+                    {"modified", modified}};
+  return diff;
+}
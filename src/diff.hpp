@@ -0,0 +1,10 @@
+#ifndef DIFF_HPP
+#define DIFF_HPP
+
+#include "wad.hpp"
+#include <nlohmann/json.hpp>
+
+// Compare two WADs, lump by lump and level by level, as a JSON document
+nlohmann::json diffWADs(const WAD &oldWad, const WAD &newWad);
+
+#endif  // DIFF_HPP
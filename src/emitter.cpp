@@ -0,0 +1,764 @@
+#include "emitter.hpp"
+#include "names.hpp"
+#include "spatial.hpp"
+#include "things.hpp"
+#include "wad.hpp"
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+/**
+ * @brief JSON value for a thing type
+ * @param type DoomEd number
+ * @return The type name for known types, the number otherwise
+ */
+static nlohmann::json thingType(uint16_t type) {
+  const ThingInfo *info = thingInfo(type);
+  if (info) {
+    return info->name;
+  }
+  return type;
+}
+
+/**
+ * @brief Opening of the brief JSON document
+ * @return Text preceding the first level
+ */
+std::string JSONEmitter::begin() {
+  return "{\n \"levels\": [\n";
+}
+
+// Append an integer to a JSON document
+static void appendInt(std::string &out, long long value) {
+  char                 buffer[24];
+  std::to_chars_result result =
+      std::to_chars(buffer, buffer + sizeof(buffer), value);
+  out.append(buffer, result.ptr);
+}
+
+// Append a string as a quoted JSON string, escaped the way nlohmann::json
+// does. Bytes outside ASCII are written as \u00XX (Latin-1).
+static void appendJSONString(std::string &out, std::string_view value) {
+  static const char hex[] = "0123456789abcdef";
+  out += '"';
+  for (char c : value) {
+    unsigned char byte = static_cast<unsigned char>(c);
+    switch (c) {
+      case '"':
+        out += "\\\"";
+        break;
+      case '\\':
+        out += "\\\\";
+        break;
+      case '\b':
+        out += "\\b";
+        break;
+      case '\f':
+        out += "\\f";
+        break;
+      case '\n':
+        out += "\\n";
+        break;
+      case '\r':
+        out += "\\r";
+        break;
+      case '\t':
+        out += "\\t";
+        break;
+      default:
+        if (byte < 0x20 || byte >= 0x80) {
+          out += "\\u00";
+          out += hex[byte >> 4];
+          out += hex[byte & 0xF];
+        } else {
+          out += c;
+        }
+    }
+  }
+  out += '"';
+}
+
+// Append a fixed-size name field as a JSON string, trimmed like trimString()
+static void appendJSONName(std::string &out, const char *name) {
+  appendJSONString(out, unpackName(packName(name)).view());
+}
+
+/**
+ * @brief Append one JSON array with one record per line
+ * @param out Document being written
+ * @param key Array key
+ * @param records Records to write
+ * @param writeRecord Callable appending a single record to out
+ */
+template <typename Records, typename WriteRecord>
+static void appendArray(std::string &out, std::string_view key,
+                        const Records &records, WriteRecord &&writeRecord) {
+  out += "   \"";
+  out += key;
+  out += "\": [\n";
+  for (size_t i = 0; i < records.size(); ++i) {
+    out += "    {";
+    writeRecord(records[i]);
+    out += i < records.size() - 1 ? "},\n" : "}\n";
+  }
+  out += "   ]";
+}
+
+/**
+ * @brief Convert one level to the brief JSON format
+ * @param level Level to convert
+ * @return JSON text for the level, one object per line inside each array
+ * @note The records are written directly, with their keys in sorted order as
+ *       nlohmann::json would dump them. Names are written straight from the
+ *       fixed-size fields, so no strings are allocated per record.
+ */
+std::string JSONEmitter::level(const WAD::Level &level) {
+  std::string out;
+  out.reserve(64 + level.vertices.size() * 24 + level.linedefs.size() * 56 +
+              level.sidedefs.size() * 72 + level.sectors.size() * 80 +
+              level.things.size() * 48);
+
+  if (count_++ > 0) {
+    out += ",\n";
+  }
+  out += "  {\n   \"name\": ";
+  appendJSONString(out, std::string_view(level.name, strnlen(level.name, 8)));
+  out += ",\n";
+
+  // v (vertices)
+  appendArray(out, "v", level.vertices, [&](const WAD::Vertex &v) {
+    out += "\"x\":";
+    appendInt(out, v.x);
+    out += ",\"y\":";
+    appendInt(out, v.y);
+  });
+  out += ",\n";
+
+  // l (linedefs)
+  appendArray(out, "l", level.linedefs, [&](const WAD::Linedef &l) {
+    out += "\"e\":";
+    appendInt(out, l.end_vertex);
+    out += ",\"f\":";
+    appendInt(out, l.flags);
+    out += ",\"g\":";
+    appendInt(out, l.sector_tag);
+    out += ",\"l\":";
+    appendInt(out, l.left_sidedef);
+    out += ",\"r\":";
+    appendInt(out, l.right_sidedef);
+    out += ",\"s\":";
+    appendInt(out, l.start_vertex);
+    out += ",\"t\":";
+    appendInt(out, l.line_type);
+  });
+  out += ",\n";
+
+  // si (sidedefs)
+  appendArray(out, "si", level.sidedefs, [&](const WAD::Sidedef &s) {
+    out += "\"l\":";
+    appendJSONName(out, s.lower_texture);
+    out += ",\"m\":";
+    appendJSONName(out, s.middle_texture);
+    out += ",\"s\":";
+    appendInt(out, s.sector);
+    out += ",\"u\":";
+    appendJSONName(out, s.upper_texture);
+    out += ",\"x\":";
+    appendInt(out, s.x_offset);
+    out += ",\"y\":";
+    appendInt(out, s.y_offset);
+  });
+  out += ",\n";
+
+  // se (sectors)
+  appendArray(out, "se", level.sectors, [&](const WAD::Sector &s) {
+    out += "\"c\":";
+    appendInt(out, s.ceiling_height);
+    out += ",\"f\":";
+    appendInt(out, s.floor_height);
+    out += ",\"g\":";
+    appendInt(out, s.tag);
+    out += ",\"l\":";
+    appendInt(out, s.light_level);
+    out += ",\"t\":";
+    appendJSONName(out, s.floor_texture);
+    out += ",\"x\":";
+    appendJSONName(out, s.ceiling_texture);
+    out += ",\"y\":";
+    appendInt(out, s.type);
+  });
+  out += ",\n";
+
+  // t (things)
+  appendArray(out, "t", level.things, [&](const WAD::Thing &t) {
+    out += "\"a\":";
+    appendInt(out, t.angle);
+    out += ",\"f\":";
+    appendInt(out, t.flags);
+    out += ",\"t\":";
+    if (const ThingInfo *info = thingInfo(t.type)) {
+      appendJSONString(out, info->name);
+    } else {
+      appendInt(out, t.type);
+    }
+    out += ",\"x\":";
+    appendInt(out, t.x);
+    out += ",\"y\":";
+    appendInt(out, t.y);
+  });
+  out += "\n  }";
+
+  return out;
+}
+
+/**
+ * @brief Closing of the brief JSON document
+ * @return Text following the last level
+ */
+std::string JSONEmitter::end() {
+  return std::string(count_ > 0 ? "\n" : "") + " ]\n}\n";
+}
+
+/**
+ * @brief Append one column: a JSON array holding a field of every record
+ * @param out Document being written
+ * @param key Column key
+ * @param records Records to read the field from
+ * @param field Callable returning the (integer) field of a record
+ */
+template <typename Records, typename Field>
+static void appendColumn(std::string &out, std::string_view key,
+                         const Records &records, Field &&field) {
+  out += '"';
+  out += key;
+  out += "\":[";
+  for (size_t i = 0; i < records.size(); ++i) {
+    if (i > 0) {
+      out += ',';
+    }
+    appendInt(out, field(records[i]));
+  }
+  out += ']';
+}
+
+/**
+ * @brief Opening of the columnar JSON document
+ * @return Text preceding the first level
+ */
+std::string JSONColumnarEmitter::begin() {
+  return "{\n \"levels\": [\n";
+}
+
+/**
+ * @brief Convert one level to the columnar JSON format
+ * @param level Level to convert
+ * @return JSON text for the level, one line per record type
+ * @note Texture and flat names are written as indices into the "names"
+ *       dictionary, which is only complete once every level has been seen and
+ *       is therefore written by end().
+ */
+std::string JSONColumnarEmitter::level(const WAD::Level &level) {
+  std::string out;
+  out.reserve(256 + level.vertices.size() * 12 + level.linedefs.size() * 28 +
+              level.sidedefs.size() * 20 + level.sectors.size() * 24 +
+              level.things.size() * 24);
+
+  auto nameId = [&](const char *name) { return names_.intern(packName(name)); };
+
+  if (count_++ > 0) {
+    out += ",\n";
+  }
+  out += "  {\n   \"name\": ";
+  appendJSONString(out, std::string_view(level.name, strnlen(level.name, 8)));
+  out += ",\n";
+
+  // v (vertices)
+  const auto &v = level.vertices;
+  out += "   \"v\": {";
+  appendColumn(out, "x", v, [](const WAD::Vertex &r) { return r.x; });
+  out += ',';
+  appendColumn(out, "y", v, [](const WAD::Vertex &r) { return r.y; });
+  out += "},\n";
+
+  // l (linedefs)
+  const auto &l = level.linedefs;
+  out += "   \"l\": {";
+  appendColumn(out, "s", l,
+               [](const WAD::Linedef &r) { return r.start_vertex; });
+  out += ',';
+  appendColumn(out, "e", l, [](const WAD::Linedef &r) { return r.end_vertex; });
+  out += ',';
+  appendColumn(out, "f", l, [](const WAD::Linedef &r) { return r.flags; });
+  out += ',';
+  appendColumn(out, "t", l, [](const WAD::Linedef &r) { return r.line_type; });
+  out += ',';
+  appendColumn(out, "g", l, [](const WAD::Linedef &r) { return r.sector_tag; });
+  out += ',';
+  appendColumn(out, "r", l,
+               [](const WAD::Linedef &r) { return r.right_sidedef; });
+  out += ',';
+  appendColumn(out, "l", l,
+               [](const WAD::Linedef &r) { return r.left_sidedef; });
+  out += "},\n";
+
+  // si (sidedefs), textures by name index
+  const auto &si = level.sidedefs;
+  out += "   \"si\": {";
+  appendColumn(out, "x", si, [](const WAD::Sidedef &r) { return r.x_offset; });
+  out += ',';
+  appendColumn(out, "y", si, [](const WAD::Sidedef &r) { return r.y_offset; });
+  out += ',';
+  appendColumn(out, "u", si,
+               [&](const WAD::Sidedef &r) { return nameId(r.upper_texture); });
+  out += ',';
+  appendColumn(out, "l", si,
+               [&](const WAD::Sidedef &r) { return nameId(r.lower_texture); });
+  out += ',';
+  appendColumn(out, "m", si,
+               [&](const WAD::Sidedef &r) { return nameId(r.middle_texture); });
+  out += ',';
+  appendColumn(out, "s", si, [](const WAD::Sidedef &r) { return r.sector; });
+  out += "},\n";
+
+  // se (sectors), flats by name index
+  const auto &se = level.sectors;
+  out += "   \"se\": {";
+  appendColumn(out, "f", se,
+               [](const WAD::Sector &r) { return r.floor_height; });
+  out += ',';
+  appendColumn(out, "c", se,
+               [](const WAD::Sector &r) { return r.ceiling_height; });
+  out += ',';
+  appendColumn(out, "t", se,
+               [&](const WAD::Sector &r) { return nameId(r.floor_texture); });
+  out += ',';
+  appendColumn(out, "x", se,
+               [&](const WAD::Sector &r) { return nameId(r.ceiling_texture); });
+  out += ',';
+  appendColumn(out, "l", se,
+               [](const WAD::Sector &r) { return r.light_level; });
+  out += ',';
+  appendColumn(out, "y", se, [](const WAD::Sector &r) { return r.type; });
+  out += ',';
+  appendColumn(out, "g", se, [](const WAD::Sector &r) { return r.tag; });
+  out += "},\n";
+
+  // t (things), types as DoomEd numbers (named in the "things" dictionary)
+  const auto &t = level.things;
+  for (const WAD::Thing &thing : t) {
+    if (thingInfo(thing.type)) {
+      thingTypes_.insert(thing.type);
+    }
+  }
+  out += "   \"t\": {";
+  appendColumn(out, "x", t, [](const WAD::Thing &r) { return r.x; });
+  out += ',';
+  appendColumn(out, "y", t, [](const WAD::Thing &r) { return r.y; });
+  out += ',';
+  appendColumn(out, "a", t, [](const WAD::Thing &r) { return r.angle; });
+  out += ',';
+  appendColumn(out, "t", t, [](const WAD::Thing &r) { return r.type; });
+  out += ',';
+  appendColumn(out, "f", t, [](const WAD::Thing &r) { return r.flags; });
+  out += "}\n  }";
+
+  return out;
+}
+
+/**
+ * @brief Closing of the columnar JSON document, with the name dictionaries
+ * @return Text following the last level
+ */
+std::string JSONColumnarEmitter::end() {
+  std::string out = count_ > 0 ? "\n ],\n" : " ],\n";
+
+  out += " \"names\": [";
+  for (NameTable::Id id = 0; id < names_.size(); id++) {
+    if (id > 0) {
+      out += ',';
+    }
+    appendJSONString(out, unpackName(names_.key(id)).view());
+  }
+  out += "],\n";
+
+  out += " \"things\": {";
+  bool first = true;
+  for (std::uint16_t type : thingTypes_) {
+    if (!first) {
+      out += ',';
+    }
+    out += '"';
+    appendInt(out, type);
+    out += "\":";
+    appendJSONString(out, thingInfo(type)->name);
+    first = false;
+  }
+  out += "}\n}\n";
+
+  return out;
+}
+
+/**
+ * @brief Convert one level to the verbose JSON format
+ * @param level Level to convert
+ * @return JSON text for the level
+ * @note The level is dumped on its own and re-indented to its depth in the
+ *       document, which gives the same text as dumping the whole document at
+ *       once. JSON strings never contain raw newlines, so indenting after
+ *       every newline is safe.
+ */
+std::string JSONVerboseEmitter::level(const WAD::Level &level) {
+  nlohmann::json levelJson;
+  levelJson["name"] = level.name;
+  if (level.format != WAD::LevelFormat::Doom) {
+    levelJson["format"] =
+        level.format == WAD::LevelFormat::Hexen ? "hexen" : "udmf";
+  }
+
+  levelJson["vertices"] = nlohmann::json::array();
+  for (size_t vertIndex = 0; vertIndex < level.vertices.size(); vertIndex++) {
+    const WAD::Vertex &v = level.vertices[vertIndex];
+    levelJson["vertices"].push_back({{"x", v.x}, {"y", v.y}});
+  }
+
+  levelJson["linedefs"] = nlohmann::json::array();
+  for (size_t lineIndex = 0; lineIndex < level.linedefs.size(); lineIndex++) {
+    const WAD::Linedef &l = level.linedefs[lineIndex];
+    levelJson["linedefs"].push_back({{"start", l.start_vertex},
+                                     {"end", l.end_vertex},
+                                     {"flags", l.flags},
+                                     {"type", l.line_type},
+                                     {"tag", l.sector_tag},
+                                     {"right_sidedef", l.right_sidedef},
+                                     {"left_sidedef", l.left_sidedef}});
+    if (lineIndex < level.linedef_args.size()) {
+      const WAD::LinedefArgs &a = level.linedef_args[lineIndex];
+      levelJson["linedefs"].back()["args"] = a.args;
+    }
+  }
+
+  levelJson["sidedefs"] = nlohmann::json::array();
+  for (size_t sideIndex = 0; sideIndex < level.sidedefs.size(); sideIndex++) {
+    const WAD::Sidedef &s = level.sidedefs[sideIndex];
+    levelJson["sidedefs"].push_back(
+        {{"x_offset", s.x_offset},
+         {"y_offset", s.y_offset},
+         {"upper_texture",
+          std::string(s.upper_texture, strnlen(s.upper_texture, 8))},
+         {"lower_texture",
+          std::string(s.lower_texture, strnlen(s.lower_texture, 8))},
+         {"middle_texture",
+          std::string(s.middle_texture, strnlen(s.middle_texture, 8))},
+         {"sector", s.sector}});
+  }
+
+  levelJson["sectors"] = nlohmann::json::array();
+  for (size_t sectIndex = 0; sectIndex < level.sectors.size(); sectIndex++) {
+    const WAD::Sector &s = level.sectors[sectIndex];
+    levelJson["sectors"].push_back(
+        {{"floor_height", s.floor_height},
+         {"ceiling_height", s.ceiling_height},
+         {"floor_texture",
+          std::string(s.floor_texture, strnlen(s.floor_texture, 8))},
+         {"ceiling_texture",
+          std::string(s.ceiling_texture, strnlen(s.ceiling_texture, 8))},
+         {"light_level", s.light_level},
+         {"type", s.type},
+         {"tag", s.tag}});
+  }
+
+  levelJson["things"] = nlohmann::json::array();
+  for (size_t thingIndex = 0; thingIndex < level.things.size(); thingIndex++) {
+    const WAD::Thing &t = level.things[thingIndex];
+    levelJson["things"].push_back({{"x", t.x},
+                                   {"y", t.y},
+                                   {"angle", t.angle},
+                                   {"type", thingType(t.type)},
+                                   {"flags", t.flags}});
+    if (thingIndex < level.thing_args.size()) {
+      const WAD::ThingArgs &a     = level.thing_args[thingIndex];
+      nlohmann::json       &thing = levelJson["things"].back();
+      thing["tid"]                = a.tid;
+      thing["z"]                  = a.z;
+      thing["special"]            = a.special;
+      thing["hexen_flags"]        = a.hexen_flags;
+      thing["args"]               = a.args;
+    }
+  }
+
+  // BSP tree, only when the nodes were built or checked (--nodes)
+  if (!level.subsectors.empty()) {
+    levelJson["segs"] = nlohmann::json::array();
+    for (const WAD::Seg &s : level.segs) {
+      levelJson["segs"].push_back({{"start", s.start_vertex},
+                                   {"end", s.end_vertex},
+                                   {"angle", s.angle},
+                                   {"linedef", s.linedef},
+                                   {"direction", s.direction},
+                                   {"offset", s.offset}});
+    }
+
+    levelJson["subsectors"] = nlohmann::json::array();
+    for (const WAD::SubSector &s : level.subsectors) {
+      levelJson["subsectors"].push_back(
+          {{"first_seg", s.first_seg}, {"seg_count", s.seg_count}});
+    }
+
+    levelJson["nodes"] = nlohmann::json::array();
+    for (const WAD::Node &n : level.nodes) {
+      levelJson["nodes"].push_back({{"x", n.x},
+                                    {"y", n.y},
+                                    {"dx", n.dx},
+                                    {"dy", n.dy},
+                                    {"right_bbox", n.bbox[0]},
+                                    {"left_bbox", n.bbox[1]},
+                                    {"right_child", n.children[0]},
+                                    {"left_child", n.children[1]}});
+    }
+  }
+
+  // Indent the level to its depth inside {"levels": [...]}
+  std::string dumped = levelJson.dump(1);
+  std::string out    = count_++ > 0 ? ",\n  " : "{\n \"levels\": [\n  ";
+  out.reserve(out.size() + dumped.size() + dumped.size() / 8);
+  for (char c : dumped) {
+    out += c;
+    if (c == '\n') {
+      out += "  ";
+    }
+  }
+
+  return out;
+}
+
+/**
+ * @brief Closing of the verbose JSON document
+ * @return Text following the last level (or the whole document if empty)
+ */
+std::string JSONVerboseEmitter::end() {
+  if (count_ == 0) {
+    return "{\n \"levels\": []\n}";
+  }
+  return "\n ]\n}";
+}
+
+/**
+ * Output buffer for the text formats. Everything is appended to one string
+ * reserved up front, and numbers are formatted with std::to_chars, so there
+ * is no stream state, locale or temporary string per field.
+ */
+class TextSink {
+public:
+  explicit TextSink(std::size_t capacity) { out_.reserve(capacity); }
+
+  TextSink &operator<<(std::string_view text) {
+    out_.append(text.data(), text.size());
+    return *this;
+  }
+
+  TextSink &operator<<(char c) {
+    out_ += c;
+    return *this;
+  }
+
+  template <typename Int, typename = std::enable_if_t<std::is_integral_v<Int>>>
+  TextSink &operator<<(Int value) {
+    char                 buffer[24];
+    std::to_chars_result result =
+        std::to_chars(buffer, buffer + sizeof(buffer), value);
+    out_.append(buffer, result.ptr);
+    return *this;
+  }
+
+  // Fixed-size name field, up to its first NUL
+  TextSink &name(const char (&field)[8]) {
+    out_.append(field, strnlen(field, 8));
+    return *this;
+  }
+
+  std::string take() { return std::move(out_); }
+
+private:
+  std::string out_;
+};
+
+/**
+ * @brief Convert one level to the custom DSL format
+ * @param level Level to convert
+ * @return DSL text for the level
+ * @note The verbose format adds a SIDEDEFS section, sector types and tags and
+ *       thing flags, which makes it lossless for the fields a level holds.
+ */
+std::string DSLEmitter::level(const WAD::Level &level) {
+  std::size_t capacity = 64 + level.vertices.size() * 16 +
+                         level.linedefs.size() * 80 +
+                         level.sectors.size() * 96 + level.things.size() * 64;
+  if (verbose_) {
+    capacity += level.sidedefs.size() * 80 + level.sectors.size() * 24 +
+                level.things.size() * 12;
+  }
+  TextSink out(capacity);
+  count_++;
+
+  std::string_view name(level.name, strnlen(level.name, 8));
+  out << "LEVEL " << name << " START\n\n";
+
+  // VERTICES
+  out << "VERTICES:\n";
+  for (const WAD::Vertex &v : level.vertices) {
+    out << '(' << v.x << ", " << v.y << ")\n";
+  }
+
+  // LINEDEFS
+  out << "\nLINEDEFS:\n";
+  for (const WAD::Linedef &l : level.linedefs) {
+    out << l.start_vertex << " -> " << l.end_vertex << " | flags: " << l.flags
+        << " | type: " << l.line_type << " | tag: " << l.sector_tag
+        << " | right: " << l.right_sidedef << " | left: " << l.left_sidedef
+        << '\n';
+  }
+
+  // SIDEDEFS
+  if (verbose_) {
+    out << "\nSIDEDEFS:\n";
+    for (const WAD::Sidedef &s : level.sidedefs) {
+      out << '(' << s.x_offset << ", " << s.y_offset << ") | upper: ";
+      out.name(s.upper_texture) << " | lower: ";
+      out.name(s.lower_texture) << " | middle: ";
+      out.name(s.middle_texture) << " | sector: " << s.sector << '\n';
+    }
+  }
+
+  // SECTORS
+  out << "\nSECTORS:\n";
+  for (const WAD::Sector &s : level.sectors) {
+    out << "floor: " << s.floor_height << " | ceil: " << s.ceiling_height
+        << " | light: " << s.light_level << " | floor_tex: ";
+    out.name(s.floor_texture) << " | ceil_tex: ";
+    out.name(s.ceiling_texture);
+    if (verbose_) {
+      out << " | type: " << s.type << " | tag: " << s.tag;
+    }
+    out << '\n';
+  }
+
+  // THINGS
+  out << "\nTHINGS:\n";
+  for (const WAD::Thing &t : level.things) {
+    const ThingInfo *info = thingInfo(t.type);
+    out << (info ? info->name : "Thing") << " at (" << t.x << ", " << t.y
+        << ") | angle: " << t.angle << " | type: " << t.type;
+    if (verbose_) {
+      out << " | flags: " << t.flags;
+    }
+    out << '\n';
+  }
+
+  out << "\nLEVEL " << name << " END\n\n";
+
+  return out.take();
+}
+
+/**
+ * @brief Opening of the spatial index document
+ * @return Text preceding the first level
+ */
+std::string SpatialEmitter::begin() {
+  return "{\n \"levels\": [\n";
+}
+
+/**
+ * @brief Sector adjacency graph and grid index of one level
+ * @param level Level to index
+ * @return JSON text for the level, on one line
+ * @note Every array is written as is from SectorGraph and GridIndex, so the
+ *       engine can load each one straight into a flat buffer.
+ */
+std::string SpatialEmitter::level(const WAD::Level &level) {
+  SectorGraph graph = buildSectorGraph(level);
+  GridIndex   grid  = buildGridIndex(level);
+  auto        same  = [](uint32_t value) { return value; };
+
+  std::string out;
+  out.reserve(128 + (graph.offsets.size() + graph.neighbours.size() +
+                     graph.linedef_offsets.size() + graph.linedefs.size() +
+                     grid.linedef_offsets.size() + grid.linedefs.size() +
+                     grid.thing_offsets.size() + grid.things.size()) *
+                        6);
+  if (count_++ > 0) {
+    out += ",\n";
+  }
+  out += "  {\"name\":";
+  appendJSONString(out, std::string_view(level.name, strnlen(level.name, 8)));
+
+  out += ",\"sectors\":{";
+  appendColumn(out, "offsets", graph.offsets, same);
+  out += ',';
+  appendColumn(out, "neighbours", graph.neighbours, same);
+  out += ',';
+  appendColumn(out, "linedef_offsets", graph.linedef_offsets, same);
+  out += ',';
+  appendColumn(out, "linedefs", graph.linedefs, same);
+
+  out += "},\"grid\":{\"x\":";
+  appendInt(out, grid.x);
+  out += ",\"y\":";
+  appendInt(out, grid.y);
+  out += ",\"cell_size\":";
+  appendInt(out, grid.cell_size);
+  out += ",\"columns\":";
+  appendInt(out, grid.columns);
+  out += ",\"rows\":";
+  appendInt(out, grid.rows);
+  out += ',';
+  appendColumn(out, "linedef_offsets", grid.linedef_offsets, same);
+  out += ',';
+  appendColumn(out, "linedefs", grid.linedefs, same);
+  out += ',';
+  appendColumn(out, "thing_offsets", grid.thing_offsets, same);
+  out += ',';
+  appendColumn(out, "things", grid.things, same);
+  out += "}}";
+
+  return out;
+}
+
+/**
+ * @brief Closing of the spatial index document
+ * @return Text following the last level
+ */
+std::string SpatialEmitter::end() {
+  return std::string(count_ > 0 ? "\n" : "") + " ]\n}\n";
+}
+
+/**
+ * @brief Create the emitter for a format
+ * @param format Output format
+ * @return Emitter instance, or nullptr for formats without a level-by-level
+ *         writer
+ */
+std::unique_ptr<Emitter> makeEmitter(WADFormat format) {
+  switch (format) {
+    case WADFormat::JSON:
+      return std::make_unique<JSONEmitter>();
+    case WADFormat::JSON_VERBOSE:
+      return std::make_unique<JSONVerboseEmitter>();
+    case WADFormat::JSON_COLUMNAR:
+      return std::make_unique<JSONColumnarEmitter>();
+    case WADFormat::DSL:
+      return std::make_unique<DSLEmitter>();
+    case WADFormat::DSL_VERBOSE:
+      return std::make_unique<DSLEmitter>(true);
+    case WADFormat::SPATIAL:
+      return std::make_unique<SpatialEmitter>();
+    default:
+      return nullptr;
+  }
+}
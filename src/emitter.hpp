@@ -0,0 +1,85 @@
+#ifndef EMITTER_HPP
+#define EMITTER_HPP
+
+#include "names.hpp"
+#include "wad.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <string>
+
+/**
+ * Base class for the level-by-level output formats. An emitter turns one
+ * level at a time into a chunk of text, so a conversion can write each level
+ * as soon as it is loaded instead of building the whole document first.
+ * Concatenating begin(), level() for every level in order, and end() gives
+ * the complete document.
+ */
+class Emitter {
+public:
+  virtual ~Emitter() = default;
+
+  // Text before the first level
+  virtual std::string begin() { return ""; }
+  // Text for one level, including any separator from the previous one
+  virtual std::string level(const WAD::Level &level) = 0;
+  // Text after the last level
+  virtual std::string end() { return ""; }
+
+protected:
+  std::size_t count_ = 0;  // Levels emitted so far
+};
+
+// Brief JSON format (-json)
+class JSONEmitter : public Emitter {
+public:
+  std::string begin() override;
+  std::string level(const WAD::Level &level) override;
+  std::string end() override;
+};
+
+// Columnar JSON format (-jsoncolumnar): one array per field, and texture and
+// flat names stored once in a per-WAD dictionary written after the levels
+class JSONColumnarEmitter : public Emitter {
+public:
+  std::string begin() override;
+  std::string level(const WAD::Level &level) override;
+  std::string end() override;
+
+private:
+  NameTable               names_;       // Texture and flat names seen so far
+  std::set<std::uint16_t> thingTypes_;  // Known thing types seen so far
+};
+
+// Verbose JSON format (-jsonverbose)
+class JSONVerboseEmitter : public Emitter {
+public:
+  std::string level(const WAD::Level &level) override;
+  std::string end() override;
+};
+
+// Custom DSL format (-dsl), or the verbose one (-dslverbose) which also has
+// the sidedefs, sector types and tags and thing flags
+class DSLEmitter : public Emitter {
+public:
+  explicit DSLEmitter(bool verbose = false) : verbose_(verbose) {}
+  std::string level(const WAD::Level &level) override;
+
+private:
+  bool verbose_;
+};
+
+// Sector adjacency graph and linedef/thing grid index of each level
+// (-spatial), one level per line (see spatial.hpp)
+class SpatialEmitter : public Emitter {
+public:
+  std::string begin() override;
+  std::string level(const WAD::Level &level) override;
+  std::string end() override;
+};
+
+// Create the emitter for a format, or nullptr if it cannot be streamed
+std::unique_ptr<Emitter> makeEmitter(WADFormat format);
+
+#endif  // EMITTER_HPP
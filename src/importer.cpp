@@ -0,0 +1,669 @@
+#include "importer.hpp"
+#include "names.hpp"
+#include "things.hpp"
+#include "wad.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <istream>
+#include <nlohmann/json.hpp>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+// Record arrays of a level, as named in the text formats
+enum class Table { None, Vertices, Linedefs, Sidedefs, Sectors, Things };
+
+// Field keys of a record in the brief and verbose JSON formats
+struct FieldName {
+  const char *brief;
+  const char *verbose;
+};
+
+// Fields of each record type, in the order of the record values below
+const FieldName kVertexFields[]  = {{"x", "x"}, {"y", "y"}};
+const FieldName kLinedefFields[] = {{"s", "start"},
+                                    {"e", "end"},
+                                    {"f", "flags"},
+                                    {"t", "type"},
+                                    {"g", "tag"},
+                                    {"r", "right_sidedef"},
+                                    {"l", "left_sidedef"}};
+const FieldName kSidedefFields[] = {{"x", "x_offset"},
+                                    {"y", "y_offset"},
+                                    {"u", "upper_texture"},
+                                    {"l", "lower_texture"},
+                                    {"m", "middle_texture"},
+                                    {"s", "sector"}};
+const FieldName kSectorFields[]  = {{"f", "floor_height"},
+                                    {"c", "ceiling_height"},
+                                    {"t", "floor_texture"},
+                                    {"x", "ceiling_texture"},
+                                    {"l", "light_level"},
+                                    {"y", "type"},
+                                    {"g", "tag"}};
+const FieldName kThingFields[]   = {{"x", "x"},
+                                    {"y", "y"},
+                                    {"a", "angle"},
+                                    {"t", "type"},
+                                    {"f", "flags"},
+                                    {"tid", "tid"},
+                                    {"z", "z"},
+                                    {"special", "special"},
+                                    {"hexen_flags", "hexen_flags"}};
+
+// Maximum number of fields in a record
+constexpr std::size_t kMaxFields = 9;
+
+// Fields past the DOOM ones, written by jsonverbose for Hexen and UDMF
+// levels only: thing fields from this index on, and the "args" array
+constexpr int kFirstThingArg = 5;
+constexpr int kArgsField     = -2;
+
+// Values of the record being read, numbers and names by field index
+struct RecordValues {
+  long long number[kMaxFields] = {};
+  NameKey   name[kMaxFields]   = {};
+  long long args[5]            = {};
+  bool      hasArgs            = false;  // Hexen or UDMF fields were read
+};
+
+// Level format from its jsonverbose name
+WAD::LevelFormat formatFor(std::string_view name) {
+  if (name == "hexen") {
+    return WAD::LevelFormat::Hexen;
+  }
+  if (name == "udmf") {
+    return WAD::LevelFormat::UDMF;
+  }
+  return WAD::LevelFormat::Doom;
+}
+
+// Table for a level key, brief or verbose
+Table tableFor(std::string_view key) {
+  if (key == "v" || key == "vertices") {
+    return Table::Vertices;
+  }
+  if (key == "l" || key == "linedefs") {
+    return Table::Linedefs;
+  }
+  if (key == "si" || key == "sidedefs") {
+    return Table::Sidedefs;
+  }
+  if (key == "se" || key == "sectors") {
+    return Table::Sectors;
+  }
+  if (key == "t" || key == "things") {
+    return Table::Things;
+  }
+  return Table::None;
+}
+
+// Index of a record field, kArgsField for the special arguments, or -1 if
+// the key is not a field of the table
+int fieldFor(Table table, std::string_view key) {
+  auto find = [&](const auto &fields) {
+    int index = 0;
+    for (const FieldName &field : fields) {
+      if (key == field.brief || key == field.verbose) {
+        return index;
+      }
+      index++;
+    }
+    return -1;
+  };
+
+  if (key == "args" && (table == Table::Linedefs || table == Table::Things)) {
+    return kArgsField;
+  }
+  switch (table) {
+    case Table::Vertices:
+      return find(kVertexFields);
+    case Table::Linedefs:
+      return find(kLinedefFields);
+    case Table::Sidedefs:
+      return find(kSidedefFields);
+    case Table::Sectors:
+      return find(kSectorFields);
+    case Table::Things:
+      return find(kThingFields);
+    default:
+      return -1;
+  }
+}
+
+// Copy a packed name into a fixed-size name field
+void setName(char (&field)[8], NameKey name) {
+  std::memcpy(field, unpackName(name).data, 8);
+}
+
+// Append a record to its level array
+void addRecord(WAD::Level &level, Table table, const RecordValues &r) {
+  const long long *n = r.number;
+  switch (table) {
+    case Table::Vertices:
+      level.vertices.push_back(
+          {static_cast<int16_t>(n[0]), static_cast<int16_t>(n[1])});
+      break;
+    case Table::Linedefs:
+      level.linedefs.push_back(
+          {static_cast<uint16_t>(n[0]), static_cast<uint16_t>(n[1]),
+           static_cast<uint16_t>(n[2]), static_cast<uint16_t>(n[3]),
+           static_cast<uint16_t>(n[4]), static_cast<uint16_t>(n[5]),
+           static_cast<uint16_t>(n[6])});
+      if (r.hasArgs) {
+        // Levels with arguments have them for every linedef
+        WAD::LinedefArgs args{};
+        for (int a = 0; a < 5; a++) {
+          args.args[a] = static_cast<int32_t>(r.args[a]);
+        }
+        level.linedef_args.resize(level.linedefs.size() - 1);
+        level.linedef_args.push_back(args);
+      }
+      break;
+    case Table::Sidedefs: {
+      WAD::Sidedef s{};
+      s.x_offset = static_cast<int16_t>(n[0]);
+      s.y_offset = static_cast<int16_t>(n[1]);
+      setName(s.upper_texture, r.name[2]);
+      setName(s.lower_texture, r.name[3]);
+      setName(s.middle_texture, r.name[4]);
+      s.sector = static_cast<uint16_t>(n[5]);
+      level.sidedefs.push_back(s);
+      break;
+    }
+    case Table::Sectors: {
+      WAD::Sector s{};
+      s.floor_height   = static_cast<int16_t>(n[0]);
+      s.ceiling_height = static_cast<int16_t>(n[1]);
+      setName(s.floor_texture, r.name[2]);
+      setName(s.ceiling_texture, r.name[3]);
+      s.light_level = static_cast<uint16_t>(n[4]);
+      s.type        = static_cast<uint16_t>(n[5]);
+      s.tag         = static_cast<uint16_t>(n[6]);
+      level.sectors.push_back(s);
+      break;
+    }
+    case Table::Things:
+      level.things.push_back(
+          {static_cast<int16_t>(n[0]), static_cast<int16_t>(n[1]),
+           static_cast<uint16_t>(n[2]), static_cast<uint16_t>(n[3]),
+           static_cast<uint16_t>(n[4])});
+      if (r.hasArgs) {
+        WAD::ThingArgs args{};
+        args.tid         = static_cast<uint16_t>(n[kFirstThingArg]);
+        args.z           = static_cast<int16_t>(n[kFirstThingArg + 1]);
+        args.special     = static_cast<uint16_t>(n[kFirstThingArg + 2]);
+        args.hexen_flags = static_cast<uint16_t>(n[kFirstThingArg + 3]);
+        for (int a = 0; a < 5; a++) {
+          args.args[a] = static_cast<int32_t>(r.args[a]);
+        }
+        level.thing_args.resize(level.things.size() - 1);
+        level.thing_args.push_back(args);
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+// Set the player start of an imported level, as WAD::loadLevel does
+void findPlayerStart(WAD::Level &level) {
+  for (const WAD::Thing &thing : level.things) {
+    if (thing.type == kPlayer1Start) {
+      level.has_player_start = true;
+      level.player_start     = thing;
+      break;
+    }
+  }
+}
+
+/**
+ * SAX handler reading {"levels": [{"name": ..., "v": [{...}, ...], ...}]}.
+ * Events are matched by nesting depth: 1 is the document, 2 the levels
+ * array, 3 a level, 4 a record array, 5 a record and 6 the special
+ * arguments of a record. Anything else is skipped, so unknown keys do not
+ * stop the import.
+ */
+class JSONLevelReader : public nlohmann::json_sax<nlohmann::json> {
+public:
+  std::vector<WAD::Level> levels;
+
+  bool null() override { return true; }
+  bool boolean(bool) override { return true; }
+  bool number_integer(number_integer_t value) override {
+    setNumber(value);
+    return true;
+  }
+  bool number_unsigned(number_unsigned_t value) override {
+    setNumber(static_cast<long long>(value));
+    return true;
+  }
+  bool number_float(number_float_t value, const string_t &) override {
+    setNumber(static_cast<long long>(value));
+    return true;
+  }
+  bool binary(binary_t &) override { return true; }
+
+  bool string(string_t &value) override {
+    if (depth_ == 3 && inLevels_ && nameNext_) {
+      setName(levels.back().name, packName(value));
+    } else if (depth_ == 3 && inLevels_ && formatNext_) {
+      levels.back().format = formatFor(value);
+    } else if (inRecord()) {
+      if (table_ == Table::Things && field_ == 3) {
+        // Thing types are written by name when known
+        const ThingInfo *info = thingInfoByName(value);
+        if (!info) {
+          throw std::runtime_error("Unknown thing type in JSON input: " +
+                                   value);
+        }
+        record_.number[field_] = info->type;
+      } else {
+        record_.name[field_] = packName(value);
+      }
+    }
+    return true;
+  }
+
+  bool start_object(std::size_t) override {
+    depth_++;
+    if (depth_ == 3 && inLevels_) {
+      levels.emplace_back();
+      table_ = Table::None;
+    } else if (depth_ == 4 && inLevels_ && table_ != Table::None) {
+      throw std::runtime_error(
+          "Columnar JSON input is not supported, use -json or -jsonverbose");
+    } else if (depth_ == 5 && inLevels_ && table_ != Table::None) {
+      record_     = RecordValues();
+      recordOpen_ = true;
+      field_      = -1;
+    }
+    return true;
+  }
+
+  bool end_object() override {
+    if (depth_ == 5 && recordOpen_) {
+      addRecord(levels.back(), table_, record_);
+      recordOpen_ = false;
+    } else if (depth_ == 3 && inLevels_) {
+      findPlayerStart(levels.back());
+    }
+    depth_--;
+    return true;
+  }
+
+  bool start_array(std::size_t) override {
+    depth_++;
+    if (depth_ == 2) {
+      inLevels_ = levelsNext_;
+    } else if (depth_ == 6 && recordOpen_ && field_ == kArgsField) {
+      argsOpen_       = true;
+      arg_            = 0;
+      record_.hasArgs = true;
+    }
+    return true;
+  }
+
+  bool end_array() override {
+    if (depth_ == 2) {
+      inLevels_ = false;
+    } else if (depth_ == 6) {
+      argsOpen_ = false;
+    }
+    depth_--;
+    return true;
+  }
+
+  bool key(string_t &value) override {
+    if (depth_ == 1) {
+      levelsNext_ = value == "levels";
+    } else if (depth_ == 3 && inLevels_) {
+      nameNext_   = value == "name";
+      formatNext_ = value == "format";
+      table_      = tableFor(value);
+    } else if (depth_ == 5 && recordOpen_) {
+      field_ = fieldFor(table_, value);
+    }
+    return true;
+  }
+
+  bool parse_error(std::size_t position, const std::string &,
+                   const nlohmann::detail::exception &e) override {
+    throw std::runtime_error("Malformed JSON input at byte " +
+                             std::to_string(position) + ": " + e.what());
+  }
+
+private:
+  // A field value of the record being read is expected
+  bool inRecord() const { return depth_ == 5 && recordOpen_ && field_ >= 0; }
+
+  void setNumber(long long value) {
+    if (inRecord()) {
+      record_.number[field_] = value;
+      if (table_ == Table::Things && field_ >= kFirstThingArg) {
+        record_.hasArgs = true;
+      }
+    } else if (depth_ == 6 && argsOpen_ && arg_ < 5) {
+      record_.args[arg_++] = value;
+    }
+  }
+
+  int          depth_      = 0;
+  bool         levelsNext_ = false;  // Last document key was "levels"
+  bool         inLevels_   = false;  // Inside the levels array
+  bool         nameNext_   = false;  // Last level key was "name"
+  bool         formatNext_ = false;  // Last level key was "format"
+  Table        table_      = Table::None;
+  bool         recordOpen_ = false;
+  int          field_      = -1;
+  bool         argsOpen_   = false;  // Inside the "args" array of a record
+  int          arg_        = 0;      // Next argument of the array
+  RecordValues record_;
+};
+
+// Error for a malformed line of a DSL document
+std::runtime_error dslError(std::size_t lineNumber, const std::string &what) {
+  return std::runtime_error("Malformed DSL input at line " +
+                            std::to_string(lineNumber) + ": " + what);
+}
+
+// Take the next " | " separated field off the front of a line
+std::string_view nextField(std::string_view &line) {
+  std::size_t      separator = line.find(" | ");
+  std::string_view field     = line.substr(0, separator);
+  line = separator == std::string_view::npos ? std::string_view()
+                                             : line.substr(separator + 3);
+  return field;
+}
+
+// Parse a whole string_view as an integer
+long long parseInteger(std::string_view text, std::size_t lineNumber) {
+  long long              value  = 0;
+  std::from_chars_result result =
+      std::from_chars(text.data(), text.data() + text.size(), value);
+  if (result.ec != std::errc() || result.ptr != text.data() + text.size()) {
+    throw dslError(lineNumber, "expected a number, got '" +
+                                   std::string(text) + "'");
+  }
+  return value;
+}
+
+// Parse "(x, y)" into two integers
+void parsePoint(std::string_view text, long long &x, long long &y,
+                std::size_t lineNumber) {
+  std::size_t comma = text.find(", ");
+  if (text.size() < 5 || text.front() != '(' || text.back() != ')' ||
+      comma == std::string_view::npos) {
+    throw dslError(lineNumber, "expected (x, y)");
+  }
+  x = parseInteger(text.substr(1, comma - 1), lineNumber);
+  y = parseInteger(text.substr(comma + 2, text.size() - comma - 3),
+                   lineNumber);
+}
+
+// Parse the "key: value" fields left on a line into a record, by key
+void parseKeyedFields(std::string_view line, const char *const keys[],
+                      std::size_t keyCount, const bool isName[],
+                      RecordValues &record, std::size_t lineNumber) {
+  while (!line.empty()) {
+    std::string_view field = nextField(line);
+    std::size_t      colon = field.find(": ");
+    if (colon == std::string_view::npos) {
+      // A trailing empty name is written as "key: " and trimmed to "key:"
+      colon = field.size() - 1;
+      if (field.empty() || field.back() != ':') {
+        throw dslError(lineNumber, "expected key: value");
+      }
+    }
+    std::string_view key   = field.substr(0, colon);
+    std::string_view value = field.substr(std::min(colon + 2, field.size()));
+    for (std::size_t k = 0; k < keyCount; k++) {
+      if (key == keys[k]) {
+        if (isName[k]) {
+          record.name[k] = packName(value);
+        } else {
+          record.number[k] = parseInteger(value, lineNumber);
+        }
+        break;
+      }
+    }
+  }
+}
+
+}  // namespace
+
+/**
+ * @brief Detect the format of an input file from its first bytes
+ * @param path Input file
+ * @return WADFormat::WAD, WADFormat::JSON (brief or verbose) or
+ *         WADFormat::DSL
+ * @throws std::runtime_error if the file cannot be read or is not recognised
+ */
+WADFormat detectInputFormat(const std::string &path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    throw std::runtime_error("Unable to open input file: " + path);
+  }
+
+  char        head[16] = {};
+  std::size_t length   = 0;
+  file.read(head, sizeof(head));
+  length = static_cast<std::size_t>(file.gcount());
+
+  std::string_view magic(head, length);
+  if (magic.substr(0, 4) == "IWAD" || magic.substr(0, 4) == "PWAD") {
+    return WADFormat::WAD;
+  }
+
+  // Text formats, possibly after leading whitespace
+  std::size_t start = magic.find_first_not_of(" \t\r\n");
+  if (start != std::string_view::npos) {
+    if (magic[start] == '{') {
+      return WADFormat::JSON;
+    }
+    if (magic.substr(start, 6) == "LEVEL ") {
+      return WADFormat::DSL;
+    }
+  }
+
+  throw std::runtime_error("Unrecognised input file (not a WAD, JSON or DSL "
+                           "document): " +
+                           path);
+}
+
+/**
+ * @brief Import levels from a `-json` or `-jsonverbose` document
+ * @param in Input stream
+ * @return Levels in document order
+ * @throws std::runtime_error if the document is malformed
+ * @note Parsed with nlohmann::json::sax_parse, so no DOM is built: each
+ *       record is collected in a fixed-size buffer and appended to its level
+ *       array as soon as it closes.
+ */
+std::vector<WAD::Level> importJSON(std::istream &in) {
+  JSONLevelReader reader;
+  nlohmann::json::sax_parse(in, &reader);
+  return std::move(reader.levels);
+}
+
+/**
+ * @brief Import levels from a `-dsl` or `-dslverbose` document
+ * @param in Input stream
+ * @return Levels in document order
+ * @throws std::runtime_error if the document is malformed
+ */
+std::vector<WAD::Level> importDSL(std::istream &in) {
+  static const char *const linedefKeys[]  = {"",     "",    "flags", "type",
+                                             "tag",  "right", "left"};
+  static const bool        linedefNames[] = {false, false, false, false,
+                                             false, false, false};
+  static const char *const sidedefKeys[]  = {"",      "",       "upper",
+                                             "lower", "middle", "sector"};
+  static const bool        sidedefNames[] = {false, false, true,
+                                             true,  true,  false};
+  static const char *const sectorKeys[]   = {"floor",     "ceil",
+                                             "floor_tex", "ceil_tex",
+                                             "light",     "type",
+                                             "tag"};
+  static const bool        sectorNames[]  = {false, false, true, true,
+                                             false, false, false};
+  static const char *const thingKeys[]    = {"",     "",     "angle",
+                                             "type", "flags"};
+  static const bool        thingNames[]   = {false, false, false, false,
+                                             false};
+
+  std::vector<WAD::Level> levels;
+  WAD::Level             *level   = nullptr;
+  Table                   section = Table::None;
+  std::string             text;
+  std::size_t             lineNumber = 0;
+
+  while (std::getline(in, text)) {
+    lineNumber++;
+    std::string_view line(text);
+    if (!line.empty() && line.back() == '\r') {
+      line.remove_suffix(1);
+    }
+    if (line.empty()) {
+      continue;
+    }
+
+    // Level start and end markers
+    if (line.substr(0, 6) == "LEVEL ") {
+      std::string_view marker = line.substr(6);
+      if (marker.size() > 6 && marker.substr(marker.size() - 6) == " START") {
+        levels.emplace_back();
+        level   = &levels.back();
+        section = Table::None;
+        setName(level->name, packName(marker.substr(0, marker.size() - 6)));
+        continue;
+      }
+      if (marker.size() > 4 && marker.substr(marker.size() - 4) == " END" &&
+          level) {
+        findPlayerStart(*level);
+        level   = nullptr;
+        section = Table::None;
+        continue;
+      }
+      throw dslError(lineNumber, "bad LEVEL line");
+    }
+
+    if (!level) {
+      throw dslError(lineNumber, "data outside of a level");
+    }
+
+    // Section headers
+    if (line == "VERTICES:") {
+      section = Table::Vertices;
+      continue;
+    }
+    if (line == "LINEDEFS:") {
+      section = Table::Linedefs;
+      continue;
+    }
+    if (line == "SIDEDEFS:") {
+      section = Table::Sidedefs;
+      continue;
+    }
+    if (line == "SECTORS:") {
+      section = Table::Sectors;
+      continue;
+    }
+    if (line == "THINGS:") {
+      section = Table::Things;
+      continue;
+    }
+
+    RecordValues record;
+    switch (section) {
+      case Table::Vertices:
+        parsePoint(line, record.number[0], record.number[1], lineNumber);
+        break;
+
+      case Table::Linedefs: {
+        // start -> end | flags: f | type: t | tag: g | right: r | left: l
+        std::string_view vertices = nextField(line);
+        std::size_t      arrow    = vertices.find(" -> ");
+        if (arrow == std::string_view::npos) {
+          throw dslError(lineNumber, "expected start -> end");
+        }
+        record.number[0] = parseInteger(vertices.substr(0, arrow), lineNumber);
+        record.number[1] = parseInteger(vertices.substr(arrow + 4), lineNumber);
+        parseKeyedFields(line, linedefKeys, 7, linedefNames, record,
+                         lineNumber);
+        break;
+      }
+
+      case Table::Sidedefs: {
+        // (x, y) | upper: U | lower: L | middle: M | sector: s
+        parsePoint(nextField(line), record.number[0], record.number[1],
+                   lineNumber);
+        parseKeyedFields(line, sidedefKeys, 6, sidedefNames, record,
+                         lineNumber);
+        break;
+      }
+
+      case Table::Sectors:
+        // floor: f | ceil: c | light: l | floor_tex: T | ceil_tex: X, and
+        // type: y | tag: g in the verbose DSL
+        parseKeyedFields(line, sectorKeys, 7, sectorNames, record, lineNumber);
+        break;
+
+      case Table::Things: {
+        // Name at (x, y) | angle: a | type: t, and flags: f in the verbose
+        // DSL (the type number is kept, not the name)
+        std::string_view position = nextField(line);
+        std::size_t      at       = position.find(" at ");
+        if (at == std::string_view::npos) {
+          throw dslError(lineNumber, "expected <thing> at (x, y)");
+        }
+        parsePoint(position.substr(at + 4), record.number[0], record.number[1],
+                   lineNumber);
+        parseKeyedFields(line, thingKeys, 5, thingNames, record, lineNumber);
+        break;
+      }
+
+      default:
+        throw dslError(lineNumber, "data outside of a section");
+    }
+    addRecord(*level, section, record);
+  }
+
+  if (level) {
+    throw dslError(lineNumber, "missing LEVEL END");
+  }
+  return levels;
+}
+
+/**
+ * @brief Import levels from a converted file
+ * @param path Input file
+ * @param format Format of the file, as returned by detectInputFormat()
+ * @return Levels in document order
+ * @throws std::runtime_error if the file cannot be read or is malformed
+ */
+std::vector<WAD::Level> importLevels(const std::string &path,
+                                     WADFormat          format) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    throw std::runtime_error("Unable to open input file: " + path);
+  }
+
+  switch (format) {
+    case WADFormat::JSON:
+    case WADFormat::JSON_VERBOSE:
+      return importJSON(file);
+    case WADFormat::DSL:
+    case WADFormat::DSL_VERBOSE:
+      return importDSL(file);
+    default:
+      throw std::runtime_error("Cannot import this format: " + path);
+  }
+}
@@ -0,0 +1,35 @@
+#ifndef IMPORTER_HPP
+#define IMPORTER_HPP
+
+#include "wad.hpp"
+#include <istream>
+#include <string>
+#include <vector>
+
+/**
+ * Importers for the text outputs, turning `-json`, `-jsonverbose`, `-dsl` and
+ * `-dslverbose` documents back into WAD::Level objects so edited maps can be
+ * converted again. Both parsers stream their input (the JSON one through
+ * nlohmann's SAX interface, the DSL one line by line) and write each record
+ * straight into the level arrays, so memory use follows the size of the
+ * levels, not of the document.
+ *
+ * Only the geometry and things are imported; assets are not part of the text
+ * formats. The brief DSL does not carry sidedefs, sector types and tags or
+ * thing flags, so those come back empty or zero; the verbose DSL has them.
+ */
+
+// Detect the format of an input file from its first bytes
+WADFormat detectInputFormat(const std::string &path);
+
+// Import levels from a -json or -jsonverbose document
+std::vector<WAD::Level> importJSON(std::istream &in);
+
+// Import levels from a -dsl or -dslverbose document
+std::vector<WAD::Level> importDSL(std::istream &in);
+
+// Import levels from a converted file, in the format detectInputFormat() gave
+std::vector<WAD::Level> importLevels(const std::string &path,
+                                     WADFormat          format);
+
+#endif  // IMPORTER_HPP
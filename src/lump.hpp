@@ -0,0 +1,429 @@
+#ifndef LUMP_HPP
+#define LUMP_HPP
+
+#include "wad.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// WAD data is always little-endian; on little-endian hosts the packed record
+// structs can be filled straight from the file bytes
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+constexpr bool kHostLittleEndian = false;
+#else
+constexpr bool kHostLittleEndian = true;
+#endif
+
+// Little-endian field decoding, independent of host byte order and alignment
+inline uint16_t readU16LE(const uint8_t *p) {
+  return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+inline int16_t readS16LE(const uint8_t *p) {
+  return static_cast<int16_t>(readU16LE(p));
+}
+
+inline uint32_t readU32LE(const uint8_t *p) {
+  return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+         (static_cast<uint32_t>(p[2]) << 16) |
+         (static_cast<uint32_t>(p[3]) << 24);
+}
+
+// Little-endian field encoding, the inverse of the readers above
+inline void writeU16LE(uint8_t *p, uint16_t value) {
+  p[0] = static_cast<uint8_t>(value);
+  p[1] = static_cast<uint8_t>(value >> 8);
+}
+
+inline void writeS16LE(uint8_t *p, int16_t value) {
+  writeU16LE(p, static_cast<uint16_t>(value));
+}
+
+inline void writeU32LE(uint8_t *p, uint32_t value) {
+  p[0] = static_cast<uint8_t>(value);
+  p[1] = static_cast<uint8_t>(value >> 8);
+  p[2] = static_cast<uint8_t>(value >> 16);
+  p[3] = static_cast<uint8_t>(value >> 24);
+}
+
+// FNV-1a hash of a lump, used to find identical lumps without comparing them
+inline uint64_t hashLump(const uint8_t *data, std::size_t size) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (std::size_t i = 0; i < size; i++) {
+    hash ^= data[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+/**
+ * Bounds-checked view over the raw bytes of a lump. Every accessor validates
+ * the requested range first and throws std::runtime_error instead of reading
+ * outside the buffer, so malformed offsets inside a lump (patch columns,
+ * texture tables...) can never walk off the end of the data.
+ */
+class LumpBytes {
+public:
+  LumpBytes(const uint8_t *data, std::size_t size, const char *what)
+      : data_(data), size_(size), what_(what) {}
+
+  const uint8_t *data() const { return data_; }
+  std::size_t    size() const { return size_; }
+
+  // Throw unless [offset, offset + count) lies inside the lump
+  void require(std::size_t offset, std::size_t count) const {
+    if (offset > size_ || count > size_ - offset) {
+      throw std::runtime_error(std::string("Malformed ") + what_ +
+                               " lump: read past end of data");
+    }
+  }
+
+  uint8_t u8(std::size_t offset) const {
+    require(offset, 1);
+    return data_[offset];
+  }
+
+  uint16_t u16(std::size_t offset) const {
+    require(offset, 2);
+    return readU16LE(data_ + offset);
+  }
+
+  int16_t s16(std::size_t offset) const {
+    require(offset, 2);
+    return readS16LE(data_ + offset);
+  }
+
+  uint32_t u32(std::size_t offset) const {
+    require(offset, 4);
+    return readU32LE(data_ + offset);
+  }
+
+  // Copy a fixed 8 byte name field
+  void name(std::size_t offset, char (&dest)[8]) const {
+    require(offset, 8);
+    std::memcpy(dest, data_ + offset, 8);
+  }
+
+private:
+  const uint8_t *data_;
+  std::size_t    size_;
+  const char    *what_;
+};
+
+/**
+ * On-disk layout of the fixed-size WAD records. Each specialisation gives the
+ * record size in the file and decodes (or encodes) one record field by field
+ * from (or to) little endian bytes, so the result does not depend on host
+ * byte order or struct padding.
+ */
+template <typename T>
+struct LumpRecord;
+
+template <>
+struct LumpRecord<WAD::Header> {
+  static constexpr std::size_t size = 12;
+  static WAD::Header           decode(const uint8_t *p) {
+    WAD::Header h;
+    std::memcpy(h.identification, p, 4);
+    h.numlumps     = readU32LE(p + 4);
+    h.infotableofs = readU32LE(p + 8);
+    return h;
+  }
+  static void encode(const WAD::Header &h, uint8_t *p) {
+    std::memcpy(p, h.identification, 4);
+    writeU32LE(p + 4, h.numlumps);
+    writeU32LE(p + 8, h.infotableofs);
+  }
+};
+
+template <>
+struct LumpRecord<WAD::Directory> {
+  static constexpr std::size_t size = 16;
+  static WAD::Directory        decode(const uint8_t *p) {
+    WAD::Directory d;
+    d.filepos = readU32LE(p);
+    d.size    = readU32LE(p + 4);
+    std::memcpy(d.name, p + 8, 8);
+    return d;
+  }
+  static void encode(const WAD::Directory &d, uint8_t *p) {
+    writeU32LE(p, d.filepos);
+    writeU32LE(p + 4, d.size);
+    std::memcpy(p + 8, d.name, 8);
+  }
+};
+
+template <>
+struct LumpRecord<WAD::Vertex> {
+  static constexpr std::size_t size = 4;
+  static WAD::Vertex           decode(const uint8_t *p) {
+    return {readS16LE(p), readS16LE(p + 2)};
+  }
+  static void encode(const WAD::Vertex &v, uint8_t *p) {
+    writeS16LE(p, v.x);
+    writeS16LE(p + 2, v.y);
+  }
+};
+
+template <>
+struct LumpRecord<WAD::Linedef> {
+  static constexpr std::size_t size = 14;
+  static WAD::Linedef          decode(const uint8_t *p) {
+    return {readU16LE(p),     readU16LE(p + 2),  readU16LE(p + 4),
+            readU16LE(p + 6), readU16LE(p + 8),  readU16LE(p + 10),
+            readU16LE(p + 12)};
+  }
+  static void encode(const WAD::Linedef &l, uint8_t *p) {
+    writeU16LE(p, l.start_vertex);
+    writeU16LE(p + 2, l.end_vertex);
+    writeU16LE(p + 4, l.flags);
+    writeU16LE(p + 6, l.line_type);
+    writeU16LE(p + 8, l.sector_tag);
+    writeU16LE(p + 10, l.right_sidedef);
+    writeU16LE(p + 12, l.left_sidedef);
+  }
+};
+
+template <>
+struct LumpRecord<WAD::Sidedef> {
+  static constexpr std::size_t size = 30;
+  static WAD::Sidedef          decode(const uint8_t *p) {
+    WAD::Sidedef s;
+    s.x_offset = readS16LE(p);
+    s.y_offset = readS16LE(p + 2);
+    std::memcpy(s.upper_texture, p + 4, 8);
+    std::memcpy(s.lower_texture, p + 12, 8);
+    std::memcpy(s.middle_texture, p + 20, 8);
+    s.sector = readU16LE(p + 28);
+    return s;
+  }
+  static void encode(const WAD::Sidedef &s, uint8_t *p) {
+    writeS16LE(p, s.x_offset);
+    writeS16LE(p + 2, s.y_offset);
+    std::memcpy(p + 4, s.upper_texture, 8);
+    std::memcpy(p + 12, s.lower_texture, 8);
+    std::memcpy(p + 20, s.middle_texture, 8);
+    writeU16LE(p + 28, s.sector);
+  }
+};
+
+template <>
+struct LumpRecord<WAD::Sector> {
+  static constexpr std::size_t size = 26;
+  static WAD::Sector           decode(const uint8_t *p) {
+    WAD::Sector s;
+    s.floor_height   = readS16LE(p);
+    s.ceiling_height = readS16LE(p + 2);
+    std::memcpy(s.floor_texture, p + 4, 8);
+    std::memcpy(s.ceiling_texture, p + 12, 8);
+    s.light_level = readU16LE(p + 20);
+    s.type        = readU16LE(p + 22);
+    s.tag         = readU16LE(p + 24);
+    return s;
+  }
+  static void encode(const WAD::Sector &s, uint8_t *p) {
+    writeS16LE(p, s.floor_height);
+    writeS16LE(p + 2, s.ceiling_height);
+    std::memcpy(p + 4, s.floor_texture, 8);
+    std::memcpy(p + 12, s.ceiling_texture, 8);
+    writeU16LE(p + 20, s.light_level);
+    writeU16LE(p + 22, s.type);
+    writeU16LE(p + 24, s.tag);
+  }
+};
+
+template <>
+struct LumpRecord<WAD::Thing> {
+  static constexpr std::size_t size = 10;
+  static WAD::Thing            decode(const uint8_t *p) {
+    return {readS16LE(p), readS16LE(p + 2), readU16LE(p + 4), readU16LE(p + 6),
+            readU16LE(p + 8)};
+  }
+  static void encode(const WAD::Thing &t, uint8_t *p) {
+    writeS16LE(p, t.x);
+    writeS16LE(p + 2, t.y);
+    writeU16LE(p + 4, t.angle);
+    writeU16LE(p + 6, t.type);
+    writeU16LE(p + 8, t.flags);
+  }
+};
+
+template <>
+struct LumpRecord<WAD::HexenThing> {
+  static constexpr std::size_t size = 20;
+  static WAD::HexenThing       decode(const uint8_t *p) {
+    WAD::HexenThing t;
+    t.tid     = readU16LE(p);
+    t.x       = readS16LE(p + 2);
+    t.y       = readS16LE(p + 4);
+    t.z       = readS16LE(p + 6);
+    t.angle   = readU16LE(p + 8);
+    t.type    = readU16LE(p + 10);
+    t.flags   = readU16LE(p + 12);
+    t.special = p[14];
+    std::memcpy(t.args, p + 15, 5);
+    return t;
+  }
+  static void encode(const WAD::HexenThing &t, uint8_t *p) {
+    writeU16LE(p, t.tid);
+    writeS16LE(p + 2, t.x);
+    writeS16LE(p + 4, t.y);
+    writeS16LE(p + 6, t.z);
+    writeU16LE(p + 8, t.angle);
+    writeU16LE(p + 10, t.type);
+    writeU16LE(p + 12, t.flags);
+    p[14] = t.special;
+    std::memcpy(p + 15, t.args, 5);
+  }
+};
+
+template <>
+struct LumpRecord<WAD::HexenLinedef> {
+  static constexpr std::size_t size = 16;
+  static WAD::HexenLinedef     decode(const uint8_t *p) {
+    WAD::HexenLinedef l;
+    l.start_vertex = readU16LE(p);
+    l.end_vertex   = readU16LE(p + 2);
+    l.flags        = readU16LE(p + 4);
+    l.special      = p[6];
+    std::memcpy(l.args, p + 7, 5);
+    l.right_sidedef = readU16LE(p + 12);
+    l.left_sidedef  = readU16LE(p + 14);
+    return l;
+  }
+  static void encode(const WAD::HexenLinedef &l, uint8_t *p) {
+    writeU16LE(p, l.start_vertex);
+    writeU16LE(p + 2, l.end_vertex);
+    writeU16LE(p + 4, l.flags);
+    p[6] = l.special;
+    std::memcpy(p + 7, l.args, 5);
+    writeU16LE(p + 12, l.right_sidedef);
+    writeU16LE(p + 14, l.left_sidedef);
+  }
+};
+
+template <>
+struct LumpRecord<WAD::Seg> {
+  static constexpr std::size_t size = 12;
+  static WAD::Seg              decode(const uint8_t *p) {
+    return {readU16LE(p),     readU16LE(p + 2), readS16LE(p + 4),
+            readU16LE(p + 6), readU16LE(p + 8), readS16LE(p + 10)};
+  }
+  static void encode(const WAD::Seg &s, uint8_t *p) {
+    writeU16LE(p, s.start_vertex);
+    writeU16LE(p + 2, s.end_vertex);
+    writeS16LE(p + 4, s.angle);
+    writeU16LE(p + 6, s.linedef);
+    writeU16LE(p + 8, s.direction);
+    writeS16LE(p + 10, s.offset);
+  }
+};
+
+template <>
+struct LumpRecord<WAD::SubSector> {
+  static constexpr std::size_t size = 4;
+  static WAD::SubSector        decode(const uint8_t *p) {
+    return {readU16LE(p), readU16LE(p + 2)};
+  }
+  static void encode(const WAD::SubSector &s, uint8_t *p) {
+    writeU16LE(p, s.seg_count);
+    writeU16LE(p + 2, s.first_seg);
+  }
+};
+
+template <>
+struct LumpRecord<WAD::Node> {
+  static constexpr std::size_t size = 28;
+  static WAD::Node             decode(const uint8_t *p) {
+    WAD::Node n;
+    n.x  = readS16LE(p);
+    n.y  = readS16LE(p + 2);
+    n.dx = readS16LE(p + 4);
+    n.dy = readS16LE(p + 6);
+    for (int side = 0; side < 2; side++) {
+      for (int edge = 0; edge < 4; edge++) {
+        n.bbox[side][edge] = readS16LE(p + 8 + side * 8 + edge * 2);
+      }
+      n.children[side] = readU16LE(p + 24 + side * 2);
+    }
+    return n;
+  }
+  static void encode(const WAD::Node &n, uint8_t *p) {
+    writeS16LE(p, n.x);
+    writeS16LE(p + 2, n.y);
+    writeS16LE(p + 4, n.dx);
+    writeS16LE(p + 6, n.dy);
+    for (int side = 0; side < 2; side++) {
+      for (int edge = 0; edge < 4; edge++) {
+        writeS16LE(p + 8 + side * 8 + edge * 2, n.bbox[side][edge]);
+      }
+      writeU16LE(p + 24 + side * 2, n.children[side]);
+    }
+  }
+};
+
+/**
+ * Typed view over a lump made of fixed-size records (VERTEXES, LINEDEFS...).
+ * The record count is computed once from the lump size; like the DOOM engine
+ * itself, a trailing partial record is ignored. Records are decoded on access
+ * straight from the underlying bytes, nothing is copied up front.
+ */
+template <typename T>
+class LumpView {
+public:
+  static constexpr std::size_t record_size = LumpRecord<T>::size;
+
+  // True when the in-memory struct matches the on-disk record byte for byte,
+  // so a vector<T> can be filled directly from the file
+  static constexpr bool is_raw_layout = kHostLittleEndian &&
+                                        sizeof(T) == record_size &&
+                                        std::is_trivially_copyable<T>::value;
+
+  explicit LumpView(const LumpBytes &bytes)
+      : data_(bytes.data()), count_(bytes.size() / record_size) {}
+
+  std::size_t size() const { return count_; }
+  bool        empty() const { return count_ == 0; }
+
+  T operator[](std::size_t index) const {
+    return LumpRecord<T>::decode(data_ + index * record_size);
+  }
+
+  T at(std::size_t index) const {
+    if (index >= count_) {
+      throw std::out_of_range("Lump record index out of range");
+    }
+    return (*this)[index];
+  }
+
+private:
+  const uint8_t *data_;
+  std::size_t    count_;
+};
+
+/**
+ * @brief Encode records into the bytes of a lump
+ * @param records Records to encode (any contiguous container of T)
+ * @return Lump data, LumpRecord<T>::size bytes per record
+ * @note Copied in one go when the struct already has the file layout.
+ */
+template <typename T, typename Records>
+std::vector<uint8_t> encodeRecords(const Records &records) {
+  std::vector<uint8_t> data(records.size() * LumpRecord<T>::size);
+  if constexpr (LumpView<T>::is_raw_layout) {
+    if (!data.empty()) {
+      std::memcpy(data.data(), records.data(), data.size());
+    }
+  } else {
+    for (std::size_t i = 0; i < records.size(); i++) {
+      LumpRecord<T>::encode(records[i], data.data() + i * LumpRecord<T>::size);
+    }
+  }
+  return data;
+}
+
+#endif  // LUMP_HPP
@@ -1,133 +1,459 @@
+#include "./arrow.hpp"
+#include "./atlas.hpp"
+#include "./audio.hpp"
+#include "./bench.hpp"
+#include "./diff.hpp"
+#include "./emitter.hpp"
+#include "./importer.hpp"
+#include "./memory.hpp"
+#include "./parallel.hpp"
+#include "./pipeline.hpp"
+#include "./usageindex.hpp"
 #include "./wad.hpp"
-#include <cstdint>
+#include "./wadwriter.hpp"
+#include <chrono>
+#include <cstddef>
 #include <exception>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
 #include <string>
+#include <utility>
+#include <vector>
 
-// enum with the possible formats
-enum class Format : std::uint8_t {
-  JSON,
-  JSON_VERBOSE,
-  DSL,
-  DSL_VERBOSE
+// Print the command line help
+static void printUsage() {
+  std::cout << "Usage: wadconvert -<format> <wad file> <output json file> "
+               "[--verbose] [--max-memory <MB>]\n";
+  std::cout << "  -<format>: The format to convert to (-json, -jsonverbose, "
+               "-jsoncolumnar, -dsl, -dslverbose, -stats, -statscsv, "
+               "-spatial, -arrow, -wad)\n";
+  std::cout << "  wad file: Path to the WAD file to convert (a -json, "
+               "-jsonverbose, -dsl or -dslverbose output is imported "
+               "back)\n";
+  std::cout << "  output json file: Path to the output JSON file\n";
+  std::cout << "  -<format> <output file>: Optional extra outputs, all written "
+               "from a single parse of the WAD\n";
+  std::cout << "  -bench: Time loading and every output format instead, and "
+               "write the report to the output file\n";
+  std::cout << "  -diff <old wad> <new wad> <output json file>: Write the "
+               "differences between two WADs, level by level\n";
+  std::cout << "  -compact: Rewrite the WAD to the output file with duplicate "
+               "lumps stored once\n";
+  std::cout << "  -atlas: Pack the flats and wall textures of every level "
+               "into PNG pages, with a JSON table of their UVs as output\n";
+  std::cout << "  -audio <wad file> <output directory>: Convert the music "
+               "lumps to MIDI and the sound lumps to WAV\n";
+  std::cout << "  -index <wad file or directory> <index file>: Add the "
+               "textures, flats and thing types used by every level to a "
+               "usage index, reading only the WADs that changed\n";
+  std::cout << "  -query <index file> <term>...: List the levels using every "
+               "term (texture:NAME, flat:NAME or thing:TYPE)\n";
+  std::cout << "  --verbose: Optional flag for detailed output\n";
+  std::cout << "  --max-memory: Optional memory budget in MB: at most "
+               "three levels are in memory while streaming (one loading, one "
+               "queued, one converting) and assets are loaded on demand\n";
+  std::cout << "  --nodes: Optional, build the BSP nodes of the levels that "
+               "have none or whose nodes no longer match their linedefs\n";
+  std::cout << "  --rebuild-nodes: Optional, build the BSP nodes of every "
+               "level\n";
+  std::cout << "  --atlas-size: Optional largest atlas page side in pixels, "
+               "a power of two (default 2048)\n";
+  std::cout << "  --atlas-padding: Optional border around every atlas "
+               "texture in pixels (default 2)\n";
+  std::cout << "  --atlas-light: Optional sector light level (0-255) to shade "
+               "the atlases with, through COLORMAP\n";
+}
+
+// One requested output: format name as given, format and destination
+struct Output {
+  std::string name;
+  WADFormat   format;
+  std::string path;
 };
 
+// Format for a name given on the command line (without the leading '-')
+static bool parseFormat(const std::string &name, WADFormat &format) {
+  if (name == "wad") {
+    format = WADFormat::WAD;
+  } else if (name == "json") {
+    format = WADFormat::JSON;
+  } else if (name == "jsonverbose") {
+    format = WADFormat::JSON_VERBOSE;
+  } else if (name == "jsoncolumnar") {
+    format = WADFormat::JSON_COLUMNAR;
+  } else if (name == "dsl") {
+    format = WADFormat::DSL;
+  } else if (name == "dslverbose") {
+    format = WADFormat::DSL_VERBOSE;
+  } else if (name == "stats") {
+    format = WADFormat::STATS;
+  } else if (name == "statscsv") {
+    format = WADFormat::STATS_CSV;
+  } else if (name == "spatial") {
+    format = WADFormat::SPATIAL;
+  } else if (name == "arrow") {
+    format = WADFormat::ARROW;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Whole document for a format, or an empty string if it has no writer
+static std::string convertLevels(const WAD &wad, WADFormat format) {
+  switch (format) {
+    case WADFormat::JSON:
+      return wad.toJSON();
+    case WADFormat::JSON_VERBOSE:
+      return wad.toJSONVerbose();
+    case WADFormat::JSON_COLUMNAR:
+      return wad.toJSONColumnar();
+    case WADFormat::DSL:
+      return wad.toDSL();
+    case WADFormat::DSL_VERBOSE:
+      return wad.toDSLVerbose();
+    case WADFormat::STATS:
+      return wad.toStats();
+    case WADFormat::STATS_CSV:
+      return wad.toStatsCSV();
+    case WADFormat::SPATIAL:
+      return wad.toSpatial();
+    default:
+      return "";
+  }
+}
+
+/**
+ * @brief Write one output from the loaded levels
+ * @param wad WAD with its levels loaded (or imported)
+ * @param output Format and destination
+ * @throws std::runtime_error if the output cannot be written
+ */
+static void writeOutput(const WAD &wad, const Output &output) {
+  if (output.format == WADFormat::WAD) {
+    writeLevels(wad.levels(), output.path);
+    return;
+  }
+  if (output.format == WADFormat::ARROW) {
+    writeArrowTables(wad, output.path);
+    return;
+  }
+
+  std::string   document = convertLevels(wad, output.format);
+  std::ofstream file(output.path, std::ios::binary);
+  if (!file) {
+    throw std::runtime_error("Unable to open output file: " + output.path);
+  }
+  file << document;
+  if (!file) {
+    throw std::runtime_error("Unable to write output file: " + output.path);
+  }
+}
+
+/**
+ * @brief Write every output from the loaded levels, concurrently
+ * @param wad WAD with its levels loaded (or imported)
+ * @param outputs Formats and destinations
+ * @throws std::runtime_error if any output cannot be written
+ * @note The WAD is only read here, so the outputs share it without copies.
+ */
+static void writeOutputs(const WAD &wad, const std::vector<Output> &outputs) {
+  parallelFor(outputs.size(),
+              [&](std::size_t i) { writeOutput(wad, outputs[i]); });
+}
+
 int main(int argc, char *argv[]) {
   try {
 
-    if (argc < 4 || argc > 5) {
-      std::cout << "Usage: wadconvert -<format> <wad file> <output json file> "
-                   "[--verbose]\n";
-      std::cout
-          << "  -<format>: The format to convert to (-json, -jsonverbose, "
-             "-dsl, -dslverbose)\n";
-      std::cout << "  wad file: Path to the WAD file to convert\n";
-      std::cout << "  output json file: Path to the output JSON file\n";
-      std::cout << "  --verbose: Optional flag for detailed output\n";
+    if (argc < 4) {
+      printUsage();
       return 1;
     }
 
-    Format      format;
-    std::string formatStr       = argv[1];
-    std::string wadFilePath     = argv[2];
-    std::string destinationPath = argv[3];
-    bool        verbose = (argc == 5 && std::string(argv[4]) == "--verbose");
-
     // remove the leading '-' from the format string only if it exists
+    std::string formatStr = argv[1];
     if (formatStr[0] == '-') {
       formatStr = formatStr.substr(1);
     }
 
-    if (formatStr == "json") {
-      format = Format::JSON;
-    } else if (formatStr == "jsonverbose") {
-      format = Format::JSON_VERBOSE;
-    } else if (formatStr == "dsl") {
-      format = Format::DSL;
-    } else if (formatStr == "dslverbose") {
-      format = Format::DSL_VERBOSE;
-    } else {
-      std::cerr
-          << "Invalid format specified. Use -json, -jsonverbose, -dsl, or "
-             "-dslverbose.\n";
-      return 1;
-    }
+    // Query mode: the levels of a usage index using every term given
+    if (formatStr == "query") {
+      std::vector<UsageIndex::Term> terms;
+      for (int i = 3; i < argc; i++) {
+        terms.push_back(parseUsageTerm(argv[i]));
+      }
+      auto                    start   = std::chrono::steady_clock::now();
+      std::vector<UsageMatch> matches = queryUsageIndex(argv[2], terms);
 
-    if (verbose) {
-      std::cout << "Converting WAD file to " << formatStr << " format...\n";
-    }
+      double ms = std::chrono::duration<double, std::milli>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
 
-    WAD wad(wadFilePath, verbose);  // Pass verbose flag to WAD constructor
-    wad.processWAD();
+      for (const UsageMatch &match : matches) {
+        std::cout << match.wad << " " << match.level << "\n";
+      }
+      std::cout << "WAD :: " << matches.size() << " levels in " << ms
+                << " ms\n";
+      return 0;
+    }
 
-    // Convert WAD data to the proper format depending on the argument passed
-    switch (format) {
-      // convert to JSON
-      case Format::JSON: {
+    // -diff takes a second input file before the output file
+    int firstOption = formatStr == "diff" ? 5 : 4;
+    if (argc < firstOption) {
+      printUsage();
+      return 1;
+    }
 
-        std::ofstream jsonFile;
-        jsonFile.open(destinationPath);
+    std::string       wadFilePath     = argv[2];
+    std::string       destinationPath = argv[firstOption - 1];
+    bool              verbose         = false;
+    std::size_t       maxMemoryMB     = 0;
+    WAD::NodeBuilding nodeBuilding    = WAD::NodeBuilding::Keep;
+    AtlasOptions      atlasOptions;
+    std::vector<std::pair<std::string, std::string>> extraOutputs;
 
-        if (!jsonFile) {
-          std::cerr << "Unable to open output JSON file: " << destinationPath
-                    << "\n";
+    for (int i = firstOption; i < argc; i++) {
+      std::string option = argv[i];
+      if (option == "--verbose") {
+        verbose = true;
+      } else if (option == "--max-memory" && i + 1 < argc) {
+        maxMemoryMB = std::stoul(argv[++i]);
+      } else if (option == "--nodes") {
+        nodeBuilding = WAD::NodeBuilding::Missing;
+      } else if (option == "--rebuild-nodes") {
+        nodeBuilding = WAD::NodeBuilding::Always;
+      } else if (option == "--atlas-size" && i + 1 < argc) {
+        atlasOptions.maxPageSize = std::stoul(argv[++i]);
+        if (atlasOptions.maxPageSize == 0 ||
+            (atlasOptions.maxPageSize & (atlasOptions.maxPageSize - 1)) != 0) {
+          std::cerr << "The atlas size must be a power of two.\n";
           return 1;
         }
+      } else if (option == "--atlas-padding" && i + 1 < argc) {
+        atlasOptions.padding = std::stoul(argv[++i]);
+      } else if (option == "--atlas-light" && i + 1 < argc) {
+        atlasOptions.lightLevel = std::stoi(argv[++i]);
+        if (atlasOptions.lightLevel < 0 || atlasOptions.lightLevel > 255) {
+          std::cerr << "The atlas light level must be between 0 and 255.\n";
+          return 1;
+        }
+      } else if (option.size() > 1 && option[0] == '-' && option[1] != '-' &&
+                 i + 1 < argc) {
+        extraOutputs.emplace_back(option.substr(1), argv[++i]);
+      } else {
+        printUsage();
+        return 1;
+      }
+    }
 
-        jsonFile << wad.toJSON();
-        jsonFile.close();
+    if ((formatStr == "bench" || formatStr == "compact" ||
+         formatStr == "diff" || formatStr == "atlas" ||
+         formatStr == "audio" || formatStr == "index") &&
+        !extraOutputs.empty()) {
+      printUsage();
+      return 1;
+    }
 
-        break;
+    // Benchmark mode: time loading and every output format, write the report
+    if (formatStr == "bench") {
+      WAD         wad(wadFilePath, verbose);
+      std::string report = runBenchmarks(wad);
+
+      std::ofstream reportFile(destinationPath);
+      if (!reportFile) {
+        std::cerr << "Unable to open output report file: " << destinationPath
+                  << "\n";
+        return 1;
       }
+      reportFile << report;
+      std::cout << report;
+      return 0;
+    }
 
-      // convert to JSON verbose
-      case Format::JSON_VERBOSE: {
+    // Diff mode: compare two WADs and write the differences as JSON
+    if (formatStr == "diff") {
+      WAD            oldWad(wadFilePath, verbose);
+      WAD            newWad(argv[3], verbose);
+      nlohmann::json diff = diffWADs(oldWad, newWad);
 
-        std::ofstream jsonFile;
-        jsonFile.open(destinationPath);
+      std::ofstream diffFile(destinationPath, std::ios::binary);
+      if (!diffFile) {
+        std::cerr << "Unable to open output diff file: " << destinationPath
+                  << "\n";
+        return 1;
+      }
+      diffFile << diff.dump(1) << "\n";
 
-        if (!jsonFile) {
-          std::cerr << "Unable to open output JSON file: " << destinationPath
-                    << "\n";
-          return 1;
-        }
+      const nlohmann::json &levels = diff["levels"];
+      std::cout << "WAD :: Levels: " << levels["modified"].size()
+                << " modified, " << levels["added"].size() << " added, "
+                << levels["removed"].size() << " removed, "
+                << levels["unchanged"].get<std::size_t>() << " unchanged\n";
+      const nlohmann::json &lumps = diff["lumps"];
+      std::cout << "WAD :: Other lumps: " << lumps["modified"].size()
+                << " modified, " << lumps["added"].size() << " added, "
+                << lumps["removed"].size() << " removed\n";
+      return 0;
+    }
 
-        jsonFile << wad.toJSONVerbose();
-        jsonFile.close();
+    // Compact mode: rewrite the WAD with duplicate lumps shared
+    if (formatStr == "compact") {
+      WAD              wad(wadFilePath, verbose);
+      WADWriter::Stats stats = compactWAD(wad, destinationPath);
+      std::size_t      inputSize =
+          static_cast<std::size_t>(std::filesystem::file_size(wadFilePath));
 
-        break;
+      std::cout << "WAD :: Wrote " << stats.lumps << " lumps ("
+                << stats.uniqueLumps << " stored, " << stats.sharedBytes
+                << " bytes of duplicates shared)\n";
+      std::cout << "WAD :: " << inputSize << " -> " << stats.fileSize
+                << " bytes, saved "
+                << (inputSize > stats.fileSize ? inputSize - stats.fileSize : 0)
+                << " bytes\n";
+      return 0;
+    }
+
+    // Atlas mode: pack the textures of every level, write pages and UVs
+    if (formatStr == "atlas") {
+      WAD wad(wadFilePath, verbose);
+      if (maxMemoryMB > 0) {
+        wad.setMemoryBudget(maxMemoryMB * 1024 * 1024);
       }
+      wad.processWAD();
+      AtlasStats stats = writeAtlases(wad, destinationPath, atlasOptions);
 
-      // convert to custom DSL format
-      case Format::DSL: {
+      std::cout << "WAD :: Atlas: " << stats.textures << " textures in "
+                << stats.pages << " pages for " << stats.levels
+                << " levels (" << stats.bytes << " bytes of PNG)\n";
+      return 0;
+    }
 
-        std::ofstream dslFile;
-        dslFile.open(destinationPath);
+    // Audio mode: convert the music and sound lumps, in parallel
+    if (formatStr == "audio") {
+      WAD        wad(wadFilePath, verbose);
+      auto       start = std::chrono::steady_clock::now();
+      AudioStats stats = extractAudio(wad, destinationPath);
+      double     ms    = std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
 
-        if (!dslFile) {
-          std::cerr << "Unable to open output DSL file: " << destinationPath
-                    << "\n";
-          return 1;
-        }
+      for (const std::string &warning : stats.warnings) {
+        std::cout << "WAD :: Warning: " << warning << "\n";
+      }
+      std::cout << "WAD :: Audio: " << stats.music << " MUS to MIDI, "
+                << stats.midi << " MIDI copied, " << stats.sounds
+                << " sounds to WAV, " << stats.skipped << " skipped\n";
+      std::cout << "WAD :: " << stats.inputBytes << " -> " << stats.outputBytes
+                << " bytes in " << ms << " ms ("
+                << (ms > 0 ? stats.inputBytes / ms / 1000.0 : 0.0)
+                << " MB/s)\n";
+      return 0;
+    }
 
-        dslFile << wad.toDSL();
-        dslFile.close();
+    // Index mode: add the WADs of a file or directory to a usage index
+    if (formatStr == "index") {
+      auto                    start = std::chrono::steady_clock::now();
+      UsageIndex              index = UsageIndex::load(destinationPath);
+      UsageIndex::UpdateStats stats = index.update(wadFilePath);
+      std::size_t             bytes = index.save(destinationPath);
 
-        break;
+      double ms = std::chrono::duration<double, std::milli>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+
+      std::size_t levels = 0;
+      for (const UsageIndex::Source &source : index.sources()) {
+        levels += source.levels.size();
+      }
+      for (const std::string &warning : stats.warnings) {
+        std::cout << "WAD :: Warning: Skipping " << warning << "\n";
+      }
+      std::cout << "WAD :: Index: " << index.sources().size() << " WADs ("
+                << stats.scanned << " read, " << stats.reused
+                << " unchanged, " << stats.removed << " removed), " << levels
+                << " levels, " << bytes << " bytes in " << ms << " ms\n";
+      return 0;
+    }
+
+    // Every requested output, the first one from the fixed arguments
+    std::vector<Output> outputs;
+    outputs.push_back({formatStr, WADFormat::WAD, destinationPath});
+    for (const auto &extra : extraOutputs) {
+      outputs.push_back({extra.first, WADFormat::WAD, extra.second});
+    }
+    std::string formatNames;
+    for (Output &output : outputs) {
+      if (!parseFormat(output.name, output.format)) {
+        std::cerr << "Invalid format specified. Use -json, -jsonverbose, "
+                     "-jsoncolumnar, -dsl, -dslverbose, -stats, -statscsv, "
+                     "-spatial, -arrow or -wad.\n";
+        return 1;
       }
+      formatNames += (formatNames.empty() ? "" : ", ") + output.name;
+    }
+
+    if (verbose) {
+      std::cout << "Converting WAD file to " << formatNames << " format...\n";
+    }
+
+    // JSON and DSL files written by this tool are imported back into levels
+    // and converted again, all at once
+    WADFormat inputFormat = detectInputFormat(wadFilePath);
+    if (inputFormat != WADFormat::WAD) {
+      WAD wad(wadFilePath, importLevels(wadFilePath, inputFormat), verbose);
+      writeOutputs(wad, outputs);
+      std::cout << std::filesystem::path(wadFilePath).filename().string()
+                << " imported and converted to " << formatNames << ".\n";
+      return 0;
+    }
 
-      default:
+    WAD wad(wadFilePath, verbose);  // Pass verbose flag to WAD constructor
+    if (maxMemoryMB > 0) {
+      wad.setMemoryBudget(maxMemoryMB * 1024 * 1024);
+    }
+    wad.setNodeBuilding(nodeBuilding);
+
+    // When every format has a level-by-level emitter, the outputs are
+    // streamed: each level is parsed once, handed to every emitter and
+    // written as soon as it is converted. In memory-bounded mode both queues
+    // hold one item, so at most three levels are in memory (loading, queued,
+    // serializing). Otherwise (stats, Arrow, WAD) all levels are loaded first
+    // and the outputs are written concurrently from them.
+    std::vector<std::unique_ptr<Emitter>> emitters;
+    std::vector<PipelineOutput>           streams;
+    for (const Output &output : outputs) {
+      emitters.push_back(makeEmitter(output.format));
+      if (!emitters.back()) {
         break;
+      }
+      streams.push_back({emitters.back().get(), output.path});
+    }
+    if (streams.size() == outputs.size()) {
+      runPipeline(wad, streams, verbose,
+                  maxMemoryMB > 0 ? 1 : kLevelQueueDepth,
+                  maxMemoryMB > 0 ? 1 : kChunkQueueDepth);
+    } else {
+      wad.processWAD();
+      writeOutputs(wad, outputs);
     }
 
     if (verbose) {
-      std::cout << "WAD file converted to " << formatStr
+      std::cout << "WAD file converted to " << formatNames
                 << " format successfully.\n";
     } else {
       std::cout << std::filesystem::path(wadFilePath).filename().string()
-                << " converted to " << formatStr << ".\n";
+                << " converted to " << formatNames << ".\n";
+    }
+    if (verbose || maxMemoryMB > 0) {
+      std::size_t peakMB = peakResidentBytes() / (1024 * 1024);
+      std::cout << "Peak resident memory: " << peakMB << " MB";
+      if (maxMemoryMB > 0 && peakMB > maxMemoryMB) {
+        std::cout << " (over the " << maxMemoryMB << " MB budget)";
+      }
+      std::cout << "\n";
     }
   } catch (const std::exception &e) {
     std::cerr << "Error: " << e.what() << "\n";
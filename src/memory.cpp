@@ -0,0 +1,21 @@
+#include "memory.hpp"
+#include <cstddef>
+#include <sys/resource.h>
+
+/**
+ * @brief Peak resident set size of the process so far
+ * @return Peak RSS in bytes, or 0 if it cannot be queried
+ * @note getrusage reports ru_maxrss in bytes on macOS and in kilobytes on
+ *       Linux and the BSDs.
+ */
+std::size_t peakResidentBytes() {
+  struct rusage usage {};
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+#ifdef __APPLE__
+  return static_cast<std::size_t>(usage.ru_maxrss);
+#else
+  return static_cast<std::size_t>(usage.ru_maxrss) * 1024;
+#endif
+}
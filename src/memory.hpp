@@ -0,0 +1,9 @@
+#ifndef MEMORY_HPP
+#define MEMORY_HPP
+
+#include <cstddef>
+
+// Peak resident set size of the process so far, in bytes (0 if unknown)
+std::size_t peakResidentBytes();
+
+#endif  // MEMORY_HPP
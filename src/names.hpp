@@ -0,0 +1,134 @@
+#ifndef NAMES_HPP
+#define NAMES_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Lump, texture and flat names are fixed 8-byte fields, padded with NULs.
+ * A NameKey packs such a name into a single 64-bit integer, first character
+ * in the most significant byte, so two names are equal when their keys are
+ * equal and keys sort in the same order as the names themselves.
+ */
+using NameKey = std::uint64_t;
+
+// Maximum length of a lump, texture or flat name
+constexpr std::size_t kNameLength = 8;
+
+// Whitespace trimmed from the end of names, like trimString()
+constexpr bool isNameSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' ||
+         c == '\v';
+}
+
+/**
+ * @brief Pack a name into a key
+ * @param name Name characters, not necessarily zero-terminated
+ * @param maxLen Size of the name field (at most 8 characters are used)
+ * @return Key of the name, without trailing whitespace
+ */
+constexpr NameKey packName(const char *name, std::size_t maxLen = kNameLength) {
+  std::size_t len = 0;
+  while (len < maxLen && len < kNameLength && name[len] != '\0') {
+    len++;
+  }
+  while (len > 0 && isNameSpace(name[len - 1])) {
+    len--;
+  }
+
+  NameKey key = 0;
+  for (std::size_t i = 0; i < kNameLength; i++) {
+    key <<= 8;
+    if (i < len) {
+      key |= static_cast<unsigned char>(name[i]);
+    }
+  }
+  return key;
+}
+
+// Pack a name given as a string (at most 8 characters are used)
+constexpr NameKey packName(std::string_view name) {
+  return packName(name.data(), name.size());
+}
+
+// Character at a position of a packed name ('\0' past the end)
+constexpr char nameChar(NameKey key, std::size_t index) {
+  return static_cast<char>((key >> (8 * (kNameLength - 1 - index))) & 0xFF);
+}
+
+// A packed name turned back into characters, on the stack
+struct NameChars {
+  char        data[kNameLength] = {};  // Zero-padded, like a name field
+  std::size_t size              = 0;
+
+  std::string_view view() const { return std::string_view(data, size); }
+};
+
+/**
+ * @brief Unpack a key into characters
+ * @param key Packed name
+ * @return The name, zero-padded to 8 characters
+ */
+constexpr NameChars unpackName(NameKey key) {
+  NameChars chars;
+  for (std::size_t i = 0; i < kNameLength; i++) {
+    chars.data[i] = nameChar(key, i);
+    if (chars.data[i] != '\0') {
+      chars.size = i + 1;
+    }
+  }
+  return chars;
+}
+
+static_assert(packName("E1M1") == packName("E1M1\0\0\0\0", 8) &&
+                  packName("MAP01") < packName("MAP02") &&
+                  packName("FLAT") < packName("FLAT1"),
+              "name keys must compare like names");
+
+/**
+ * Table giving every distinct name a small integer id, in order of first
+ * appearance. Names are compared by id (or key) and only turned back into
+ * characters when they are written out.
+ */
+class NameTable {
+public:
+  using Id = std::uint32_t;
+
+  // Id returned by find() for names that are not in the table
+  static constexpr Id kNone = std::numeric_limits<Id>::max();
+
+  // Id of a name, adding it to the table if needed
+  Id intern(NameKey key) {
+    auto it = ids_.find(key);
+    if (it != ids_.end()) {
+      return it->second;
+    }
+    Id id = static_cast<Id>(keys_.size());
+    ids_.emplace(key, id);
+    keys_.push_back(key);
+    return id;
+  }
+
+  // Id of a name, or kNone if it is not in the table
+  Id find(NameKey key) const {
+    auto it = ids_.find(key);
+    return it != ids_.end() ? it->second : kNone;
+  }
+
+  NameKey     key(Id id) const { return keys_[id]; }
+  std::size_t size() const { return keys_.size(); }
+  void        clear() {
+    ids_.clear();
+    keys_.clear();
+  }
+
+private:
+  std::unordered_map<NameKey, Id> ids_;
+  std::vector<NameKey>            keys_;
+};
+
+#endif  // NAMES_HPP
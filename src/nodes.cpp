@@ -0,0 +1,576 @@
+#include "nodes.hpp"
+#include "parallel.hpp"
+#include "wad.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+constexpr double      kOnLine        = 0.5;   // Distance to count as on a line
+constexpr double      kOnLinedef     = 1.0;   // Slack for rounded seg ends
+constexpr std::size_t kMaxCandidates = 128;   // Partitions tried per node
+constexpr long        kSplitCost     = 8;     // Cost of splitting one seg
+constexpr std::size_t kParallelSegs  = 1000;  // Smallest set built in parallel
+constexpr uint16_t    kNoSidedef     = 0xFFFF;
+constexpr double      kPi            = 3.14159265358979323846;
+
+// A seg while the tree is built: integer end points, as in the lumps
+struct BuildSeg {
+  int32_t  x1, y1, x2, y2;
+  int32_t  v1, v2;  // Vertex indices, -1 for split points not numbered yet
+  int32_t  lx, ly;  // Start of the linedef side
+  int32_t  dx, dy;  // Direction of the linedef side
+  uint16_t linedef;
+  uint16_t direction;
+  double   offset;  // Distance from the start of the linedef side
+};
+
+// Partition line through a seg: its whole linedef side, so that rounded
+// split points do not move it
+struct Line {
+  int64_t x, y, dx, dy;
+  double  length;
+
+  explicit Line(const BuildSeg &seg)
+      : x(seg.lx), y(seg.ly), dx(seg.dx), dy(seg.dy),
+        length(std::hypot(static_cast<double>(seg.dx),
+                          static_cast<double>(seg.dy))) {}
+
+  // Signed distance of a point, positive on the right (front) side, the
+  // side the game's R_PointOnSide() calls 0
+  double distance(int32_t px, int32_t py) const {
+    return static_cast<double>((px - x) * dy - (py - y) * dx) / length;
+  }
+};
+
+enum Side { kFront, kBack, kSplit };
+
+/**
+ * @brief Place a seg against a partition line
+ * @param x,y Set to the split point when the seg is split
+ * @return Side of the seg, or kSplit if the line cuts it
+ * @note Segs of linedefs collinear with the partition go to the front when
+ *       they face the same way as it. A split point rounding onto an end of
+ *       the seg does not split it; the seg goes to the side of its other
+ *       end.
+ */
+Side classify(const Line &line, const BuildSeg &seg, int32_t &x, int32_t &y) {
+  // Segs of collinear linedefs, split points included, are on the line
+  // whatever the rounding of their end points
+  if (seg.dx * line.dy == seg.dy * line.dx &&
+      (seg.lx - line.x) * line.dy == (seg.ly - line.y) * line.dx) {
+    return seg.dx * line.dx + seg.dy * line.dy > 0 ? kFront : kBack;
+  }
+
+  double d1  = line.distance(seg.x1, seg.y1);
+  double d2  = line.distance(seg.x2, seg.y2);
+  bool   on1 = std::fabs(d1) < kOnLine;
+  bool   on2 = std::fabs(d2) < kOnLine;
+  if (on1 && on2) {
+    return kFront;  // Too short to tell; either side will do
+  }
+  if ((on1 || d1 > 0) && (on2 || d2 > 0)) {
+    return kFront;
+  }
+  if ((on1 || d1 < 0) && (on2 || d2 < 0)) {
+    return kBack;
+  }
+
+  double t = d1 / (d1 - d2);
+  x        = static_cast<int32_t>(std::lround(seg.x1 + t * (seg.x2 - seg.x1)));
+  y        = static_cast<int32_t>(std::lround(seg.y1 + t * (seg.y2 - seg.y1)));
+  if ((x == seg.x1 && y == seg.y1) || (x == seg.x2 && y == seg.y2)) {
+    double far = std::fabs(d1) > std::fabs(d2) ? d1 : d2;
+    return far > 0 ? kFront : kBack;
+  }
+  return kSplit;
+}
+
+/**
+ * @brief Cost of a partition line
+ * @param best Cost to beat; counting stops once it cannot be beaten
+ * @return Cost, or -1 if the line leaves a side empty
+ */
+long partitionCost(const Line &line, const std::vector<BuildSeg> &segs,
+                   long best) {
+  long    front = 0, back = 0, splits = 0;
+  int32_t x, y;
+  for (const BuildSeg &seg : segs) {
+    switch (classify(line, seg, x, y)) {
+      case kFront:
+        front++;
+        break;
+      case kBack:
+        back++;
+        break;
+      default:
+        splits++;
+        if (splits * kSplitCost >= best) {
+          return best;
+        }
+        break;
+    }
+  }
+  if (splits == 0 && (front == 0 || back == 0)) {
+    return -1;
+  }
+  return splits * kSplitCost + std::labs(front - back);
+}
+
+/**
+ * @brief Pick the partition of a set of segs
+ * @return Index of the seg whose line to use, or -1 if the set is convex
+ */
+long choosePartition(const std::vector<BuildSeg> &segs) {
+  long best      = std::numeric_limits<long>::max();
+  long bestIndex = -1;
+  auto tryAll    = [&](std::size_t step) {
+    uint32_t previous = UINT32_MAX;
+    for (std::size_t i = 0; i < segs.size(); i += step) {
+      uint32_t lineSide = segs[i].linedef * 2u + segs[i].direction;
+      if (lineSide == previous) {
+        continue;  // Another piece of the same linedef side
+      }
+      previous  = lineSide;
+      long cost = partitionCost(Line(segs[i]), segs, best);
+      if (cost >= 0 && cost < best) {
+        best      = cost;
+        bestIndex = static_cast<long>(i);
+      }
+    }
+  };
+
+  std::size_t step = std::max<std::size_t>(1, segs.size() / kMaxCandidates);
+  tryAll(step);
+  if (bestIndex < 0 && step > 1) {
+    tryAll(1);  // The sample may have missed the lines that divide the set
+  }
+  return bestIndex;
+}
+
+// A subtree: a partition and two children, or a leaf holding its segs
+struct Tree {
+  std::vector<BuildSeg> segs;
+  BuildSeg              partition;
+  std::unique_ptr<Tree> children[2];
+  int32_t               box[4];  // Top, bottom, left, right
+};
+
+/**
+ * @brief Build the subtree of a set of segs
+ * @param parallelDepth Levels below which both halves are built in parallel
+ * @param splits Number of segs split so far
+ * @param maxSplits Splits that still leave the segs within the lump limit
+ * @throws std::runtime_error past maxSplits, without building the rest
+ */
+std::unique_ptr<Tree> build(std::vector<BuildSeg> segs, int parallelDepth,
+                            std::atomic<std::size_t> &splits,
+                            std::size_t               maxSplits) {
+  auto tree    = std::make_unique<Tree>();
+  tree->box[0] = tree->box[3] = std::numeric_limits<int32_t>::min();
+  tree->box[1] = tree->box[2] = std::numeric_limits<int32_t>::max();
+  for (const BuildSeg &seg : segs) {
+    tree->box[0] = std::max({tree->box[0], seg.y1, seg.y2});
+    tree->box[1] = std::min({tree->box[1], seg.y1, seg.y2});
+    tree->box[2] = std::min({tree->box[2], seg.x1, seg.x2});
+    tree->box[3] = std::max({tree->box[3], seg.x1, seg.x2});
+  }
+
+  long index = choosePartition(segs);
+  if (index < 0) {
+    tree->segs = std::move(segs);
+    return tree;
+  }
+
+  tree->partition = segs[index];
+  Line                  line(tree->partition);
+  std::vector<BuildSeg> sides[2];
+  for (const BuildSeg &seg : segs) {
+    int32_t x, y;
+    Side    side = classify(line, seg, x, y);
+    if (side != kSplit) {
+      sides[side].push_back(seg);
+      continue;
+    }
+    BuildSeg first = seg, second = seg;
+    first.x2       = x;
+    first.y2       = y;
+    first.v2       = -1;
+    second.x1      = x;
+    second.y1      = y;
+    second.v1      = -1;
+    second.offset += std::hypot(static_cast<double>(x - seg.x1),
+                                static_cast<double>(y - seg.y1));
+    bool firstFront = line.distance(seg.x1, seg.y1) > 0;
+    sides[firstFront ? kFront : kBack].push_back(first);
+    sides[firstFront ? kBack : kFront].push_back(second);
+    if (++splits > maxSplits) {
+      throw std::runtime_error("Too many segs for the DOOM node format");
+    }
+  }
+  segs.clear();
+  segs.shrink_to_fit();
+
+  auto buildSide = [&](std::size_t side) {
+    tree->children[side] =
+        build(std::move(sides[side]), parallelDepth - 1, splits, maxSplits);
+  };
+  if (parallelDepth > 0 &&
+      sides[kFront].size() + sides[kBack].size() >= kParallelSegs) {
+    parallelFor(2, buildSide);
+  } else {
+    buildSide(kFront);
+    buildSide(kBack);
+  }
+  return tree;
+}
+
+// Check an index against the 16-bit fields of the node lumps
+uint16_t index16(std::size_t index, std::size_t limit, const char *what) {
+  if (index >= limit) {
+    throw std::runtime_error(std::string("Too many ") + what +
+                             " for the DOOM node format");
+  }
+  return static_cast<uint16_t>(index);
+}
+
+/**
+ * Numbers a built tree into the lump records: subsectors and their segs in
+ * tree order, nodes after both their children, and split points as new
+ * vertices (a point shared by several segs gets one vertex).
+ */
+class Numbering {
+public:
+  explicit Numbering(WAD::Level &level) : level_(level) {
+    for (std::size_t i = 0; i < level.vertices.size(); i++) {
+      vertices_.emplace(key(level.vertices[i].x, level.vertices[i].y),
+                        static_cast<uint16_t>(i));
+    }
+  }
+
+  // Number a subtree; returns its reference in a node's children
+  uint16_t add(const Tree &tree) {
+    if (!tree.children[0]) {
+      WAD::SubSector subsector;
+      subsector.first_seg = index16(level_.segs.size(), 0x10000, "segs");
+      subsector.seg_count = index16(tree.segs.size(), 0x10000, "segs");
+      for (const BuildSeg &seg : tree.segs) {
+        addSeg(seg);
+      }
+      level_.subsectors.push_back(subsector);
+      return WAD::kSubSector | index16(level_.subsectors.size() - 1,
+                                       WAD::kSubSector, "subsectors");
+    }
+
+    WAD::Node node;
+    int32_t   dx = tree.partition.dx, dy = tree.partition.dy;
+    while (std::abs(dx) > INT16_MAX || std::abs(dy) > INT16_MAX) {
+      dx /= 2;
+      dy /= 2;
+    }
+    node.x  = static_cast<int16_t>(tree.partition.lx);
+    node.y  = static_cast<int16_t>(tree.partition.ly);
+    node.dx = static_cast<int16_t>(dx);
+    node.dy = static_cast<int16_t>(dy);
+    for (int side = 0; side < 2; side++) {
+      const Tree &child = *tree.children[side];
+      for (int edge = 0; edge < 4; edge++) {
+        node.bbox[side][edge] = static_cast<int16_t>(child.box[edge]);
+      }
+      node.children[side] = add(child);
+    }
+    level_.nodes.push_back(node);
+    return index16(level_.nodes.size() - 1, WAD::kSubSector, "nodes");
+  }
+
+private:
+  WAD::Level                            &level_;
+  std::unordered_map<uint64_t, uint16_t> vertices_;  // By coordinates
+
+  static uint64_t key(int32_t x, int32_t y) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) |
+           static_cast<uint32_t>(y);
+  }
+
+  uint16_t vertex(int32_t index, int32_t x, int32_t y) {
+    if (index >= 0) {
+      return static_cast<uint16_t>(index);
+    }
+    auto [found, added] = vertices_.emplace(
+        key(x, y), static_cast<uint16_t>(level_.vertices.size()));
+    if (added) {
+      index16(level_.vertices.size(), 0x10000, "vertices");
+      level_.vertices.push_back(
+          {static_cast<int16_t>(x), static_cast<int16_t>(y)});
+    }
+    return found->second;
+  }
+
+  void addSeg(const BuildSeg &seg) {
+    WAD::Seg out;
+    out.start_vertex = vertex(seg.v1, seg.x1, seg.y1);
+    out.end_vertex   = vertex(seg.v2, seg.x2, seg.y2);
+    // Binary angle of the linedef side: a full turn is 65536
+    long angle = std::lround(std::atan2(static_cast<double>(seg.dy),
+                                        static_cast<double>(seg.dx)) *
+                             32768.0 / kPi);
+    out.angle     = static_cast<int16_t>(static_cast<uint16_t>(angle));
+    out.linedef   = seg.linedef;
+    out.direction = seg.direction;
+    out.offset    = static_cast<int16_t>(std::lround(seg.offset));
+    index16(level_.segs.size(), 0x10000, "segs");
+    level_.segs.push_back(out);
+  }
+};
+
+// Linedef side has a sidedef
+bool hasSide(const WAD::Level &level, const WAD::Linedef &line, int side) {
+  uint16_t sidedef = side == 0 ? line.right_sidedef : line.left_sidedef;
+  return sidedef != kNoSidedef && sidedef < level.sidedefs.size();
+}
+
+// Whether a point lies on the segment from a to b, within the rounding of
+// split points to whole map units
+bool onLinedef(const WAD::Vertex &p, const WAD::Vertex &a,
+               const WAD::Vertex &b) {
+  double dx     = b.x - a.x;
+  double dy     = b.y - a.y;
+  double length = std::hypot(dx, dy);
+  double across = ((p.x - a.x) * dy - (p.y - a.y) * dx) / length;
+  double along  = ((p.x - a.x) * dx + (p.y - a.y) * dy) / length;
+  return std::fabs(across) <= kOnLinedef && along >= -kOnLinedef &&
+         along <= length + kOnLinedef;
+}
+
+// Bounding box of seg end points, in the order of a node's: top, bottom,
+// left, right
+struct SegBox {
+  int32_t edge[4] = {std::numeric_limits<int32_t>::min(),
+                     std::numeric_limits<int32_t>::max(),
+                     std::numeric_limits<int32_t>::max(),
+                     std::numeric_limits<int32_t>::min()};
+
+  void add(const WAD::Vertex &v) {
+    edge[0] = std::max<int32_t>(edge[0], v.y);
+    edge[1] = std::min<int32_t>(edge[1], v.y);
+    edge[2] = std::min<int32_t>(edge[2], v.x);
+    edge[3] = std::max<int32_t>(edge[3], v.x);
+  }
+  void add(const SegBox &box) {
+    edge[0] = std::max(edge[0], box.edge[0]);
+    edge[1] = std::min(edge[1], box.edge[1]);
+    edge[2] = std::min(edge[2], box.edge[2]);
+    edge[3] = std::max(edge[3], box.edge[3]);
+  }
+  bool inside(const int16_t (&bbox)[4]) const {
+    return edge[0] <= bbox[0] && edge[1] >= bbox[1] && edge[2] >= bbox[2] &&
+           edge[3] <= bbox[3];
+  }
+};
+
+}  // namespace
+
+/**
+ * @brief Build the BSP tree of a level: its segs, subsectors and nodes
+ * @param level Level with its vertices, linedefs and sidedefs; its segs,
+ *        subsectors and nodes are replaced, and the vertices created by
+ *        splitting segs are appended to its vertices
+ * @return Sizes of the tree
+ * @throws std::runtime_error if the tree does not fit the 16-bit indices of
+ *         the DOOM node lumps
+ * @note Every linedef side gives a seg. Each node picks its partition among
+ *       the seg lines (at most 128 evenly spread candidates for large sets)
+ *       by cost, 8 per seg split plus the imbalance between both sides, and
+ *       stops at convex sets, which become subsectors. Geometry is integer:
+ *       split points are rounded to whole map units as the lumps store them,
+ *       and points within half a unit of a partition count as on it. Both
+ *       halves of large sets are built in parallel, as far down as there are
+ *       cores, and the tree is numbered afterwards as the game expects:
+ *       children before their parent, the root node last.
+ * @note Vertices past the last one used by a linedef are split vertices of
+ *       earlier nodes; they are dropped first.
+ */
+NodeStats buildNodes(WAD::Level &level) {
+  level.segs.clear();
+  level.subsectors.clear();
+  level.nodes.clear();
+  index16(level.linedefs.size(), 0x10000, "linedefs");
+
+  // Drop the split vertices of earlier nodes
+  std::size_t used = 0;
+  for (const WAD::Linedef &line : level.linedefs) {
+    if (line.start_vertex < level.vertices.size() &&
+        line.end_vertex < level.vertices.size()) {
+      used = std::max<std::size_t>(
+          used, std::max(line.start_vertex, line.end_vertex) + 1u);
+    }
+  }
+  level.vertices.resize(used);
+
+  // One seg per linedef side
+  std::vector<BuildSeg> segs;
+  segs.reserve(level.linedefs.size() * 2);
+  for (std::size_t i = 0; i < level.linedefs.size(); i++) {
+    const WAD::Linedef &line = level.linedefs[i];
+    if (line.start_vertex >= used || line.end_vertex >= used) {
+      continue;
+    }
+    const WAD::Vertex &a = level.vertices[line.start_vertex];
+    const WAD::Vertex &b = level.vertices[line.end_vertex];
+    if (a.x == b.x && a.y == b.y) {
+      continue;
+    }
+    for (uint16_t side = 0; side < 2; side++) {
+      if (!hasSide(level, line, side)) {
+        continue;
+      }
+      const WAD::Vertex &from = side == 0 ? a : b;
+      const WAD::Vertex &to   = side == 0 ? b : a;
+      BuildSeg           seg;
+      seg.x1        = from.x;
+      seg.y1        = from.y;
+      seg.x2        = to.x;
+      seg.y2        = to.y;
+      seg.v1        = side == 0 ? line.start_vertex : line.end_vertex;
+      seg.v2        = side == 0 ? line.end_vertex : line.start_vertex;
+      seg.lx        = seg.x1;
+      seg.ly        = seg.y1;
+      seg.dx        = seg.x2 - seg.x1;
+      seg.dy        = seg.y2 - seg.y1;
+      seg.linedef   = static_cast<uint16_t>(i);
+      seg.direction = side;
+      seg.offset    = 0;
+      segs.push_back(seg);
+    }
+  }
+
+  NodeStats stats;
+  if (segs.empty()) {
+    return stats;
+  }
+
+  // Split in parallel down to about one subtree per core
+  int parallelDepth = 0;
+  for (unsigned n = 1; n < std::thread::hardware_concurrency(); n *= 2) {
+    parallelDepth++;
+  }
+  std::atomic<std::size_t> splits{0};
+  std::size_t              maxSplits = 0x10000 - std::min<std::size_t>(
+                                            segs.size(), 0x10000);
+  std::unique_ptr<Tree>    tree =
+      build(std::move(segs), parallelDepth, splits, maxSplits);
+
+  Numbering numbering(level);
+  numbering.add(*tree);
+
+  stats.nodes      = level.nodes.size();
+  stats.subsectors = level.subsectors.size();
+  stats.segs       = level.segs.size();
+  stats.splits     = splits;
+  return stats;
+}
+
+/**
+ * @brief Check that the nodes of a level match its geometry
+ * @param level Level with the segs, subsectors and nodes read from its lumps
+ * @return true if every index is in range, every linedef side has a seg,
+ *         every seg lies on its linedef and every node child's bounding box
+ *         holds the segs under it
+ * @note Editors that change a map without rebuilding its nodes leave new
+ *       linedefs without segs, segs pointing past the linedefs, or segs and
+ *       bounding boxes where the moved linedefs used to be.
+ */
+bool nodesMatchLevel(const WAD::Level &level) {
+  if (level.segs.empty() || level.subsectors.empty() ||
+      (level.nodes.empty() && level.subsectors.size() > 1)) {
+    return false;
+  }
+
+  for (const WAD::Linedef &line : level.linedefs) {
+    if (line.start_vertex >= level.vertices.size() ||
+        line.end_vertex >= level.vertices.size()) {
+      return false;
+    }
+  }
+
+  // Sides of each linedef that have a seg; every seg must lie on its
+  // linedef, or the linedefs were moved since the nodes were built
+  std::vector<uint8_t> covered(level.linedefs.size(), 0);
+  for (const WAD::Seg &seg : level.segs) {
+    if (seg.start_vertex >= level.vertices.size() ||
+        seg.end_vertex >= level.vertices.size() ||
+        seg.linedef >= level.linedefs.size() || seg.direction > 1 ||
+        !hasSide(level, level.linedefs[seg.linedef], seg.direction)) {
+      return false;
+    }
+    const WAD::Linedef &line = level.linedefs[seg.linedef];
+    const WAD::Vertex  &a    = level.vertices[line.start_vertex];
+    const WAD::Vertex  &b    = level.vertices[line.end_vertex];
+    bool zeroLength = a.x == b.x && a.y == b.y;
+    if (!zeroLength && (!onLinedef(level.vertices[seg.start_vertex], a, b) ||
+                        !onLinedef(level.vertices[seg.end_vertex], a, b))) {
+      return false;
+    }
+    covered[seg.linedef] |= 1 << seg.direction;
+  }
+  for (std::size_t i = 0; i < level.linedefs.size(); i++) {
+    const WAD::Linedef &line = level.linedefs[i];
+    const WAD::Vertex  &a    = level.vertices[line.start_vertex];
+    const WAD::Vertex &b = level.vertices[line.end_vertex];
+    if (a.x == b.x && a.y == b.y) {
+      continue;  // Zero-length lines get no segs
+    }
+    for (int side = 0; side < 2; side++) {
+      if (hasSide(level, line, side) && (covered[i] & (1 << side)) == 0) {
+        return false;
+      }
+    }
+  }
+
+  std::vector<SegBox> subsectorBoxes(level.subsectors.size());
+  for (std::size_t i = 0; i < level.subsectors.size(); i++) {
+    const WAD::SubSector &subsector = level.subsectors[i];
+    if (subsector.seg_count == 0 ||
+        subsector.first_seg + subsector.seg_count > level.segs.size()) {
+      return false;
+    }
+    for (uint32_t s = 0; s < subsector.seg_count; s++) {
+      const WAD::Seg &seg = level.segs[subsector.first_seg + s];
+      subsectorBoxes[i].add(level.vertices[seg.start_vertex]);
+      subsectorBoxes[i].add(level.vertices[seg.end_vertex]);
+    }
+  }
+
+  // Children come before their parent, so the box of every child is known
+  // when its parent is checked
+  std::vector<SegBox> nodeBoxes(level.nodes.size());
+  for (std::size_t i = 0; i < level.nodes.size(); i++) {
+    const WAD::Node &node = level.nodes[i];
+    for (int side = 0; side < 2; side++) {
+      uint16_t child = node.children[side];
+      uint16_t index = child & ~WAD::kSubSector;
+      bool     leaf  = (child & WAD::kSubSector) != 0;
+      if (leaf ? index >= level.subsectors.size() : child >= i) {
+        return false;
+      }
+      const SegBox &box = leaf ? subsectorBoxes[index] : nodeBoxes[child];
+      if (!box.inside(node.bbox[side])) {
+        return false;
+      }
+      nodeBoxes[i].add(box);
+    }
+  }
+  return true;
+}
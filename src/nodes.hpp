@@ -0,0 +1,22 @@
+#ifndef NODES_HPP
+#define NODES_HPP
+
+#include "wad.hpp"
+#include <cstddef>
+
+// What buildNodes() produced
+struct NodeStats {
+  std::size_t nodes      = 0;
+  std::size_t subsectors = 0;
+  std::size_t segs       = 0;
+  std::size_t splits     = 0;  // Segs cut in two by a partition line
+};
+
+// Build the BSP tree of a level, replacing its segs, subsectors and nodes and
+// appending the vertices created by splits
+NodeStats buildNodes(WAD::Level &level);
+
+// Whether the nodes read from a level's lumps still match its geometry
+bool nodesMatchLevel(const WAD::Level &level);
+
+#endif  // NODES_HPP
@@ -0,0 +1,66 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Run fn(i) for every i in [0, count) spread over the available cores
+ * @param count Number of independent work items
+ * @param fn Callable taking the item index
+ * @note Items are handed out one at a time from a shared counter, so uneven
+ *       items (e.g. levels of very different size) still balance well. The
+ *       first exception thrown by any item is rethrown on the calling thread
+ *       once all workers have stopped.
+ */
+template <typename Fn>
+void parallelFor(std::size_t count, Fn &&fn) {
+  std::size_t workers =
+      std::min<std::size_t>(count, std::thread::hardware_concurrency());
+
+  if (workers <= 1) {
+    for (std::size_t i = 0; i < count; i++) {
+      fn(i);
+    }
+    return;
+  }
+
+  std::atomic<std::size_t> next{0};
+  std::exception_ptr       error;
+  std::mutex               errorMutex;
+
+  auto worker = [&]() {
+    for (std::size_t i = next++; i < count; i = next++) {
+      try {
+        fn(i);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(errorMutex);
+        if (!error) {
+          error = std::current_exception();
+        }
+        next = count;  // Stop handing out new items
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(workers - 1);
+  for (std::size_t t = 1; t < workers; t++) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+#endif  // PARALLEL_HPP
@@ -0,0 +1,209 @@
+#include "pipeline.hpp"
+#include "emitter.hpp"
+#include "wad.hpp"
+#include <chrono>
+#include <cstddef>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Milliseconds elapsed since a start point
+static double elapsedMs(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+namespace {
+
+// Serialize and write stages of one output. Levels arrive as shared
+// pointers, so every output reads the same loaded level.
+struct OutputStage {
+  OutputStage(const PipelineOutput &output, std::size_t levelQueueDepth,
+              std::size_t chunkQueueDepth)
+      : emitter(*output.emitter), path(output.path),
+        file(output.path, std::ios::binary), levels(levelQueueDepth),
+        chunks(chunkQueueDepth) {}
+
+  Emitter                                        &emitter;
+  const std::string                              &path;
+  std::ofstream                                   file;
+  BoundedQueue<std::shared_ptr<const WAD::Level>> levels;
+  BoundedQueue<std::string>                       chunks;
+  std::thread                                     serializer;
+  std::thread                                     writer;
+  std::exception_ptr                              serializeError;
+  std::exception_ptr                              writeError;
+};
+
+}  // namespace
+
+/**
+ * @brief Convert a WAD level by level: parse -> serialize -> write
+ * @param wad WAD with its directory read (assets are loaded here)
+ * @param outputs Emitters and their output files, all fed from one parse
+ * @param verbose Print stage timings
+ * @param levelQueueDepth Maximum number of loaded levels waiting to be
+ * serialized, per output
+ * @param chunkQueueDepth Maximum number of serialized chunks waiting to be
+ * written, per output
+ * @throws std::runtime_error if an output cannot be written or any stage
+ * fails
+ * @note The calling thread loads levels and every output gets its own
+ *       serializer thread, writer thread and file stream, connected by
+ *       bounded queues. Each loaded level is handed to all outputs and freed
+ *       once the last of them has converted it, so the WAD is parsed once
+ *       however many formats are written, and the slowest output sets the
+ *       pace. A level is written as soon as it has been converted, and at
+ *       most a few levels and chunks are in flight per output. If any stage
+ *       fails, every queue is closed so the other stages stop, and the first
+ *       error is rethrown here.
+ * @note Besides the queued items, the level being loaded, the level being
+ *       serialized and the chunk being written are held too: with both
+ *       depths at 1, at most three levels are in memory, plus, per output,
+ *       three serialized levels (one being produced, one queued, one being
+ *       written).
+ */
+void runPipeline(WAD &wad, const std::vector<PipelineOutput> &outputs,
+                 bool verbose, std::size_t levelQueueDepth,
+                 std::size_t chunkQueueDepth) {
+  std::vector<std::unique_ptr<OutputStage>> stages;
+  for (const PipelineOutput &output : outputs) {
+    stages.push_back(std::make_unique<OutputStage>(output, levelQueueDepth,
+                                                   chunkQueueDepth));
+    if (!stages.back()->file) {
+      throw std::runtime_error("Unable to open output file: " + output.path);
+    }
+  }
+
+  auto               start = std::chrono::steady_clock::now();
+  std::exception_ptr parseError;
+  std::size_t        levelCount = 0;
+
+  auto abort = [&]() {
+    for (const std::unique_ptr<OutputStage> &stage : stages) {
+      stage->levels.close();
+      stage->chunks.close();
+    }
+  };
+
+  for (const std::unique_ptr<OutputStage> &stagePtr : stages) {
+    OutputStage &stage = *stagePtr;
+
+    // Serialize stage: levels -> text chunks
+    stage.serializer = std::thread([&stage, &abort]() {
+      try {
+        if (!stage.chunks.push(stage.emitter.begin())) {
+          return;
+        }
+        while (std::optional<std::shared_ptr<const WAD::Level>> level =
+                   stage.levels.pop()) {
+          if (!stage.chunks.push(stage.emitter.level(**level))) {
+            return;
+          }
+        }
+        stage.chunks.push(stage.emitter.end());
+        stage.chunks.close();
+      } catch (...) {
+        stage.serializeError = std::current_exception();
+        abort();
+      }
+    });
+
+    // Write stage: text chunks -> output file
+    stage.writer = std::thread([&stage, &abort, start, verbose]() {
+      try {
+        bool firstByte = true;
+        while (std::optional<std::string> chunk = stage.chunks.pop()) {
+          stage.file.write(chunk->data(),
+                           static_cast<std::streamsize>(chunk->size()));
+          if (!stage.file) {
+            throw std::runtime_error("Unable to write output file: " +
+                                     stage.path);
+          }
+          if (verbose && firstByte && !chunk->empty()) {
+            std::cout << "Pipeline :: First byte written to " << stage.path
+                      << " after " << elapsedMs(start) << " ms\n";
+            firstByte = false;
+          }
+        }
+        stage.file.flush();
+      } catch (...) {
+        stage.writeError = std::current_exception();
+        abort();
+      }
+    });
+  }
+
+  // Parse stage: directory -> levels, handed to every output
+  try {
+    wad.processAssets();
+    for (std::size_t markerIndex : wad.levelMarkers()) {
+      std::shared_ptr<const WAD::Level> level =
+          std::make_shared<const WAD::Level>(wad.loadLevel(markerIndex));
+      bool open = true;
+      for (const std::unique_ptr<OutputStage> &stage : stages) {
+        open = stage->levels.push(level) && open;
+      }
+      if (!open) {
+        break;
+      }
+      levelCount++;
+    }
+    for (const std::unique_ptr<OutputStage> &stage : stages) {
+      stage->levels.close();
+    }
+  } catch (...) {
+    parseError = std::current_exception();
+    abort();
+  }
+
+  for (const std::unique_ptr<OutputStage> &stage : stages) {
+    stage->serializer.join();
+    stage->writer.join();
+  }
+
+  if (parseError) {
+    std::rethrow_exception(parseError);
+  }
+  for (const std::unique_ptr<OutputStage> &stage : stages) {
+    for (const std::exception_ptr &error :
+         {stage->serializeError, stage->writeError}) {
+      if (error) {
+        std::rethrow_exception(error);
+      }
+    }
+  }
+
+  if (verbose) {
+    std::cout << "Pipeline :: " << levelCount << " levels written in "
+              << elapsedMs(start) << " ms\n";
+  }
+}
+
+/**
+ * @brief Convert a WAD level by level into a single output
+ * @param wad WAD with its directory read (assets are loaded here)
+ * @param emitter Emitter for the output format
+ * @param destinationPath Output file
+ * @param verbose Print stage timings
+ * @param levelQueueDepth Maximum number of loaded levels waiting to be
+ * serialized
+ * @param chunkQueueDepth Maximum number of serialized chunks waiting to be
+ * written
+ * @throws std::runtime_error if the output cannot be written or any stage
+ * fails
+ */
+void runPipeline(WAD &wad, Emitter &emitter, const std::string &destinationPath,
+                 bool verbose, std::size_t levelQueueDepth,
+                 std::size_t chunkQueueDepth) {
+  runPipeline(wad, {{&emitter, destinationPath}}, verbose, levelQueueDepth,
+              chunkQueueDepth);
+}
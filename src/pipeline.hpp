@@ -0,0 +1,96 @@
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include "emitter.hpp"
+#include "wad.hpp"
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Fixed-capacity queue connecting two pipeline stages. push() blocks while
+ * the queue is full, which throttles a fast producer to the pace of its
+ * consumer (back-pressure), and pop() blocks while it is empty. close() wakes
+ * everybody up: consumers drain what is left and then stop, producers stop
+ * immediately.
+ */
+template <typename T>
+class BoundedQueue {
+public:
+  explicit BoundedQueue(std::size_t capacity) : capacity_(capacity) {}
+
+  // Add an item, waiting for room. Returns false if the queue was closed
+  bool push(T item) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    notFull_.wait(lock,
+                  [&] { return closed_ || items_.size() < capacity_; });
+    if (closed_) {
+      return false;
+    }
+    items_.push_back(std::move(item));
+    notEmpty_.notify_one();
+    return true;
+  }
+
+  // Take the next item, waiting for one. Returns nothing once closed and
+  // empty. The item is move-constructed out of the queue, so anything tied
+  // to it (like a level's arena) travels with it.
+  std::optional<T> pop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    notEmpty_.wait(lock, [&] { return closed_ || !items_.empty(); });
+    if (items_.empty()) {
+      return std::nullopt;
+    }
+    std::optional<T> item(std::move(items_.front()));
+    items_.pop_front();
+    notFull_.notify_one();
+    return item;
+  }
+
+  // No more items will be pushed
+  void close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    notEmpty_.notify_all();
+    notFull_.notify_all();
+  }
+
+private:
+  std::size_t             capacity_;
+  std::deque<T>           items_;
+  bool                    closed_ = false;
+  std::mutex              mutex_;
+  std::condition_variable notEmpty_;
+  std::condition_variable notFull_;
+};
+
+// Number of loaded levels waiting to be serialized
+constexpr std::size_t kLevelQueueDepth = 2;
+// Number of serialized chunks waiting to be written
+constexpr std::size_t kChunkQueueDepth = 8;
+
+// One output of a pipeline run: an emitter and the file it writes
+struct PipelineOutput {
+  Emitter    *emitter;
+  std::string path;
+};
+
+// Convert a WAD level by level: parse -> serialize -> write, into every output
+void runPipeline(WAD &wad, const std::vector<PipelineOutput> &outputs,
+                 bool        verbose,
+                 std::size_t levelQueueDepth = kLevelQueueDepth,
+                 std::size_t chunkQueueDepth = kChunkQueueDepth);
+
+// Convert a WAD level by level into a single output
+void runPipeline(WAD &wad, Emitter &emitter, const std::string &destinationPath,
+                 bool        verbose,
+                 std::size_t levelQueueDepth = kLevelQueueDepth,
+                 std::size_t chunkQueueDepth = kChunkQueueDepth);
+
+#endif  // PIPELINE_HPP
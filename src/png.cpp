@@ -0,0 +1,330 @@
+#include "png.hpp"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+// CRC-32 of the PNG chunks (polynomial 0xEDB88320)
+uint32_t crc32(const uint8_t *data, std::size_t size, uint32_t crc = 0) {
+  static const std::array<uint32_t, 256> table = []() {
+    std::array<uint32_t, 256> t{};
+    for (uint32_t n = 0; n < 256; n++) {
+      uint32_t c = n;
+      for (int k = 0; k < 8; k++) {
+        c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      }
+      t[n] = c;
+    }
+    return t;
+  }();
+
+  crc = ~crc;
+  for (std::size_t i = 0; i < size; i++) {
+    crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+// Adler-32 checksum of the zlib stream
+uint32_t adler32(const uint8_t *data, std::size_t size) {
+  uint32_t a = 1, b = 0;
+  while (size > 0) {
+    // 5552 bytes is the most that can be summed before b overflows
+    std::size_t block = std::min<std::size_t>(size, 5552);
+    for (std::size_t i = 0; i < block; i++) {
+      a += data[i];
+      b += a;
+    }
+    a %= 65521;
+    b %= 65521;
+    data += block;
+    size -= block;
+  }
+  return (b << 16) | a;
+}
+
+void appendU32BE(std::vector<uint8_t> &out, uint32_t value) {
+  out.push_back(static_cast<uint8_t>(value >> 24));
+  out.push_back(static_cast<uint8_t>(value >> 16));
+  out.push_back(static_cast<uint8_t>(value >> 8));
+  out.push_back(static_cast<uint8_t>(value));
+}
+
+// Deflate bit stream, least significant bit first
+class BitWriter {
+public:
+  explicit BitWriter(std::vector<uint8_t> &out) : out_(out) {}
+
+  void bits(uint32_t value, int count) {
+    buffer_ |= static_cast<uint64_t>(value) << used_;
+    used_ += count;
+    while (used_ >= 8) {
+      out_.push_back(static_cast<uint8_t>(buffer_));
+      buffer_ >>= 8;
+      used_ -= 8;
+    }
+  }
+
+  // Huffman codes are stored most significant bit first
+  void code(uint32_t code, int length) {
+    uint32_t reversed = 0;
+    for (int i = 0; i < length; i++) {
+      reversed |= ((code >> i) & 1) << (length - 1 - i);
+    }
+    bits(reversed, length);
+  }
+
+  void flush() {
+    if (used_ > 0) {
+      out_.push_back(static_cast<uint8_t>(buffer_));
+    }
+    buffer_ = 0;
+    used_   = 0;
+  }
+
+private:
+  std::vector<uint8_t> &out_;
+  uint64_t              buffer_ = 0;
+  int                   used_   = 0;
+};
+
+// Fixed Huffman code of a literal/length symbol (RFC 1951, 3.2.6)
+void literal(BitWriter &writer, int symbol) {
+  if (symbol < 144) {
+    writer.code(0x30 + symbol, 8);
+  } else if (symbol < 256) {
+    writer.code(0x190 + symbol - 144, 9);
+  } else if (symbol < 280) {
+    writer.code(symbol - 256, 7);
+  } else {
+    writer.code(0xC0 + symbol - 280, 8);
+  }
+}
+
+constexpr uint16_t kLengthBase[29]  = {3,  4,  5,  6,   7,   8,   9,   10,
+                                       11, 13, 15, 17,  19,  23,  27,  31,
+                                       35, 43, 51, 59,  67,  83,  99,  115,
+                                       131, 163, 195, 227, 258};
+constexpr uint8_t  kLengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                       1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                       4, 4, 4, 4, 5, 5, 5, 5, 0};
+constexpr uint16_t kDistBase[30]    = {
+    1,    2,    3,    4,    5,    7,     9,     13,    17,    25,
+    33,   49,   65,   97,   129,  193,   257,   385,   513,   769,
+    1025, 1537, 2049, 3073, 4097, 6145,  8193,  12289, 16385, 24577};
+constexpr uint8_t kDistExtra[30] = {0, 0, 0, 0, 1, 1, 2,  2,  3,  3,
+                                    4, 4, 5, 5, 6, 6, 7,  7,  8,  8,
+                                    9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+void match(BitWriter &writer, int length, int distance) {
+  int l = 28;
+  while (kLengthBase[l] > length) {
+    l--;
+  }
+  literal(writer, 257 + l);
+  writer.bits(length - kLengthBase[l], kLengthExtra[l]);
+
+  int d = 29;
+  while (kDistBase[d] > distance) {
+    d--;
+  }
+  writer.code(d, 5);
+  writer.bits(distance - kDistBase[d], kDistExtra[d]);
+}
+
+/**
+ * @brief Compress data into a zlib stream
+ * @note One fixed-Huffman deflate block. Matches are found greedily through
+ *       a hash of the next 3 bytes holding the last position seen, which
+ *       catches the long runs and repeated rows of texture pages.
+ */
+std::vector<uint8_t> zlibCompress(const std::vector<uint8_t> &data) {
+  constexpr int         kHashBits  = 15;
+  constexpr std::size_t kWindow    = 32768;
+  constexpr std::size_t kMaxLength = 258;
+
+  std::vector<uint8_t> out;
+  out.reserve(data.size() / 4 + 64);
+  out.push_back(0x78);  // Deflate, 32K window
+  out.push_back(0x01);  // No dictionary, fastest compression
+
+  BitWriter writer(out);
+  writer.bits(1, 1);  // Final block
+  writer.bits(1, 2);  // Fixed Huffman codes
+
+  std::vector<int64_t> head(std::size_t(1) << kHashBits, -1);
+  auto hash = [&](std::size_t i) {
+    uint32_t v = data[i] | (data[i + 1] << 8) | (data[i + 2] << 16);
+    return (v * 2654435761u) >> (32 - kHashBits);
+  };
+
+  std::size_t i = 0;
+  while (i < data.size()) {
+    std::size_t length = 0;
+    std::size_t distance = 0;
+    if (i + 3 <= data.size()) {
+      uint32_t h         = hash(i);
+      int64_t  candidate = head[h];
+      head[h]            = static_cast<int64_t>(i);
+      if (candidate >= 0 && i - candidate <= kWindow) {
+        std::size_t limit = std::min(kMaxLength, data.size() - i);
+        const uint8_t *a  = &data[candidate];
+        const uint8_t *b  = &data[i];
+        while (length < limit && a[length] == b[length]) {
+          length++;
+        }
+        distance = i - candidate;
+      }
+    }
+
+    if (length >= 3) {
+      match(writer, static_cast<int>(length), static_cast<int>(distance));
+      // Index the positions inside the match too, for the next ones
+      std::size_t end = i + length;
+      for (i++; i < end && i + 3 <= data.size(); i++) {
+        head[hash(i)] = static_cast<int64_t>(i);
+      }
+      i = end;
+    } else {
+      literal(writer, data[i]);
+      i++;
+    }
+  }
+  literal(writer, 256);  // End of block
+  writer.flush();
+
+  appendU32BE(out, adler32(data.data(), data.size()));
+  return out;
+}
+
+void appendChunk(std::vector<uint8_t> &png, const char *type,
+                 const std::vector<uint8_t> &data) {
+  appendU32BE(png, static_cast<uint32_t>(data.size()));
+  std::size_t start = png.size();
+  png.insert(png.end(), type, type + 4);
+  png.insert(png.end(), data.begin(), data.end());
+  appendU32BE(png, crc32(&png[start], png.size() - start));
+}
+
+uint8_t paeth(int a, int b, int c) {
+  int p  = a + b - c;
+  int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+  if (pa <= pb && pa <= pc) {
+    return static_cast<uint8_t>(a);
+  }
+  return static_cast<uint8_t>(pb <= pc ? b : c);
+}
+
+}  // namespace
+
+/**
+ * @brief Encode an RGBA image as a PNG file
+ * @param rgba Pixels, 4 bytes each, rows from top to bottom
+ * @param width Image width
+ * @param height Image height
+ * @return Contents of the PNG file
+ * @note Self-contained, there is no zlib dependency: each row gets the PNG
+ *       filter that makes it smallest, and the image data is compressed with
+ *       a greedy LZ77 pass and the fixed Huffman codes of deflate. Files are
+ *       larger than zlib's best but far smaller than raw pixels, and encoding
+ *       runs at memory speed.
+ */
+std::vector<uint8_t> encodePNG(const uint8_t *rgba, uint32_t width,
+                               uint32_t height) {
+  const std::size_t stride = static_cast<std::size_t>(width) * 4;
+
+  // Filter every row with the filter giving the smallest sum of absolute
+  // values (the usual heuristic), each row prefixed by its filter type
+  std::vector<uint8_t> filtered;
+  filtered.reserve((stride + 1) * height);
+  std::vector<uint8_t> candidates[5];
+  for (std::vector<uint8_t> &candidate : candidates) {
+    candidate.resize(stride);
+  }
+  std::vector<uint8_t> zeros(stride, 0);
+  for (uint32_t y = 0; y < height; y++) {
+    const uint8_t *row  = rgba + y * stride;
+    const uint8_t *up   = y > 0 ? row - stride : zeros.data();
+    uint64_t       best = UINT64_MAX;
+    int            type = 0;
+    for (int f = 0; f < 5; f++) {
+      uint8_t *out = candidates[f].data();
+      uint64_t sum = 0;
+      for (std::size_t x = 0; x < stride; x++) {
+        int a = x >= 4 ? row[x - 4] : 0;
+        int b = up[x];
+        int c = x >= 4 ? up[x - 4] : 0;
+        uint8_t value = row[x];
+        switch (f) {
+          case 1:
+            value -= a;
+            break;
+          case 2:
+            value -= b;
+            break;
+          case 3:
+            value -= static_cast<uint8_t>((a + b) / 2);
+            break;
+          case 4:
+            value -= paeth(a, b, c);
+            break;
+          default:
+            break;
+        }
+        out[x] = value;
+        sum += static_cast<int8_t>(value) < 0 ? 256 - value : value;
+      }
+      if (sum < best) {
+        best = sum;
+        type = f;
+      }
+    }
+    filtered.push_back(static_cast<uint8_t>(type));
+    filtered.insert(filtered.end(), candidates[type].begin(),
+                    candidates[type].end());
+  }
+
+  std::vector<uint8_t> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+  std::vector<uint8_t> header;
+  appendU32BE(header, width);
+  appendU32BE(header, height);
+  header.push_back(8);  // Bits per channel
+  header.push_back(6);  // RGBA
+  header.push_back(0);  // Deflate
+  header.push_back(0);  // Adaptive filtering
+  header.push_back(0);  // Not interlaced
+  appendChunk(png, "IHDR", header);
+  appendChunk(png, "IDAT", zlibCompress(filtered));
+  appendChunk(png, "IEND", {});
+  return png;
+}
+
+/**
+ * @brief Write an RGBA image to a PNG file
+ * @param path Output file
+ * @param rgba Pixels, 4 bytes each, rows from top to bottom
+ * @param width Image width
+ * @param height Image height
+ * @throws std::runtime_error if the file cannot be written
+ */
+void writePNG(const std::string &path, const uint8_t *rgba, uint32_t width,
+              uint32_t height) {
+  std::vector<uint8_t> png = encodePNG(rgba, width, height);
+  std::ofstream        file(path, std::ios::binary);
+  if (!file) {
+    throw std::runtime_error("Unable to open output file: " + path);
+  }
+  file.write(reinterpret_cast<const char *>(png.data()),
+             static_cast<std::streamsize>(png.size()));
+  if (!file) {
+    throw std::runtime_error("Unable to write output file: " + path);
+  }
+}
@@ -0,0 +1,16 @@
+#ifndef PNG_HPP
+#define PNG_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Encode an RGBA image as the bytes of a PNG file
+std::vector<uint8_t> encodePNG(const uint8_t *rgba, uint32_t width,
+                               uint32_t height);
+
+// Write an RGBA image to a PNG file
+void writePNG(const std::string &path, const uint8_t *rgba, uint32_t width,
+              uint32_t height);
+
+#endif  // PNG_HPP
@@ -0,0 +1,149 @@
+#include "readplan.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <fcntl.h>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+[[noreturn]] void truncated(uint64_t offset) {
+  throw std::runtime_error("Unable to read lump at offset " +
+                           std::to_string(offset) + ": truncated WAD file");
+}
+
+// Closes a file descriptor when going out of scope
+struct FileDescriptor {
+  int fd;
+  ~FileDescriptor() {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+};
+
+}  // namespace
+
+std::size_t ReadPlan::add(uint64_t offset, std::size_t size) {
+  ranges_.push_back({offset, size, nullptr});
+  return ranges_.size() - 1;
+}
+
+/**
+ * @brief Merge the ranges into runs
+ * @param order Set to the range indices sorted by offset
+ * @return Runs in file order; empty ranges belong to no run
+ */
+std::vector<ReadPlan::Run>
+ReadPlan::plan(std::vector<std::size_t> &order) const {
+  order.resize(ranges_.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+    return ranges_[a].offset < ranges_[b].offset;
+  });
+
+  std::vector<Run> runs;
+  for (std::size_t i = 0; i < order.size(); i++) {
+    const Range &range = ranges_[order[i]];
+    if (range.size == 0) {
+      continue;
+    }
+    uint64_t end = range.offset + range.size;
+    if (!runs.empty()) {
+      Run     &run    = runs.back();
+      uint64_t runEnd = run.offset + run.size;
+      if (range.offset <= runEnd + kMaxGap &&
+          std::max(end, runEnd) - run.offset <= kMaxRun) {
+        run.size = static_cast<std::size_t>(std::max(end, runEnd) - run.offset);
+        run.last = i + 1;
+        continue;
+      }
+    }
+    runs.push_back({range.offset, range.size, i, i + 1});
+  }
+  return runs;
+}
+
+/**
+ * @brief Read every lump added from a file
+ * @param path WAD file
+ * @throws std::runtime_error if the file cannot be opened or a lump extends
+ *         past its end
+ * @note Every run is hinted before the first one is read, so the kernel can
+ *       have them all in flight while the reads proceed in file order.
+ */
+void ReadPlan::read(const std::string &path) {
+  std::vector<std::size_t> order;
+  std::vector<Run>         runs = plan(order);
+  if (runs.empty()) {
+    return;
+  }
+
+  FileDescriptor file{open(path.c_str(), O_RDONLY)};
+  if (file.fd < 0) {
+    throw std::runtime_error("Unable to open file: " + path);
+  }
+#ifdef POSIX_FADV_WILLNEED
+  for (const Run &run : runs) {
+    posix_fadvise(file.fd, static_cast<off_t>(run.offset),
+                  static_cast<off_t>(run.size), POSIX_FADV_WILLNEED);
+  }
+#endif
+
+  buffers_.resize(runs.size());
+  for (std::size_t r = 0; r < runs.size(); r++) {
+    const Run            &run    = runs[r];
+    std::vector<uint8_t> &buffer = buffers_[r];
+    buffer.resize(run.size);
+    std::size_t done = 0;
+    while (done < run.size) {
+      ssize_t n = pread(file.fd, buffer.data() + done, run.size - done,
+                        static_cast<off_t>(run.offset + done));
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        // Only the lumps past the end of the file are missing; report the
+        // first of them as a single lump read would
+        for (std::size_t i = run.first; i < run.last; i++) {
+          const Range &range = ranges_[order[i]];
+          if (range.offset + range.size > run.offset + done) {
+            truncated(range.offset);
+          }
+        }
+        truncated(run.offset + done);
+      }
+      done += static_cast<std::size_t>(n);
+    }
+    reads_++;
+    bytesRead_ += run.size;
+
+    for (std::size_t i = run.first; i < run.last; i++) {
+      Range &range = ranges_[order[i]];
+      if (range.size > 0) {
+        range.data = buffer.data() + (range.offset - run.offset);
+      }
+    }
+  }
+}
+
+/**
+ * @brief Take every lump added from a WAD already in memory
+ * @param data File contents
+ * @param size File size
+ * @throws std::runtime_error if a lump extends past the end of the data
+ * @note The lumps point into data, which must outlive the plan.
+ */
+void ReadPlan::read(const uint8_t *data, std::size_t size) {
+  for (Range &range : ranges_) {
+    if (range.offset > size || range.size > size - range.offset) {
+      truncated(range.offset);
+    }
+    range.data = data + range.offset;
+  }
+}
@@ -0,0 +1,72 @@
+#ifndef READPLAN_HPP
+#define READPLAN_HPP
+
+#include "lump.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Reads a set of lumps with as few I/O calls as possible. Lumps are added
+ * first; read() then sorts them by file position, merges ranges that touch
+ * or lie close together into runs, hints the kernel to fetch every run
+ * ahead (posix_fadvise) and reads each run with a single pread. The lumps
+ * are slices of the run buffers, so nothing is copied after the read.
+ *
+ * Level lumps follow each other right after the marker and patches sit
+ * side by side between their markers, so a level or a whole patch section
+ * usually comes in one read instead of one open and seek per lump, which is
+ * what matters on cold caches and network storage.
+ */
+class ReadPlan {
+public:
+  // Gap between two lumps that is read through rather than starting a new
+  // read; skipping it would cost a request, reading it costs little
+  static constexpr std::size_t kMaxGap = 64 * 1024;
+  // Largest run made by merging; a single larger lump is still one read
+  static constexpr std::size_t kMaxRun = 16 * 1024 * 1024;
+
+  // Add a lump to read; returns its index for lump()
+  std::size_t add(uint64_t offset, std::size_t size);
+
+  // Read every lump added from a file
+  void read(const std::string &path);
+
+  // Take every lump added from a WAD already in memory, which must outlive
+  // the plan
+  void read(const uint8_t *data, std::size_t size);
+
+  // Bytes of a lump, once read; what names the lump in error messages
+  LumpBytes lump(std::size_t index, const char *what) const {
+    return LumpBytes(ranges_[index].data, ranges_[index].size, what);
+  }
+
+  // Number of reads issued and bytes they fetched, gaps included
+  std::size_t reads() const { return reads_; }
+  std::size_t bytesRead() const { return bytesRead_; }
+
+private:
+  struct Range {
+    uint64_t       offset;
+    std::size_t    size;
+    const uint8_t *data;  // Set by read()
+  };
+
+  // A merged read: first and one past last index in the sorted order
+  struct Run {
+    uint64_t    offset;
+    std::size_t size;
+    std::size_t first, last;
+  };
+
+  std::vector<Range>                ranges_;
+  std::vector<std::vector<uint8_t>> buffers_;  // One per run, file reads only
+  std::size_t                       reads_     = 0;
+  std::size_t                       bytesRead_ = 0;
+
+  // Merge the ranges into runs, over their indices sorted by offset
+  std::vector<Run> plan(std::vector<std::size_t> &order) const;
+};
+
+#endif  // READPLAN_HPP
@@ -0,0 +1,161 @@
+#include "shade.hpp"
+#include "wad.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SHADE_AVX2 1
+#include <immintrin.h>
+#else
+#define SHADE_AVX2 0
+#endif
+
+namespace {
+
+void shadeScalar(const uint32_t *colors, const uint8_t *indices,
+                 std::size_t count, uint8_t *rgba) {
+  for (std::size_t i = 0; i < count; i++) {
+    std::memcpy(rgba + i * 4, &colors[indices[i]], 4);
+  }
+}
+
+// Pixels first to count - 1; the mask is indexed from pixel 0
+void shadeMaskedScalar(const uint32_t *colors, const uint8_t *indices,
+                       const uint8_t *mask, std::size_t first,
+                       std::size_t count, uint8_t *rgba) {
+  for (std::size_t i = first; i < count; i++) {
+    uint32_t color = (mask[i >> 3] >> (i & 7)) & 1 ? colors[indices[i]] : 0;
+    std::memcpy(rgba + i * 4, &color, 4);
+  }
+}
+
+#if SHADE_AVX2
+
+// 8 pixels per step: widen the indices to 32 bits and gather their colours
+__attribute__((target("avx2"))) void
+shadeAVX2(const uint32_t *colors, const uint8_t *indices, std::size_t count,
+          uint8_t *rgba) {
+  const int  *table = reinterpret_cast<const int *>(colors);
+  std::size_t i     = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m128i bytes =
+        _mm_loadl_epi64(reinterpret_cast<const __m128i *>(indices + i));
+    __m256i color =
+        _mm256_i32gather_epi32(table, _mm256_cvtepu8_epi32(bytes), 4);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(rgba + i * 4), color);
+  }
+  shadeScalar(colors, indices + i, count - i, rgba + i * 4);
+}
+
+// Same, then each mask byte spread over the 8 lanes (lane k keeps bit k)
+// clears the transparent ones
+__attribute__((target("avx2"))) void
+shadeMaskedAVX2(const uint32_t *colors, const uint8_t *indices,
+                const uint8_t *mask, std::size_t count, uint8_t *rgba) {
+  const int    *table = reinterpret_cast<const int *>(colors);
+  const __m256i bits  = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+  std::size_t   i     = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m128i bytes =
+        _mm_loadl_epi64(reinterpret_cast<const __m128i *>(indices + i));
+    __m256i color =
+        _mm256_i32gather_epi32(table, _mm256_cvtepu8_epi32(bytes), 4);
+    __m256i opaque = _mm256_cmpeq_epi32(
+        _mm256_and_si256(_mm256_set1_epi32(mask[i >> 3]), bits), bits);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(rgba + i * 4),
+                        _mm256_and_si256(opaque, color));
+  }
+  shadeMaskedScalar(colors, indices, mask, i, count, rgba);
+}
+
+bool hasAVX2() {
+  static const bool supported = __builtin_cpu_supports("avx2") != 0;
+  return supported;
+}
+
+#endif
+
+}  // namespace
+
+/**
+ * @brief Resolve every light map of a COLORMAP through a palette
+ * @param palette PLAYPAL colours; missing entries are grey levels
+ * @param colormap COLORMAP lump, 256 indices per map; without it every
+ *        light level shows the palette unchanged
+ */
+LightTable::LightTable(const std::vector<WAD::Color> &palette,
+                       const std::vector<uint8_t>    &colormap) {
+  // Without COLORMAP a single identity map stands for every light level
+  std::size_t maps = std::max<std::size_t>(colormap.size() / 256, 1);
+  tables_.resize(maps * 256);
+  for (std::size_t map = 0; map < maps; map++) {
+    for (std::size_t i = 0; i < 256; i++) {
+      std::size_t index = colormap.empty() ? i : colormap[map * 256 + i];
+      uint8_t     rgba[4];
+      if (index < palette.size()) {
+        rgba[0] = palette[index].r;
+        rgba[1] = palette[index].g;
+        rgba[2] = palette[index].b;
+      } else {
+        rgba[0] = rgba[1] = rgba[2] = static_cast<uint8_t>(index);
+      }
+      rgba[3] = 255;
+      std::memcpy(&tables_[map * 256 + i], rgba, 4);
+    }
+  }
+}
+
+/**
+ * @brief COLORMAP map for a sector light level
+ * @param lightLevel Sector light level, 0 to 255
+ * @return Map index, 0 (full bright) to 31
+ * @note DOOM also darkens with distance; this is the map of a surface at
+ *       the distance where the sector light applies unscaled.
+ */
+int LightTable::mapForLight(int lightLevel) {
+  return (255 - std::clamp(lightLevel, 0, 255)) >> 3;
+}
+
+/**
+ * @brief Shade palette indices, as in a flat
+ * @param indices Palette indices
+ * @param count Number of pixels
+ * @param lightLevel Sector light level, 0 to 255
+ * @param rgba Output, 4 bytes per pixel, opaque
+ */
+void LightTable::shade(const uint8_t *indices, std::size_t count,
+                       int lightLevel, uint8_t *rgba) const {
+  const uint32_t *table = colors(mapForLight(lightLevel));
+#if SHADE_AVX2
+  if (hasAVX2()) {
+    shadeAVX2(table, indices, count, rgba);
+    return;
+  }
+#endif
+  shadeScalar(table, indices, count, rgba);
+}
+
+/**
+ * @brief Shade masked pixels, as in PatchData or a composed wall texture
+ * @param indices Palette indices
+ * @param mask Opacity, one bit per pixel: bit i % 8 of byte i / 8
+ * @param count Number of pixels
+ * @param lightLevel Sector light level, 0 to 255
+ * @param rgba Output, 4 bytes per pixel; transparent pixels are all zero
+ * @note With AVX2 one mask byte covers each step of 8 pixels.
+ */
+void LightTable::shadeMasked(const uint8_t *indices, const uint8_t *mask,
+                             std::size_t count, int lightLevel,
+                             uint8_t *rgba) const {
+  const uint32_t *table = colors(mapForLight(lightLevel));
+#if SHADE_AVX2
+  if (hasAVX2()) {
+    shadeMaskedAVX2(table, indices, mask, count, rgba);
+    return;
+  }
+#endif
+  shadeMaskedScalar(table, indices, mask, 0, count, rgba);
+}
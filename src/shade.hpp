@@ -0,0 +1,49 @@
+#ifndef SHADE_HPP
+#define SHADE_HPP
+
+#include "wad.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Palette-resolved light maps: for every COLORMAP light map, the RGBA colour
+ * of each of the 256 palette indices. Shading a texture at a light level is
+ * then one table lookup per pixel, done 8 pixels at a time with AVX2 gathers
+ * when the CPU has them. Built without a COLORMAP, the table expands palette
+ * indices to their plain palette colours.
+ */
+class LightTable {
+public:
+  // Light maps of COLORMAP, from full bright (0) to darkest (31)
+  static constexpr int kLightMaps = 32;
+
+  // Resolve every light map of a COLORMAP through a palette; without a
+  // COLORMAP every light level shows the palette unchanged
+  LightTable(const std::vector<WAD::Color> &palette,
+             const std::vector<uint8_t>    &colormap);
+
+  // Number of maps: 34 for DOOM (32 light levels, invulnerability, black)
+  std::size_t maps() const { return tables_.size() / 256; }
+
+  // COLORMAP map for a sector light level, 0 (full bright) to 31
+  static int mapForLight(int lightLevel);
+
+  // Colours of the 256 palette indices in a map, bytes R, G, B, A in memory
+  const uint32_t *colors(std::size_t map) const {
+    return &tables_[(map < maps() ? map : 0) * 256];
+  }
+
+  // Shade palette indices, as in a flat, into opaque RGBA pixels
+  void shade(const uint8_t *indices, std::size_t count, int lightLevel,
+             uint8_t *rgba) const;
+
+  // Shade masked pixels, as in PatchData or a composed wall texture
+  void shadeMasked(const uint8_t *indices, const uint8_t *mask,
+                   std::size_t count, int lightLevel, uint8_t *rgba) const;
+
+private:
+  std::vector<uint32_t> tables_;  // 256 colours per map
+};
+
+#endif  // SHADE_HPP
@@ -0,0 +1,213 @@
+#include "spatial.hpp"
+#include "wad.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace {
+
+constexpr uint16_t kNoSidedef = 0xFFFF;
+
+/**
+ * @brief Turn (key, value) pairs into compressed sparse rows
+ * @param pairs Pairs with keys below count, in increasing value order for
+ *        each key
+ * @param count Number of rows
+ * @param offsets Set to count + 1 row starts
+ * @param values Set to the values, row by row
+ * @note A counting sort: stable, so the values keep their order in a row.
+ */
+void toRows(const std::vector<std::pair<uint32_t, uint32_t>> &pairs,
+            std::size_t count, std::vector<uint32_t> &offsets,
+            std::vector<uint32_t> &values) {
+  offsets.assign(count + 1, 0);
+  for (const auto &pair : pairs) {
+    offsets[pair.first + 1]++;
+  }
+  for (std::size_t i = 0; i < count; i++) {
+    offsets[i + 1] += offsets[i];
+  }
+  values.resize(pairs.size());
+  std::vector<uint32_t> next(offsets.begin(), offsets.end() - 1);
+  for (const auto &pair : pairs) {
+    values[next[pair.first]++] = pair.second;
+  }
+}
+
+// Sector on one side of a linedef, or -1 if that side has none
+long sideSector(const WAD::Level &level, uint16_t sidedef) {
+  if (sidedef == kNoSidedef || sidedef >= level.sidedefs.size()) {
+    return -1;
+  }
+  uint16_t sector = level.sidedefs[sidedef].sector;
+  return sector < level.sectors.size() ? sector : -1;
+}
+
+}  // namespace
+
+/**
+ * @brief Build the sector adjacency graph of a level
+ * @param level Level with its linedefs, sidedefs and sectors
+ * @return Graph with an entry for every sector
+ * @note A linedef joins the sectors of its right and left sidedefs. Linedefs
+ *       with a side missing, sidedefs or sectors out of range and linedefs
+ *       with the same sector on both sides are left out. The graph is
+ *       symmetric: each joining linedef is listed from both sectors.
+ */
+SectorGraph buildSectorGraph(const WAD::Level &level) {
+  // Every joining linedef from both sides: (sector, neighbour, linedef)
+  struct Link {
+    uint32_t sector, neighbour, linedef;
+  };
+  std::vector<Link> links;
+  for (std::size_t i = 0; i < level.linedefs.size(); i++) {
+    const WAD::Linedef &line  = level.linedefs[i];
+    long                right = sideSector(level, line.right_sidedef);
+    long                left  = sideSector(level, line.left_sidedef);
+    if (right < 0 || left < 0 || right == left) {
+      continue;
+    }
+    auto r = static_cast<uint32_t>(right), l = static_cast<uint32_t>(left);
+    links.push_back({r, l, static_cast<uint32_t>(i)});
+    links.push_back({l, r, static_cast<uint32_t>(i)});
+  }
+  std::sort(links.begin(), links.end(), [](const Link &a, const Link &b) {
+    return std::tie(a.sector, a.neighbour, a.linedef) <
+           std::tie(b.sector, b.neighbour, b.linedef);
+  });
+
+  SectorGraph graph;
+  graph.offsets.assign(level.sectors.size() + 1, 0);
+  graph.linedef_offsets.push_back(0);
+  graph.linedefs.reserve(links.size());
+  for (std::size_t i = 0; i < links.size(); i++) {
+    const Link &link = links[i];
+    if (i == 0 || link.sector != links[i - 1].sector ||
+        link.neighbour != links[i - 1].neighbour) {
+      if (i > 0) {
+        graph.linedef_offsets.push_back(
+            static_cast<uint32_t>(graph.linedefs.size()));
+      }
+      graph.neighbours.push_back(link.neighbour);
+      graph.offsets[link.sector + 1]++;
+    }
+    graph.linedefs.push_back(link.linedef);
+  }
+  if (!links.empty()) {
+    graph.linedef_offsets.push_back(
+        static_cast<uint32_t>(graph.linedefs.size()));
+  }
+  for (std::size_t s = 0; s < level.sectors.size(); s++) {
+    graph.offsets[s + 1] += graph.offsets[s];
+  }
+  return graph;
+}
+
+/**
+ * @brief Build the uniform grid index of a level
+ * @param level Level with its vertices, linedefs and things
+ * @param cellSize Cell side in map units
+ * @return Grid covering every vertex and thing of the level; an empty level
+ *         gets a single cell
+ * @note A linedef is listed in every cell its segment passes through, found
+ *       by walking the grid along it; linedefs with a vertex out of range
+ *       are left out.
+ */
+GridIndex buildGridIndex(const WAD::Level &level, uint32_t cellSize) {
+  GridIndex grid;
+  grid.cell_size = std::max<uint32_t>(cellSize, 1);
+
+  // Bounds of the vertices and things
+  int32_t minX = std::numeric_limits<int32_t>::max(), minY = minX;
+  int32_t maxX = std::numeric_limits<int32_t>::min(), maxY = maxX;
+  auto    include = [&](int32_t x, int32_t y) {
+    minX = std::min(minX, x);
+    minY = std::min(minY, y);
+    maxX = std::max(maxX, x);
+    maxY = std::max(maxY, y);
+  };
+  for (const WAD::Vertex &v : level.vertices) {
+    include(v.x, v.y);
+  }
+  for (const WAD::Thing &t : level.things) {
+    include(t.x, t.y);
+  }
+  if (minX > maxX) {
+    minX = minY = maxX = maxY = 0;
+  }
+  grid.x       = minX;
+  grid.y       = minY;
+  grid.columns = static_cast<uint32_t>(maxX - minX) / grid.cell_size + 1;
+  grid.rows    = static_cast<uint32_t>(maxY - minY) / grid.cell_size + 1;
+  std::size_t cells = static_cast<std::size_t>(grid.columns) * grid.rows;
+
+  auto column = [&](int32_t x) {
+    return std::min<uint32_t>(static_cast<uint32_t>(x - minX) / grid.cell_size,
+                              grid.columns - 1);
+  };
+  auto row = [&](int32_t y) {
+    return std::min<uint32_t>(static_cast<uint32_t>(y - minY) / grid.cell_size,
+                              grid.rows - 1);
+  };
+
+  // Linedefs: walk the cells along each segment, one column or row
+  // boundary at a time, in the order the segment crosses them
+  std::vector<std::pair<uint32_t, uint32_t>> pairs;
+  pairs.reserve(level.linedefs.size() * 2);
+  for (std::size_t i = 0; i < level.linedefs.size(); i++) {
+    const WAD::Linedef &line = level.linedefs[i];
+    if (line.start_vertex >= level.vertices.size() ||
+        line.end_vertex >= level.vertices.size()) {
+      continue;
+    }
+    const WAD::Vertex &a = level.vertices[line.start_vertex];
+    const WAD::Vertex &b = level.vertices[line.end_vertex];
+
+    long   cx = column(a.x), cy = row(a.y);
+    long   ex = column(b.x), ey = row(b.y);
+    double dx = b.x - a.x, dy = b.y - a.y;
+    long   stepX = dx > 0 ? 1 : -1, stepY = dy > 0 ? 1 : -1;
+    // Distance along the segment, as a fraction of it, to the next column
+    // and row boundary, and between two boundaries
+    double cell   = grid.cell_size;
+    double inf    = std::numeric_limits<double>::infinity();
+    double edgeX  = minX + (cx + (stepX > 0 ? 1 : 0)) * cell;
+    double edgeY  = minY + (cy + (stepY > 0 ? 1 : 0)) * cell;
+    double nextX  = dx != 0 ? (edgeX - a.x) / dx : inf;
+    double nextY  = dy != 0 ? (edgeY - a.y) / dy : inf;
+    double deltaX = dx != 0 ? cell / std::fabs(dx) : inf;
+    double deltaY = dy != 0 ? cell / std::fabs(dy) : inf;
+
+    long steps = std::labs(ex - cx) + std::labs(ey - cy);
+    for (long s = 0;; s++) {
+      pairs.emplace_back(static_cast<uint32_t>(cy * grid.columns + cx),
+                         static_cast<uint32_t>(i));
+      if ((cx == ex && cy == ey) || s == steps) {
+        break;
+      }
+      if (nextX < nextY ? cx != ex : cy == ey) {
+        cx    += stepX;
+        nextX += deltaX;
+      } else {
+        cy    += stepY;
+        nextY += deltaY;
+      }
+    }
+  }
+  toRows(pairs, cells, grid.linedef_offsets, grid.linedefs);
+
+  pairs.clear();
+  for (std::size_t i = 0; i < level.things.size(); i++) {
+    const WAD::Thing &t = level.things[i];
+    pairs.emplace_back(row(t.y) * grid.columns + column(t.x),
+                       static_cast<uint32_t>(i));
+  }
+  toRows(pairs, cells, grid.thing_offsets, grid.things);
+  return grid;
+}
@@ -0,0 +1,53 @@
+#ifndef SPATIAL_HPP
+#define SPATIAL_HPP
+
+#include "wad.hpp"
+#include <cstdint>
+#include <vector>
+
+/**
+ * Sectors next to each other through two-sided linedefs, in compressed
+ * sparse row form. The neighbours of sector s are
+ * neighbours[offsets[s] .. offsets[s + 1]), in increasing order, and the
+ * linedefs joining s to its i-th neighbour (i an index into neighbours) are
+ * linedefs[linedef_offsets[i] .. linedef_offsets[i + 1]), also in order.
+ */
+struct SectorGraph {
+  std::vector<uint32_t> offsets;          // One per sector, plus one
+  std::vector<uint32_t> neighbours;       // Neighbour sector indices
+  std::vector<uint32_t> linedef_offsets;  // One per neighbour, plus one
+  std::vector<uint32_t> linedefs;         // Linedef indices
+};
+
+// Build the sector adjacency graph of a level, one entry per sector
+SectorGraph buildSectorGraph(const WAD::Level &level);
+
+/**
+ * Uniform grid over a level, listing the linedefs crossing each cell and the
+ * things standing in it, in compressed sparse row form like SectorGraph.
+ * Cell (column, row) has index row * columns + column, row 0 at the bottom;
+ * it covers x from x + column * cell_size and y from y + row * cell_size.
+ * Its linedefs are linedefs[linedef_offsets[c] .. linedef_offsets[c + 1])
+ * and its things things[thing_offsets[c] .. thing_offsets[c + 1]), both in
+ * increasing index order.
+ */
+struct GridIndex {
+  int32_t               x         = 0;  // Bottom left corner of the grid
+  int32_t               y         = 0;
+  uint32_t              cell_size = 0;  // Cell side, map units
+  uint32_t              columns   = 0;
+  uint32_t              rows      = 0;
+  std::vector<uint32_t> linedef_offsets;  // One per cell, plus one
+  std::vector<uint32_t> linedefs;         // Linedef indices
+  std::vector<uint32_t> thing_offsets;    // One per cell, plus one
+  std::vector<uint32_t> things;           // Thing indices
+};
+
+// Cell side of GridIndex by default: the 128 units of a DOOM BLOCKMAP block
+constexpr uint32_t kGridCellSize = 128;
+
+// Build the uniform grid index of a level, covering its vertices and things
+GridIndex buildGridIndex(const WAD::Level &level,
+                         uint32_t          cellSize = kGridCellSize);
+
+#endif  // SPATIAL_HPP
@@ -0,0 +1,325 @@
+#include "stats.hpp"
+#include "parallel.hpp"
+#include "wad.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <nlohmann/json.hpp>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Round to two decimals so the report stays compact
+static double round2(double value) {
+  return std::round(value * 100.0) / 100.0;
+}
+
+// Count a texture name unless it is empty or the "no texture" marker
+static void countName(std::map<std::string, uint32_t> &counts,
+                      const char                      *name) {
+  std::size_t len = strnlen(name, 8);
+  if (len == 0 || (len == 1 && name[0] == '-')) {
+    return;
+  }
+  counts[std::string(name, len)]++;
+}
+
+// Write a CSV field, quoted (with quotes doubled) when it holds a comma, a
+// quote or a line break
+static void writeCSVField(std::ostream &out, const std::string &field) {
+  if (field.find_first_of(",\"\r\n") == std::string::npos) {
+    out << field;
+    return;
+  }
+  out << '"';
+  for (char c : field) {
+    if (c == '"') {
+      out << '"';
+    }
+    out << c;
+  }
+  out << '"';
+}
+
+/**
+ * @brief Compute the analytics for a single level
+ * @param level Level to analyse
+ * @return LevelStats with all the aggregated values
+ * @note The geometry passes first copy the fields they need into flat
+ *       int32/float arrays, so the min/max, length and sum loops run over
+ *       contiguous lanes the compiler can vectorise, instead of striding
+ *       through the packed WAD structures. Out of range vertex or sidedef
+ *       references are skipped rather than trusted.
+ */
+LevelStats computeLevelStats(const WAD::Level &level) {
+  LevelStats stats;
+  stats.name     = std::string(level.name, strnlen(level.name, 8));
+  stats.vertices = level.vertices.size();
+  stats.linedefs = level.linedefs.size();
+  stats.sidedefs = level.sidedefs.size();
+  stats.sectors  = level.sectors.size();
+  stats.things   = level.things.size();
+
+  // Vertices as structure of arrays
+  std::size_t          numVertices = level.vertices.size();
+  std::vector<int32_t> xs(numVertices);
+  std::vector<int32_t> ys(numVertices);
+  for (std::size_t i = 0; i < numVertices; i++) {
+    xs[i] = level.vertices[i].x;
+    ys[i] = level.vertices[i].y;
+  }
+
+  // Bounding box
+  if (numVertices > 0) {
+    int32_t minX = xs[0], maxX = xs[0], minY = ys[0], maxY = ys[0];
+    for (std::size_t i = 1; i < numVertices; i++) {
+      minX = std::min(minX, xs[i]);
+      maxX = std::max(maxX, xs[i]);
+      minY = std::min(minY, ys[i]);
+      maxY = std::max(maxY, ys[i]);
+    }
+    stats.min_x = minX;
+    stats.min_y = minY;
+    stats.max_x = maxX;
+    stats.max_y = maxY;
+  }
+
+  // Gather linedef deltas, then compute all the lengths in one pass
+  std::vector<float> dx, dy;
+  dx.reserve(level.linedefs.size());
+  dy.reserve(level.linedefs.size());
+  for (const WAD::Linedef &l : level.linedefs) {
+    if (l.start_vertex < numVertices && l.end_vertex < numVertices) {
+      dx.push_back(static_cast<float>(xs[l.end_vertex] - xs[l.start_vertex]));
+      dy.push_back(static_cast<float>(ys[l.end_vertex] - ys[l.start_vertex]));
+    }
+  }
+
+  std::vector<float> lengths(dx.size());
+  for (std::size_t i = 0; i < dx.size(); i++) {
+    lengths[i] = std::sqrt(dx[i] * dx[i] + dy[i] * dy[i]);
+  }
+
+  if (!lengths.empty()) {
+    double total = 0.0;
+    float  minL  = lengths[0];
+    float  maxL  = lengths[0];
+    for (float len : lengths) {
+      total += len;
+      minL   = std::min(minL, len);
+      maxL   = std::max(maxL, len);
+    }
+    stats.linedef_total = round2(total);
+    stats.linedef_min   = round2(minL);
+    stats.linedef_max   = round2(maxL);
+  }
+
+  // Sector areas with the shoelace formula over each sector's boundary: a
+  // linedef adds its cross product to the sector on its right side and
+  // subtracts it from the sector on its left side
+  std::size_t         numSectors = level.sectors.size();
+  std::vector<double> areas(numSectors, 0.0);
+  auto                sectorOf = [&](uint16_t sidedef) -> std::size_t {
+    if (sidedef < level.sidedefs.size()) {
+      return level.sidedefs[sidedef].sector;
+    }
+    return std::numeric_limits<std::size_t>::max();
+  };
+  for (const WAD::Linedef &l : level.linedefs) {
+    if (l.start_vertex >= numVertices || l.end_vertex >= numVertices) {
+      continue;
+    }
+    double cross =
+        static_cast<double>(xs[l.start_vertex]) * ys[l.end_vertex] -
+        static_cast<double>(xs[l.end_vertex]) * ys[l.start_vertex];
+    std::size_t right = sectorOf(l.right_sidedef);
+    std::size_t left  = sectorOf(l.left_sidedef);
+    if (right < numSectors) {
+      areas[right] += cross;
+    }
+    if (left < numSectors) {
+      areas[left] -= cross;
+    }
+  }
+
+  if (numSectors > 0) {
+    int32_t floorMin  = level.sectors[0].floor_height;
+    int32_t ceilMax   = level.sectors[0].ceiling_height;
+    int32_t heightMin = std::numeric_limits<int32_t>::max();
+    int32_t heightMax = std::numeric_limits<int32_t>::min();
+    double  areaTotal = 0.0;
+    double  areaMin   = std::numeric_limits<double>::max();
+    double  areaMax   = 0.0;
+
+    for (std::size_t i = 0; i < numSectors; i++) {
+      const WAD::Sector &s      = level.sectors[i];
+      int32_t            height = s.ceiling_height - s.floor_height;
+      double             area   = std::fabs(areas[i]) * 0.5;
+
+      floorMin   = std::min<int32_t>(floorMin, s.floor_height);
+      ceilMax    = std::max<int32_t>(ceilMax, s.ceiling_height);
+      heightMin  = std::min(heightMin, height);
+      heightMax  = std::max(heightMax, height);
+      areaTotal += area;
+      areaMin    = std::min(areaMin, area);
+      areaMax    = std::max(areaMax, area);
+
+      stats.light_histogram[std::min<uint16_t>(s.light_level, 255) >> 4]++;
+      countName(stats.flats, s.floor_texture);
+      countName(stats.flats, s.ceiling_texture);
+    }
+
+    stats.floor_min  = floorMin;
+    stats.ceil_max   = ceilMax;
+    stats.height_min = heightMin;
+    stats.height_max = heightMax;
+    stats.area_total = round2(areaTotal);
+    stats.area_min   = round2(areaMin);
+    stats.area_max   = round2(areaMax);
+  }
+
+  for (const WAD::Sidedef &s : level.sidedefs) {
+    countName(stats.textures, s.upper_texture);
+    countName(stats.textures, s.lower_texture);
+    countName(stats.textures, s.middle_texture);
+  }
+
+  for (const WAD::Thing &t : level.things) {
+    stats.thing_types[t.type]++;
+  }
+
+  return stats;
+}
+
+/**
+ * @brief Compute the analytics of every level, in parallel across levels
+ * @param levels Levels to analyse
+ * @return One LevelStats per level, in the same order
+ */
+static std::vector<LevelStats>
+computeAllStats(const std::vector<WAD::Level> &levels) {
+  std::vector<LevelStats> result(levels.size());
+  parallelFor(levels.size(),
+              [&](std::size_t i) { result[i] = computeLevelStats(levels[i]); });
+  return result;
+}
+
+/**
+ * @brief Convert WAD data to a JSON analytics report
+ * @return JSON string with one compact object per level
+ * @note Each level object is written on a single line, so the report can be
+ *       grepped or diffed level by level.
+ */
+std::string WAD::toStats() const {
+  std::vector<LevelStats> all = computeAllStats(levels_);
+  std::ostringstream      out;
+
+  out << "{\n";
+  out << " \"wad\": "
+      << nlohmann::json(std::filesystem::path(filepath_).filename().string())
+             .dump()
+      << ",\n";
+  out << " \"levels\": [\n";
+
+  for (size_t i = 0; i < all.size(); i++) {
+    const LevelStats &s = all[i];
+    nlohmann::json    j;
+    j["name"]   = s.name;
+    j["counts"] = {{"v", s.vertices},
+                   {"l", s.linedefs},
+                   {"si", s.sidedefs},
+                   {"se", s.sectors},
+                   {"t", s.things}};
+    j["bbox"]   = {s.min_x, s.min_y, s.max_x, s.max_y};
+    j["linedef_length"] = {{"total", s.linedef_total},
+                           {"min", s.linedef_min},
+                           {"max", s.linedef_max}};
+    j["sector_height"]  = {{"floor_min", s.floor_min},
+                           {"ceil_max", s.ceil_max},
+                           {"min", s.height_min},
+                           {"max", s.height_max}};
+    j["sector_area"]    = {
+        {"total", s.area_total}, {"min", s.area_min}, {"max", s.area_max}};
+    j["light"]    = s.light_histogram;
+    j["textures"] = s.textures;
+    j["flats"]    = s.flats;
+
+    nlohmann::json things = nlohmann::json::object();
+    for (const auto &entry : s.thing_types) {
+      things[std::to_string(entry.first)] = entry.second;
+    }
+    j["things"] = things;
+
+    out << "  " << j.dump(-1);
+    if (i < all.size() - 1) {
+      out << ",";
+    }
+    out << "\n";
+  }
+
+  out << " ]\n";
+  out << "}\n";
+
+  return out.str();
+}
+
+/**
+ * @brief Convert WAD data to a CSV analytics report
+ * @return CSV string with a header row and one row per level
+ * @note Texture, flat and thing usage are packed into single columns as
+ *       `NAME=count` pairs separated by `;`. Fields holding a comma, a quote
+ *       or a line break (names are free-form bytes) are quoted as RFC 4180
+ *       describes.
+ */
+std::string WAD::toStatsCSV() const {
+  std::vector<LevelStats> all = computeAllStats(levels_);
+  std::ostringstream      out;
+
+  out << "level,vertices,linedefs,sidedefs,sectors,things,"
+         "min_x,min_y,max_x,max_y,"
+         "linedef_total,linedef_min,linedef_max,"
+         "floor_min,ceil_max,height_min,height_max,"
+         "area_total,area_min,area_max";
+  for (size_t b = 0; b < 16; b++) {
+    out << ",light_" << b * 16;
+  }
+  out << ",textures,flats,things\n";
+
+  for (const LevelStats &s : all) {
+    writeCSVField(out, s.name);
+    out << "," << s.vertices << "," << s.linedefs << ","
+        << s.sidedefs << "," << s.sectors << "," << s.things << "," << s.min_x
+        << "," << s.min_y << "," << s.max_x << "," << s.max_y << ","
+        << s.linedef_total << "," << s.linedef_min << "," << s.linedef_max
+        << "," << s.floor_min << "," << s.ceil_max << "," << s.height_min
+        << "," << s.height_max << "," << s.area_total << "," << s.area_min
+        << "," << s.area_max;
+    for (uint32_t count : s.light_histogram) {
+      out << "," << count;
+    }
+
+    auto packCounts = [&](const auto &counts) {
+      std::ostringstream packed;
+      bool               first = true;
+      for (const auto &entry : counts) {
+        if (!first) {
+          packed << ";";
+        }
+        packed << entry.first << "=" << entry.second;
+        first = false;
+      }
+      out << ",";
+      writeCSVField(out, packed.str());
+    };
+    packCounts(s.textures);
+    packCounts(s.flats);
+    packCounts(s.thing_types);
+    out << "\n";
+  }
+
+  return out.str();
+}
@@ -0,0 +1,57 @@
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include "wad.hpp"
+#include <array>
+#include <cstdint>
+#include <map>
+#include <string>
+
+/**
+ * Per-level analytics used by the `-stats` and `-statscsv` outputs. Every
+ * value is derived from the raw WAD::Level arrays, so the report can be
+ * produced without going through any of the text formats.
+ */
+struct LevelStats {
+  std::string name;
+
+  // Element counts
+  std::size_t vertices = 0;
+  std::size_t linedefs = 0;
+  std::size_t sidedefs = 0;
+  std::size_t sectors  = 0;
+  std::size_t things   = 0;
+
+  // Bounding box of all vertices
+  int32_t min_x = 0;
+  int32_t min_y = 0;
+  int32_t max_x = 0;
+  int32_t max_y = 0;
+
+  // Linedef lengths (map units)
+  double linedef_total = 0.0;
+  double linedef_min   = 0.0;
+  double linedef_max   = 0.0;
+
+  // Sector heights and areas (map units / square map units)
+  int32_t floor_min  = 0;
+  int32_t ceil_max   = 0;
+  int32_t height_min = 0;
+  int32_t height_max = 0;
+  double  area_total = 0.0;
+  double  area_min   = 0.0;
+  double  area_max   = 0.0;
+
+  // Sector light levels in 16 buckets of 16 (DOOM's own light granularity)
+  std::array<uint32_t, 16> light_histogram{};
+
+  // Usage counts, sorted by key for stable output
+  std::map<std::string, uint32_t> textures;  // Wall textures (sidedefs)
+  std::map<std::string, uint32_t> flats;     // Floor/ceiling textures
+  std::map<uint16_t, uint32_t>    thing_types;
+};
+
+// Compute the analytics for a single level
+LevelStats computeLevelStats(const WAD::Level &level);
+
+#endif  // STATS_HPP
@@ -0,0 +1,23 @@
+#ifndef STRINGS_HPP
+#define STRINGS_HPP
+
+#include <cstddef>
+#include <string>
+
+// Local trimFixedString implementation
+inline std::string trimString(const std::string &str, size_t maxLen) {
+  static const std::string whitespace = " \t\n\r\f\v";
+  std::string              result;
+  if (str.length() > maxLen) {
+    result = str.substr(0, maxLen);
+  } else {
+    result = str;
+  }
+  size_t last = result.find_last_not_of(whitespace);
+  if (last == std::string::npos) {
+    return "";
+  }
+  return result.substr(0, last + 1);
+}
+
+#endif  // STRINGS_HPP
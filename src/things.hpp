@@ -0,0 +1,259 @@
+#ifndef THINGS_HPP
+#define THINGS_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/**
+ * Thing categories, used to group DoomEd numbers in the outputs.
+ */
+enum class ThingCategory : std::uint8_t {
+  PlayerStart,
+  Monster,
+  Weapon,
+  Ammo,
+  Health,
+  Armor,
+  Powerup,
+  Key,
+  Obstacle,
+  Decoration,
+  Special
+};
+
+// Thing behaviour flags
+namespace ThingFlags {
+  constexpr std::uint8_t None     = 0;
+  constexpr std::uint8_t Monster  = 1 << 0;  // Counts as a monster (kills)
+  constexpr std::uint8_t Pickup   = 1 << 1;  // Picked up by the player
+  constexpr std::uint8_t Obstacle = 1 << 2;  // Blocks movement
+  constexpr std::uint8_t Hangs    = 1 << 3;  // Hangs from the ceiling
+  constexpr std::uint8_t Counted  = 1 << 4;  // Counts for item percentage
+}  // namespace ThingFlags
+
+// Static description of a DoomEd thing type
+struct ThingInfo {
+  std::uint16_t type;    // DoomEd number, as stored in Thing::type
+  const char   *name;    // Name used in the JSON and DSL outputs
+  ThingCategory category;
+  std::uint8_t  radius;  // Collision radius in map units
+  std::uint8_t  flags;   // ThingFlags
+};
+
+// Player 1 start, the thing used for Level::player_start
+constexpr std::uint16_t kPlayer1Start = 1;
+
+// clang-format off
+constexpr ThingInfo kThingTable[] = {
+    // Player starts and other specials
+    {1, "PlayerStart", ThingCategory::PlayerStart, 16, ThingFlags::None},
+    {2, "Player2Start", ThingCategory::PlayerStart, 16, ThingFlags::None},
+    {3, "Player3Start", ThingCategory::PlayerStart, 16, ThingFlags::None},
+    {4, "Player4Start", ThingCategory::PlayerStart, 16, ThingFlags::None},
+    {11, "DeathmatchStart", ThingCategory::Special, 20, ThingFlags::None},
+    {14, "TeleportDestination", ThingCategory::Special, 20, ThingFlags::None},
+    {87, "BossTarget", ThingCategory::Special, 20, ThingFlags::None},
+    {88, "BossBrain", ThingCategory::Monster, 16, ThingFlags::Obstacle},
+    {89, "BossShooter", ThingCategory::Special, 20, ThingFlags::None},
+
+    // Monsters
+    {3004, "Zombieman", ThingCategory::Monster, 20, ThingFlags::Monster | ThingFlags::Obstacle},
+    {9, "ShotgunGuy", ThingCategory::Monster, 20, ThingFlags::Monster | ThingFlags::Obstacle},
+    {65, "HeavyWeaponDude", ThingCategory::Monster, 20, ThingFlags::Monster | ThingFlags::Obstacle},
+    {3001, "Imp", ThingCategory::Monster, 20, ThingFlags::Monster | ThingFlags::Obstacle},
+    {3002, "Demon", ThingCategory::Monster, 30, ThingFlags::Monster | ThingFlags::Obstacle},
+    {58, "Spectre", ThingCategory::Monster, 30, ThingFlags::Monster | ThingFlags::Obstacle},
+    {3006, "LostSoul", ThingCategory::Monster, 16, ThingFlags::Monster | ThingFlags::Obstacle},
+    {3005, "Cacodemon", ThingCategory::Monster, 31, ThingFlags::Monster | ThingFlags::Obstacle},
+    {69, "HellKnight", ThingCategory::Monster, 24, ThingFlags::Monster | ThingFlags::Obstacle},
+    {3003, "BaronOfHell", ThingCategory::Monster, 24, ThingFlags::Monster | ThingFlags::Obstacle},
+    {68, "Arachnotron", ThingCategory::Monster, 64, ThingFlags::Monster | ThingFlags::Obstacle},
+    {71, "PainElemental", ThingCategory::Monster, 31, ThingFlags::Monster | ThingFlags::Obstacle},
+    {66, "Revenant", ThingCategory::Monster, 20, ThingFlags::Monster | ThingFlags::Obstacle},
+    {67, "Mancubus", ThingCategory::Monster, 48, ThingFlags::Monster | ThingFlags::Obstacle},
+    {64, "ArchVile", ThingCategory::Monster, 20, ThingFlags::Monster | ThingFlags::Obstacle},
+    {7, "SpiderMastermind", ThingCategory::Monster, 128, ThingFlags::Monster | ThingFlags::Obstacle},
+    {16, "Cyberdemon", ThingCategory::Monster, 40, ThingFlags::Monster | ThingFlags::Obstacle},
+    {84, "WolfensteinSS", ThingCategory::Monster, 20, ThingFlags::Monster | ThingFlags::Obstacle},
+    {72, "CommanderKeen", ThingCategory::Monster, 16, ThingFlags::Monster | ThingFlags::Obstacle | ThingFlags::Hangs},
+
+    // Weapons
+    {2005, "Chainsaw", ThingCategory::Weapon, 20, ThingFlags::Pickup},
+    {2001, "Shotgun", ThingCategory::Weapon, 20, ThingFlags::Pickup},
+    {82, "SuperShotgun", ThingCategory::Weapon, 20, ThingFlags::Pickup},
+    {2002, "Chaingun", ThingCategory::Weapon, 20, ThingFlags::Pickup},
+    {2003, "RocketLauncher", ThingCategory::Weapon, 20, ThingFlags::Pickup},
+    {2004, "PlasmaGun", ThingCategory::Weapon, 20, ThingFlags::Pickup},
+    {2006, "BFG9000", ThingCategory::Weapon, 20, ThingFlags::Pickup},
+
+    // Ammunition
+    {2007, "Clip", ThingCategory::Ammo, 20, ThingFlags::Pickup},
+    {2048, "AmmoBox", ThingCategory::Ammo, 20, ThingFlags::Pickup},
+    {2008, "Shells", ThingCategory::Ammo, 20, ThingFlags::Pickup},
+    {2049, "ShellBox", ThingCategory::Ammo, 20, ThingFlags::Pickup},
+    {2010, "Rocket", ThingCategory::Ammo, 20, ThingFlags::Pickup},
+    {2046, "RocketBox", ThingCategory::Ammo, 20, ThingFlags::Pickup},
+    {2047, "Cell", ThingCategory::Ammo, 20, ThingFlags::Pickup},
+    {17, "CellPack", ThingCategory::Ammo, 20, ThingFlags::Pickup},
+    {8, "Backpack", ThingCategory::Ammo, 20, ThingFlags::Pickup},
+
+    // Health and armor
+    {2011, "Stimpack", ThingCategory::Health, 20, ThingFlags::Pickup},
+    {2012, "Medikit", ThingCategory::Health, 20, ThingFlags::Pickup},
+    {2014, "HealthBonus", ThingCategory::Health, 20, ThingFlags::Pickup | ThingFlags::Counted},
+    {2015, "ArmorBonus", ThingCategory::Armor, 20, ThingFlags::Pickup | ThingFlags::Counted},
+    {2018, "GreenArmor", ThingCategory::Armor, 20, ThingFlags::Pickup},
+    {2019, "BlueArmor", ThingCategory::Armor, 20, ThingFlags::Pickup},
+
+    // Powerups
+    {2013, "Soulsphere", ThingCategory::Powerup, 20, ThingFlags::Pickup | ThingFlags::Counted},
+    {83, "Megasphere", ThingCategory::Powerup, 20, ThingFlags::Pickup | ThingFlags::Counted},
+    {2022, "Invulnerability", ThingCategory::Powerup, 20, ThingFlags::Pickup | ThingFlags::Counted},
+    {2023, "Berserk", ThingCategory::Powerup, 20, ThingFlags::Pickup | ThingFlags::Counted},
+    {2024, "Invisibility", ThingCategory::Powerup, 20, ThingFlags::Pickup | ThingFlags::Counted},
+    {2025, "RadiationSuit", ThingCategory::Powerup, 20, ThingFlags::Pickup},
+    {2026, "ComputerMap", ThingCategory::Powerup, 20, ThingFlags::Pickup | ThingFlags::Counted},
+    {2045, "LightAmpGoggles", ThingCategory::Powerup, 20, ThingFlags::Pickup | ThingFlags::Counted},
+
+    // Keys
+    {5, "BlueKeycard", ThingCategory::Key, 20, ThingFlags::Pickup},
+    {40, "BlueSkullKey", ThingCategory::Key, 20, ThingFlags::Pickup},
+    {13, "RedKeycard", ThingCategory::Key, 20, ThingFlags::Pickup},
+    {38, "RedSkullKey", ThingCategory::Key, 20, ThingFlags::Pickup},
+    {6, "YellowKeycard", ThingCategory::Key, 20, ThingFlags::Pickup},
+    {39, "YellowSkullKey", ThingCategory::Key, 20, ThingFlags::Pickup},
+
+    // Obstacles
+    {2035, "ExplodingBarrel", ThingCategory::Obstacle, 10, ThingFlags::Obstacle},
+    {70, "BurningBarrel", ThingCategory::Obstacle, 16, ThingFlags::Obstacle},
+    {25, "ImpaledHuman", ThingCategory::Obstacle, 16, ThingFlags::Obstacle},
+    {26, "TwitchingImpaledHuman", ThingCategory::Obstacle, 16, ThingFlags::Obstacle},
+    {27, "SkullOnPole", ThingCategory::Obstacle, 16, ThingFlags::Obstacle},
+    {28, "SkullShishKebab", ThingCategory::Obstacle, 16, ThingFlags::Obstacle},
+    {29, "PileOfSkullsAndCandles", ThingCategory::Obstacle, 16, ThingFlags::Obstacle},
+    {30, "TallGreenPillar", ThingCategory::Obstacle, 16, ThingFlags::Obstacle},
+    {31, "ShortGreenPillar", ThingCategory::Obstacle, 16, ThingFlags::Obstacle},
+    {32, "TallRedPillar", ThingCategory::Obstacle, 16, ThingFlags::Obstacle},
+    {33, "ShortRedPillar", ThingCategory::Obstacle, 16, ThingFlags::Obstacle},
+    {35, "Candelabra", ThingCategory::Obstacle, 16, ThingFlags::Obstacle},
+    {36, "ShortGreenPillarWithHeart", ThingCategory::Obstacle, 16, ThingFlags::Obstacle},
+    {37, "ShortRedPillarWithSkull", ThingCategory::Obstacle, 16, ThingFlags::Obstacle},
+    {41, "EvilEye", ThingCategory::Obstacle, 16, ThingFlags::Obstacle},
+    {42, "FloatingSkull", ThingCategory::Obstacle, 16, ThingFlags::Obstacle},
+    {43, "BurntTree", ThingCategory::Obstacle, 16, ThingFlags::Obstacle},
+    {44, "TallBlueFirestick", ThingCategory::Obstacle, 16, ThingFlags::Obstacle},
+    {45, "TallGreenFirestick", ThingCategory::Obstacle, 16, ThingFlags::Obstacle},
+    {46, "TallRedFirestick", ThingCategory::Obstacle, 16, ThingFlags::Obstacle},
+    {47, "Stalagmite", ThingCategory::Obstacle, 16, ThingFlags::Obstacle},
+    {48, "TallTechnoPillar", ThingCategory::Obstacle, 16, ThingFlags::Obstacle},
+    {49, "HangingVictimTwitching", ThingCategory::Obstacle, 16, ThingFlags::Obstacle | ThingFlags::Hangs},
+    {50, "HangingVictimArmsOut", ThingCategory::Obstacle, 16, ThingFlags::Obstacle | ThingFlags::Hangs},
+    {51, "HangingVictimOneLegged", ThingCategory::Obstacle, 16, ThingFlags::Obstacle | ThingFlags::Hangs},
+    {52, "HangingPairOfLegs", ThingCategory::Obstacle, 16, ThingFlags::Obstacle | ThingFlags::Hangs},
+    {53, "HangingLeg", ThingCategory::Obstacle, 16, ThingFlags::Obstacle | ThingFlags::Hangs},
+    {54, "LargeBrownTree", ThingCategory::Obstacle, 32, ThingFlags::Obstacle},
+    {55, "ShortBlueFirestick", ThingCategory::Obstacle, 16, ThingFlags::Obstacle},
+    {56, "ShortGreenFirestick", ThingCategory::Obstacle, 16, ThingFlags::Obstacle},
+    {57, "ShortRedFirestick", ThingCategory::Obstacle, 16, ThingFlags::Obstacle},
+    {73, "HangingVictimGutsRemoved", ThingCategory::Obstacle, 16, ThingFlags::Obstacle | ThingFlags::Hangs},
+    {74, "HangingVictimGutsAndBrainRemoved", ThingCategory::Obstacle, 16, ThingFlags::Obstacle | ThingFlags::Hangs},
+    {75, "HangingTorsoLookingDown", ThingCategory::Obstacle, 16, ThingFlags::Obstacle | ThingFlags::Hangs},
+    {76, "HangingTorsoOpenSkull", ThingCategory::Obstacle, 16, ThingFlags::Obstacle | ThingFlags::Hangs},
+    {77, "HangingTorsoLookingUp", ThingCategory::Obstacle, 16, ThingFlags::Obstacle | ThingFlags::Hangs},
+    {78, "HangingTorsoBrainRemoved", ThingCategory::Obstacle, 16, ThingFlags::Obstacle | ThingFlags::Hangs},
+    {85, "TallTechnoFloorLamp", ThingCategory::Obstacle, 16, ThingFlags::Obstacle},
+    {86, "ShortTechnoFloorLamp", ThingCategory::Obstacle, 16, ThingFlags::Obstacle},
+    {2028, "FloorLamp", ThingCategory::Obstacle, 16, ThingFlags::Obstacle},
+
+    // Decorations (no collision)
+    {10, "BloodyMess", ThingCategory::Decoration, 20, ThingFlags::None},
+    {12, "BloodyMess2", ThingCategory::Decoration, 20, ThingFlags::None},
+    {15, "DeadPlayer", ThingCategory::Decoration, 20, ThingFlags::None},
+    {18, "DeadZombieman", ThingCategory::Decoration, 20, ThingFlags::None},
+    {19, "DeadShotgunGuy", ThingCategory::Decoration, 20, ThingFlags::None},
+    {20, "DeadImp", ThingCategory::Decoration, 20, ThingFlags::None},
+    {21, "DeadDemon", ThingCategory::Decoration, 20, ThingFlags::None},
+    {22, "DeadCacodemon", ThingCategory::Decoration, 20, ThingFlags::None},
+    {23, "DeadLostSoul", ThingCategory::Decoration, 20, ThingFlags::None},
+    {24, "PoolOfBloodAndGuts", ThingCategory::Decoration, 20, ThingFlags::None},
+    {34, "Candle", ThingCategory::Decoration, 20, ThingFlags::None},
+    {59, "HangingVictimArmsOutNoBlock", ThingCategory::Decoration, 20, ThingFlags::Hangs},
+    {60, "HangingPairOfLegsNoBlock", ThingCategory::Decoration, 20, ThingFlags::Hangs},
+    {61, "HangingVictimOneLeggedNoBlock", ThingCategory::Decoration, 20, ThingFlags::Hangs},
+    {62, "HangingLegNoBlock", ThingCategory::Decoration, 20, ThingFlags::Hangs},
+    {63, "HangingVictimTwitchingNoBlock", ThingCategory::Decoration, 20, ThingFlags::Hangs},
+    {79, "PoolOfBloodAndBones", ThingCategory::Decoration, 20, ThingFlags::None},
+    {80, "PoolOfBlood", ThingCategory::Decoration, 20, ThingFlags::None},
+    {81, "PoolOfBrains", ThingCategory::Decoration, 20, ThingFlags::None},
+};
+// clang-format on
+
+constexpr std::size_t kThingTableSize =
+    sizeof(kThingTable) / sizeof(kThingTable[0]);
+
+// Highest DoomEd number in the table, bounds the dense lookup below
+constexpr std::uint16_t maxThingType() {
+  std::uint16_t max = 0;
+  for (std::size_t i = 0; i < kThingTableSize; i++) {
+    if (kThingTable[i].type > max) {
+      max = kThingTable[i].type;
+    }
+  }
+  return max;
+}
+
+constexpr std::uint16_t kMaxThingType = maxThingType();
+constexpr std::uint8_t  kNoThingInfo  = 0xFF;
+static_assert(kThingTableSize < kNoThingInfo, "thing table too large");
+
+// Dense DoomEd number -> table index map, built at compile time
+constexpr std::array<std::uint8_t, kMaxThingType + 1> buildThingIndex() {
+  std::array<std::uint8_t, kMaxThingType + 1> index{};
+  for (std::size_t i = 0; i <= kMaxThingType; i++) {
+    index[i] = kNoThingInfo;
+  }
+  for (std::size_t i = 0; i < kThingTableSize; i++) {
+    index[kThingTable[i].type] = static_cast<std::uint8_t>(i);
+  }
+  return index;
+}
+
+constexpr std::array<std::uint8_t, kMaxThingType + 1> kThingIndex =
+    buildThingIndex();
+
+/**
+ * @brief Look up a DoomEd thing type
+ * @param type DoomEd number (Thing::type)
+ * @return The thing description, or nullptr for unknown types
+ * @note A bounds check and two array reads, no hashing or string work.
+ */
+constexpr const ThingInfo *thingInfo(std::uint16_t type) {
+  if (type > kMaxThingType || kThingIndex[type] == kNoThingInfo) {
+    return nullptr;
+  }
+  return &kThingTable[kThingIndex[type]];
+}
+
+/**
+ * @brief Look up a thing type by the name used in the outputs
+ * @param name Thing name, e.g. "PlayerStart"
+ * @return The thing description, or nullptr for unknown names
+ * @note A linear scan, only used when importing converted levels back.
+ */
+constexpr const ThingInfo *thingInfoByName(std::string_view name) {
+  for (std::size_t i = 0; i < kThingTableSize; i++) {
+    if (name == kThingTable[i].name) {
+      return &kThingTable[i];
+    }
+  }
+  return nullptr;
+}
+
+static_assert(thingInfo(kPlayer1Start) != nullptr &&
+                  thingInfo(3001)->category == ThingCategory::Monster &&
+                  thingInfo(0) == nullptr,
+              "thing lookup table is inconsistent");
+
+#endif  // THINGS_HPP
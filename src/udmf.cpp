@@ -0,0 +1,881 @@
+#include "udmf.hpp"
+#include "wad.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace {
+
+bool isIdentStart(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+bool isIdentChar(char c) { return isIdentStart(c) || (c >= '0' && c <= '9'); }
+
+bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+bool isSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' ||
+         c == '\v';
+}
+
+}  // namespace
+
+/**
+ * @brief Read the next token
+ * @return Next token, of type End once the text is exhausted
+ * @throws std::runtime_error on an unterminated string or comment
+ */
+UDMFToken UDMFTokenizer::next() {
+  const std::size_t size = text_.size();
+
+  // Whitespace and comments
+  while (pos_ < size) {
+    char c = text_[pos_];
+    if (isSpace(c)) {
+      pos_++;
+    } else if (c == '/' && pos_ + 1 < size && text_[pos_ + 1] == '/') {
+      std::size_t end = text_.find('\n', pos_ + 2);
+      pos_            = end == std::string_view::npos ? size : end + 1;
+    } else if (c == '/' && pos_ + 1 < size && text_[pos_ + 1] == '*') {
+      std::size_t end = text_.find("*/", pos_ + 2);
+      if (end == std::string_view::npos) {
+        throw std::runtime_error("Malformed TEXTMAP lump at line " +
+                                 std::to_string(lineAt(pos_)) +
+                                 ": unterminated comment");
+      }
+      pos_ = end + 2;
+    } else {
+      break;
+    }
+  }
+
+  if (pos_ >= size) {
+    return {UDMFToken::Type::End, {}, size};
+  }
+
+  std::size_t start = pos_;
+  char        c     = text_[pos_];
+
+  if (c == '"') {
+    std::size_t end = start + 1;
+    while (end < size && text_[end] != '"') {
+      end += text_[end] == '\\' ? 2 : 1;
+    }
+    if (end >= size) {
+      throw std::runtime_error("Malformed TEXTMAP lump at line " +
+                               std::to_string(lineAt(start)) +
+                               ": unterminated string");
+    }
+    pos_ = end + 1;
+    return {UDMFToken::Type::String, text_.substr(start + 1, end - start - 1),
+            start};
+  }
+
+  if (isIdentStart(c)) {
+    while (pos_ < size && isIdentChar(text_[pos_])) {
+      pos_++;
+    }
+    return {UDMFToken::Type::Identifier, text_.substr(start, pos_ - start),
+            start};
+  }
+
+  if (isDigit(c) || ((c == '-' || c == '+' || c == '.') && pos_ + 1 < size &&
+                     (isDigit(text_[pos_ + 1]) || text_[pos_ + 1] == '.'))) {
+    // Integers are decimal, octal or 0x hexadecimal; anything with a point
+    // or (outside hexadecimal) an exponent is a float
+    pos_++;
+    bool hex = c == '0' && pos_ < size &&
+               (text_[pos_] == 'x' || text_[pos_] == 'X');
+    if (!hex && (c == '-' || c == '+') && pos_ + 1 < size &&
+        text_[pos_] == '0') {
+      hex = text_[pos_ + 1] == 'x' || text_[pos_ + 1] == 'X';
+    }
+    bool isFloat = c == '.';
+    while (pos_ < size) {
+      char d = text_[pos_];
+      if (isDigit(d) || (hex && isIdentChar(d))) {
+        pos_++;
+      } else if (d == '.') {
+        isFloat = true;
+        pos_++;
+      } else if (!hex && (d == 'e' || d == 'E')) {
+        isFloat = true;
+        pos_++;
+        if (pos_ < size && (text_[pos_] == '-' || text_[pos_] == '+')) {
+          pos_++;
+        }
+      } else {
+        break;
+      }
+    }
+    return {isFloat ? UDMFToken::Type::Float : UDMFToken::Type::Integer,
+            text_.substr(start, pos_ - start), start};
+  }
+
+  pos_++;
+  return {UDMFToken::Type::Symbol, text_.substr(start, 1), start};
+}
+
+/**
+ * @brief Line number of a byte offset
+ * @param offset Byte offset in the text
+ * @return Line number, from 1
+ * @note Only used for error messages, so lines are counted on demand instead
+ *       of being tracked for every token.
+ */
+std::size_t UDMFTokenizer::lineAt(std::size_t offset) const {
+  offset = std::min(offset, text_.size());
+  return 1 + static_cast<std::size_t>(
+                 std::count(text_.begin(), text_.begin() + offset, '\n'));
+}
+
+namespace {
+
+// Blocks of a TEXTMAP lump that end up in a WAD::Level
+enum class Block { Vertex, Linedef, Sidedef, Sector, Thing, Other };
+
+Block blockType(std::string_view name) {
+  constexpr std::pair<std::string_view, Block> blocks[] = {
+      {"vertex", Block::Vertex}, {"linedef", Block::Linedef},
+      {"sidedef", Block::Sidedef}, {"sector", Block::Sector},
+      {"thing", Block::Thing}};
+  for (const auto &[blockName, block] : blocks) {
+    if (name == blockName) {
+      return block;
+    }
+  }
+  return Block::Other;
+}
+
+// Fields of the block being parsed, with the defaults of the specification
+struct BlockFields {
+  double           x = 0, y = 0, height = 0;
+  long long        v1 = -1, v2 = -1, sidefront = -1, sideback = -1;
+  long long        special = 0, id = -1, args[5] = {};
+  long long        offsetx = 0, offsety = 0, sector = -1;
+  long long        heightfloor = 0, heightceiling = 0, lightlevel = 160;
+  long long        angle = 0, type = 0;
+  uint16_t         flags = 0, hexenFlags = 0, activation = 0;
+  bool             single = false, skill[5] = {};
+  std::string_view texturetop = "-", texturebottom = "-",
+                   texturemiddle = "-", texturefloor, textureceiling;
+};
+
+// Activation keys of a linedef, as bits of BlockFields::activation
+enum : uint16_t {
+  kPlayerCross  = 0x0001,
+  kPlayerUse    = 0x0002,
+  kMonsterCross = 0x0004,
+  kMonsterUse   = 0x0008,
+  kImpact       = 0x0010,
+  kPlayerPush   = 0x0020,
+  kMonsterPush  = 0x0040,
+  kMissileCross = 0x0080,
+  kPassUse      = 0x0100,
+  kAnyCross     = 0x0200,
+};
+
+// Hexen activation (SPAC value) of each activation key set, in the order
+// ZDoom reads them back: the key of the player, and the one of monsters
+// that kHexenMonsterActivate adds to it
+struct Trigger {
+  uint16_t spac;
+  uint16_t player;
+  uint16_t monster;
+};
+constexpr Trigger kTriggers[] = {
+    {7, kAnyCross, 0},
+    {6, kPlayerUse | kPassUse, kMonsterUse},
+    {0, kPlayerCross, kMonsterCross},
+    {1, kPlayerUse, kMonsterUse},
+    {4, kPlayerPush, kMonsterPush},
+    {2, kMonsterCross, 0},
+    {3, kImpact, 0},
+    {5, kMissileCross, 0},
+    {1, kMonsterUse, 0},
+    {4, kMonsterPush, 0},
+};
+
+/**
+ * @brief Fold the activation keys of a linedef into its Hexen flag bits
+ * @param activation Keys set, as bits of BlockFields::activation
+ * @return SPAC value and monster bit, as the Hexen LINEDEFS flags hold them
+ * @note Hexen has room for one activation: the first trigger all of whose
+ *       player keys are set wins, and monsters get kHexenMonsterActivate
+ *       when their key for the same trigger is set too (a monster-only use
+ *       or push also needs the bit).
+ */
+uint16_t hexenActivation(uint16_t activation) {
+  for (const Trigger &t : kTriggers) {
+    if ((activation & t.player) != t.player) {
+      continue;
+    }
+    bool monsters = (activation & t.monster) != 0 ||
+                    ((t.player & (kMonsterUse | kMonsterPush)) != 0);
+    return static_cast<uint16_t>(
+        (t.spac << WAD::kHexenActivationShift) |
+        (monsters ? WAD::kHexenMonsterActivate : 0));
+  }
+  return 0;
+}
+
+// Keys of each block and the field they go to
+struct Key {
+  Block            block;
+  std::string_view name;
+  enum Kind { Integer, Number, String, Flag, HexenFlag, Activation } kind;
+  long long BlockFields::*integer = nullptr;
+  double BlockFields::*number     = nullptr;
+  std::string_view BlockFields::*string = nullptr;
+  uint16_t flag = 0;
+};
+
+constexpr Key kKeys[] = {
+    {Block::Vertex, "x", Key::Number, nullptr, &BlockFields::x},
+    {Block::Vertex, "y", Key::Number, nullptr, &BlockFields::y},
+
+    {Block::Linedef, "v1", Key::Integer, &BlockFields::v1},
+    {Block::Linedef, "v2", Key::Integer, &BlockFields::v2},
+    {Block::Linedef, "sidefront", Key::Integer, &BlockFields::sidefront},
+    {Block::Linedef, "sideback", Key::Integer, &BlockFields::sideback},
+    {Block::Linedef, "special", Key::Integer, &BlockFields::special},
+    {Block::Linedef, "id", Key::Integer, &BlockFields::id},
+    {Block::Linedef, "blocking", Key::Flag, nullptr, nullptr, nullptr, 0x0001},
+    {Block::Linedef, "blockmonsters", Key::Flag, nullptr, nullptr, nullptr,
+     0x0002},
+    {Block::Linedef, "twosided", Key::Flag, nullptr, nullptr, nullptr, 0x0004},
+    {Block::Linedef, "dontpegtop", Key::Flag, nullptr, nullptr, nullptr,
+     0x0008},
+    {Block::Linedef, "dontpegbottom", Key::Flag, nullptr, nullptr, nullptr,
+     0x0010},
+    {Block::Linedef, "secret", Key::Flag, nullptr, nullptr, nullptr, 0x0020},
+    {Block::Linedef, "blocksound", Key::Flag, nullptr, nullptr, nullptr,
+     0x0040},
+    {Block::Linedef, "dontdraw", Key::Flag, nullptr, nullptr, nullptr, 0x0080},
+    {Block::Linedef, "mapped", Key::Flag, nullptr, nullptr, nullptr, 0x0100},
+    {Block::Linedef, "repeatspecial", Key::Flag, nullptr, nullptr, nullptr,
+     WAD::kHexenRepeatSpecial},
+    {Block::Linedef, "playercross", Key::Activation, nullptr, nullptr,
+     nullptr, kPlayerCross},
+    {Block::Linedef, "playeruse", Key::Activation, nullptr, nullptr, nullptr,
+     kPlayerUse},
+    {Block::Linedef, "monstercross", Key::Activation, nullptr, nullptr,
+     nullptr, kMonsterCross},
+    {Block::Linedef, "monsteruse", Key::Activation, nullptr, nullptr, nullptr,
+     kMonsterUse},
+    {Block::Linedef, "impact", Key::Activation, nullptr, nullptr, nullptr,
+     kImpact},
+    {Block::Linedef, "playerpush", Key::Activation, nullptr, nullptr, nullptr,
+     kPlayerPush},
+    {Block::Linedef, "monsterpush", Key::Activation, nullptr, nullptr,
+     nullptr, kMonsterPush},
+    {Block::Linedef, "missilecross", Key::Activation, nullptr, nullptr,
+     nullptr, kMissileCross},
+    {Block::Linedef, "passuse", Key::Activation, nullptr, nullptr, nullptr,
+     kPassUse},
+    {Block::Linedef, "anycross", Key::Activation, nullptr, nullptr, nullptr,
+     kAnyCross},
+
+    {Block::Sidedef, "offsetx", Key::Integer, &BlockFields::offsetx},
+    {Block::Sidedef, "offsety", Key::Integer, &BlockFields::offsety},
+    {Block::Sidedef, "texturetop", Key::String, nullptr, nullptr,
+     &BlockFields::texturetop},
+    {Block::Sidedef, "texturebottom", Key::String, nullptr, nullptr,
+     &BlockFields::texturebottom},
+    {Block::Sidedef, "texturemiddle", Key::String, nullptr, nullptr,
+     &BlockFields::texturemiddle},
+    {Block::Sidedef, "sector", Key::Integer, &BlockFields::sector},
+
+    {Block::Sector, "heightfloor", Key::Integer, &BlockFields::heightfloor},
+    {Block::Sector, "heightceiling", Key::Integer,
+     &BlockFields::heightceiling},
+    {Block::Sector, "texturefloor", Key::String, nullptr, nullptr,
+     &BlockFields::texturefloor},
+    {Block::Sector, "textureceiling", Key::String, nullptr, nullptr,
+     &BlockFields::textureceiling},
+    {Block::Sector, "lightlevel", Key::Integer, &BlockFields::lightlevel},
+    {Block::Sector, "special", Key::Integer, &BlockFields::special},
+    {Block::Sector, "id", Key::Integer, &BlockFields::id},
+
+    {Block::Thing, "x", Key::Number, nullptr, &BlockFields::x},
+    {Block::Thing, "y", Key::Number, nullptr, &BlockFields::y},
+    {Block::Thing, "height", Key::Number, nullptr, &BlockFields::height},
+    {Block::Thing, "angle", Key::Integer, &BlockFields::angle},
+    {Block::Thing, "type", Key::Integer, &BlockFields::type},
+    {Block::Thing, "id", Key::Integer, &BlockFields::id},
+    {Block::Thing, "special", Key::Integer, &BlockFields::special},
+    {Block::Thing, "ambush", Key::Flag, nullptr, nullptr, nullptr, 0x0008},
+    {Block::Thing, "dormant", Key::HexenFlag, nullptr, nullptr, nullptr,
+     WAD::kHexenDormant},
+    {Block::Thing, "class1", Key::HexenFlag, nullptr, nullptr, nullptr,
+     WAD::kHexenFighter},
+    {Block::Thing, "class2", Key::HexenFlag, nullptr, nullptr, nullptr,
+     WAD::kHexenCleric},
+    {Block::Thing, "class3", Key::HexenFlag, nullptr, nullptr, nullptr,
+     WAD::kHexenMage},
+    {Block::Thing, "coop", Key::HexenFlag, nullptr, nullptr, nullptr,
+     WAD::kHexenCoop},
+    {Block::Thing, "dm", Key::HexenFlag, nullptr, nullptr, nullptr,
+     WAD::kHexenDeathmatch},
+};
+
+// Parser state: the tokenizer plus error reporting
+class Parser {
+public:
+  explicit Parser(std::string_view text) : tokens_(text) {}
+
+  UDMFToken next() { return tokens_.next(); }
+
+  [[noreturn]] void fail(const UDMFToken &token, const std::string &what) {
+    throw std::runtime_error("Malformed TEXTMAP lump at line " +
+                             std::to_string(tokens_.lineAt(token.offset)) +
+                             ": " + what);
+  }
+
+  void expect(const UDMFToken &token, char symbol) {
+    if (token.type != UDMFToken::Type::Symbol || token.text[0] != symbol) {
+      fail(token, std::string("expected '") + symbol + "'");
+    }
+  }
+
+  long long integer(const UDMFToken &token) {
+    if (token.type == UDMFToken::Type::Float) {
+      return std::llround(number(token));
+    }
+    if (token.type != UDMFToken::Type::Integer) {
+      fail(token, "expected an integer");
+    }
+    std::string_view text     = token.text;
+    bool             negative = false;
+    if (text[0] == '-' || text[0] == '+') {
+      negative = text[0] == '-';
+      text.remove_prefix(1);
+    }
+    int base = 10;
+    if (text.size() > 2 && text[0] == '0' &&
+        (text[1] == 'x' || text[1] == 'X')) {
+      base = 16;
+      text.remove_prefix(2);
+    } else if (text.size() > 1 && text[0] == '0') {
+      base = 8;
+    }
+    long long value = 0;
+    auto [end, ec]  = std::from_chars(text.data(), text.data() + text.size(),
+                                      value, base);
+    if (ec != std::errc() || end != text.data() + text.size()) {
+      fail(token, "invalid integer " + std::string(token.text));
+    }
+    return negative ? -value : value;
+  }
+
+  double number(const UDMFToken &token) {
+    if (token.type == UDMFToken::Type::Integer) {
+      return static_cast<double>(integer(token));
+    }
+    if (token.type != UDMFToken::Type::Float || token.text.size() >= 64) {
+      fail(token, "expected a number");
+    }
+    // strtod needs a terminated string; tokens point into the lump
+    char buffer[64];
+    std::memcpy(buffer, token.text.data(), token.text.size());
+    buffer[token.text.size()] = '\0';
+    return std::strtod(buffer, nullptr);
+  }
+
+  bool boolean(const UDMFToken &token) {
+    if (token.type == UDMFToken::Type::Identifier) {
+      if (token.text == "true") {
+        return true;
+      }
+      if (token.text == "false") {
+        return false;
+      }
+    }
+    fail(token, "expected true or false");
+  }
+
+  std::string_view string(const UDMFToken &token) {
+    if (token.type != UDMFToken::Type::String) {
+      fail(token, "expected a string");
+    }
+    return token.text;
+  }
+
+private:
+  UDMFTokenizer tokens_;
+};
+
+int16_t toInt16(double value) {
+  double rounded = std::round(value);
+  return static_cast<int16_t>(std::clamp(rounded, -32768.0, 32767.0));
+}
+
+uint16_t toUInt16(long long value) {
+  return static_cast<uint16_t>(std::clamp<long long>(value, 0, 65535));
+}
+
+// Sidedef references: -1 (none) becomes the DOOM 0xFFFF
+uint16_t toIndex(long long value) {
+  return value < 0 ? 0xFFFF : toUInt16(value);
+}
+
+void copyName(std::string_view name, char (&dest)[8]) {
+  std::memset(dest, 0, sizeof(dest));
+  std::memcpy(dest, name.data(), std::min<std::size_t>(name.size(), 8));
+}
+
+/**
+ * @brief Store one key = value pair of a block
+ * @note Keys the level has no room for are skipped.
+ */
+void assign(Parser &parser, Block block, std::string_view key,
+            const UDMFToken &value, BlockFields &f) {
+  if (block == Block::Other) {
+    return;
+  }
+
+  // Special arguments and thing skills are numbered keys
+  if ((block == Block::Linedef || block == Block::Thing) && key.size() == 4 &&
+      key.substr(0, 3) == "arg" && key[3] >= '0' && key[3] <= '4') {
+    f.args[key[3] - '0'] = parser.integer(value);
+    return;
+  }
+  if (block == Block::Thing && key.size() == 6 && key.substr(0, 5) == "skill" &&
+      key[5] >= '1' && key[5] <= '5') {
+    f.skill[key[5] - '1'] = parser.boolean(value);
+    return;
+  }
+  if (block == Block::Thing && key == "single") {
+    f.single = parser.boolean(value);
+    return;
+  }
+
+  for (const Key &k : kKeys) {
+    if (k.block != block || k.name != key) {
+      continue;
+    }
+    switch (k.kind) {
+      case Key::Integer:
+        f.*k.integer = parser.integer(value);
+        break;
+      case Key::Number:
+        f.*k.number = parser.number(value);
+        break;
+      case Key::String:
+        f.*k.string = parser.string(value);
+        break;
+      case Key::Flag:
+        if (parser.boolean(value)) {
+          f.flags |= k.flag;
+        }
+        break;
+      case Key::HexenFlag:
+        if (parser.boolean(value)) {
+          f.hexenFlags |= k.flag;
+        }
+        break;
+      case Key::Activation:
+        if (parser.boolean(value)) {
+          f.activation |= k.flag;
+        }
+        break;
+    }
+    return;
+  }
+}
+
+/**
+ * @brief Append a finished block to the level
+ */
+void store(Parser &parser, Block block, const BlockFields &f,
+           const UDMFToken &start, WAD::Level &level) {
+  switch (block) {
+    case Block::Vertex:
+      level.vertices.push_back({toInt16(f.x), toInt16(f.y)});
+      break;
+
+    case Block::Linedef: {
+      if (f.v1 < 0 || f.v2 < 0 || f.sidefront < 0) {
+        parser.fail(start, "linedef without v1, v2 or sidefront");
+      }
+      WAD::Linedef linedef;
+      linedef.start_vertex  = toUInt16(f.v1);
+      linedef.end_vertex    = toUInt16(f.v2);
+      linedef.flags         = f.flags | hexenActivation(f.activation);
+      linedef.line_type     = toUInt16(f.special);
+      linedef.sector_tag    = f.id < 0 ? 0 : toUInt16(f.id);
+      linedef.right_sidedef = toIndex(f.sidefront);
+      linedef.left_sidedef  = toIndex(f.sideback);
+      level.linedefs.push_back(linedef);
+
+      WAD::LinedefArgs args;
+      for (int a = 0; a < 5; a++) {
+        args.args[a] = static_cast<int32_t>(f.args[a]);
+      }
+      level.linedef_args.push_back(args);
+      break;
+    }
+
+    case Block::Sidedef: {
+      if (f.sector < 0) {
+        parser.fail(start, "sidedef without sector");
+      }
+      WAD::Sidedef sidedef;
+      sidedef.x_offset = toInt16(static_cast<double>(f.offsetx));
+      sidedef.y_offset = toInt16(static_cast<double>(f.offsety));
+      copyName(f.texturetop, sidedef.upper_texture);
+      copyName(f.texturebottom, sidedef.lower_texture);
+      copyName(f.texturemiddle, sidedef.middle_texture);
+      sidedef.sector = toUInt16(f.sector);
+      level.sidedefs.push_back(sidedef);
+      break;
+    }
+
+    case Block::Sector: {
+      WAD::Sector sector;
+      sector.floor_height   = toInt16(static_cast<double>(f.heightfloor));
+      sector.ceiling_height = toInt16(static_cast<double>(f.heightceiling));
+      copyName(f.texturefloor, sector.floor_texture);
+      copyName(f.textureceiling, sector.ceiling_texture);
+      sector.light_level = toUInt16(f.lightlevel);
+      sector.type        = toUInt16(f.special);
+      sector.tag         = f.id < 0 ? 0 : toUInt16(f.id);
+      level.sectors.push_back(sector);
+      break;
+    }
+
+    case Block::Thing: {
+      // Skills 1-2, 3 and 4-5 share the three DOOM skill bits
+      WAD::Thing thing;
+      thing.x     = toInt16(f.x);
+      thing.y     = toInt16(f.y);
+      thing.angle = toUInt16(f.angle);
+      thing.type  = toUInt16(f.type);
+      thing.flags = f.flags;
+      if (f.skill[0] || f.skill[1]) {
+        thing.flags |= 0x0001;
+      }
+      if (f.skill[2]) {
+        thing.flags |= 0x0002;
+      }
+      if (f.skill[3] || f.skill[4]) {
+        thing.flags |= 0x0004;
+      }
+      if (!f.single) {
+        thing.flags |= 0x0010;  // Multiplayer only
+      }
+      level.things.push_back(thing);
+
+      WAD::ThingArgs args;
+      args.tid         = f.id < 0 ? 0 : toUInt16(f.id);
+      args.z           = toInt16(f.height);
+      args.special     = toUInt16(f.special);
+      args.hexen_flags = f.hexenFlags | (f.single ? WAD::kHexenSingle : 0);
+      for (int a = 0; a < 5; a++) {
+        args.args[a] = static_cast<int32_t>(f.args[a]);
+      }
+      level.thing_args.push_back(args);
+      break;
+    }
+
+    case Block::Other:
+      break;
+  }
+}
+
+/**
+ * Text of a TEXTMAP lump, written block by block: one key per line, and the
+ * keys at their default value left out.
+ */
+class Writer {
+public:
+  void block(const char *name, std::size_t index) {
+    text_ += name;
+    text_ += " // ";
+    text_ += std::to_string(index);
+    text_ += "\n{\n";
+  }
+  void end() { text_ += "}\n\n"; }
+
+  void integer(const char *key, long long value) {
+    text_ += key;
+    text_ += " = ";
+    text_ += std::to_string(value);
+    text_ += ";\n";
+  }
+  // Coordinates are floats in UDMF; ours are whole map units
+  void number(const char *key, long long value) {
+    text_ += key;
+    text_ += " = ";
+    text_ += std::to_string(value);
+    text_ += ".0;\n";
+  }
+  void string(const char *key, std::string_view value) {
+    text_ += key;
+    text_ += " = \"";
+    for (char c : value) {
+      if (c == '"' || c == '\\') {
+        text_ += '\\';
+      }
+      text_ += c;
+    }
+    text_ += "\";\n";
+  }
+  void name(const char *key, const char (&value)[8]) {
+    string(key, std::string_view(value, strnlen(value, 8)));
+  }
+  void flag(std::string_view key) {
+    text_ += key;
+    text_ += " = true;\n";
+  }
+  // The boolean keys of a block whose bit is set in flags
+  void flags(Block block, Key::Kind kind, uint16_t flags) {
+    for (const Key &k : kKeys) {
+      if (k.block == block && k.kind == kind && (flags & k.flag)) {
+        flag(k.name);
+      }
+    }
+  }
+  // The activation keys of a linedef from its Hexen flag bits, the inverse
+  // of hexenActivation(); a line with no special and the default
+  // activation (player cross) gets none
+  void activation(uint16_t flags, uint16_t special) {
+    uint16_t spac =
+        (flags & WAD::kHexenActivation) >> WAD::kHexenActivationShift;
+    bool monsters = (flags & WAD::kHexenMonsterActivate) != 0;
+    if (spac == 0 && !monsters && special == 0) {
+      return;
+    }
+    for (const Trigger &t : kTriggers) {
+      if (t.spac == spac) {
+        uint16_t keys = t.player | (monsters ? t.monster : 0);
+        for (const Key &k : kKeys) {
+          if (k.block == Block::Linedef && k.kind == Key::Activation &&
+              (keys & k.flag)) {
+            flag(k.name);
+          }
+        }
+        return;
+      }
+    }
+  }
+  void args(const int32_t (&values)[5]) {
+    static const char *const names[] = {"arg0", "arg1", "arg2", "arg3",
+                                        "arg4"};
+    for (int a = 0; a < 5; a++) {
+      if (values[a] != 0) {
+        integer(names[a], values[a]);
+      }
+    }
+  }
+
+  std::string &text() { return text_; }
+
+private:
+  std::string text_;
+};
+
+}  // namespace
+
+/**
+ * @brief Parse a TEXTMAP lump into a level
+ * @param text Contents of the lump
+ * @param level Level to fill: geometry, things and their specials
+ * @throws std::runtime_error if the text is not valid UDMF
+ * @note Coordinates are rounded to whole map units and the boolean flags of
+ *       linedefs and things are folded into the DOOM flag bits, so UDMF maps
+ *       go through every output like binary ones. The activation keys of a
+ *       linedef and repeatspecial go to the Hexen flag bits, as the Hexen
+ *       LINEDEFS lump holds them (see WAD::kHexenActivation). Unknown blocks
+ *       and keys are ignored, as the specification requires.
+ */
+void parseUDMF(std::string_view text, WAD::Level &level) {
+  Parser parser(text);
+
+  for (;;) {
+    UDMFToken name = parser.next();
+    if (name.type == UDMFToken::Type::End) {
+      break;
+    }
+    if (name.type != UDMFToken::Type::Identifier) {
+      parser.fail(name, "expected a block or a global assignment");
+    }
+
+    UDMFToken token = parser.next();
+    if (token.type == UDMFToken::Type::Symbol && token.text[0] == '=') {
+      // Global assignment; only the namespace is kept, for writeUDMF()
+      UDMFToken value = parser.next();
+      parser.expect(parser.next(), ';');
+      if (name.text == "namespace") {
+        level.udmf_namespace = std::string(parser.string(value));
+      }
+      continue;
+    }
+    parser.expect(token, '{');
+
+    Block       block = blockType(name.text);
+    BlockFields fields;
+    for (;;) {
+      UDMFToken key = parser.next();
+      if (key.type == UDMFToken::Type::Symbol && key.text[0] == '}') {
+        break;
+      }
+      if (key.type != UDMFToken::Type::Identifier) {
+        parser.fail(key, "expected a key or '}'");
+      }
+      parser.expect(parser.next(), '=');
+      UDMFToken value = parser.next();
+      if (value.type == UDMFToken::Type::End ||
+          value.type == UDMFToken::Type::Symbol) {
+        parser.fail(value, "expected a value");
+      }
+      parser.expect(parser.next(), ';');
+      assign(parser, block, key.text, value, fields);
+    }
+    store(parser, block, fields, name, level);
+  }
+}
+
+/**
+ * @brief Write a level as the text of a TEXTMAP lump
+ * @param level Level, of any format
+ * @return The lump text, in the level's namespace ("zdoom" when it has none)
+ * @note The inverse of parseUDMF: the DOOM flag bits go back to their
+ *       boolean keys (skills 1-2 and 4-5 share a bit, so both are written)
+ *       and keys at their default value are left out, so parsing the text
+ *       gives the level back. The activation of a Hexen or UDMF linedef is
+ *       written as the keys of its one trigger; a special with no activation
+ *       key at all comes back as player cross, the Hexen default.
+ */
+std::string writeUDMF(const WAD::Level &level) {
+  Writer out;
+  out.string("namespace", level.udmf_namespace.empty()
+                              ? std::string_view("zdoom")
+                              : std::string_view(level.udmf_namespace));
+  out.text() += "\n";
+
+  for (std::size_t i = 0; i < level.vertices.size(); i++) {
+    out.block("vertex", i);
+    out.number("x", level.vertices[i].x);
+    out.number("y", level.vertices[i].y);
+    out.end();
+  }
+
+  for (std::size_t i = 0; i < level.linedefs.size(); i++) {
+    const WAD::Linedef &l = level.linedefs[i];
+    out.block("linedef", i);
+    out.integer("v1", l.start_vertex);
+    out.integer("v2", l.end_vertex);
+    out.integer("sidefront", l.right_sidedef);
+    if (l.left_sidedef != 0xFFFF) {
+      out.integer("sideback", l.left_sidedef);
+    }
+    if (l.line_type != 0) {
+      out.integer("special", l.line_type);
+    }
+    if (l.sector_tag != 0) {
+      out.integer("id", l.sector_tag);
+    }
+    if (i < level.linedef_args.size()) {
+      out.args(level.linedef_args[i].args);
+    }
+    if (level.format == WAD::LevelFormat::Doom) {
+      out.flags(Block::Linedef, Key::Flag, l.flags & 0x01FF);
+    } else {
+      out.flags(Block::Linedef, Key::Flag, l.flags);
+      out.activation(l.flags, l.line_type);
+    }
+    out.end();
+  }
+
+  for (std::size_t i = 0; i < level.sidedefs.size(); i++) {
+    const WAD::Sidedef &s = level.sidedefs[i];
+    out.block("sidedef", i);
+    if (s.x_offset != 0) {
+      out.integer("offsetx", s.x_offset);
+    }
+    if (s.y_offset != 0) {
+      out.integer("offsety", s.y_offset);
+    }
+    for (const auto &[key, texture] :
+         {std::pair<const char *, const char *>{"texturetop", s.upper_texture},
+          {"texturebottom", s.lower_texture},
+          {"texturemiddle", s.middle_texture}}) {
+      std::string_view name(texture, strnlen(texture, 8));
+      if (!name.empty() && name != "-") {
+        out.string(key, name);
+      }
+    }
+    out.integer("sector", s.sector);
+    out.end();
+  }
+
+  for (std::size_t i = 0; i < level.sectors.size(); i++) {
+    const WAD::Sector &s = level.sectors[i];
+    out.block("sector", i);
+    out.integer("heightfloor", s.floor_height);
+    out.integer("heightceiling", s.ceiling_height);
+    out.name("texturefloor", s.floor_texture);
+    out.name("textureceiling", s.ceiling_texture);
+    out.integer("lightlevel", s.light_level);
+    if (s.type != 0) {
+      out.integer("special", s.type);
+    }
+    if (s.tag != 0) {
+      out.integer("id", s.tag);
+    }
+    out.end();
+  }
+
+  // Thing flags as parseUDMF folds them: three skill bits for five skills,
+  // and multiplayer only for a thing absent from single player
+  for (std::size_t i = 0; i < level.things.size(); i++) {
+    const WAD::Thing &t = level.things[i];
+    out.block("thing", i);
+    out.number("x", t.x);
+    out.number("y", t.y);
+    if (i < level.thing_args.size() && level.thing_args[i].z != 0) {
+      out.number("height", level.thing_args[i].z);
+    }
+    out.integer("angle", t.angle);
+    out.integer("type", t.type);
+    if (i < level.thing_args.size()) {
+      const WAD::ThingArgs &a = level.thing_args[i];
+      if (a.tid != 0) {
+        out.integer("id", a.tid);
+      }
+      if (a.special != 0) {
+        out.integer("special", a.special);
+      }
+      out.args(a.args);
+      out.flags(Block::Thing, Key::HexenFlag, a.hexen_flags);
+    }
+    const char *const skills[][2] = {
+        {"skill1", "skill2"}, {"skill3", nullptr}, {"skill4", "skill5"}};
+    for (int bit = 0; bit < 3; bit++) {
+      if (t.flags & (1 << bit)) {
+        for (const char *skill : skills[bit]) {
+          if (skill) {
+            out.flag(skill);
+          }
+        }
+      }
+    }
+    if (!(t.flags & 0x0010)) {
+      out.flag("single");
+    }
+    out.flags(Block::Thing, Key::Flag, t.flags);
+    out.end();
+  }
+
+  return std::move(out.text());
+}
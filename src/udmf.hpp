@@ -0,0 +1,45 @@
+#ifndef UDMF_HPP
+#define UDMF_HPP
+
+#include "wad.hpp"
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Token of a UDMF TEXTMAP lump
+struct UDMFToken {
+  enum class Type { End, Identifier, Integer, Float, String, Symbol };
+
+  Type             type;
+  std::string_view text;    // Points into the lump; strings without quotes
+  std::size_t      offset;  // Byte offset in the lump, for error messages
+};
+
+/**
+ * Streaming tokenizer over the text of a TEXTMAP lump. Tokens are views into
+ * the lump bytes, so nothing is copied or allocated however large the map
+ * is. Whitespace and both comment styles are skipped; string escapes are
+ * left as they are (names never contain any).
+ */
+class UDMFTokenizer {
+public:
+  explicit UDMFTokenizer(std::string_view text) : text_(text) {}
+
+  // Next token, of type End once the text is exhausted
+  UDMFToken next();
+
+  // Line number (from 1) of a byte offset, for error messages
+  std::size_t lineAt(std::size_t offset) const;
+
+private:
+  std::string_view text_;
+  std::size_t      pos_ = 0;
+};
+
+// Parse a TEXTMAP lump into a level
+void parseUDMF(std::string_view text, WAD::Level &level);
+
+// Write a level as the text of a TEXTMAP lump, the inverse of parseUDMF
+std::string writeUDMF(const WAD::Level &level);
+
+#endif  // UDMF_HPP
@@ -0,0 +1,569 @@
+#include "usageindex.hpp"
+#include "lump.hpp"
+#include "names.hpp"
+#include "parallel.hpp"
+#include "udmf.hpp"
+#include "wad.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace {
+
+constexpr char        kMagic[4]  = {'W', 'C', 'U', 'I'};
+constexpr uint32_t    kVersion   = 1;
+constexpr std::size_t kEntrySize = 20;  // Term table entry
+
+void appendU32(std::vector<uint8_t> &out, uint32_t value) {
+  for (std::size_t k = 0; k < 4; k++) {
+    out.push_back(static_cast<uint8_t>(value >> (8 * k)));
+  }
+}
+
+void appendU64(std::vector<uint8_t> &out, uint64_t value) {
+  for (std::size_t k = 0; k < 8; k++) {
+    out.push_back(static_cast<uint8_t>(value >> (8 * k)));
+  }
+}
+
+// Bounds-checked little-endian reads over the index file
+class Reader {
+public:
+  Reader(const std::vector<uint8_t> &data, const std::string &path)
+      : data_(data), path_(path) {}
+
+  const uint8_t *bytes(std::size_t count) {
+    if (count > data_.size() - position_) {
+      throw std::runtime_error("Malformed usage index: " + path_);
+    }
+    const uint8_t *p = data_.data() + position_;
+    position_        += count;
+    return p;
+  }
+
+  uint64_t integer(std::size_t size) {
+    const uint8_t *p     = bytes(size);
+    uint64_t       value = 0;
+    for (std::size_t k = size; k-- > 0;) {
+      value = (value << 8) | p[k];
+    }
+    return value;
+  }
+
+  uint32_t u32() { return static_cast<uint32_t>(integer(4)); }
+  uint64_t u64() { return integer(8); }
+
+private:
+  const std::vector<uint8_t> &data_;
+  const std::string          &path_;
+  std::size_t                 position_ = 0;
+};
+
+// An index file split into its parts; the levels of the sources have their
+// names but no terms yet
+struct IndexFile {
+  std::vector<uint8_t>            data;
+  std::vector<UsageIndex::Source> sources;
+  const uint8_t                  *terms        = nullptr;
+  std::size_t                     termCount    = 0;
+  const uint8_t                  *postings     = nullptr;
+  std::size_t                     postingsSize = 0;
+};
+
+/**
+ * @brief Read and split an index file
+ * @param path Index file
+ * @return Its parts
+ * @throws std::runtime_error if the file cannot be read or is not a valid
+ *         index
+ */
+IndexFile readIndex(const std::string &path) {
+  IndexFile     file;
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    throw std::runtime_error("Unable to open usage index: " + path);
+  }
+  file.data.assign(std::istreambuf_iterator<char>(in),
+                   std::istreambuf_iterator<char>());
+
+  Reader reader(file.data, path);
+  if (std::memcmp(reader.bytes(4), kMagic, 4) != 0 ||
+      reader.u32() != kVersion) {
+    throw std::runtime_error("Not a usage index: " + path);
+  }
+  file.sources.resize(reader.u32());
+  for (UsageIndex::Source &source : file.sources) {
+    uint32_t length = reader.u32();
+    source.path.assign(reinterpret_cast<const char *>(reader.bytes(length)),
+                       length);
+    source.size  = reader.u64();
+    source.mtime = static_cast<int64_t>(reader.u64());
+    source.levels.resize(reader.u32());
+    for (UsageIndex::Level &level : source.levels) {
+      level.name = reader.u64();
+    }
+  }
+  file.termCount    = reader.u32();
+  file.terms        = reader.bytes(file.termCount * kEntrySize);
+  file.postingsSize = static_cast<std::size_t>(reader.u64());
+  file.postings     = reader.bytes(file.postingsSize);
+  return file;
+}
+
+// Term of a term table entry: u32 kind, u32 postings count, u32 postings
+// offset, u64 key
+UsageIndex::Term entryTerm(const uint8_t *entry) {
+  return {static_cast<UsageIndex::Kind>(readU32LE(entry)),
+          static_cast<uint64_t>(readU32LE(entry + 12)) |
+              static_cast<uint64_t>(readU32LE(entry + 16)) << 32};
+}
+
+/**
+ * @brief Decode the postings of a term table entry
+ * @param file Index file
+ * @param entry Term table entry
+ * @param path Index file path, for errors
+ * @return Level ids, increasing
+ * @throws std::runtime_error if the postings run past the end of the file
+ */
+std::vector<uint32_t> decodePostings(const IndexFile   &file,
+                                     const uint8_t     *entry,
+                                     const std::string &path) {
+  uint32_t    count  = readU32LE(entry + 4);
+  std::size_t offset = readU32LE(entry + 8);
+
+  std::vector<uint32_t> ids;
+  ids.reserve(count);
+  uint32_t id = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t delta = 0;
+    for (int shift = 0;; shift += 7) {
+      if (offset >= file.postingsSize || shift > 28) {
+        throw std::runtime_error("Malformed usage index: " + path);
+      }
+      uint8_t byte = file.postings[offset++];
+      delta        |= static_cast<uint32_t>(byte & 0x7F) << shift;
+      if ((byte & 0x80) == 0) {
+        break;
+      }
+    }
+    id += delta;
+    ids.push_back(id);
+  }
+  return ids;
+}
+
+// Key of a texture or flat name, in upper case like the game matches them
+NameKey upperName(const char *name) {
+  char upper[kNameLength] = {};
+  for (std::size_t i = 0; i < kNameLength; i++) {
+    upper[i] = static_cast<char>(
+        std::toupper(static_cast<unsigned char>(name[i])));
+    if (name[i] == '\0') {
+      break;
+    }
+  }
+  return packName(upper, strnlen(name, kNameLength));
+}
+
+/**
+ * @brief Read the levels of a WAD and collect the terms each one uses
+ * @param source WAD to read; its levels are replaced
+ * @throws std::runtime_error if the WAD cannot be read
+ * @note Only the directory and the lumps holding the terms are read:
+ *       SIDEDEFS, SECTORS and THINGS, or TEXTMAP for UDMF levels. Records are
+ *       decoded straight from the lump bytes; nothing else of the level, and
+ *       none of the WAD's assets, is loaded.
+ */
+void scanSource(UsageIndex::Source &source) {
+  using Kind = UsageIndex::Kind;
+  constexpr NameKey kNoTexture = packName("-");
+
+  WAD wad(source.path);
+  wad.setQuiet(true);
+  const std::vector<WAD::Directory> &directory = wad.directory();
+  std::vector<size_t>                markers   = wad.levelMarkers();
+  source.levels.clear();
+  for (size_t m = 0; m < markers.size(); m++) {
+    // A lump of the level: between its marker and the next one
+    size_t end  = m + 1 < markers.size() ? markers[m + 1] : directory.size();
+    auto   read = [&](const char *name) {
+      NameKey key = packName(name);
+      for (size_t i = markers[m] + 1; i < end; i++) {
+        if (packName(directory[i].name) == key) {
+          return wad.lumpData(i);
+        }
+      }
+      return std::vector<uint8_t>();
+    };
+
+    std::vector<UsageIndex::Term> terms;
+    auto                          texture = [&](Kind kind, const char *name) {
+      NameKey key = upperName(name);
+      if (key != 0 && key != kNoTexture) {
+        terms.push_back({kind, key});
+      }
+    };
+    auto addSidedef = [&](const WAD::Sidedef &side) {
+      texture(Kind::Texture, side.upper_texture);
+      texture(Kind::Texture, side.lower_texture);
+      texture(Kind::Texture, side.middle_texture);
+    };
+    auto addSector = [&](const WAD::Sector &sector) {
+      texture(Kind::Flat, sector.floor_texture);
+      texture(Kind::Flat, sector.ceiling_texture);
+    };
+
+    WAD::LevelFormat format = wad.levelFormat(markers[m]);
+    if (format == WAD::LevelFormat::UDMF) {
+      std::vector<uint8_t> text = read("TEXTMAP");
+      WAD::Level           level;
+      parseUDMF(std::string_view(reinterpret_cast<const char *>(text.data()),
+                                 text.size()),
+                level);
+      for (const WAD::Sidedef &side : level.sidedefs) {
+        addSidedef(side);
+      }
+      for (const WAD::Sector &sector : level.sectors) {
+        addSector(sector);
+      }
+      for (const WAD::Thing &thing : level.things) {
+        terms.push_back({Kind::Thing, thing.type});
+      }
+    } else {
+      std::vector<uint8_t> sides   = read("SIDEDEFS");
+      std::vector<uint8_t> sectors = read("SECTORS");
+      std::vector<uint8_t> things  = read("THINGS");
+      LumpView<WAD::Sidedef> sideView(
+          LumpBytes(sides.data(), sides.size(), "SIDEDEFS"));
+      for (std::size_t i = 0; i < sideView.size(); i++) {
+        addSidedef(sideView[i]);
+      }
+      LumpView<WAD::Sector> sectorView(
+          LumpBytes(sectors.data(), sectors.size(), "SECTORS"));
+      for (std::size_t i = 0; i < sectorView.size(); i++) {
+        addSector(sectorView[i]);
+      }
+      LumpBytes thingBytes(things.data(), things.size(), "THINGS");
+      if (format == WAD::LevelFormat::Hexen) {
+        LumpView<WAD::HexenThing> thingView(thingBytes);
+        for (std::size_t i = 0; i < thingView.size(); i++) {
+          terms.push_back({Kind::Thing, thingView[i].type});
+        }
+      } else {
+        LumpView<WAD::Thing> thingView(thingBytes);
+        for (std::size_t i = 0; i < thingView.size(); i++) {
+          terms.push_back({Kind::Thing, thingView[i].type});
+        }
+      }
+    }
+    std::sort(terms.begin(), terms.end());
+    terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+    source.levels.push_back({packName(directory[markers[m]].name),
+                             std::move(terms)});
+  }
+}
+
+}  // namespace
+
+/**
+ * @brief Read an index file
+ * @param path Index file; a missing file gives an empty index
+ * @return The index, with the terms of every level
+ * @throws std::runtime_error if the file is not a valid index
+ */
+UsageIndex UsageIndex::load(const std::string &path) {
+  UsageIndex index;
+  if (!std::filesystem::exists(path)) {
+    return index;
+  }
+  IndexFile file = readIndex(path);
+
+  // Levels by id, then every term handed to the levels in its postings;
+  // terms come in order, so each level gets them sorted
+  std::vector<Level *> levels;
+  for (Source &source : file.sources) {
+    for (Level &level : source.levels) {
+      levels.push_back(&level);
+    }
+  }
+  for (std::size_t t = 0; t < file.termCount; t++) {
+    const uint8_t *entry = file.terms + t * kEntrySize;
+    Term           term  = entryTerm(entry);
+    for (uint32_t id : decodePostings(file, entry, path)) {
+      if (id >= levels.size()) {
+        throw std::runtime_error("Malformed usage index: " + path);
+      }
+      levels[id]->terms.push_back(term);
+    }
+  }
+  index.sources_ = std::move(file.sources);
+  return index;
+}
+
+/**
+ * @brief Index the WADs of a file or directory
+ * @param input WAD file, or directory searched recursively for .wad files
+ * @return What was scanned, reused and removed
+ * @throws std::runtime_error if the input does not exist
+ * @note WADs whose size and modification time did not change keep their
+ *       entries without being read; WADs indexed earlier elsewhere are kept
+ *       while their file exists.
+ */
+UsageIndex::UpdateStats UsageIndex::update(const std::string &input) {
+  namespace fs = std::filesystem;
+  if (!fs::exists(input)) {
+    throw std::runtime_error("No such file or directory: " + input);
+  }
+
+  // Every WAD to look at: those under the input and those indexed before
+  std::set<std::string> paths;
+  auto add = [&](const fs::path &path) {
+    paths.insert(fs::absolute(path).lexically_normal().string());
+  };
+  if (fs::is_directory(input)) {
+    for (const fs::directory_entry &entry : fs::recursive_directory_iterator(
+             input, fs::directory_options::skip_permission_denied)) {
+      std::string extension = entry.path().extension().string();
+      std::transform(extension.begin(), extension.end(), extension.begin(),
+                     [](unsigned char c) { return std::tolower(c); });
+      if (entry.is_regular_file() && extension == ".wad") {
+        add(entry.path());
+      }
+    }
+  } else {
+    add(input);
+  }
+  std::map<std::string, Source> previous;
+  for (Source &source : sources_) {
+    paths.insert(source.path);
+    previous[source.path] = std::move(source);
+  }
+
+  // Unchanged WADs keep their entry, the others are read again
+  UpdateStats              stats;
+  std::vector<Source>      sources;
+  std::vector<std::size_t> scan;
+  for (const std::string &path : paths) {
+    std::error_code error;
+    uint64_t        size = fs::file_size(path, error);
+    if (error) {
+      stats.removed++;
+      continue;
+    }
+    int64_t mtime =
+        fs::last_write_time(path, error).time_since_epoch().count();
+    auto found = previous.find(path);
+    if (found != previous.end() && found->second.size == size &&
+        found->second.mtime == mtime) {
+      sources.push_back(std::move(found->second));
+      stats.reused++;
+    } else {
+      scan.push_back(sources.size());
+      sources.push_back({path, size, mtime, {}});
+    }
+  }
+
+  std::vector<std::string> errors(scan.size());
+  parallelFor(scan.size(), [&](std::size_t j) {
+    try {
+      scanSource(sources[scan[j]]);
+    } catch (const std::runtime_error &e) {
+      errors[j] = e.what();
+    }
+  });
+
+  // WADs that could not be read are left out, and tried again next time
+  std::vector<bool> failed(sources.size(), false);
+  for (std::size_t j = 0; j < scan.size(); j++) {
+    if (!errors[j].empty()) {
+      stats.warnings.push_back(sources[scan[j]].path + ": " + errors[j]);
+      failed[scan[j]] = true;
+    } else {
+      stats.scanned++;
+    }
+  }
+  sources_.clear();
+  for (std::size_t i = 0; i < sources.size(); i++) {
+    if (!failed[i]) {
+      sources_.push_back(std::move(sources[i]));
+    }
+  }
+  return stats;
+}
+
+/**
+ * @brief Write the index file
+ * @param path Index file
+ * @return Size of the file
+ * @throws std::runtime_error if the file cannot be written
+ * @note The file is written next to the destination and renamed over it, so
+ *       an interrupted update leaves the previous index intact.
+ */
+std::size_t UsageIndex::save(const std::string &path) const {
+  // Postings of every term; level ids increase, so each list is sorted
+  std::map<Term, std::vector<uint32_t>> postings;
+  uint32_t                              id = 0;
+  for (const Source &source : sources_) {
+    for (const Level &level : source.levels) {
+      for (const Term &term : level.terms) {
+        postings[term].push_back(id);
+      }
+      id++;
+    }
+  }
+
+  std::vector<uint8_t> out(std::begin(kMagic), std::end(kMagic));
+  appendU32(out, kVersion);
+  appendU32(out, static_cast<uint32_t>(sources_.size()));
+  for (const Source &source : sources_) {
+    appendU32(out, static_cast<uint32_t>(source.path.size()));
+    out.insert(out.end(), source.path.begin(), source.path.end());
+    appendU64(out, source.size);
+    appendU64(out, static_cast<uint64_t>(source.mtime));
+    appendU32(out, static_cast<uint32_t>(source.levels.size()));
+    for (const Level &level : source.levels) {
+      appendU64(out, level.name);
+    }
+  }
+
+  std::vector<uint8_t> encoded;
+  appendU32(out, static_cast<uint32_t>(postings.size()));
+  for (const auto &posting : postings) {
+    appendU32(out, static_cast<uint32_t>(posting.first.kind));
+    appendU32(out, static_cast<uint32_t>(posting.second.size()));
+    appendU32(out, static_cast<uint32_t>(encoded.size()));
+    appendU64(out, posting.first.key);
+    uint32_t last = 0;
+    for (uint32_t level : posting.second) {
+      uint32_t delta = level - last;
+      last           = level;
+      while (delta >= 0x80) {
+        encoded.push_back(static_cast<uint8_t>(delta | 0x80));
+        delta >>= 7;
+      }
+      encoded.push_back(static_cast<uint8_t>(delta));
+    }
+  }
+  appendU64(out, encoded.size());
+  out.insert(out.end(), encoded.begin(), encoded.end());
+
+  std::string   temporary = path + ".tmp";
+  std::ofstream file(temporary, std::ios::binary);
+  file.write(reinterpret_cast<const char *>(out.data()),
+             static_cast<std::streamsize>(out.size()));
+  file.close();
+  std::error_code error;
+  if (file) {
+    std::filesystem::rename(temporary, path, error);
+  }
+  if (!file || error) {
+    std::filesystem::remove(temporary, error);
+    throw std::runtime_error("Unable to write usage index: " + path);
+  }
+  return out.size();
+}
+
+/**
+ * @brief Parse a query term
+ * @param text texture:NAME, flat:NAME or thing:TYPE (names in any case)
+ * @return The term
+ * @throws std::runtime_error if the term is not one of these forms
+ */
+UsageIndex::Term parseUsageTerm(const std::string &text) {
+  std::size_t colon = text.find(':');
+  std::string kind  = text.substr(0, colon);
+  std::string value = colon == std::string::npos ? "" : text.substr(colon + 1);
+  if ((kind == "texture" || kind == "flat") && !value.empty() &&
+      value.size() <= kNameLength) {
+    return {kind == "texture" ? UsageIndex::Kind::Texture
+                              : UsageIndex::Kind::Flat,
+            upperName(value.c_str())};
+  }
+  if (kind == "thing" && !value.empty() && value.size() <= 5 &&
+      std::all_of(value.begin(), value.end(),
+                  [](unsigned char c) { return std::isdigit(c); }) &&
+      std::stoul(value) <= 0xFFFF) {
+    return {UsageIndex::Kind::Thing, std::stoul(value)};
+  }
+  throw std::runtime_error("Invalid query term '" + text +
+                           "': use texture:NAME, flat:NAME or thing:TYPE");
+}
+
+/**
+ * @brief Find the levels using every given term
+ * @param path Index file
+ * @param terms Terms, all of which a level must use
+ * @return Matching levels, in index order (by WAD path, then level order)
+ * @throws std::runtime_error if the file is not a valid index
+ * @note Reads the file once and decodes only the postings of the terms,
+ *       without rebuilding the index.
+ */
+std::vector<UsageMatch> queryUsageIndex(const std::string             &path,
+                                        const std::vector<UsageIndex::Term>
+                                            &terms) {
+  IndexFile               file = readIndex(path);
+  std::vector<UsageMatch> matches;
+  if (terms.empty()) {
+    return matches;
+  }
+
+  // Binary search of each term in the sorted table; the level ids are the
+  // intersection of their postings
+  std::vector<uint32_t> ids;
+  for (std::size_t t = 0; t < terms.size(); t++) {
+    std::size_t low = 0, high = file.termCount;
+    while (low < high) {
+      std::size_t middle = (low + high) / 2;
+      if (entryTerm(file.terms + middle * kEntrySize) < terms[t]) {
+        low = middle + 1;
+      } else {
+        high = middle;
+      }
+    }
+    if (low == file.termCount ||
+        !(entryTerm(file.terms + low * kEntrySize) == terms[t])) {
+      return matches;
+    }
+    std::vector<uint32_t> postings =
+        decodePostings(file, file.terms + low * kEntrySize, path);
+    if (t == 0) {
+      ids = std::move(postings);
+    } else {
+      std::vector<uint32_t> both;
+      std::set_intersection(ids.begin(), ids.end(), postings.begin(),
+                            postings.end(), std::back_inserter(both));
+      ids = std::move(both);
+    }
+  }
+
+  // Level ids number the levels of every source in order
+  std::size_t source = 0, first = 0;
+  for (uint32_t id : ids) {
+    while (source < file.sources.size() &&
+           id >= first + file.sources[source].levels.size()) {
+      first += file.sources[source].levels.size();
+      source++;
+    }
+    if (source == file.sources.size()) {
+      throw std::runtime_error("Malformed usage index: " + path);
+    }
+    const UsageIndex::Source &wad  = file.sources[source];
+    NameChars                 name = unpackName(wad.levels[id - first].name);
+    matches.push_back({wad.path, std::string(name.view())});
+  }
+  return matches;
+}
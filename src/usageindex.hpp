@@ -0,0 +1,88 @@
+#ifndef USAGEINDEX_HPP
+#define USAGEINDEX_HPP
+
+#include "names.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Inverted index from the wall textures, flats and thing types used by the
+ * levels of many WADs to the levels using them. Only the directory and the
+ * level lumps of each WAD are read; patches and textures are never decoded.
+ *
+ * The index file holds the indexed WADs (path, size, modification time and
+ * level names), then a table of terms sorted by kind and name, and for each
+ * term its postings: the ids of the levels using it (levels numbered across
+ * every WAD in order), delta and varint encoded. A lookup is a binary search
+ * in the term table and one postings decode.
+ */
+class UsageIndex {
+public:
+  enum class Kind : uint8_t { Texture = 1, Flat = 2, Thing = 3 };
+
+  // Texture or flat name key (see packName), or thing type
+  struct Term {
+    Kind     kind;
+    uint64_t key;
+
+    bool operator<(const Term &other) const {
+      return kind != other.kind ? kind < other.kind : key < other.key;
+    }
+    bool operator==(const Term &other) const {
+      return kind == other.kind && key == other.key;
+    }
+  };
+
+  struct Level {
+    NameKey           name;
+    std::vector<Term> terms;  // Sorted, unique
+  };
+
+  // One indexed WAD
+  struct Source {
+    std::string        path;  // Absolute
+    uint64_t           size  = 0;
+    int64_t            mtime = 0;  // Modification time, file clock ticks
+    std::vector<Level> levels;
+  };
+
+  // What update() did
+  struct UpdateStats {
+    std::size_t              scanned = 0;  // WADs new or changed, read again
+    std::size_t              reused  = 0;  // WADs unchanged, kept as indexed
+    std::size_t              removed = 0;  // WADs gone from the disk
+    std::vector<std::string> warnings;     // WADs that could not be read
+  };
+
+  // Read an index file; a missing file gives an empty index
+  static UsageIndex load(const std::string &path);
+
+  // Index a WAD file, or the .wad files under a directory
+  UpdateStats update(const std::string &input);
+
+  // Write the index file and return its size
+  std::size_t save(const std::string &path) const;
+
+  const std::vector<Source> &sources() const { return sources_; }
+
+private:
+  std::vector<Source> sources_;  // Sorted by path
+};
+
+// A level matching a query
+struct UsageMatch {
+  std::string wad;
+  std::string level;
+};
+
+// Parse texture:NAME, flat:NAME or thing:TYPE
+UsageIndex::Term parseUsageTerm(const std::string &text);
+
+// Levels using every given term, read from an index file
+std::vector<UsageMatch> queryUsageIndex(const std::string             &path,
+                                        const std::vector<UsageIndex::Term>
+                                            &terms);
+
+#endif  // USAGEINDEX_HPP
@@ -1,35 +1,34 @@
 #include "wad.hpp"
+#include "emitter.hpp"
+#include "lump.hpp"
+#include "names.hpp"
+#include "nodes.hpp"
+#include "parallel.hpp"
+#include "readplan.hpp"
+#include "strings.hpp"
+#include "things.hpp"
+#include "udmf.hpp"
 #include <_string.h>
-#include <cctype>
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <memory_resource>
+#include <new>
 #include <nlohmann/json.hpp>
 #include <nlohmann/json_fwd.hpp>
 #include <set>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
-// Local trimFixedString implementation
-static std::string trimString(const std::string &str, size_t maxLen) {
-  static const std::string whitespace = " \t\n\r\f\v";
-  std::string              result;
-  if (str.length() > maxLen) {
-    result = str.substr(0, maxLen);
-  } else {
-    result = str;
-  }
-  size_t last = result.find_last_not_of(whitespace);
-  if (last == std::string::npos) {
-    return "";
-  }
-  return result.substr(0, last + 1);
-}
-
 /**
  * @brief WAD constructor
  * @param filepath Path to the WAD file
@@ -47,10 +46,39 @@ WAD::WAD(const std::string &filepath, bool verbose) {
   }
 
   // Read header
-  file.read(reinterpret_cast<char *>(&header_), sizeof(Header));
+  uint8_t raw[LumpRecord<Header>::size];
+  file.read(reinterpret_cast<char *>(raw), sizeof(raw));
   if (!file) {
     throw std::runtime_error("Unable to read WAD header");
   }
+  readHeader(raw);
+}
+
+/**
+ * @brief WAD constructor for a file already in memory
+ * @param data Contents of the WAD file
+ * @param name Name used in place of a path in messages and outputs
+ * @param verbose Verbose flag
+ * @throws std::runtime_error if the data is not a valid WAD file
+ * @note Lumps are then copied out of the buffer instead of being read from
+ *       disk; everything else works as for a file.
+ */
+WAD::WAD(std::vector<uint8_t> data, const std::string &name, bool verbose)
+    : verbose_(verbose), filepath_(name),
+      memory_(std::make_shared<const std::vector<uint8_t>>(std::move(data))) {
+  if (memory_->size() < LumpRecord<Header>::size) {
+    throw std::runtime_error("Unable to read WAD header");
+  }
+  readHeader(memory_->data());
+}
+
+/**
+ * @brief Decode and check the header, then read the directory
+ * @param raw The first bytes of the file
+ * @throws std::runtime_error if the file is not a valid WAD file
+ */
+void WAD::readHeader(const uint8_t *raw) {
+  header_ = LumpRecord<Header>::decode(raw);
 
   // Verify WAD type
   std::string id(header_.identification, 4);
@@ -59,55 +87,106 @@ WAD::WAD(const std::string &filepath, bool verbose) {
   }
 
   if (verbose_) {
-    std::cout << "WAD type: " << id << "\n";
-    std::cout << "Num lumps: " << header_.numlumps << "\n";
+    log() << "WAD type: " << id << "\n";
+    log() << "Num lumps: " << header_.numlumps << "\n";
   }
 
   // Read directory
   readDirectory();
 }
 
+/**
+ * @brief WAD constructor for levels imported from a converted file
+ * @param filepath Path of the file the levels were imported from
+ * @param levels Imported levels
+ * @param verbose Verbose flag
+ */
+WAD::WAD(const std::string &filepath, std::vector<Level> levels, bool verbose)
+    : verbose_(verbose), filepath_(filepath), header_(),
+      levels_(std::move(levels)) {
+  if (verbose_) {
+    log() << "Imported levels: " << levels_.size() << "\n";
+  }
+}
+
+/**
+ * @brief Stream for the console messages
+ * @return std::cout, or a stream discarding everything once setQuiet(true)
+ *         was called
+ */
+std::ostream &WAD::log() const {
+  static std::ostream discard(nullptr);
+  return quiet_ ? discard : std::cout;
+}
+
 /**
  * @brief Read the WAD directory
  * @throws std::runtime_error if the directory cannot be read
  */
 void WAD::readDirectory() {
-  // Open the WAD file in binary mode.
-  std::ifstream file(filepath_, std::ios::binary);
-
-  // Move the file read position to the start of the directory, using the
-  // offset from the header (header_.infotableofs).
-  file.seekg(header_.infotableofs);
-
-  // Prepare the directory_ vector to hold all directory entries. The number of
-  // entries is specified in the header (header_.numlumps).
-  directory_.resize(header_.numlumps);
+  // Each lump has a fixed-size record (16 bytes) in the directory, which
+  // starts at the offset given by the header (header_.infotableofs). The
+  // whole table is read at once and then decoded entry by entry.
+  std::size_t          tableSize = static_cast<std::size_t>(header_.numlumps) *
+                          LumpRecord<Directory>::size;
+  std::vector<uint8_t> data = readLump(header_.infotableofs, tableSize);
+
+  LumpView<Directory> entries(LumpBytes(data.data(), data.size(), "directory"));
+  directory_.resize(entries.size());
+  lumpNames_.resize(entries.size());
+  names_.clear();
+  for (size_t i = 0; i < entries.size(); i++) {
+    directory_[i] = entries[i];
+    lumpNames_[i] = names_.intern(packName(directory_[i].name));
+  }
 
-  // Read the entire directory into memory: each lump has a fixed-size record
-  // (16 bytes), and we read all of them at once.
-  file.read(reinterpret_cast<char *>(directory_.data()),
-            static_cast<std::streamsize>(header_.numlumps * sizeof(Directory)));
+  // Flats sit between F_START and F_END (FF_START and FF_END in PWADs).
+  // They are indexed by name once here, so levels look their flats up
+  // without scanning the directory; the first lump of a name wins. A WAD
+  // without flat markers has all of its lumps indexed instead.
+  constexpr NameKey flatStart[] = {packName("F_START"), packName("FF_START")};
+  constexpr NameKey flatEnd[]   = {packName("F_END"), packName("FF_END")};
+  bool              inFlats     = false;
+  bool              hasMarkers  = false;
+  flatLumps_.clear();
+  for (size_t i = 0; i < directory_.size(); i++) {
+    NameKey key = names_.key(lumpNames_[i]);
+    if (key == flatStart[0] || key == flatStart[1]) {
+      inFlats    = true;
+      hasMarkers = true;
+    } else if (key == flatEnd[0] || key == flatEnd[1]) {
+      inFlats = false;
+    } else if (inFlats) {
+      flatLumps_.emplace(key, LumpRef{directory_[i].filepos,
+                                      directory_[i].size});
+    }
+  }
+  if (!hasMarkers) {
+    for (size_t i = 0; i < directory_.size(); i++) {
+      flatLumps_.emplace(names_.key(lumpNames_[i]),
+                         LumpRef{directory_[i].filepos, directory_[i].size});
+    }
+  }
 }
 
 /**
  * @brief Check if a lump name is a level marker
- * @param name Lump name
+ * @param name Packed lump name
  * @return true if the name is a level marker, false otherwise
  */
-bool WAD::isLevelMarker(const std::string &name) {
-  std::string cleanName = trimString(name, 8);
+bool WAD::isLevelMarker(NameKey name) {
+  auto isDigit = [](char c) { return c >= '0' && c <= '9'; };
+  size_t length = unpackName(name).size;
 
   // DOOM 1 level names are ExMy (x = episode, y = mission)
-  if (cleanName.length() == 4 && cleanName[0] == 'E' && cleanName[2] == 'M' &&
-      std::isdigit(cleanName[1]) && std::isdigit(cleanName[3])) {
-    std::cout << "WAD :: Found DOOM1 level in WAD file: " << cleanName << "\n";
+  if (length == 4 && nameChar(name, 0) == 'E' && nameChar(name, 2) == 'M' &&
+      isDigit(nameChar(name, 1)) && isDigit(nameChar(name, 3))) {
     return true;
   }
 
   // DOOM 2 level names are MAPxx (xx = 01-32)
-  if (cleanName.length() == 5 && cleanName.substr(0, 3) == "MAP" &&
-      std::isdigit(cleanName[3]) && std::isdigit(cleanName[4])) {
-    std::cout << "WAD :: Found DOOM2 level in WAD file: " << cleanName << "\n";
+  if (length == 5 && (name >> 40) == (packName("MAP") >> 40) &&
+      isDigit(nameChar(name, 3)) && isDigit(nameChar(name, 4))) {
     return true;
   }
 
@@ -116,27 +195,38 @@ bool WAD::isLevelMarker(const std::string &name) {
 
 /**
  * @brief Find a lump by name
- * @param name Lump name
+ * @param name Packed lump name (see packName)
  * @param offset Offset of the lump in the file
  * @param size Size of the lump
  * @param startIndex Index to start searching from
  * @return true if the lump is found, false otherwise
+ * @note Names are compared by their interned id, a single integer compare
+ *       per directory entry.
  */
-bool WAD::findLump(const std::string &name, uint32_t &offset, uint32_t &size,
+bool WAD::findLump(NameKey name, uint32_t &offset, uint32_t &size,
                    size_t startIndex) const {
-  for (size_t i = startIndex; i < directory_.size(); i++) {
-    std::string lumpName = trimString(directory_[i].name, 8);
+  NameTable::Id id = names_.find(name);
+  if (id == NameTable::kNone) {
+    return false;
+  }
 
-    // Stop searching for level data at next level marker
-    if (name == "VERTEXES" || name == "LINEDEFS" || name == "SIDEDEFS" ||
-        name == "SECTORS" || name == "THINGS") {
-      // Only stop if we're after a level marker and find another one
-      if (i > startIndex && isLevelMarker(lumpName)) {
-        break;
-      }
+  // Stop searching for level data at next level marker
+  constexpr NameKey levelLumps[] = {
+      packName("VERTEXES"), packName("LINEDEFS"), packName("SIDEDEFS"),
+      packName("SECTORS"),  packName("THINGS"),   packName("SEGS"),
+      packName("SSECTORS"), packName("NODES")};
+  bool              levelLump    = std::find(std::begin(levelLumps),
+                                             std::end(levelLumps),
+                                             name) != std::end(levelLumps);
+
+  for (size_t i = startIndex; i < directory_.size(); i++) {
+    // Only stop if we're after a level marker and find another one
+    if (levelLump && i > startIndex &&
+        isLevelMarker(names_.key(lumpNames_[i]))) {
+      break;
     }
 
-    if (lumpName == name) {
+    if (lumpNames_[i] == id) {
       offset = directory_[i].filepos;
       size   = directory_[i].size;
       return true;
@@ -153,139 +243,286 @@ bool WAD::findLump(const std::string &name, uint32_t &offset, uint32_t &size,
  * @return Vector containing the lump data
  * @throws std::runtime_error if the lump cannot be read
  */
-std::vector<uint8_t> WAD::readLump(std::streamoff offset, std::size_t size) {
+std::vector<uint8_t> WAD::readLump(std::streamoff offset,
+                                   std::size_t    size) const {
   std::vector<uint8_t> data(size);
-  std::ifstream        file(filepath_, std::ios::binary);
+  readLumpInto(offset, size, data.data());
+  return data;
+}
+
+/**
+ * @brief Read a lump from the WAD file into an existing buffer
+ * @param offset Offset of the lump in the file
+ * @param size Size of the lump
+ * @param dest Destination buffer, at least size bytes long
+ * @throws std::runtime_error if the file cannot be opened or the lump extends
+ * past the end of the file
+ */
+void WAD::readLumpInto(std::streamoff offset, std::size_t size,
+                       uint8_t *dest) const {
+  if (size == 0) {
+    return;
+  }
+  if (memory_) {
+    if (offset < 0 || static_cast<std::size_t>(offset) > memory_->size() ||
+        size > memory_->size() - static_cast<std::size_t>(offset)) {
+      throw std::runtime_error("Unable to read lump at offset " +
+                               std::to_string(offset) +
+                               ": truncated WAD file");
+    }
+    std::memcpy(dest, memory_->data() + offset, size);
+    return;
+  }
+  std::ifstream file(filepath_, std::ios::binary);
   if (!file) {
     throw std::runtime_error("Unable to open file: " + filepath_);
   }
   file.seekg(offset);
-  file.read(reinterpret_cast<char *>(data.data()),
+  file.read(reinterpret_cast<char *>(dest),
             static_cast<std::streamsize>(size));
-  return data;
+  if (static_cast<std::size_t>(file.gcount()) != size) {
+    throw std::runtime_error("Unable to read lump at offset " +
+                             std::to_string(offset) + ": truncated WAD file");
+  }
+}
+
+/**
+ * @brief Read every lump of a plan
+ * @param plan Lumps to read
+ * @throws std::runtime_error if the file cannot be opened or a lump extends
+ *         past the end of the file
+ */
+void WAD::fetch(ReadPlan &plan) const {
+  if (memory_) {
+    plan.read(memory_->data(), memory_->size());
+  } else {
+    plan.read(filepath_);
+  }
+}
+
+/**
+ * @brief Decode a lump made of fixed-size records
+ * @param data Lump bytes
+ * @param size Size of the lump
+ * @param resource Memory resource for the result
+ * @return Vector containing the decoded records
+ * @note When the struct layout matches the little-endian file layout the
+ *       bytes are copied straight into the result vector. Otherwise the lump
+ *       is decoded record by record through a LumpView, which handles byte
+ *       order and padding.
+ */
+template <typename T>
+std::pmr::vector<T>
+WAD::readRecords(const uint8_t *data, std::size_t size,
+                 std::pmr::memory_resource *resource) const {
+  std::size_t         count = size / LumpView<T>::record_size;
+  std::pmr::vector<T> records(count, resource);
+  if (count == 0) {
+    return records;
+  }
+
+  if constexpr (LumpView<T>::is_raw_layout) {
+    std::memcpy(records.data(), data, count * LumpView<T>::record_size);
+  } else {
+    LumpView<T> view(LumpBytes(data, size, "level"));
+    for (std::size_t i = 0; i < count; i++) {
+      records[i] = view[i];
+    }
+  }
+
+  return records;
 }
 
 /**
- * @brief Read vertices from the WAD file
- * @param offset Offset of the vertices in the file
+ * @brief Decode vertices
+ * @param data Lump bytes
  * @param size Size of the vertices
+ * @param res Memory resource for the result
  * @return Vector containing the vertices
  */
-std::vector<WAD::Vertex> WAD::readVertices(std::streamoff offset,
-                                           std::size_t    size) {
-  auto                data = readLump(offset, size);
-  std::vector<Vertex> vertices(size / sizeof(Vertex));
-  std::memcpy(vertices.data(), data.data(), size);
-  return vertices;
+std::pmr::vector<WAD::Vertex>
+WAD::readVertices(const uint8_t *data, std::size_t size,
+                  std::pmr::memory_resource *res) const {
+  return readRecords<Vertex>(data, size, res);
 }
 
 /**
- * @brief Read linedefs from the WAD file
- * @param offset Offset of the linedefs in the file
+ * @brief Decode linedefs
+ * @param data Lump bytes
  * @param size Size of the linedefs
+ * @param res Memory resource for the result
  * @return Vector containing the linedefs
  */
-std::vector<WAD::Linedef> WAD::readLinedefs(std::streamoff offset,
-                                            std::size_t    size) {
-  auto                 data = readLump(offset, size);
-  std::vector<Linedef> linedefs(size / sizeof(Linedef));
-  std::memcpy(linedefs.data(), data.data(), size);
-  return linedefs;
+std::pmr::vector<WAD::Linedef>
+WAD::readLinedefs(const uint8_t *data, std::size_t size,
+                  std::pmr::memory_resource *res) const {
+  return readRecords<Linedef>(data, size, res);
 }
 
 /**
- * @brief Read sidedefs from the WAD file
- * @param offset Offset of the sidedefs in the file
+ * @brief Decode sidedefs
+ * @param data Lump bytes
  * @param size Size of the sidedefs
+ * @param res Memory resource for the result
  * @return Vector containing the sidedefs
  */
-std::vector<WAD::Sidedef> WAD::readSidedefs(std::streamoff offset,
-                                            std::size_t    size) {
-  auto                 data = readLump(offset, size);
-  std::vector<Sidedef> sidedefs(size / sizeof(Sidedef));
-  std::memcpy(sidedefs.data(), data.data(), size);
-  return sidedefs;
+std::pmr::vector<WAD::Sidedef>
+WAD::readSidedefs(const uint8_t *data, std::size_t size,
+                  std::pmr::memory_resource *res) const {
+  return readRecords<Sidedef>(data, size, res);
 }
 
 /**
- * @brief Read sectors from the WAD file
- * @param offset Offset of the sectors in the file
+ * @brief Decode sectors
+ * @param data Lump bytes
  * @param size Size of the sectors
+ * @param res Memory resource for the result
  * @return Vector containing the sectors
  */
-std::vector<WAD::Sector> WAD::readSectors(std::streamoff offset,
-                                          std::size_t    size) {
-  auto                data = readLump(offset, size);
-  std::vector<Sector> sectors(size / sizeof(Sector));
-  std::memcpy(sectors.data(), data.data(), size);
-  return sectors;
+std::pmr::vector<WAD::Sector>
+WAD::readSectors(const uint8_t *data, std::size_t size,
+                 std::pmr::memory_resource *res) const {
+  return readRecords<Sector>(data, size, res);
 }
 
 /**
- * @brief Read things from the WAD file
- * @param offset Offset of the things in the file
+ * @brief Decode things
+ * @param data Lump bytes
  * @param size Size of the things
+ * @param res Memory resource for the result
  * @return Vector containing the things
  */
-std::vector<WAD::Thing> WAD::readThings(std::streamoff offset,
-                                        std::size_t    size) {
-  auto               data = readLump(offset, size);
-  std::vector<Thing> things(size / sizeof(Thing));
-  std::memcpy(things.data(), data.data(), size);
-  return things;
+std::pmr::vector<WAD::Thing>
+WAD::readThings(const uint8_t *data, std::size_t size,
+                std::pmr::memory_resource *res) const {
+  return readRecords<Thing>(data, size, res);
 }
 
 /**
- * @brief Read a patch lump and convert it to RGBA format
+ * @brief Decode Hexen things into a level
+ * @param data Lump bytes
+ * @param size Size of the things
+ * @param level Level receiving the things and their specials
+ * @note The DOOM fields go to Level::things like any other level, the thing
+ *       id, height and special to Level::thing_args. The flags are split as
+ *       parseUDMF does: skills and ambush keep their DOOM bits, a thing
+ *       absent from single player is multiplayer only, and the other Hexen
+ *       bits (dormant, classes, game modes) go to ThingArgs::hexen_flags.
+ */
+void WAD::readHexenThings(const uint8_t *data, std::size_t size,
+                          Level &level) const {
+  std::pmr::vector<HexenThing> records =
+      readRecords<HexenThing>(data, size, std::pmr::get_default_resource());
+  level.things.reserve(records.size());
+  level.thing_args.reserve(records.size());
+  for (const HexenThing &record : records) {
+    uint16_t flags = record.flags & 0x000F;
+    if (!(record.flags & kHexenSingle)) {
+      flags |= 0x0010;  // Multiplayer only
+    }
+    level.things.push_back(
+        {record.x, record.y, record.angle, record.type, flags});
+    ThingArgs args{record.tid, record.z, record.special,
+                   static_cast<uint16_t>(record.flags & ~0x000F), {}};
+    std::copy(std::begin(record.args), std::end(record.args), args.args);
+    level.thing_args.push_back(args);
+  }
+}
+
+/**
+ * @brief Decode Hexen linedefs into a level
+ * @param data Lump bytes
+ * @param size Size of the linedefs
+ * @param level Level receiving the linedefs and their arguments
+ * @note The special goes to Linedef::line_type. Hexen linedefs have no tag
+ *       (specials take it as an argument), so sector_tag is left at 0.
+ */
+void WAD::readHexenLinedefs(const uint8_t *data, std::size_t size,
+                            Level &level) const {
+  std::pmr::vector<HexenLinedef> records = readRecords<HexenLinedef>(
+      data, size, std::pmr::get_default_resource());
+  level.linedefs.reserve(records.size());
+  level.linedef_args.reserve(records.size());
+  for (const HexenLinedef &record : records) {
+    level.linedefs.push_back({record.start_vertex, record.end_vertex,
+                              record.flags, record.special, 0,
+                              record.right_sidedef, record.left_sidedef});
+    LinedefArgs args{};
+    std::copy(std::begin(record.args), std::end(record.args), args.args);
+    level.linedef_args.push_back(args);
+  }
+}
+
+/**
+ * @brief Read and decode a patch lump
  * @param offset Offset of the patch in the file
  * @param size Size of the patch
  * @param name Name of the patch
- * @return PatchData containing the converted patch
+ * @return The decoded patch
+ * @throws std::runtime_error if the patch cannot be read or is malformed
  */
 WAD::PatchData WAD::readPatch(std::streamoff offset, std::size_t size,
-                              const std::string &name) {
-  auto      data = readLump(offset, size);
+                              const std::string &name) const {
+  std::vector<uint8_t> data = readLump(offset, size);
+  return decodePatch(data.data(), data.size(), name);
+}
+
+/**
+ * @brief Decode a patch lump into palette indices and an opacity mask
+ * @param data Lump bytes
+ * @param size Size of the patch
+ * @param name Name of the patch
+ * @return The decoded patch
+ * @throws std::runtime_error if the patch header, column offsets or posts
+ * point outside the lump
+ */
+WAD::PatchData WAD::decodePatch(const uint8_t *data, std::size_t size,
+                                const std::string &name) const {
+  LumpBytes bytes(data, size, "patch");
   PatchData patch;
   std::strncpy(patch.name, name.c_str(), 8);  // Copy name to char array
 
   // Read patch header
-  const PatchHeader *header =
-      reinterpret_cast<const PatchHeader *>(data.data());
-  patch.width  = header->width;
-  patch.height = header->height;
+  int16_t width  = bytes.s16(0);
+  int16_t height = bytes.s16(2);
+  if (width <= 0 || height <= 0) {
+    throw std::runtime_error("Malformed patch lump: invalid size");
+  }
+  patch.width  = width;
+  patch.height = height;
 
-  // Initialize pixel data (RGBA format)
-  patch.pixels.resize(patch.width * patch.height * 4, 0);
+  // One index per pixel, and one opacity bit, all clear until a post
+  // covers the pixel
+  std::size_t pixels = static_cast<std::size_t>(patch.width) * patch.height;
+  patch.pixels.resize(pixels, 0);
+  patch.mask.resize((pixels + 7) / 8, 0);
 
-  // Read column offsets
-  const uint32_t *columnOffsets = &header->column_offsets[0];
+  // Column offsets follow the 8 byte header, one per column
+  bytes.require(8, static_cast<std::size_t>(patch.width) * 4);
 
   // Process each column
   for (int x = 0; x < patch.width; x++) {
-    uint32_t       columnOffset = columnOffsets[x];
-    const uint8_t *column       = data.data() + columnOffset;
+    std::size_t column = bytes.u32(8 + x * 4);
 
     while (true) {
-      uint8_t topdelta = *column++;
+      uint8_t topdelta = bytes.u8(column++);
       if (topdelta == 0xFF)  // End of column
         break;
 
-      uint8_t length = *column++;
+      uint8_t length = bytes.u8(column++);
       column++;  // Skip padding byte
 
-      // Copy pixels to RGBA format
-      for (int y = 0; y < length; y++) {
-        uint8_t pixel     = *column++;
-        int     destIndex = ((topdelta + y) * patch.width + x) * 4;
+      // Pixel data plus the trailing padding byte must be inside the lump
+      bytes.require(column, length + 1);
 
-        // Store raw palette index in the pixels array
-        patch.pixels[destIndex + 0] = pixel;  // Store palette index
-        patch.pixels[destIndex + 1] = 0;      // Not used
-        patch.pixels[destIndex + 2] = 0;      // Not used
-        patch.pixels[destIndex + 3] = 255;    // Fully opaque
+      // Copy the palette indices, ignoring rows outside the patch
+      for (int y = 0; y < length && topdelta + y < patch.height; y++) {
+        std::size_t dest      = (topdelta + y) * patch.width + x;
+        patch.pixels[dest]    = data[column + y];
+        patch.mask[dest >> 3] |= static_cast<uint8_t>(1 << (dest & 7));
       }
 
-      column++;  // Skip padding byte
+      column += length + 1;  // Skip pixels and padding byte
     }
   }
 
@@ -297,15 +534,17 @@ WAD::PatchData WAD::readPatch(std::streamoff offset, std::size_t size,
  * @param offset Offset of the patch names in the file
  * @param size Size of the patch names
  * @return Vector containing the patch names
+ * @throws std::runtime_error if the lump is shorter than its patch count says
  */
 std::vector<std::string> WAD::readPatchNames(std::streamoff offset,
-                                             std::size_t    size) {
+                                             std::size_t    size) const {
   auto                     data = readLump(offset, size);
+  LumpBytes                bytes(data.data(), data.size(), "PNAMES");
   std::vector<std::string> names;
 
   // First 4 bytes is number of patches
-  uint32_t num_patches;
-  std::memcpy(&num_patches, data.data(), sizeof(uint32_t));
+  uint32_t num_patches = bytes.u32(0);
+  bytes.require(4, static_cast<std::size_t>(num_patches) * 8);
 
   // Pre-allocate vector capacity
   names.reserve(num_patches);
@@ -313,7 +552,8 @@ std::vector<std::string> WAD::readPatchNames(std::streamoff offset,
   // Read patch names (8 bytes each, zero-terminated)
   const char *name_data = reinterpret_cast<const char *>(data.data() + 4);
   for (uint32_t i = 0; i < num_patches; i++) {
-    names.push_back(trimString(name_data + i * 8, 8));
+    const char *entry = name_data + i * 8;
+    names.push_back(trimString(std::string(entry, strnlen(entry, 8)), 8));
   }
 
   return names;
@@ -324,48 +564,51 @@ std::vector<std::string> WAD::readPatchNames(std::streamoff offset,
  * @param offset Offset of the texture definitions in the file
  * @param size Size of the texture definitions
  * @return Vector containing the texture definitions
+ * @throws std::runtime_error if a texture offset or patch list points outside
+ * the lump
  */
 std::vector<WAD::TextureDef> WAD::readTextureDefs(std::streamoff offset,
-                                                  std::size_t    size) {
+                                                  std::size_t    size) const {
   auto                    data = readLump(offset, size);
+  LumpBytes               bytes(data.data(), data.size(), "TEXTURE");
   std::vector<TextureDef> textures;
 
-  // First 4 bytes is number of textures
-  uint32_t num_textures;
-  std::memcpy(&num_textures, data.data(), sizeof(uint32_t));
+  // First 4 bytes is number of textures, followed by the offset to each
+  uint32_t num_textures = bytes.u32(0);
+  bytes.require(4, static_cast<std::size_t>(num_textures) * 4);
 
   // Pre-allocate vectors
   textures.reserve(num_textures);
 
-  // Get offsets to each texture
-  std::vector<uint32_t> offsets(num_textures);
-  std::memcpy(offsets.data(), data.data() + 4, num_textures * sizeof(uint32_t));
-
   // Read each texture definition
   for (uint32_t i = 0; i < num_textures; i++) {
-    TextureDef     tex;
-    const uint8_t *tex_data = data.data() + offsets[i];
+    TextureDef  tex;
+    std::size_t tex_data = bytes.u32(4 + i * 4);
 
     // Read texture header
-    std::memcpy(tex.name, tex_data, 8);
-    std::memcpy(&tex.masked, tex_data + 8, 4);
-    std::memcpy(&tex.width, tex_data + 12, 2);
-    std::memcpy(&tex.height, tex_data + 14, 2);
-    std::memcpy(&tex.column_dir, tex_data + 16, 4);
-    std::memcpy(&tex.patch_count, tex_data + 20, 2);
+    bytes.name(tex_data, tex.name);
+    tex.masked      = bytes.u32(tex_data + 8);
+    tex.width       = bytes.u16(tex_data + 12);
+    tex.height      = bytes.u16(tex_data + 14);
+    tex.column_dir  = bytes.u32(tex_data + 16);
+    tex.patch_count = bytes.u16(tex_data + 20);
+
+    // Patches are 10 byte records after the 22 byte texture header
+    std::size_t patch_data = tex_data + 22;
+    bytes.require(patch_data, static_cast<std::size_t>(tex.patch_count) * 10);
 
     // Pre-allocate patches vector
     tex.patches.reserve(tex.patch_count);
 
     // Read patches
-    const uint8_t *patch_data = tex_data + 22;
     for (uint16_t j = 0; j < tex.patch_count; j++) {
+      const uint8_t *p = data.data() + patch_data + j * 10;
       PatchInTexture patch;
-      std::memcpy(&patch.origin_x, patch_data + j * 10, 2);
-      std::memcpy(&patch.origin_y, patch_data + j * 10 + 2, 2);
-      std::memcpy(&patch.patch_num, patch_data + j * 10 + 4, 2);
-      std::memcpy(&patch.stepdir, patch_data + j * 10 + 6, 2);
-      std::memcpy(&patch.colormap, patch_data + j * 10 + 8, 2);
+      patch.origin_x  = readS16LE(p);
+      patch.origin_y  = readS16LE(p + 2);
+      patch.patch_num = readU16LE(p + 4);
+      patch.stepdir   = readU16LE(p + 6);
+      patch.colormap  = readU16LE(p + 8);
       tex.patches.push_back(patch);
     }
 
@@ -380,11 +623,14 @@ std::vector<WAD::TextureDef> WAD::readTextureDefs(std::streamoff offset,
  * @param offset Offset of the palette in the file
  * @param size Size of the palette
  * @return Vector containing the palette colors
+ * @throws std::runtime_error if the lump is shorter than one palette
  */
 std::vector<WAD::Color> WAD::readPalette(std::streamoff offset,
-                                         std::size_t    size) {
+                                         std::size_t    size) const {
   std::vector<Color>   palette(256);  // DOOM palette has 256 colors
   std::vector<uint8_t> data = readLump(offset, size);
+  LumpBytes            bytes(data.data(), data.size(), "PLAYPAL");
+  bytes.require(0, 256 * 3);
 
   // First palette is at offset 0
   for (int i = 0; i < 256; i++) {
@@ -396,6 +642,25 @@ std::vector<WAD::Color> WAD::readPalette(std::streamoff offset,
   return palette;
 }
 
+/**
+ * @brief Read the light maps from the WAD file
+ * @param offset Offset of the COLORMAP lump in the file
+ * @param size Size of the lump
+ * @return The maps, 256 palette indices each, brightest first
+ * @throws std::runtime_error if the lump does not hold one map
+ * @note DOOM has 32 light maps, then the invulnerability map and an all
+ *       black one; a trailing partial map is dropped.
+ */
+std::vector<uint8_t> WAD::readColormap(std::streamoff offset,
+                                       std::size_t    size) const {
+  std::vector<uint8_t> data = readLump(offset, size);
+  LumpBytes            bytes(data.data(), data.size(), "COLORMAP");
+  bytes.require(0, 256);
+
+  data.resize(data.size() / 256 * 256);
+  return data;
+}
+
 /**
  * @brief Process the WAD file and load all data
  * @throws std::runtime_error if any of the lumps cannot be read
@@ -404,244 +669,650 @@ std::vector<WAD::Color> WAD::readPalette(std::streamoff offset,
  *       to the console.
  */
 void WAD::processWAD() {
-  uint32_t                 offset, size;
-  std::vector<TextureDef>  allTextures;
-  std::vector<PatchData>   allPatches;
-  std::vector<Color>       palette;
-  std::vector<std::string> patchNames;
+  processAssets();
+
+  // Now process levels (using the loaded textures/patches)
+  for (size_t markerIndex : levelMarkers()) {
+    levels_.push_back(loadLevel(markerIndex));
+  }
+}
+
+/**
+ * @brief Load the data shared by every level: palette, textures and patches
+ * @throws std::runtime_error if any of the lumps cannot be read
+ */
+void WAD::processAssets() {
+  Assets  &assets = *assets_;
+  uint32_t offset, size;
 
   // First load PLAYPAL (needed for texture conversion)
-  if (findLump("PLAYPAL", offset, size, 0)) {
-    palette = readPalette(offset, size);
-    std::cout << "WAD :: Loaded PLAYPAL (palette data)\n";
+  if (findLump(packName("PLAYPAL"), offset, size, 0)) {
+    assets.palette = readPalette(offset, size);
+    log() << "WAD :: Loaded PLAYPAL (palette data)\n";
+  }
+
+  // COLORMAP maps the palette to each light level
+  if (findLump(packName("COLORMAP"), offset, size, 0)) {
+    assets.colormap = readColormap(offset, size);
+    log() << "WAD :: Loaded COLORMAP (" << assets.colormap.size() / 256
+          << " light maps)\n";
   }
 
   // Then load TEXTURE1/TEXTURE2 to know which patches we actually need
-  if (findLump("TEXTURE1", offset, size, 0)) {
+  if (findLump(packName("TEXTURE1"), offset, size, 0)) {
     std::vector<TextureDef> tex1 = readTextureDefs(offset, size);
-    allTextures.insert(allTextures.end(), tex1.begin(), tex1.end());
+    assets.texture_defs.insert(assets.texture_defs.end(), tex1.begin(),
+                               tex1.end());
   }
 
-  if (findLump("TEXTURE2", offset, size, 0)) {
+  if (findLump(packName("TEXTURE2"), offset, size, 0)) {
     std::vector<TextureDef> tex2 = readTextureDefs(offset, size);
-    allTextures.insert(allTextures.end(), tex2.begin(), tex2.end());
+    assets.texture_defs.insert(assets.texture_defs.end(), tex2.begin(),
+                               tex2.end());
   }
 
   // Load PNAMES (needed to map patch numbers to names)
-  if (findLump("PNAMES", offset, size, 0)) {
-    patchNames = readPatchNames(offset, size);
-    std::cout << "WAD :: Found " << patchNames.size()
-              << " patch names in PNAMES\n";
+  if (findLump(packName("PNAMES"), offset, size, 0)) {
+    assets.patch_names = readPatchNames(offset, size);
+    log() << "WAD :: Found " << assets.patch_names.size()
+          << " patch names in PNAMES\n";
 
     // Create a set of required patch indices from textures
-    std::vector<bool> requiredPatches(patchNames.size(), false);
-    for (size_t i = 0; i < allTextures.size(); i++) {
-      const TextureDef &tex = allTextures[i];
+    std::vector<bool> requiredPatches(assets.patch_names.size(), false);
+    for (size_t i = 0; i < assets.texture_defs.size(); i++) {
+      const TextureDef &tex = assets.texture_defs[i];
       for (size_t j = 0; j < tex.patches.size(); j++) {
         uint16_t patchNum = tex.patches[j].patch_num;
-        if (patchNum < patchNames.size()) {
+        if (patchNum < assets.patch_names.size()) {
           requiredPatches[patchNum] = true;
         } else {
-          std::cout << "WAD :: Warning: Texture '"
-                    << std::string(tex.name, strnlen(tex.name, 8))
-                    << "' references invalid patch number " << patchNum << "\n";
+          log() << "WAD :: Warning: Texture '"
+                << std::string(tex.name, strnlen(tex.name, 8))
+                << "' references invalid patch number " << patchNum << "\n";
         }
       }
     }
 
-    // Count how many patches we actually need
-    size_t                   requiredCount = 0;
-    std::vector<std::string> missingPatches;
-    missingPatches.reserve(patchNames.size());  // Pre-allocate worst case
-
-    for (size_t i = 0; i < requiredPatches.size(); i++) {
-      if (requiredPatches[i]) {
+    // PNAMES indices by name; a name listed more than once keeps every index
+    std::unordered_map<NameKey, std::vector<size_t>> patchIndex;
+    patchIndex.reserve(assets.patch_names.size());
+    size_t requiredCount = 0;
+    for (size_t p = 0; p < assets.patch_names.size(); p++) {
+      if (requiredPatches[p]) {
+        patchIndex[packName(assets.patch_names[p])].push_back(p);
         requiredCount++;
-        // Try to find this patch
-        uint32_t pOffset, pSize;
-        if (!findLump(patchNames[i], pOffset, pSize, 0)) {
-          missingPatches.push_back(patchNames[i]);
-        }
-      }
-    }
-    std::cout << "WAD :: Need to load " << requiredCount
-              << " patches for textures\n";
-    if (!missingPatches.empty()) {
-      std::cout << "WAD :: Missing patches: ";
-      for (const std::string &name : missingPatches) {
-        std::cout << name << " ";
       }
-      std::cout << "\n";
     }
 
-    // Struct to track patch marker sections
+    // Patch marker sections, by directory index
     struct PatchSection {
-      std::string start;
-      std::string end;
-      bool        found;
+      const char *start;
+      NameKey     startKey;
+      NameKey     endKey;
       size_t      startIndex;
       size_t      endIndex;
     };
-
-    // Define all possible patch sections
-    PatchSection sections[] = {
-        {"P1_START", "P1_END", false, 0, 0},  // Shareware patches
-        {"P2_START", "P2_END", false, 0, 0},  // Registered patches
-        {"P3_START", "P3_END", false, 0, 0}   // DOOM2 patches
+    constexpr size_t kNoLump    = static_cast<size_t>(-1);
+    PatchSection     sections[] = {
+        {"P1_START", packName("P1_START"), packName("P1_END"), kNoLump,
+         kNoLump},  // Shareware patches
+        {"P2_START", packName("P2_START"), packName("P2_END"), kNoLump,
+         kNoLump},  // Registered patches
+        {"P3_START", packName("P3_START"), packName("P3_END"), kNoLump,
+         kNoLump}  // DOOM2 patches
     };
 
-    // Find all patch marker sections
-    for (size_t s = 0; s < 3; s++) {
-      uint32_t startOffset, startSize, endOffset, endSize;
-      if (findLump(sections[s].start, startOffset, startSize, 0) &&
-          findLump(sections[s].end, endOffset, endSize, 0)) {
-        sections[s].found = true;
-        // Find section indices
-        for (size_t i = 0; i < directory_.size(); i++) {
-          std::string name(directory_[i].name, 8);
-          while (!name.empty() && name.back() == ' ')
-            name.pop_back();
-
-          if (name == sections[s].start)
-            sections[s].startIndex = i;
-          if (name == sections[s].end) {
-            sections[s].endIndex = i;
-            break;
+    // One pass over the directory finds the section markers and the first
+    // lump of every required patch, which is also what the direct lookup by
+    // name falls back to
+    std::vector<size_t> firstLump(assets.patch_names.size(), kNoLump);
+    for (size_t i = 0; i < lumpNames_.size(); i++) {
+      NameKey key = names_.key(lumpNames_[i]);
+      for (PatchSection &section : sections) {
+        if (key == section.startKey && section.startIndex == kNoLump) {
+          section.startIndex = i;
+        } else if (key == section.endKey && section.endIndex == kNoLump) {
+          section.endIndex = i;
+        }
+      }
+      auto found = patchIndex.find(key);
+      if (found != patchIndex.end()) {
+        for (size_t p : found->second) {
+          if (firstLump[p] == kNoLump) {
+            firstLump[p] = i;
           }
         }
       }
     }
 
-    // Load required patches from each section
-    std::vector<bool> patchLoaded(patchNames.size(), false);
-    size_t            totalLoaded = 0;
+    std::vector<std::string> missingPatches;
+    for (size_t p = 0; p < assets.patch_names.size(); p++) {
+      if (requiredPatches[p] && firstLump[p] == kNoLump) {
+        missingPatches.push_back(assets.patch_names[p]);
+      }
+    }
+    log() << "WAD :: Need to load " << requiredCount
+          << " patches for textures\n";
+    if (!missingPatches.empty()) {
+      log() << "WAD :: Missing patches: ";
+      for (const std::string &name : missingPatches) {
+        log() << name << " ";
+      }
+      log() << "\n";
+    }
+
+    // Pick the lump each required patch is loaded from: the one inside a
+    // patch section if there is one, otherwise the first lump with its name
+    struct PatchJob {
+      size_t patch;    // Index in PNAMES
+      size_t lump;     // Index in the directory
+      size_t section;  // Index in sections, or 3 when loaded by name
+    };
+    std::vector<PatchJob> jobs;
+    std::vector<bool>     patchAssigned(assets.patch_names.size(), false);
+    jobs.reserve(requiredCount);
 
     for (size_t s = 0; s < 3; s++) {
-      if (!sections[s].found)
+      const PatchSection &section = sections[s];
+      if (section.startIndex == kNoLump || section.endIndex == kNoLump) {
         continue;
-
-      size_t sectionLoaded = 0;
-      for (size_t i = sections[s].startIndex + 1; i < sections[s].endIndex;
-           i++) {
-        std::string patchName(directory_[i].name, 8);
-        while (!patchName.empty() && patchName.back() == ' ')
-          patchName.pop_back();
-
-        // Find this patch's index in PNAMES
-        for (size_t p = 0; p < patchNames.size(); p++) {
-          if (!patchLoaded[p] && requiredPatches[p] &&
-              patchNames[p] == patchName) {
-            // Load the patch
-            PatchData patch =
-                readPatch(directory_[i].filepos, directory_[i].size, patchName);
-            allPatches.push_back(patch);
-            patchLoaded[p] = true;
-            sectionLoaded++;
-            totalLoaded++;
+      }
+      for (size_t i = section.startIndex + 1; i < section.endIndex; i++) {
+        auto found = patchIndex.find(names_.key(lumpNames_[i]));
+        if (found == patchIndex.end()) {
+          continue;
+        }
+        for (size_t p : found->second) {
+          if (!patchAssigned[p]) {
+            patchAssigned[p] = true;
+            jobs.push_back({p, i, s});
             break;
           }
         }
       }
+    }
+    for (size_t p = 0; p < assets.patch_names.size(); p++) {
+      if (requiredPatches[p] && !patchAssigned[p] && firstLump[p] != kNoLump) {
+        jobs.push_back({p, firstLump[p], 3});
+      }
+    }
 
-      std::cout << "WAD :: Loaded " << sectionLoaded << " patches from "
-                << sections[s].start << " section\n";
-    }
-
-    // If we still have missing patches, try loading directly by name
-    if (totalLoaded < requiredCount) {
-      size_t directLoaded = 0;
-      for (size_t p = 0; p < patchNames.size(); p++) {
-        if (!patchLoaded[p] && requiredPatches[p]) {
-          if (findLump(patchNames[p], offset, size, 0)) {
-            PatchData patch = readPatch(offset, size, patchNames[p]);
-            allPatches.push_back(patch);
-            patchLoaded[p] = true;
-            directLoaded++;
-            totalLoaded++;
+    // Read the patches through one plan, a few large reads since they sit
+    // side by side in their sections, then decode them in parallel. If a
+    // patch runs past the end of the file, each one is read on its own so
+    // only the broken ones are skipped. With a memory budget only their
+    // location is recorded, see getPatch()
+    std::vector<PatchData>   decoded;
+    std::vector<std::string> errors(jobs.size());
+    if (memoryBudget_ == 0) {
+      decoded.resize(jobs.size());
+      ReadPlan plan;
+      for (const PatchJob &job : jobs) {
+        plan.add(directory_[job.lump].filepos, directory_[job.lump].size);
+      }
+      bool fetched = true;
+      try {
+        fetch(plan);
+      } catch (const std::runtime_error &) {
+        fetched = false;
+      }
+      parallelFor(jobs.size(), [&](size_t j) {
+        const Directory   &entry = directory_[jobs[j].lump];
+        const std::string &name  = assets.patch_names[jobs[j].patch];
+        try {
+          if (fetched) {
+            LumpBytes bytes = plan.lump(j, "patch");
+            decoded[j]      = decodePatch(bytes.data(), bytes.size(), name);
+          } else {
+            decoded[j] = readPatch(entry.filepos, entry.size, name);
           }
+        } catch (const std::runtime_error &e) {
+          errors[j] = e.what();
         }
+      });
+      if (verbose_ && fetched) {
+        log() << "Patch reads: " << plan.reads() << " (" << plan.bytesRead()
+              << " bytes)\n";
+      }
+    }
+
+    // Keep the results in job order so the patch list is deterministic,
+    // skipping (with a warning) any malformed patch. Only patches that
+    // decoded are registered for getPatch(); with a memory budget nothing is
+    // decoded yet, so every located patch is
+    size_t sectionLoaded[4] = {0, 0, 0, 0};
+    size_t totalLoaded      = 0;
+    for (size_t j = 0; j < jobs.size(); j++) {
+      const std::string &patchName = assets.patch_names[jobs[j].patch];
+      const Directory   &entry     = directory_[jobs[j].lump];
+      if (!errors[j].empty()) {
+        log() << "WAD :: Warning: Skipping patch '" << patchName
+              << "': " << errors[j] << "\n";
+        patchErrors_.emplace(packName(patchName), std::move(errors[j]));
+        continue;
       }
-      if (directLoaded > 0) {
-        std::cout << "WAD :: Loaded " << directLoaded
-                  << " patches directly by name\n";
+      NameKey key = packName(patchName);
+      if (memoryBudget_ == 0) {
+        patchIndex_.emplace(key, assets.patches.size());
+        assets.patches.push_back(std::move(decoded[j]));
+      } else {
+        patchLumps_.emplace(key, LumpRef{entry.filepos, entry.size});
       }
+      sectionLoaded[jobs[j].section]++;
+      totalLoaded++;
     }
 
-    std::cout << "WAD :: Successfully loaded " << totalLoaded << " of "
-              << requiredCount << " required patches\n";
+    for (size_t s = 0; s < 3; s++) {
+      if (sections[s].startIndex != kNoLump &&
+          sections[s].endIndex != kNoLump) {
+        log() << "WAD :: Loaded " << sectionLoaded[s] << " patches from "
+              << sections[s].start << " section\n";
+      }
+    }
+    if (sectionLoaded[3] > 0) {
+      log() << "WAD :: Loaded " << sectionLoaded[3]
+            << " patches directly by name\n";
+    }
+
+    log() << "WAD :: "
+          << (memoryBudget_ > 0 ? "Indexed " : "Successfully loaded ")
+          << totalLoaded << " of " << requiredCount
+          << " required patches\n";
   }
+}
 
-  // Now process levels (using the loaded textures/patches)
+/**
+ * @brief Enable the memory-bounded mode
+ * @param bytes Approximate memory budget in bytes, 0 to disable
+ * @note Must be called before processAssets(). Half of the budget goes to
+ *       decoded patches and an eighth to flats; the rest is left for the
+ *       level being converted and its output.
+ */
+void WAD::setMemoryBudget(std::size_t bytes) {
+  memoryBudget_ = bytes;
+  patchCache_.setBudget(bytes / 2);
+  flatCache_.setBudget(bytes / 8);
+}
+
+/**
+ * @brief Get a decoded patch by name
+ * @param name Packed patch name (as in PNAMES, see packName)
+ * @return The patch, or nullptr if the WAD has no such patch
+ * @throws std::runtime_error if the patch is malformed, whether it failed to
+ *         decode up front or on demand
+ * @note Patches decoded up front by processAssets() are returned directly
+ *       (the pointer shares ownership of the assets); in memory-bounded mode
+ *       they are decoded on demand through the LRU patch cache.
+ */
+std::shared_ptr<const WAD::PatchData> WAD::getPatch(NameKey name) const {
+  auto decoded = patchIndex_.find(name);
+  if (decoded != patchIndex_.end()) {
+    return std::shared_ptr<const PatchData>(
+        assets_, &assets_->patches[decoded->second]);
+  }
+  auto failed = patchErrors_.find(name);
+  if (failed != patchErrors_.end()) {
+    throw std::runtime_error(failed->second);
+  }
+
+  auto it = patchLumps_.find(name);
+  if (it == patchLumps_.end()) {
+    return nullptr;
+  }
+
+  const LumpRef &ref = it->second;
+  return patchCache_.get(
+      name,
+      [&]() {
+        return readPatch(ref.filepos, ref.size,
+                         std::string(unpackName(name).view()));
+      },
+      [](const PatchData &patch) {
+        return sizeof(PatchData) + patch.pixels.size() + patch.mask.size();
+      });
+}
+
+/**
+ * @brief Read the data of a lump
+ * @param index Directory index of the lump
+ * @return The lump bytes
+ * @throws std::runtime_error if the index is out of range or the lump cannot
+ *         be read
+ */
+std::vector<uint8_t> WAD::lumpData(size_t index) const {
+  if (index >= directory_.size()) {
+    throw std::runtime_error("Lump index out of range");
+  }
+  return readLump(directory_[index].filepos, directory_[index].size);
+}
+
+/**
+ * @brief Find the directory index of every level marker
+ * @return Directory indices of the level markers, in file order
+ * @note Besides the ExMy and MAPxx names, any lump followed by a TEXTMAP lump
+ *       is a marker: UDMF levels may have any name.
+ */
+std::vector<size_t> WAD::levelMarkers() const {
+  constexpr NameKey   textmap = packName("TEXTMAP");
+  std::vector<size_t> markers;
   for (size_t i = 0; i < directory_.size(); i++) {
-    std::string lumpName = trimString(directory_[i].name, 8);
-
-    if (isLevelMarker(lumpName)) {
-      Level level;
-      std::strncpy(level.name, lumpName.c_str(), 8);
-      level.texture_defs = allTextures;
-      level.patches      = allPatches;
-      level.patch_names  = patchNames;
-      level.palette      = palette;
-
-      // Load level data (VERTEXES, LINEDEFS, etc.)
-      uint32_t vOffset, vSize;
-      if (findLump("VERTEXES", vOffset, vSize, i + 1)) {
-        level.vertices = readVertices(vOffset, vSize);
-      }
-      if (findLump("LINEDEFS", vOffset, vSize, i + 1)) {
-        level.linedefs = readLinedefs(vOffset, vSize);
-      }
-      if (findLump("SIDEDEFS", vOffset, vSize, i + 1)) {
-        level.sidedefs = readSidedefs(vOffset, vSize);
+    NameKey lumpName  = names_.key(lumpNames_[i]);
+    bool    isTextmap = i + 1 < directory_.size() &&
+                     names_.key(lumpNames_[i + 1]) == textmap;
+    if (isLevelMarker(lumpName) || isTextmap) {
+      LevelFormat format = levelFormat(i);
+      const char *kind   = format == LevelFormat::UDMF    ? "UDMF"
+                           : format == LevelFormat::Hexen ? "Hexen"
+                           : nameChar(lumpName, 0) == 'E' ? "DOOM1"
+                                                          : "DOOM2";
+      log() << "WAD :: Found " << kind
+            << " level in WAD file: " << unpackName(lumpName).view()
+            << "\n";
+      markers.push_back(i);
+    }
+  }
+  return markers;
+}
+
+/**
+ * @brief Detect the map format of a level
+ * @param markerIndex Directory index of the level marker
+ * @return UDMF if the marker is followed by TEXTMAP, Hexen if the level lumps
+ *         include BEHAVIOR, DOOM otherwise
+ * @note Only the binary level lumps right after the marker are looked at, so
+ *       a BEHAVIOR lump further down the WAD cannot change the format.
+ */
+WAD::LevelFormat WAD::levelFormat(size_t markerIndex) const {
+  constexpr NameKey textmap      = packName("TEXTMAP");
+  constexpr NameKey behavior     = packName("BEHAVIOR");
+  constexpr NameKey binaryLumps[] = {
+      packName("THINGS"),   packName("LINEDEFS"), packName("SIDEDEFS"),
+      packName("VERTEXES"), packName("SEGS"),     packName("SSECTORS"),
+      packName("NODES"),    packName("SECTORS"),  packName("REJECT"),
+      packName("BLOCKMAP"), packName("SCRIPTS")};
+
+  for (size_t i = markerIndex + 1; i < directory_.size(); i++) {
+    NameKey name = names_.key(lumpNames_[i]);
+    if (name == textmap && i == markerIndex + 1) {
+      return LevelFormat::UDMF;
+    }
+    if (name == behavior) {
+      return LevelFormat::Hexen;
+    }
+    if (std::find(std::begin(binaryLumps), std::end(binaryLumps), name) ==
+        std::end(binaryLumps)) {
+      break;
+    }
+  }
+  return LevelFormat::Doom;
+}
+
+/**
+ * @brief Copy a level into this one
+ * @param other Level to copy
+ * @return This level
+ * @note See the move assignment; the copy is made first, so this level is
+ *       left as it was if copying throws.
+ */
+WAD::Level &WAD::Level::operator=(const Level &other) {
+  if (this != &other) {
+    *this = Level(other);
+  }
+  return *this;
+}
+
+/**
+ * @brief Move a level into this one
+ * @param other Level to move from
+ * @return This level
+ * @note The implicit assignment would replace the arena first, as the first
+ *       member, and free it while the vectors still hold memory from it; the
+ *       vectors would then move their elements one by one into freed memory,
+ *       since polymorphic allocators do not propagate on assignment. The
+ *       level is instead destroyed, vectors first, and move constructed
+ *       again, so its vectors take the allocator of the other level.
+ */
+WAD::Level &WAD::Level::operator=(Level &&other) noexcept {
+  if (this != &other) {
+    this->~Level();
+    new (this) Level(std::move(other));
+  }
+  return *this;
+}
+
+/**
+ * @brief Load a single level
+ * @param markerIndex Directory index of the level marker
+ * @param upstream Memory resource the level arena takes its memory from
+ * @param useArena Allocate the geometry from a per-level arena (true), or
+ *        directly from upstream (false, used by the benchmarks to compare)
+ * @return Level with its geometry, things, flats and the shared assets
+ * @throws std::runtime_error if any of the level lumps cannot be read
+ * @note processAssets() must have been called first for the level to carry
+ *       the palette, texture definitions and patches.
+ * @note Hexen things and linedefs are split into the DOOM records and their
+ *       specials; UDMF levels are parsed from their TEXTMAP lump.
+ * @note The arena is sized from the level lumps up front, so the whole
+ *       geometry of a level normally lives in a single upstream block which
+ *       is released at once when the last copy of the level goes away.
+ */
+WAD::Level WAD::loadLevel(size_t                     markerIndex,
+                          std::pmr::memory_resource *upstream,
+                          bool                       useArena) const {
+  size_t      i      = markerIndex;
+  LevelFormat format = levelFormat(i);
+
+  // Locate the level lumps (VERTEXES, LINEDEFS, etc.) first, to size the
+  // arena and plan their reads; the node lumps are only needed to check them
+  constexpr NameKey lumpNames[] = {
+      packName("VERTEXES"), packName("LINEDEFS"), packName("SIDEDEFS"),
+      packName("SECTORS"),  packName("THINGS"),   packName("SEGS"),
+      packName("SSECTORS"), packName("NODES")};
+  LumpRef     lumps[8]  = {};
+  bool        found[8]  = {};
+  std::size_t arenaSize = 0;
+  ReadPlan    plan;
+  std::size_t planned[8] = {};
+  std::size_t textmap    = 0;
+  std::size_t behavior   = 0;
+  if (format == LevelFormat::UDMF) {
+    // The geometry takes about half the size of its text
+    arenaSize = directory_[i + 1].size / 2;
+    textmap   = plan.add(directory_[i + 1].filepos, directory_[i + 1].size);
+  } else {
+    // The node lumps are read whenever nodes are built: to check them, or to
+    // keep them when new ones cannot be built
+    size_t count = nodeBuilding_ == NodeBuilding::Keep ? 5 : 8;
+    for (size_t l = 0; l < count; l++) {
+      found[l] = findLump(lumpNames[l], lumps[l].filepos, lumps[l].size, i + 1);
+      if (!found[l]) {
+        lumps[l] = {};
+      } else if (l < 5) {
+        // Room for the records plus alignment slack for each vector
+        arenaSize += lumps[l].size + alignof(std::max_align_t);
       }
-      if (findLump("SECTORS", vOffset, vSize, i + 1)) {
-        level.sectors = readSectors(vOffset, vSize);
+      planned[l] = plan.add(lumps[l].filepos, lumps[l].size);
+    }
+    if (format == LevelFormat::Hexen) {
+      // Kept as is, for the WAD writer
+      LumpRef ref{};
+      findLump(packName("BEHAVIOR"), ref.filepos, ref.size, i + 1);
+      behavior = plan.add(ref.filepos, ref.size);
+    }
+  }
+  // Lumps usually follow the marker back to back: one read for the level
+  fetch(plan);
+  if (format == LevelFormat::Hexen) {
+    // Hexen records are larger than the DOOM ones; add their arguments
+    arenaSize += lumps[1].size / LumpRecord<HexenLinedef>::size *
+                     sizeof(LinedefArgs) +
+                 lumps[4].size / LumpRecord<HexenThing>::size *
+                     sizeof(ThingArgs) +
+                 2 * alignof(std::max_align_t);
+  }
+
+  std::shared_ptr<std::pmr::memory_resource> arena;
+  if (useArena) {
+    arena = std::make_shared<std::pmr::monotonic_buffer_resource>(
+        std::max<std::size_t>(arenaSize, 64), upstream);
+  } else {
+    // Non-owning: the geometry goes straight to upstream
+    arena = std::shared_ptr<std::pmr::memory_resource>(
+        std::shared_ptr<std::pmr::memory_resource>(), upstream);
+  }
+
+  Level level(arena);
+  std::memcpy(level.name, unpackName(names_.key(lumpNames_[i])).data, 8);
+  level.format = format;
+  level.assets = assets_;
+  if (format == LevelFormat::Hexen) {
+    LumpBytes b = plan.lump(behavior, "BEHAVIOR");
+    level.behavior.assign(b.data(), b.data() + b.size());
+  }
+
+  // Load level data (VERTEXES, LINEDEFS, etc.)
+  if (format == LevelFormat::UDMF) {
+    LumpBytes text = plan.lump(textmap, "TEXTMAP");
+    parseUDMF(std::string_view(reinterpret_cast<const char *>(text.data()),
+                               text.size()),
+              level);
+  }
+  auto bytes = [&](size_t l) { return plan.lump(planned[l], "level"); };
+  if (found[0]) {
+    LumpBytes b    = bytes(0);
+    level.vertices = readVertices(b.data(), b.size(), arena.get());
+  }
+  if (found[1] && format == LevelFormat::Hexen) {
+    LumpBytes b = bytes(1);
+    readHexenLinedefs(b.data(), b.size(), level);
+  } else if (found[1]) {
+    LumpBytes b    = bytes(1);
+    level.linedefs = readLinedefs(b.data(), b.size(), arena.get());
+  }
+  if (found[2]) {
+    LumpBytes b    = bytes(2);
+    level.sidedefs = readSidedefs(b.data(), b.size(), arena.get());
+  }
+  if (found[3]) {
+    LumpBytes b   = bytes(3);
+    level.sectors = readSectors(b.data(), b.size(), arena.get());
+  }
+  if (found[4] && format == LevelFormat::Hexen) {
+    LumpBytes b = bytes(4);
+    readHexenThings(b.data(), b.size(), level);
+  } else if (found[4]) {
+    LumpBytes b  = bytes(4);
+    level.things = readThings(b.data(), b.size(), arena.get());
+  }
+
+  // Build the BSP nodes, or keep the level's own when they still fit it
+  if (nodeBuilding_ != NodeBuilding::Keep) {
+    // The level's own nodes (UDMF levels have none)
+    auto readNodes = [&]() {
+      if (format == LevelFormat::UDMF) {
+        level.segs.clear();
+        level.subsectors.clear();
+        level.nodes.clear();
+        return;
       }
-      if (findLump("THINGS", vOffset, vSize, i + 1)) {
-        level.things = readThings(vOffset, vSize);
+      LumpBytes segs = bytes(5), subsectors = bytes(6), nodes = bytes(7);
+      level.segs = readRecords<Seg>(segs.data(), segs.size(), arena.get());
+      level.subsectors = readRecords<SubSector>(
+          subsectors.data(), subsectors.size(), arena.get());
+      level.nodes = readRecords<Node>(nodes.data(), nodes.size(), arena.get());
+    };
+    bool rebuild = nodeBuilding_ == NodeBuilding::Always ||
+                   format == LevelFormat::UDMF;
+    if (!rebuild) {
+      readNodes();
+      rebuild = !nodesMatchLevel(level);
+    }
+    if (rebuild) {
+      std::string name(level.name, strnlen(level.name, 8));
+      // buildNodes() drops the split vertices of the old nodes first; they
+      // are put back if the level is too big for the DOOM node format
+      std::vector<Vertex> vertices(level.vertices.begin(),
+                                   level.vertices.end());
+      std::ostringstream  message;
+      try {
+        NodeStats stats = buildNodes(level);
+        message << "WAD :: Built nodes for " << name << ": " << stats.nodes
+                << " nodes, " << stats.subsectors << " subsectors, "
+                << stats.segs << " segs (" << stats.splits << " splits)\n";
+      } catch (const std::runtime_error &e) {
+        level.vertices.assign(vertices.begin(), vertices.end());
+        readNodes();
+        message << "WAD :: Warning: Cannot build the nodes of " << name
+                << ": " << e.what()
+                << (level.subsectors.empty() ? "; it is left without nodes\n"
+                                             : "; keeping its own nodes\n");
       }
+      log() << message.str();
+    }
+  }
 
-      // Load player start position (Thing type 1)
-      for (size_t j = 0; j < level.things.size(); j++) {
-        if (level.things[j].type == 1) {
-          level.has_player_start = true;
-          level.player_start     = level.things[j];
-          break;
-        }
-      }
+  // Load player start position (Thing type 1)
+  for (size_t j = 0; j < level.things.size(); j++) {
+    if (level.things[j].type == kPlayer1Start) {
+      level.has_player_start = true;
+      level.player_start     = level.things[j];
+      break;
+    }
+  }
 
-      // Load all unique flat textures referenced by sectors
-      std::set<std::string> uniqueFlats;
-      for (size_t j = 0; j < level.sectors.size(); j++) {
-        std::string floorTex = trimString(level.sectors[j].floor_texture, 8);
-        std::string ceilTex  = trimString(level.sectors[j].ceiling_texture, 8);
+  // Load all unique flat textures referenced by sectors. The packed names are
+  // only needed while loading, so they live in a scratch buffer on the stack.
+  constexpr NameKey                   noTexture = packName("-");
+  std::byte                           scratch[4096];
+  std::pmr::monotonic_buffer_resource scratchArena(scratch, sizeof(scratch),
+                                                   upstream);
+  std::pmr::set<NameKey>              uniqueFlats(&scratchArena);
+  for (size_t j = 0; j < level.sectors.size(); j++) {
+    NameKey floorTex = packName(level.sectors[j].floor_texture);
+    NameKey ceilTex  = packName(level.sectors[j].ceiling_texture);
+
+    if (floorTex != 0 && floorTex != noTexture) {
+      uniqueFlats.insert(floorTex);
+    }
+    if (ceilTex != 0 && ceilTex != noTexture) {
+      uniqueFlats.insert(ceilTex);
+    }
+  }
 
-        if (!floorTex.empty() && floorTex != "-") {
-          uniqueFlats.insert(floorTex);
-        }
-        if (!ceilTex.empty() && ceilTex != "-") {
-          uniqueFlats.insert(ceilTex);
-        }
+  // Load each unique flat texture
+  for (NameKey flatName : uniqueFlats) {
+    auto found = flatLumps_.find(flatName);
+    if (found != flatLumps_.end()) {
+      const LumpRef                              &ref      = found->second;
+      std::shared_ptr<const std::vector<uint8_t>> flatData = flatCache_.get(
+          flatName, [&]() { return readLump(ref.filepos, ref.size); },
+          [](const std::vector<uint8_t> &data) { return data.size(); });
+      if (flatData->size() == 64 * 64) {  // DOOM flats are always 64x64
+        FlatData flat;
+        std::memcpy(flat.name, unpackName(flatName).data, 8);
+        flat.data = *flatData;
+        level.flats.push_back(flat);
       }
+    }
+  }
 
-      // Load each unique flat texture
-      for (std::set<std::string>::iterator it = uniqueFlats.begin();
-           it != uniqueFlats.end(); ++it) {
-        uint32_t offset, size;
-        if (findLump(*it, offset, size, 0)) {
-          std::vector<uint8_t> flatData = readLump(offset, size);
-          if (flatData.size() == 64 * 64) {  // DOOM flats are always 64x64
-            FlatData flat;
-            std::strncpy(flat.name, it->c_str(), 8);
-            flat.data = flatData;
-            level.flats.push_back(flat);
-          }
-        }
-      }
+  return level;
+}
 
-      levels_.push_back(level);
-    }
+/**
+ * @brief Run every loaded level through an emitter
+ * @param emitter Emitter for the output format
+ * @param levels Levels to convert
+ * @return The complete document
+ */
+static std::string emitLevels(Emitter                       &emitter,
+                              const std::vector<WAD::Level> &levels) {
+  std::string out = emitter.begin();
+  for (const WAD::Level &level : levels) {
+    out += emitter.level(level);
   }
+  out += emitter.end();
+  return out;
 }
 
 /**
@@ -652,77 +1323,17 @@ void WAD::processWAD() {
  * compact version, with arrays formatted in a more human-readable way.
  */
 std::string WAD::toJSONVerbose() const {
-  nlohmann::json j;
-  j["levels"] = nlohmann::json::array();
-
-  for (size_t levelIndex = 0; levelIndex < levels_.size(); levelIndex++) {
-    const Level   &level = levels_[levelIndex];
-    nlohmann::json levelJson;
-    levelJson["name"] = level.name;
-
-    levelJson["vertices"] = nlohmann::json::array();
-    for (size_t vertIndex = 0; vertIndex < level.vertices.size(); vertIndex++) {
-      const Vertex &v = level.vertices[vertIndex];
-      levelJson["vertices"].push_back({{"x", v.x}, {"y", v.y}});
-    }
-
-    levelJson["linedefs"] = nlohmann::json::array();
-    for (size_t lineIndex = 0; lineIndex < level.linedefs.size(); lineIndex++) {
-      const Linedef &l = level.linedefs[lineIndex];
-      levelJson["linedefs"].push_back({{"start", l.start_vertex},
-                                       {"end", l.end_vertex},
-                                       {"flags", l.flags},
-                                       {"type", l.line_type},
-                                       {"tag", l.sector_tag},
-                                       {"right_sidedef", l.right_sidedef},
-                                       {"left_sidedef", l.left_sidedef}});
-    }
-
-    levelJson["sidedefs"] = nlohmann::json::array();
-    for (size_t sideIndex = 0; sideIndex < level.sidedefs.size(); sideIndex++) {
-      const Sidedef &s = level.sidedefs[sideIndex];
-      levelJson["sidedefs"].push_back(
-          {{"x_offset", s.x_offset},
-           {"y_offset", s.y_offset},
-           {"upper_texture",
-            std::string(s.upper_texture, strnlen(s.upper_texture, 8))},
-           {"lower_texture",
-            std::string(s.lower_texture, strnlen(s.lower_texture, 8))},
-           {"middle_texture",
-            std::string(s.middle_texture, strnlen(s.middle_texture, 8))},
-           {"sector", s.sector}});
-    }
-
-    levelJson["sectors"] = nlohmann::json::array();
-    for (size_t sectIndex = 0; sectIndex < level.sectors.size(); sectIndex++) {
-      const Sector &s = level.sectors[sectIndex];
-      levelJson["sectors"].push_back(
-          {{"floor_height", s.floor_height},
-           {"ceiling_height", s.ceiling_height},
-           {"floor_texture",
-            std::string(s.floor_texture, strnlen(s.floor_texture, 8))},
-           {"ceiling_texture",
-            std::string(s.ceiling_texture, strnlen(s.ceiling_texture, 8))},
-           {"light_level", s.light_level},
-           {"type", s.type},
-           {"tag", s.tag}});
-    }
-
-    levelJson["things"] = nlohmann::json::array();
-    for (size_t thingIndex = 0; thingIndex < level.things.size();
-         thingIndex++) {
-      const Thing &t = level.things[thingIndex];
-      levelJson["things"].push_back({{"x", t.x},
-                                     {"y", t.y},
-                                     {"angle", t.angle},
-                                     {"type", t.type},
-                                     {"flags", t.flags}});
-    }
-
-    j["levels"].push_back(levelJson);
-  }
-
-  return j.dump(1);
+  JSONVerboseEmitter emitter;
+  return emitLevels(emitter, levels_);
+}
+
+/**
+ * @brief Convert WAD data to the columnar JSON format
+ * @return JSON string with one array per field and a name dictionary
+ */
+std::string WAD::toJSONColumnar() const {
+  JSONColumnarEmitter emitter;
+  return emitLevels(emitter, levels_);
 }
 
 /**
@@ -749,56 +1360,26 @@ std::string formatArray(const nlohmann::json &array) {
  * @return DSL string containing the WAD data
  */
 std::string WAD::toDSL() const {
-  std::ostringstream out;
-
-  for (size_t levelIndex = 0; levelIndex < levels_.size(); levelIndex++) {
-    const Level &level = levels_[levelIndex];
-
-    out << "LEVEL " << level.name << " START\n\n";
-
-    // VERTICES
-    out << "VERTICES:\n";
-    for (size_t vertIndex = 0; vertIndex < level.vertices.size(); vertIndex++) {
-      const Vertex &v = level.vertices[vertIndex];
-      out << "(" << v.x << ", " << v.y << ")\n";
-    }
-
-    // LINEDEFS
-    out << "\nLINEDEFS:\n";
-    for (size_t lineIndex = 0; lineIndex < level.linedefs.size(); lineIndex++) {
-      const Linedef &l = level.linedefs[lineIndex];
-      out << l.start_vertex << " -> " << l.end_vertex << " | flags: " << l.flags
-          << " | type: " << l.line_type << " | tag: " << l.sector_tag
-          << " | right: " << l.right_sidedef << " | left: " << l.left_sidedef
-          << "\n";
-    }
-
-    // SECTORS
-    out << "\nSECTORS:\n";
-    for (size_t sectIndex = 0; sectIndex < level.sectors.size(); sectIndex++) {
-      const Sector &s = level.sectors[sectIndex];
-      out << "floor: " << s.floor_height << " | ceil: " << s.ceiling_height
-          << " | light: " << s.light_level << " | floor_tex: "
-          << std::string(s.floor_texture, strnlen(s.floor_texture, 8))
-          << " | ceil_tex: "
-          << std::string(s.ceiling_texture, strnlen(s.ceiling_texture, 8))
-          << "\n";
-    }
-
-    // THINGS
-    out << "\nTHINGS:\n";
-    for (size_t thingIndex = 0; thingIndex < level.things.size();
-         thingIndex++) {
-      const Thing &t       = level.things[thingIndex];
-      std::string  typeStr = (t.type == 1) ? "PlayerStart" : "Thing";
-      out << typeStr << " at (" << t.x << ", " << t.y << ")"
-          << " | angle: " << t.angle << " | type: " << t.type << "\n";
-    }
+  DSLEmitter emitter;
+  return emitLevels(emitter, levels_);
+}
 
-    out << "\nLEVEL " << level.name << " END\n\n";
-  }
+/**
+ * @brief Convert WAD data to the verbose DSL format
+ * @return DSL string containing the WAD data, sidedefs included
+ */
+std::string WAD::toDSLVerbose() const {
+  DSLEmitter emitter(true);
+  return emitLevels(emitter, levels_);
+}
 
-  return out.str();
+/**
+ * @brief Sector adjacency graph and grid index of every level
+ * @return JSON string with one line per level
+ */
+std::string WAD::toSpatial() const {
+  SpatialEmitter emitter;
+  return emitLevels(emitter, levels_);
 }
 
 /**
@@ -809,110 +1390,8 @@ std::string WAD::toDSL() const {
  * verbose version, with arrays formatted in a single line.
  */
 std::string WAD::toJSON() const {
-  std::ostringstream out;
-  out << "{\n";
-
-  // lambda helper to print arrays with one object per line
-  auto dumpArray = [&](const std::string &key, const nlohmann::json &array) {
-    out << "   \"" << key << "\": [\n";
-    for (size_t i = 0; i < array.size(); ++i) {
-      out << "    " << array[i].dump(-1);
-      if (i < array.size() - 1)
-        out << ",";
-      out << "\n";
-    }
-    out << "   ]";
-  };
-
-  out << " \"levels\": [\n";
-  for (size_t levelIndex = 0; levelIndex < levels_.size(); levelIndex++) {
-    const Level &level = levels_[levelIndex];
-    // nlohmann::json levelJson;
-    // levelJson["name"] = level.name;
-    out << "  {\n" << "   \"name\": \"" << level.name << "\",\n";
-
-    // v (vertices)
-    nlohmann::json jv = nlohmann::json::array();
-    for (size_t vertIndex = 0; vertIndex < level.vertices.size(); vertIndex++) {
-      const Vertex &v = level.vertices[vertIndex];
-      jv.push_back({{"x", v.x}, {"y", v.y}});
-    }
-    // levelJson["v"] = jv;
-    dumpArray("v", jv);
-    out << ",\n";
-
-    // l (linedefs)
-    nlohmann::json jl = nlohmann::json::array();
-    for (size_t lineIndex = 0; lineIndex < level.linedefs.size(); lineIndex++) {
-      const Linedef &l = level.linedefs[lineIndex];
-      jl.push_back({{"s", l.start_vertex},
-                    {"e", l.end_vertex},
-                    {"f", l.flags},
-                    {"t", l.line_type},
-                    {"g", l.sector_tag},
-                    {"r", l.right_sidedef},
-                    {"l", l.left_sidedef}});
-    }
-    // levelJson["l"] = jl;
-    dumpArray("l", jl);
-    out << ",\n";
-
-    // si (sidedefs)
-    nlohmann::json jsi = nlohmann::json::array();
-    for (size_t sideIndex = 0; sideIndex < level.sidedefs.size(); sideIndex++) {
-      const Sidedef &s = level.sidedefs[sideIndex];
-      jsi.push_back({{"x", s.x_offset},
-                     {"y", s.y_offset},
-                     {"u", trimString(s.upper_texture, 8)},
-                     {"l", trimString(s.lower_texture, 8)},
-                     {"m", trimString(s.middle_texture, 8)},
-                     {"s", s.sector}});
-    }
-    // levelJson["si"] = jsi;
-    dumpArray("si", jsi);
-    out << ",\n";
-
-    // se (sectors)
-    nlohmann::json jse = nlohmann::json::array();
-    for (size_t sectIndex = 0; sectIndex < level.sectors.size(); sectIndex++) {
-      const Sector &s = level.sectors[sectIndex];
-      jse.push_back({{"f", s.floor_height},
-                     {"c", s.ceiling_height},
-                     {"t", trimString(s.floor_texture, 8)},
-                     {"x", trimString(s.ceiling_texture, 8)},
-                     {"l", s.light_level},
-                     {"y", s.type},
-                     {"g", s.tag}});
-    }
-    // levelJson["se"] = jse;
-    dumpArray("se", jse);
-    out << ",\n";
-
-    // t (things)
-    nlohmann::json jt = nlohmann::json::array();
-    for (size_t thingIndex = 0; thingIndex < level.things.size();
-         thingIndex++) {
-      const Thing &t = level.things[thingIndex];
-      jt.push_back({{"x", t.x},
-                    {"y", t.y},
-                    {"a", t.angle},
-                    {"t", t.type},
-                    {"f", t.flags}});
-    }
-    // levelJson["t"] = jt;
-    dumpArray("t", jt);
-    out << "\n  }";
-
-    // out << "  " << levelJson.dump(2);
-    if (levelIndex < levels_.size() - 1) {
-      out << ",";
-    }
-    out << "\n";
-  }
-  out << " ]\n";
-  out << "}\n";
-
-  return out.str();
+  JSONEmitter emitter;
+  return emitLevels(emitter, levels_);
 }
 
 /**
@@ -922,12 +1401,12 @@ std::string WAD::toJSON() const {
  * @throws std::runtime_error if the level is not found
  */
 WAD::Level WAD::getLevel(const std::string &name) const {
-  std::cout << "WAD :: Looking for level: '" << name << "'...";
+  log() << "WAD :: Looking for level: '" << name << "'...";
 
   // Compare the first 8 characters of the name
   for (size_t i = 0; i < levels_.size(); i++) {
     if (strncmp(levels_[i].name, name.c_str(), 8) == 0) {
-      std::cout << " found!\n";
+      log() << " found!\n";
       return levels_[i];
     }
   }
@@ -1,10 +1,18 @@
 #ifndef WAD_HPP
 #define WAD_HPP
 
+#include "assetcache.hpp"
+#include "names.hpp"
 #include <cstddef>
 #include <cstdint>
 #include <ios>
+#include <iosfwd>
+#include <memory>
+#include <memory_resource>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 /**
@@ -12,8 +20,13 @@
  * - WAD: Standard WAD format
  * - JSON: JSON format
  * - JSON_VERBOSE: JSON format with verbose output
+ * - JSON_COLUMNAR: JSON format with one array per field
  * - DSL: Custom DSL format
  * - DSL_VERBOSE: Custom DSL format with verbose output
+ * - STATS: Per-level analytics report in JSON
+ * - STATS_CSV: Per-level analytics report in CSV
+ * - SPATIAL: Per-level sector adjacency graph and grid index in JSON
+ * - ARROW: Level tables in the Apache Arrow IPC file format
  * The format is used to determine how to read or write the file.
  * The default format is WAD.
  */
@@ -21,10 +34,17 @@ enum class WADFormat : std::uint8_t {
   WAD,
   JSON,
   JSON_VERBOSE,
+  JSON_COLUMNAR,
   DSL,
-  DSL_VERBOSE
+  DSL_VERBOSE,
+  STATS,
+  STATS_CSV,
+  SPATIAL,
+  ARROW
 };
 
+class ReadPlan;  // See readplan.hpp
+
 /**
  * Class representing a WAD file. This class provides methods to read and
  * process WAD files, extract level data, and convert it to various formats. The
@@ -45,6 +65,15 @@ class WAD {
 public:
   // Constructor takes WAD file path
   explicit WAD(const std::string &filepath, bool verbose = false);
+  // WAD file already in memory; name stands in for the path
+  WAD(std::vector<uint8_t> data, const std::string &name,
+      bool verbose = false);
+
+  // Levels imported from a converted file (see importer.hpp). There is no
+  // directory and there are no assets, processWAD() keeps the given levels
+  struct Level;
+  WAD(const std::string &filepath, std::vector<Level> levels,
+      bool verbose = false);
 
   // WAD header structure
   struct Header {
@@ -103,6 +132,99 @@ public:
     uint16_t flags;
   };
 
+  // BSP records of the SEGS, SSECTORS and NODES lumps (see nodes.hpp)
+  struct Seg {
+    uint16_t start_vertex;
+    uint16_t end_vertex;
+    int16_t  angle;      // Binary angle, 0x4000 is 90 degrees
+    uint16_t linedef;
+    uint16_t direction;  // 0 along the linedef (right side), 1 against it
+    int16_t  offset;     // Distance from the start of the linedef side
+  };
+
+  struct SubSector {
+    uint16_t seg_count;
+    uint16_t first_seg;
+  };
+
+  struct Node {
+    int16_t  x, y;         // Partition line start
+    int16_t  dx, dy;       // Partition line direction
+    int16_t  bbox[2][4];   // Child bounding boxes: top, bottom, left, right
+    uint16_t children[2];  // Right and left child; kSubSector for a leaf
+  };
+
+  // Node child flag: the child is a subsector
+  static constexpr uint16_t kSubSector = 0x8000;
+
+  // Map format of a level, detected from the lumps after its marker
+  enum class LevelFormat {
+    Doom,   // Binary lumps, 10 byte things and 14 byte linedefs
+    Hexen,  // Binary lumps with a BEHAVIOR lump, 20 byte things and 16 byte
+            // linedefs carrying action specials
+    UDMF    // TEXTMAP text lump up to ENDMAP
+  };
+
+  // Hexen THINGS record (20 bytes)
+  struct HexenThing {
+    uint16_t tid;
+    int16_t  x;
+    int16_t  y;
+    int16_t  z;
+    uint16_t angle;
+    uint16_t type;
+    uint16_t flags;
+    uint8_t  special;
+    uint8_t  args[5];
+  };
+
+  // Hexen LINEDEFS record (16 bytes)
+  struct HexenLinedef {
+    uint16_t start_vertex;
+    uint16_t end_vertex;
+    uint16_t flags;
+    uint8_t  special;
+    uint8_t  args[5];
+    uint16_t right_sidedef;
+    uint16_t left_sidedef;
+  };
+
+  // What a Hexen or UDMF thing has on top of a DOOM one
+  struct ThingArgs {
+    uint16_t tid;          // Thing id
+    int16_t  z;            // Height above the floor
+    uint16_t special;      // Action special
+    uint16_t hexen_flags;  // Hexen thing flags DOOM has no bit for
+    int32_t  args[5];      // Special arguments
+  };
+
+  // Hexen thing flags. The skill bits and ambush (0x000F) are the DOOM ones
+  // and go to Thing::flags, with multiplayer only (0x0010) set when the
+  // thing is not in single player; these go to ThingArgs::hexen_flags
+  static constexpr uint16_t kHexenDormant    = 0x0010;
+  static constexpr uint16_t kHexenFighter    = 0x0020;
+  static constexpr uint16_t kHexenCleric     = 0x0040;
+  static constexpr uint16_t kHexenMage       = 0x0080;
+  static constexpr uint16_t kHexenSingle     = 0x0100;
+  static constexpr uint16_t kHexenCoop       = 0x0200;
+  static constexpr uint16_t kHexenDeathmatch = 0x0400;
+
+  // Hexen linedef flags above the DOOM ones (0x0001-0x0100), kept as is in
+  // Linedef::flags: a repeatable special, what activates it (a SPAC value in
+  // kHexenActivation: 0 player cross, 1 use, 2 monster cross, 3 impact,
+  // 4 push, 5 projectile cross, and in ZDoom 6 use through, 7 any cross)
+  // and ZDoom's monsters-can-activate bit
+  static constexpr uint16_t kHexenRepeatSpecial   = 0x0200;
+  static constexpr uint16_t kHexenActivation      = 0x1C00;
+  static constexpr int      kHexenActivationShift = 10;
+  static constexpr uint16_t kHexenMonsterActivate = 0x2000;
+
+  // Special arguments of a Hexen or UDMF linedef (the special itself is in
+  // Linedef::line_type)
+  struct LinedefArgs {
+    int32_t args[5];
+  };
+
   struct PatchHeader {
     int16_t  width;             // Width of patch
     int16_t  height;            // Height of patch
@@ -118,11 +240,17 @@ public:
     uint8_t data[];     // Pixel data
   };
 
+  // Decoded patch: one palette index per pixel, and a bit per pixel set
+  // where a post covers it (the holes between posts are transparent), both
+  // row by row. Expand to RGBA with LightTable::shadeMasked (shade.hpp).
   struct PatchData {
     char                 name[8];  // name from PNAMES
     uint16_t             width;    // Width of the patch
     uint16_t             height;   // Height of the patch
-    std::vector<uint8_t> pixels;   // Pixel data (width * height)
+    std::vector<uint8_t> pixels;   // Palette indices (width * height)
+    std::vector<uint8_t> mask;     // Opacity, bit i % 8 of byte i / 8
+
+    bool opaque(std::size_t i) const { return (mask[i >> 3] >> (i & 7)) & 1; }
   };
 
   // Patch definition in a texture
@@ -154,72 +282,216 @@ public:
     std::vector<uint8_t> data;  // Raw flat data (64x64 pixels)
   };
 
+  // Palette, textures and patches, loaded once by processAssets() and shared
+  // by every level rather than copied into each
+  struct Assets {
+    std::vector<PatchData>   patches;       // Empty in memory-bounded mode
+    std::vector<std::string> patch_names;   // PNAMES
+    std::vector<TextureDef>  texture_defs;  // TEXTURE1/TEXTURE2
+    std::vector<Color>       palette;       // PLAYPAL lump (256 colors)
+    std::vector<uint8_t>     colormap;      // COLORMAP lump (see shade.hpp)
+  };
+
   struct Level {
-    char name[8];
+    Level() = default;
+    // Level whose geometry is allocated from the given arena (see loadLevel)
+    explicit Level(std::shared_ptr<std::pmr::memory_resource> levelArena)
+        : arena(std::move(levelArena)), vertices(arena.get()),
+          linedefs(arena.get()), sidedefs(arena.get()), sectors(arena.get()),
+          things(arena.get()), thing_args(arena.get()),
+          linedef_args(arena.get()), segs(arena.get()),
+          subsectors(arena.get()), nodes(arena.get()) {}
+
+    // Copies allocate their geometry from the default memory resource; moves
+    // keep the arena of the level moved from. Assignment destroys this
+    // level's vectors before its arena goes (see WAD::Level::operator=).
+    Level(const Level &)            = default;
+    Level(Level &&)                 = default;
+    Level &operator=(const Level &other);
+    Level &operator=(Level &&other) noexcept;
+    ~Level()                        = default;
+
+    // Arena owning the geometry below, released in one shot with the level.
+    // Declared first so it outlives the vectors allocated from it.
+    std::shared_ptr<std::pmr::memory_resource> arena;
+
+    char        name[8];
+    LevelFormat format = LevelFormat::Doom;
     // Initial player position and angle
     Thing player_start;  // Player 1 start position (Thing type 1)
-    bool  has_player_start;
+    bool  has_player_start = false;
     // Level geometry
-    std::vector<Vertex>  vertices;
-    std::vector<Linedef> linedefs;
-    std::vector<Sidedef> sidedefs;
-    std::vector<Sector>  sectors;
-    std::vector<Thing>   things;
-    // Textures and visuals
-    std::vector<PatchData>   patches;
-    std::vector<std::string> patch_names;   // PNAMES
-    std::vector<TextureDef>  texture_defs;  // TEXTURE1/TEXTURE2
-    std::vector<Color>       palette;       // PLAYPAL lump (256 colors)
-    std::vector<FlatData>    flats;         // Floor/ceiling textures
+    std::pmr::vector<Vertex>  vertices;
+    std::pmr::vector<Linedef> linedefs;
+    std::pmr::vector<Sidedef> sidedefs;
+    std::pmr::vector<Sector>  sectors;
+    std::pmr::vector<Thing>   things;
+    // Hexen and UDMF levels only: specials and arguments, one entry per thing
+    // and per linedef in the same order (empty for DOOM levels)
+    std::pmr::vector<ThingArgs>   thing_args;
+    std::pmr::vector<LinedefArgs> linedef_args;
+    // BSP tree, only with node building on (see setNodeBuilding); the split
+    // vertices it needs follow the map vertices in vertices
+    std::pmr::vector<Seg>       segs;
+    std::pmr::vector<SubSector> subsectors;
+    std::pmr::vector<Node>      nodes;
+    // What the WAD writer needs to write Hexen and UDMF levels back: the
+    // BEHAVIOR lump (compiled scripts) as read, and the TEXTMAP namespace
+    std::vector<uint8_t> behavior;
+    std::string          udmf_namespace;
+    // Textures and visuals: the WAD's assets (null for imported levels)
+    // and the floor/ceiling textures this level uses
+    std::shared_ptr<const Assets> assets;
+    std::vector<FlatData>         flats;
   };
 
   // Process and load all WAD data
   void processWAD();
 
+  // Incremental loading, used by the conversion pipeline: load the shared
+  // assets once, then each level on its own from its marker index
+  void                processAssets();
+  std::vector<size_t> levelMarkers() const;
+  LevelFormat         levelFormat(size_t markerIndex) const;
+  Level               loadLevel(size_t                     markerIndex,
+                                std::pmr::memory_resource *upstream =
+                                    std::pmr::new_delete_resource(),
+                                bool useArena = true) const;
+
+  // Memory-bounded mode: with a non-zero budget (in bytes) patches are no
+  // longer decoded up front, but decoded on demand through getPatch() and
+  // evicted when the caches go over budget
+  void        setMemoryBudget(std::size_t bytes);
+  std::size_t memoryBudget() const { return memoryBudget_; }
+  std::shared_ptr<const PatchData> getPatch(NameKey name) const;
+
+  // BSP nodes of the loaded levels: Keep leaves SEGS, SSECTORS and NODES
+  // alone (the levels carry none), Missing builds them for the levels that
+  // lack them or whose nodes do not match their linedefs and keeps the
+  // others, Always rebuilds them for every level (see nodes.hpp)
+  enum class NodeBuilding { Keep, Missing, Always };
+  void setNodeBuilding(NodeBuilding mode) { nodeBuilding_ = mode; }
+
   // Convert WAD data to JSON format
   std::string toJSON() const;
   std::string toJSONVerbose() const;
+  std::string toJSONColumnar() const;
   // Convert WAD data to custom DSL format
   std::string toDSL() const;
+  std::string toDSLVerbose() const;
+  // Per-level analytics report (see stats.hpp)
+  std::string toStats() const;
+  std::string toStatsCSV() const;
+  // Sector adjacency graphs and grid indexes (see spatial.hpp)
+  std::string toSpatial() const;
+
+  // Raw access to the file, used by the WAD writer (see wadwriter.hpp)
+  const Header                 &header() const { return header_; }
+  const std::vector<Directory> &directory() const { return directory_; }
+  std::vector<uint8_t>          lumpData(size_t index) const;
+  const std::string            &filepath() const { return filepath_; }
+  const std::vector<Level>     &levels() const { return levels_; }
+
+  // Silence the console messages, for library use (see wadconvert.h)
+  void setQuiet(bool quiet) { quiet_ = quiet; }
 
   Level       getLevel(const std::string &) const;
   std::string getLevelNameByIndex(int index) const;
 
 private:
   bool                   verbose_;
+  bool                   quiet_ = false;
   std::string            filepath_;
+  // File contents when opened from memory, otherwise lumps are read from disk
+  std::shared_ptr<const std::vector<uint8_t>> memory_;
   Header                 header_;
   std::vector<Directory> directory_;
-  std::vector<PatchData> patches_;
+
+  // Interned lump names, one id per directory entry (see names.hpp)
+  NameTable                  names_;
+  std::vector<NameTable::Id> lumpNames_;
+
+  // Assets shared by every level (see processAssets)
+  std::shared_ptr<Assets> assets_ = std::make_shared<Assets>();
+
+  // Location of a lump in the file
+  struct LumpRef {
+    uint32_t filepos;
+    uint32_t size;
+  };
+
+  // Flats by name, from the flat sections of the directory (readDirectory)
+  std::unordered_map<NameKey, LumpRef> flatLumps_;
+
+  // Patches decoded up front, by name: index in assets_->patches; and the
+  // error of those that could not be decoded, thrown again by getPatch()
+  std::unordered_map<NameKey, std::size_t> patchIndex_;
+  std::unordered_map<NameKey, std::string> patchErrors_;
+
+  // On-demand asset loading (see setMemoryBudget)
+  std::size_t                                       memoryBudget_ = 0;
+  std::unordered_map<NameKey, LumpRef>              patchLumps_;
+  mutable AssetCache<PatchData, NameKey>            patchCache_;
+  mutable AssetCache<std::vector<uint8_t>, NameKey> flatCache_;
+
+  NodeBuilding nodeBuilding_ = NodeBuilding::Keep;
 
   // List of levels in the WAD file
   std::vector<Level> levels_;
 
-  // Method to read the WAD directory
-  void        readDirectory();
-  static bool isLevelMarker(const std::string &name);
+  // Methods to read the WAD header and directory
+  void          readHeader(const uint8_t *raw);
+  void          readDirectory();
+  std::ostream &log() const;
+  static bool   isLevelMarker(NameKey name);
 
   // Method to find a lump by name
-  bool findLump(const std::string &name, uint32_t &offset, uint32_t &size,
+  bool findLump(NameKey name, uint32_t &offset, uint32_t &size,
                 size_t startIndex) const;
   // Method to read a lump from the WAD file
-  std::vector<uint8_t> readLump(std::streamoff offset, std::size_t size);
-
-  // Methods to read lumps by type
-  // These methods will read the lump data and return a vector of the
-  // appropriate type
-  std::vector<Vertex>  readVertices(std::streamoff offset, std::size_t size);
-  std::vector<Linedef> readLinedefs(std::streamoff offset, std::size_t size);
-  std::vector<Sidedef> readSidedefs(std::streamoff offset, std::size_t size);
-  std::vector<Sector>  readSectors(std::streamoff offset, std::size_t size);
-  std::vector<Thing>   readThings(std::streamoff offset, std::size_t size);
+  std::vector<uint8_t> readLump(std::streamoff offset, std::size_t size) const;
+  void readLumpInto(std::streamoff offset, std::size_t size,
+                    uint8_t *dest) const;
+  // Read every lump of a plan, from the file or from memory_
+  void fetch(ReadPlan &plan) const;
+  // Decode a lump of fixed-size records through LumpView<T>
+  template <typename T>
+  std::pmr::vector<T> readRecords(const uint8_t             *data,
+                                  std::size_t                size,
+                                  std::pmr::memory_resource *resource) const;
+
+  // Methods to decode level lumps by type, from the bytes of the lump
+  std::pmr::vector<Vertex>  readVertices(const uint8_t             *data,
+                                         std::size_t                size,
+                                         std::pmr::memory_resource *res) const;
+  std::pmr::vector<Linedef> readLinedefs(const uint8_t             *data,
+                                         std::size_t                size,
+                                         std::pmr::memory_resource *res) const;
+  std::pmr::vector<Sidedef> readSidedefs(const uint8_t             *data,
+                                         std::size_t                size,
+                                         std::pmr::memory_resource *res) const;
+  std::pmr::vector<Sector>  readSectors(const uint8_t             *data,
+                                        std::size_t                size,
+                                        std::pmr::memory_resource *res) const;
+  std::pmr::vector<Thing>   readThings(const uint8_t             *data,
+                                       std::size_t                size,
+                                       std::pmr::memory_resource *res) const;
+  void readHexenThings(const uint8_t *data, std::size_t size,
+                       Level &level) const;
+  void readHexenLinedefs(const uint8_t *data, std::size_t size,
+                         Level &level) const;
   std::vector<std::string> readPatchNames(std::streamoff offset,
-                                          std::size_t    size);
+                                          std::size_t    size) const;
   std::vector<TextureDef>  readTextureDefs(std::streamoff offset,
-                                           std::size_t    size);
+                                           std::size_t    size) const;
   PatchData                readPatch(std::streamoff offset, std::size_t size,
-                                     const std::string &name);
-  std::vector<Color>       readPalette(std::streamoff offset, std::size_t size);
+                                     const std::string &name) const;
+  PatchData                decodePatch(const uint8_t *data, std::size_t size,
+                                       const std::string &name) const;
+  std::vector<Color>       readPalette(std::streamoff offset,
+                                       std::size_t    size) const;
+  std::vector<uint8_t>     readColormap(std::streamoff offset,
+                                        std::size_t    size) const;
 };
 
 #endif  // WAD_HPP
@@ -0,0 +1,164 @@
+#ifndef WADCONVERT_H
+#define WADCONVERT_H
+
+/*
+ * C API of libwadconvert: open a WAD from a file or from memory, list its
+ * levels and get their geometry as plain arrays, without going through any
+ * of the text outputs.
+ *
+ * Thread safety: an open wc_wad is never modified, any number of threads may
+ * call wc_load_level() and the other functions on it at the same time. A
+ * wc_level belongs to the caller. Error messages are kept per thread.
+ *
+ * Record structures have the layout of the level lumps of a DOOM WAD (and of
+ * the C++ WAD::Vertex, WAD::Linedef, ... structures), so the arrays point
+ * straight into the loaded level and stay valid until wc_free_level().
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(WADCONVERT_SHARED)
+#if defined(_WIN32)
+#if defined(WADCONVERT_BUILDING)
+#define WC_API __declspec(dllexport)
+#else
+#define WC_API __declspec(dllimport)
+#endif
+#else
+#define WC_API __attribute__((visibility("default")))
+#endif
+#else
+#define WC_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Version of this interface, raised on incompatible changes */
+#define WC_API_VERSION 1
+
+typedef struct wc_wad   wc_wad;
+typedef struct wc_level wc_level;
+
+typedef enum wc_status {
+  WC_OK               = 0,
+  WC_ERROR_ARGUMENT   = 1, /* Null pointer or index out of range */
+  WC_ERROR_WAD        = 2, /* Unreadable file, invalid WAD or level data */
+  WC_ERROR_NO_MEMORY  = 3,
+  WC_ERROR_NOT_FOUND  = 4  /* No level with that name */
+} wc_status;
+
+typedef enum wc_level_format {
+  WC_FORMAT_DOOM  = 0,
+  WC_FORMAT_HEXEN = 1,
+  WC_FORMAT_UDMF  = 2
+} wc_level_format;
+
+typedef struct wc_vertex {
+  int16_t x;
+  int16_t y;
+} wc_vertex;
+
+typedef struct wc_linedef {
+  uint16_t start_vertex;
+  uint16_t end_vertex;
+  uint16_t flags;
+  uint16_t line_type; /* Special for Hexen and UDMF levels */
+  uint16_t sector_tag;
+  uint16_t right_sidedef;
+  uint16_t left_sidedef; /* 0xFFFF when one-sided */
+} wc_linedef;
+
+typedef struct wc_sidedef {
+  int16_t  x_offset;
+  int16_t  y_offset;
+  char     upper_texture[8]; /* Names are zero-padded, not terminated */
+  char     lower_texture[8];
+  char     middle_texture[8];
+  uint16_t sector;
+} wc_sidedef;
+
+typedef struct wc_sector {
+  int16_t  floor_height;
+  int16_t  ceiling_height;
+  char     floor_texture[8];
+  char     ceiling_texture[8];
+  uint16_t light_level;
+  uint16_t type;
+  uint16_t tag;
+} wc_sector;
+
+typedef struct wc_thing {
+  int16_t  x;
+  int16_t  y;
+  uint16_t angle;
+  uint16_t type;
+  uint16_t flags;
+} wc_thing;
+
+/* Hexen and UDMF levels: what a thing and a linedef have on top */
+typedef struct wc_thing_args {
+  uint16_t tid;
+  int16_t  z;
+  uint16_t special;
+  uint16_t hexen_flags; /* Dormant, classes, single, coop, deathmatch */
+  int32_t  args[5];
+} wc_thing_args;
+
+typedef struct wc_linedef_args {
+  int32_t args[5];
+} wc_linedef_args;
+
+/* WC_API_VERSION of the library actually loaded */
+WC_API uint32_t wc_api_version(void);
+
+/* Message of the last error on the calling thread ("" if none) */
+WC_API const char *wc_last_error(void);
+
+/* Open a WAD file. Only the header and directory are read here. */
+WC_API wc_status wc_open_file(const char *path, wc_wad **wad);
+
+/* Open a WAD held in memory. The data is copied, the caller keeps it. */
+WC_API wc_status wc_open_memory(const void *data, size_t size, wc_wad **wad);
+
+/* Close a WAD; levels loaded from it stay valid */
+WC_API void wc_close(wc_wad *wad);
+
+/* Levels, in directory order */
+WC_API size_t      wc_level_count(const wc_wad *wad);
+WC_API const char *wc_level_name(const wc_wad *wad, size_t index);
+WC_API wc_status   wc_find_level(const wc_wad *wad, const char *name,
+                                 size_t *index);
+
+/* Load a level; free it with wc_free_level() */
+WC_API wc_status wc_load_level(const wc_wad *wad, size_t index,
+                               wc_level **level);
+WC_API void      wc_free_level(wc_level *level);
+
+/* Level contents. Each array function stores the number of records in
+   *count (which may be null) and returns null when there are none. */
+WC_API const char      *wc_level_get_name(const wc_level *level);
+WC_API wc_level_format  wc_level_get_format(const wc_level *level);
+WC_API const wc_vertex *wc_level_vertices(const wc_level *level,
+                                          size_t         *count);
+WC_API const wc_linedef *wc_level_linedefs(const wc_level *level,
+                                           size_t         *count);
+WC_API const wc_sidedef *wc_level_sidedefs(const wc_level *level,
+                                           size_t         *count);
+WC_API const wc_sector *wc_level_sectors(const wc_level *level,
+                                         size_t         *count);
+WC_API const wc_thing  *wc_level_things(const wc_level *level,
+                                        size_t         *count);
+/* One entry per thing and per linedef, none for DOOM levels */
+WC_API const wc_thing_args   *wc_level_thing_args(const wc_level *level,
+                                                  size_t         *count);
+WC_API const wc_linedef_args *wc_level_linedef_args(const wc_level *level,
+                                                    size_t         *count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* WADCONVERT_H */
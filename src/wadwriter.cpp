@@ -0,0 +1,328 @@
+#include "wadwriter.hpp"
+#include "lump.hpp"
+#include "udmf.hpp"
+#include "wad.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+// Lump data is aligned to this many bytes in the file
+constexpr uint64_t kLumpAlignment = 4;
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+// Round an offset up to the lump alignment
+static uint64_t alignLump(uint64_t offset) {
+  return (offset + kLumpAlignment - 1) & ~(kLumpAlignment - 1);
+}
+
+/**
+ * @brief Write a list of buffers to a file descriptor
+ * @param fd File descriptor
+ * @param buffers Buffers, written in order
+ * @return true if everything was written
+ * @note Uses writev() in batches of at most IOV_MAX buffers, continuing after
+ *       partial writes, so the whole file goes out in very few system calls
+ *       without first being copied into one contiguous buffer.
+ */
+static bool writeAll(int fd, std::vector<iovec> &buffers) {
+  std::size_t first = 0;
+  while (first < buffers.size()) {
+    int     count   = static_cast<int>(
+        std::min<std::size_t>(buffers.size() - first, IOV_MAX));
+    ssize_t written = writev(fd, &buffers[first], count);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+
+    // Skip what was written, which may end in the middle of a buffer
+    std::size_t remaining = static_cast<std::size_t>(written);
+    while (first < buffers.size() && remaining >= buffers[first].iov_len) {
+      remaining -= buffers[first].iov_len;
+      first++;
+    }
+    if (remaining > 0) {
+      buffers[first].iov_base =
+          static_cast<char *>(buffers[first].iov_base) + remaining;
+      buffers[first].iov_len -= remaining;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Rebuild the Hexen THINGS records of a level
+ * @param level Hexen level
+ * @return One record per thing
+ * @note The reverse of WAD::readHexenThings: the skill and ambush bits come
+ *       from the DOOM flags, the other bits from ThingArgs::hexen_flags.
+ */
+static std::vector<WAD::HexenThing> hexenThings(const WAD::Level &level) {
+  std::vector<WAD::HexenThing> records(level.things.size());
+  for (std::size_t i = 0; i < level.things.size(); i++) {
+    const WAD::Thing &thing = level.things[i];
+    WAD::ThingArgs    args  = {};
+    if (i < level.thing_args.size()) {
+      args = level.thing_args[i];
+    } else if (!(thing.flags & 0x0010)) {
+      args.hexen_flags = WAD::kHexenSingle;
+    }
+    WAD::HexenThing &record = records[i];
+    record.tid              = args.tid;
+    record.x                = thing.x;
+    record.y                = thing.y;
+    record.z                = args.z;
+    record.angle            = thing.angle;
+    record.type             = thing.type;
+    record.flags   = static_cast<uint16_t>((thing.flags & 0x000F) |
+                                           (args.hexen_flags & ~0x000F));
+    record.special = static_cast<uint8_t>(args.special);
+    for (int a = 0; a < 5; a++) {
+      record.args[a] = static_cast<uint8_t>(args.args[a]);
+    }
+  }
+  return records;
+}
+
+/**
+ * @brief Rebuild the Hexen LINEDEFS records of a level
+ * @param level Hexen level
+ * @return One record per linedef, the special from Linedef::line_type
+ */
+static std::vector<WAD::HexenLinedef>
+hexenLinedefs(const WAD::Level &level) {
+  std::vector<WAD::HexenLinedef> records(level.linedefs.size());
+  for (std::size_t i = 0; i < level.linedefs.size(); i++) {
+    const WAD::Linedef &linedef = level.linedefs[i];
+    WAD::HexenLinedef  &record  = records[i];
+    record.start_vertex         = linedef.start_vertex;
+    record.end_vertex           = linedef.end_vertex;
+    record.flags                = linedef.flags;
+    record.special              = static_cast<uint8_t>(linedef.line_type);
+    for (int a = 0; a < 5; a++) {
+      record.args[a] = i < level.linedef_args.size()
+                           ? static_cast<uint8_t>(level.linedef_args[i].args[a])
+                           : 0;
+    }
+    record.right_sidedef = linedef.right_sidedef;
+    record.left_sidedef  = linedef.left_sidedef;
+  }
+  return records;
+}
+
+/**
+ * @brief WAD writer constructor
+ * @param identification "PWAD" or "IWAD"
+ */
+WADWriter::WADWriter(std::string_view identification)
+    : dataEnd_(LumpRecord<WAD::Header>::size) {
+  std::memset(identification_, 0, sizeof(identification_));
+  std::memcpy(identification_, identification.data(),
+              std::min(identification.size(), sizeof(identification_)));
+}
+
+/**
+ * @brief Add a lump at the end of the directory
+ * @param name Lump name, copied as is (up to 8 bytes, zero-padded)
+ * @param data Lump data
+ * @throws std::runtime_error if the file would grow past 4 GB
+ * @note If an identical lump was already added, the new entry points at it
+ *       and the data is not stored again.
+ */
+void WADWriter::addLump(std::string_view name, std::vector<uint8_t> data) {
+  WAD::Directory entry{};
+  std::memcpy(entry.name, name.data(), std::min<std::size_t>(name.size(), 8));
+  entry.size = static_cast<uint32_t>(data.size());
+
+  if (data.empty()) {
+    // Markers have no data, point them at the current end of the lumps
+    entry.filepos = static_cast<uint32_t>(dataEnd_);
+    directory_.push_back(entry);
+    return;
+  }
+
+  uint64_t hash  = hashLump(data.data(), data.size());
+  auto     range = blobsByHash_.equal_range(hash);
+  for (auto it = range.first; it != range.second; ++it) {
+    const Blob &blob = blobs_[it->second];
+    if (blob.data == data) {
+      entry.filepos = blob.filepos;
+      directory_.push_back(entry);
+      sharedBytes_ += data.size();
+      return;
+    }
+  }
+
+  if (dataEnd_ + data.size() > std::numeric_limits<uint32_t>::max()) {
+    throw std::runtime_error("WAD output is larger than 4 GB");
+  }
+  entry.filepos = static_cast<uint32_t>(dataEnd_);
+  dataEnd_      = alignLump(dataEnd_ + data.size());
+  blobsByHash_.emplace(hash, blobs_.size());
+  blobs_.push_back({std::move(data), entry.filepos});
+  directory_.push_back(entry);
+}
+
+/**
+ * @brief Add the lumps of a level
+ * @param level Level to add
+ * @note Only the lumps held by WAD::Level are written, in the level's own
+ *       format. DOOM and Hexen levels get their binary lumps: SEGS, SSECTORS
+ *       and NODES go in their usual place when the level has nodes (see
+ *       WAD::setNodeBuilding), REJECT and BLOCKMAP are not written (most
+ *       ports build them when they are missing), and Hexen levels end with
+ *       their BEHAVIOR lump. UDMF levels get a TEXTMAP lump and ENDMAP.
+ */
+void WADWriter::addLevel(const WAD::Level &level) {
+  addLump(std::string_view(level.name, strnlen(level.name, 8)), {});
+  if (level.format == WAD::LevelFormat::UDMF) {
+    std::string text = writeUDMF(level);
+    addLump("TEXTMAP", std::vector<uint8_t>(text.begin(), text.end()));
+    addLump("ENDMAP", {});
+    return;
+  }
+
+  if (level.format == WAD::LevelFormat::Hexen) {
+    addLump("THINGS", encodeRecords<WAD::HexenThing>(hexenThings(level)));
+    addLump("LINEDEFS",
+            encodeRecords<WAD::HexenLinedef>(hexenLinedefs(level)));
+  } else {
+    addLump("THINGS", encodeRecords<WAD::Thing>(level.things));
+    addLump("LINEDEFS", encodeRecords<WAD::Linedef>(level.linedefs));
+  }
+  addLump("SIDEDEFS", encodeRecords<WAD::Sidedef>(level.sidedefs));
+  addLump("VERTEXES", encodeRecords<WAD::Vertex>(level.vertices));
+  if (!level.subsectors.empty()) {
+    addLump("SEGS", encodeRecords<WAD::Seg>(level.segs));
+    addLump("SSECTORS", encodeRecords<WAD::SubSector>(level.subsectors));
+    addLump("NODES", encodeRecords<WAD::Node>(level.nodes));
+  }
+  addLump("SECTORS", encodeRecords<WAD::Sector>(level.sectors));
+  if (level.format == WAD::LevelFormat::Hexen) {
+    // An empty BEHAVIOR still marks the level as a Hexen one
+    addLump("BEHAVIOR", level.behavior);
+  }
+}
+
+/**
+ * @brief Write the WAD file
+ * @param path Output file
+ * @return Sizes of what was written
+ * @throws std::runtime_error if the file cannot be written
+ */
+WADWriter::Stats WADWriter::write(const std::string &path) const {
+  constexpr std::size_t entrySize = LumpRecord<WAD::Directory>::size;
+
+  // Header and directory
+  WAD::Header header;
+  std::memcpy(header.identification, identification_, 4);
+  header.numlumps     = static_cast<uint32_t>(directory_.size());
+  header.infotableofs = static_cast<uint32_t>(dataEnd_);
+  uint8_t headerBytes[LumpRecord<WAD::Header>::size];
+  LumpRecord<WAD::Header>::encode(header, headerBytes);
+
+  std::vector<uint8_t> directoryBytes(directory_.size() * entrySize);
+  for (std::size_t i = 0; i < directory_.size(); i++) {
+    LumpRecord<WAD::Directory>::encode(directory_[i],
+                                       directoryBytes.data() + i * entrySize);
+  }
+
+  // Gather header, lumps (with their alignment padding) and directory
+  static const uint8_t padding[kLumpAlignment] = {};
+  std::vector<iovec>   buffers;
+  buffers.reserve(blobs_.size() * 2 + 2);
+  buffers.push_back({headerBytes, sizeof(headerBytes)});
+  for (const Blob &blob : blobs_) {
+    buffers.push_back(
+        {const_cast<uint8_t *>(blob.data.data()), blob.data.size()});
+    std::size_t pad = alignLump(blob.data.size()) - blob.data.size();
+    if (pad > 0) {
+      buffers.push_back({const_cast<uint8_t *>(padding), pad});
+    }
+  }
+  buffers.push_back({directoryBytes.data(), directoryBytes.size()});
+
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    throw std::runtime_error("Unable to open output file: " + path);
+  }
+  bool written = writeAll(fd, buffers);
+  if (close(fd) != 0 || !written) {
+    throw std::runtime_error("Unable to write output file: " + path);
+  }
+
+  Stats stats;
+  stats.lumps       = directory_.size();
+  stats.uniqueLumps = blobs_.size();
+  stats.sharedBytes = sharedBytes_;
+  stats.fileSize    = dataEnd_ + directoryBytes.size();
+  return stats;
+}
+
+/**
+ * @brief Write levels to a new PWAD
+ * @param levels Levels to write
+ * @param path Output file
+ * @return Sizes of what was written
+ * @throws std::runtime_error if the file cannot be written
+ */
+WADWriter::Stats writeLevels(const std::vector<WAD::Level> &levels,
+                             const std::string             &path) {
+  WADWriter writer;
+  for (const WAD::Level &level : levels) {
+    writer.addLevel(level);
+  }
+  return writer.write(path);
+}
+
+/**
+ * @brief Rewrite a WAD with shared duplicate lumps and no unused space
+ * @param wad WAD with its directory read
+ * @param path Output file
+ * @return Sizes of what was written
+ * @throws std::runtime_error if the file cannot be written, or the rewritten
+ *         file does not hold the same lumps as the original
+ * @note Every directory entry is kept, in order and with its exact name, so
+ *       the result loads exactly like the original. This is checked by
+ *       reading the new file back.
+ */
+WADWriter::Stats compactWAD(const WAD &wad, const std::string &path) {
+  const std::vector<WAD::Directory> &directory = wad.directory();
+
+  WADWriter writer(std::string_view(wad.header().identification, 4));
+  for (std::size_t i = 0; i < directory.size(); i++) {
+    writer.addLump(std::string_view(directory[i].name, 8), wad.lumpData(i));
+  }
+  WADWriter::Stats stats = writer.write(path);
+
+  // Read the new file back and compare it lump by lump
+  WAD                                compacted(path);
+  const std::vector<WAD::Directory> &check = compacted.directory();
+  bool same = check.size() == directory.size();
+  for (std::size_t i = 0; same && i < directory.size(); i++) {
+    same = std::memcmp(check[i].name, directory[i].name, 8) == 0 &&
+           compacted.lumpData(i) == wad.lumpData(i);
+  }
+  if (!same) {
+    throw std::runtime_error("Compacted WAD does not match the original: " +
+                             path);
+  }
+
+  return stats;
+}
@@ -0,0 +1,64 @@
+#ifndef WADWRITER_HPP
+#define WADWRITER_HPP
+
+#include "wad.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Builds a WAD file in memory and writes it out in one go. Lumps are added
+ * in directory order; byte-identical lumps are stored only once, with every
+ * directory entry for them pointing at the same file position. Lump data is
+ * aligned to 4 bytes and the directory goes after the last lump.
+ */
+class WADWriter {
+public:
+  // What a write produced
+  struct Stats {
+    std::size_t lumps       = 0;  // Directory entries
+    std::size_t uniqueLumps = 0;  // Lumps stored in the file
+    std::size_t sharedBytes = 0;  // Lump bytes not stored thanks to sharing
+    std::size_t fileSize    = 0;  // Size of the written file
+  };
+
+  // identification is "PWAD" or "IWAD"
+  explicit WADWriter(std::string_view identification = "PWAD");
+
+  // Add a lump; the name is copied as is (up to 8 bytes, zero-padded)
+  void addLump(std::string_view name, std::vector<uint8_t> data);
+  // Add a level in its own format: marker, THINGS, LINEDEFS, SIDEDEFS,
+  // VERTEXES, the nodes if any (SEGS, SSECTORS, NODES), SECTORS and for
+  // Hexen levels BEHAVIOR; or marker, TEXTMAP and ENDMAP for UDMF levels
+  void addLevel(const WAD::Level &level);
+
+  // Write the WAD file and return the sizes of what was written
+  Stats write(const std::string &path) const;
+
+private:
+  // Unique lump data and where it goes in the file
+  struct Blob {
+    std::vector<uint8_t> data;
+    uint32_t             filepos;
+  };
+
+  char                                           identification_[4];
+  std::vector<WAD::Directory>                    directory_;
+  std::vector<Blob>                              blobs_;
+  std::unordered_multimap<uint64_t, std::size_t> blobsByHash_;
+  uint64_t                                       dataEnd_;  // End of data
+  std::size_t                                    sharedBytes_ = 0;
+};
+
+// Write levels to a new PWAD
+WADWriter::Stats writeLevels(const std::vector<WAD::Level> &levels,
+                             const std::string             &path);
+
+// Rewrite a WAD with shared duplicate lumps and no unused space, checking
+// that the new file holds the same lumps
+WADWriter::Stats compactWAD(const WAD &wad, const std::string &path);
+
+#endif  // WADWRITER_HPP
@@ -0,0 +1,84 @@
+// Assignment of loaded levels: each level allocates its geometry from its
+// own arena, so assigning one to another must leave the target with the
+// source's geometry and no memory from its old, released arena. Run under
+// AddressSanitizer to catch a use after free. Exits with a non-zero status
+// on the first mismatch.
+
+#include "testwad.hpp"
+#include "wad.hpp"
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// True when two levels hold the same geometry and things
+bool sameLevel(const WAD::Level &a, const WAD::Level &b) {
+  auto same = [](const auto &x, const auto &y) {
+    return x.size() == y.size() &&
+           (x.empty() ||
+            std::memcmp(x.data(), y.data(), x.size() * sizeof(x[0])) == 0);
+  };
+  return std::memcmp(a.name, b.name, sizeof(a.name)) == 0 &&
+         same(a.vertices, b.vertices) && same(a.linedefs, b.linedefs) &&
+         same(a.sidedefs, b.sidedefs) && same(a.sectors, b.sectors) &&
+         same(a.things, b.things);
+}
+
+int check(const char *what, bool ok) {
+  std::cout << what << (ok ? ": ok\n" : ": MISMATCH\n");
+  return ok ? 0 : 1;
+}
+
+}  // namespace
+
+int main() {
+  try {
+    Lumps lumps = doomLevel("E1M1", 0);
+    for (auto &lump : doomLevel("E1M2", 32)) {
+      lumps.push_back(std::move(lump));
+    }
+    WAD wad(buildWAD(lumps), "level.wad");
+    wad.setQuiet(true);
+    std::vector<size_t> markers = wad.levelMarkers();
+    if (markers.size() != 2) {
+      std::cerr << "Error: expected 2 levels, found " << markers.size()
+                << "\n";
+      return 1;
+    }
+    const WAD::Level expected = wad.loadLevel(markers[1]);
+
+    int failures = 0;
+
+    // Move assignment between levels with their own arenas
+    WAD::Level moved = wad.loadLevel(markers[0]);
+    moved            = wad.loadLevel(markers[1]);
+    moved.vertices.push_back({1, 2});
+    moved.vertices.pop_back();
+    failures += check("move assignment", sameLevel(moved, expected));
+
+    // Copy assignment, then the source goes away
+    WAD::Level copied = wad.loadLevel(markers[0]);
+    {
+      WAD::Level source = wad.loadLevel(markers[1]);
+      copied            = source;
+    }
+    copied.things.push_back(copied.things.front());
+    copied.things.pop_back();
+    failures += check("copy assignment", sameLevel(copied, expected));
+
+    // Self assignment leaves the level as it was
+    WAD::Level &self = moved;
+    moved            = self;
+    moved            = std::move(self);
+    failures += check("self assignment", sameLevel(moved, expected));
+
+    return failures == 0 ? 0 : 1;
+  } catch (const std::exception &e) {
+    std::cerr << "Error: " << e.what() << "\n";
+    return 1;
+  }
+}
@@ -0,0 +1,91 @@
+// Round trip of the text outputs: a small WAD built in memory, with DOOM,
+// Hexen and UDMF levels, is converted to JSON, verbose JSON, DSL and verbose
+// DSL, each document is imported back and converted again, and the second
+// conversion must be identical to the first. The verbose JSON import must
+// also give the levels their format back. Exits with a non-zero status on
+// the first mismatch.
+
+#include "emitter.hpp"
+#include "importer.hpp"
+#include "testwad.hpp"
+#include "wad.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// A PWAD with two DOOM levels, a Hexen level and a UDMF level
+std::vector<uint8_t> testWAD() {
+  Lumps lumps = doomLevel("E1M1", 0);
+  for (Lumps level : {doomLevel("E1M2", 32), hexenLevel("MAP01"),
+                      udmfLevel("ARENA")}) {
+    for (auto &lump : level) {
+      lumps.push_back(std::move(lump));
+    }
+  }
+  return buildWAD(lumps);
+}
+
+// Convert levels to a whole document with the emitter of a format
+std::string emitAll(WADFormat format, const std::vector<WAD::Level> &levels) {
+  std::unique_ptr<Emitter> emitter = makeEmitter(format);
+  std::string              text    = emitter->begin();
+  for (const WAD::Level &level : levels) {
+    text += emitter->level(level);
+  }
+  text += emitter->end();
+  return text;
+}
+
+}  // namespace
+
+int main() {
+  try {
+    WAD wad(testWAD(), "roundtrip.wad");
+    wad.setQuiet(true);
+    wad.processWAD();
+    const std::vector<WAD::Level> &levels = wad.levels();
+
+    const std::pair<const char *, WADFormat> formats[] = {
+        {"json", WADFormat::JSON},
+        {"jsonverbose", WADFormat::JSON_VERBOSE},
+        {"dsl", WADFormat::DSL},
+        {"dslverbose", WADFormat::DSL_VERBOSE}};
+    int failures = 0;
+    for (const auto &format : formats) {
+      std::string             text = emitAll(format.second, levels);
+      std::istringstream      in(text);
+      std::vector<WAD::Level> imported =
+          format.second == WADFormat::DSL ||
+                  format.second == WADFormat::DSL_VERBOSE
+              ? importDSL(in)
+              : importJSON(in);
+
+      std::string again = emitAll(format.second, imported);
+      bool        sameFormats = imported.size() == levels.size();
+      for (std::size_t i = 0; sameFormats && i < levels.size(); i++) {
+        sameFormats = format.second != WADFormat::JSON_VERBOSE ||
+                      imported[i].format == levels[i].format;
+      }
+      if (levels.size() != 4 || !sameFormats || again != text) {
+        std::cerr << format.first << ": round trip MISMATCH ("
+                  << levels.size() << " levels, " << imported.size()
+                  << " imported)\n";
+        failures++;
+      } else {
+        std::cout << format.first << ": round trip ok\n";
+      }
+    }
+    return failures == 0 ? 0 : 1;
+  } catch (const std::exception &e) {
+    std::cerr << "Error: " << e.what() << "\n";
+    return 1;
+  }
+}
@@ -0,0 +1,196 @@
+// Small WADs built in memory for the tests: a little-endian lump writer, a
+// DOOM level of two rooms, and the PWAD around a list of lumps.
+
+#ifndef TESTWAD_HPP
+#define TESTWAD_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Little-endian writer for the lumps of a test WAD
+class Bytes {
+public:
+  Bytes &u8(uint8_t value) {
+    data.push_back(value);
+    return *this;
+  }
+  Bytes &u16(uint16_t value) {
+    data.push_back(static_cast<uint8_t>(value));
+    data.push_back(static_cast<uint8_t>(value >> 8));
+    return *this;
+  }
+  Bytes &i16(int16_t value) { return u16(static_cast<uint16_t>(value)); }
+  Bytes &u32(uint32_t value) {
+    u16(static_cast<uint16_t>(value));
+    return u16(static_cast<uint16_t>(value >> 16));
+  }
+  Bytes &name(const char *text) {
+    char padded[8] = {};
+    std::memcpy(padded, text, strnlen(text, sizeof(padded)));
+    data.insert(data.end(), padded, padded + sizeof(padded));
+    return *this;
+  }
+  Bytes &text(const std::string &text) {
+    data.insert(data.end(), text.begin(), text.end());
+    return *this;
+  }
+
+  std::vector<uint8_t> data;
+};
+
+// Lumps of a WAD, by name, in directory order
+using Lumps = std::vector<std::pair<std::string, Bytes>>;
+
+// Two rooms joined by a two-sided line, with things, tags and specials so
+// every field of the verbose formats carries something
+inline Lumps doomLevel(const char *marker, int16_t shift) {
+  Bytes things;
+  things.i16(64).i16(64).u16(90).u16(1).u16(7);
+  things.i16(384).i16(128).u16(180).u16(3001).u16(12);
+  things.i16(100).i16(200).u16(0).u16(2001).u16(7);
+  things.i16(300).i16(50).u16(270).u16(9999).u16(1);
+
+  Bytes linedefs;
+  const uint16_t lines[][7] = {
+      {0, 1, 1, 0, 0, 0, 0xFFFF}, {1, 2, 1, 0, 0, 1, 0xFFFF},
+      {2, 3, 4, 1, 7, 2, 4},      {3, 0, 1, 0, 0, 3, 0xFFFF},
+      {2, 4, 1, 0, 0, 5, 0xFFFF}, {4, 5, 1, 0, 0, 6, 0xFFFF},
+      {5, 3, 1, 0, 0, 7, 0xFFFF}};
+  for (const auto &line : lines) {
+    for (uint16_t field : line) {
+      linedefs.u16(field);
+    }
+  }
+
+  Bytes sidedefs;
+  const char *walls[][3] = {
+      {"-", "-", "STARTAN2"}, {"-", "-", "STARTAN2"}, {"-", "-", "-"},
+      {"-", "-", "BIGDOOR1"}, {"STARTAN2", "BROWN1", "-"},
+      {"-", "-", "STARTAN2"}, {"-", "-", "STARTAN2"}, {"-", "-", "BIGDOOR1"}};
+  for (uint16_t s = 0; s < 8; s++) {
+    sidedefs.i16(static_cast<int16_t>(s * 8)).i16(0);
+    sidedefs.name(walls[s][0]).name(walls[s][1]).name(walls[s][2]);
+    sidedefs.u16(s < 4 ? 0 : 1);
+  }
+
+  Bytes vertices;
+  const int16_t points[][2] = {{0, 0},   {0, 256}, {256, 256},
+                               {256, 0}, {512, 256}, {512, 0}};
+  for (const auto &point : points) {
+    vertices.i16(static_cast<int16_t>(point[0] + shift)).i16(point[1]);
+  }
+
+  Bytes sectors;
+  sectors.i16(0).i16(128).name("FLOOR0_1").name("CEIL1_1");
+  sectors.u16(160).u16(0).u16(0);
+  sectors.i16(16).i16(120).name("FLAT14").name("CEIL1_1");
+  sectors.u16(200).u16(9).u16(7);
+
+  return {{marker, {}},          {"THINGS", things},
+          {"LINEDEFS", linedefs}, {"SIDEDEFS", sidedefs},
+          {"VERTEXES", vertices}, {"SEGS", {}},
+          {"SSECTORS", {}},       {"NODES", {}},
+          {"SECTORS", sectors},   {"REJECT", {}},
+          {"BLOCKMAP", {}}};
+}
+
+// The rooms of doomLevel in the Hexen format: things with ids, heights and
+// specials, linedefs with activation flags and arguments, and a BEHAVIOR
+// lump
+inline Lumps hexenLevel(const char *marker) {
+  Lumps lumps = doomLevel(marker, 0);
+
+  Bytes things;
+  const int16_t spots[][8] = {{0, 64, 64, 0, 90, 1, 0x0107, 0},
+                              {5, 384, 128, 24, 180, 3001, 0x0617, 80},
+                              {0, 100, 200, 0, 0, 2001, 0x0007, 0}};
+  for (const auto &spot : spots) {
+    things.u16(static_cast<uint16_t>(spot[0])).i16(spot[1]).i16(spot[2]);
+    things.i16(spot[3]).i16(spot[4]).i16(spot[5]);
+    things.u16(static_cast<uint16_t>(spot[6]));
+    things.u8(static_cast<uint8_t>(spot[7])).u8(1).u8(2).u8(0).u8(0).u8(0);
+  }
+
+  Bytes linedefs;
+  const uint16_t lines[][6] = {
+      {0, 1, 1, 0, 0, 0xFFFF},      {1, 2, 1, 0, 1, 0xFFFF},
+      {2, 3, 0x0604, 12, 2, 4},     {3, 0, 1, 0, 3, 0xFFFF},
+      {2, 4, 0x2201, 70, 5, 0xFFFF}, {4, 5, 1, 0, 6, 0xFFFF},
+      {5, 3, 1, 0, 7, 0xFFFF}};
+  for (const auto &line : lines) {
+    linedefs.u16(line[0]).u16(line[1]).u16(line[2]);
+    linedefs.u8(static_cast<uint8_t>(line[3]));
+    linedefs.u8(line[3] != 0 ? 4 : 0).u8(0).u8(line[3] != 0 ? 16 : 0);
+    linedefs.u8(0).u8(0);
+    linedefs.u16(line[4]).u16(line[5]);
+  }
+
+  for (auto &lump : lumps) {
+    if (lump.first == "THINGS") {
+      lump.second = things;
+    } else if (lump.first == "LINEDEFS") {
+      lump.second = linedefs;
+    }
+  }
+  Bytes behavior;
+  behavior.text("ACS").u8(0).u32(8).u32(0);
+  lumps.emplace_back("BEHAVIOR", behavior);
+  return lumps;
+}
+
+// A UDMF level: one room whose linedefs and things use the keys the tool
+// keeps, marked by a name that is not ExMy or MAPxx
+inline Lumps udmfLevel(const char *marker) {
+  Bytes textmap;
+  textmap.text(R"(namespace = "zdoom";
+vertex { x = 0.0; y = 0.0; }
+vertex { x = 0.0; y = 128.0; }
+vertex { x = 128.5; y = 128.0; }
+vertex { x = 128.0; y = 0.0; }
+linedef { v1 = 0; v2 = 1; sidefront = 0; blocking = true; }
+linedef { v1 = 1; v2 = 2; sidefront = 1; special = 80; arg0 = 3;
+          playeruse = true; repeatspecial = true; }
+linedef { v1 = 2; v2 = 3; sidefront = 2; special = 70; id = 4;
+          playercross = true; monstercross = true; }
+linedef { v1 = 3; v2 = 0; sidefront = 3; special = 24; impact = true; }
+sidedef { sector = 0; texturemiddle = "STONE2"; }
+sidedef { sector = 0; texturemiddle = "STONE2"; offsetx = 8; }
+sidedef { sector = 0; texturemiddle = "DOOR1"; }
+sidedef { sector = 0; texturemiddle = "STONE2"; }
+sector { texturefloor = "FLOOR1"; textureceiling = "CEIL1";
+         heightceiling = 128; lightlevel = 192; special = 9; id = 2; }
+thing { x = 32.0; y = 32.0; type = 1; angle = 90; skill1 = true;
+        skill2 = true; skill3 = true; skill4 = true; skill5 = true;
+        single = true; }
+thing { x = 96.0; y = 96.0; height = 16.0; type = 3001; id = 7;
+        special = 80; arg0 = 1; arg1 = -2; skill3 = true; ambush = true;
+        class1 = true; dm = true; }
+)");
+  return {{marker, {}}, {"TEXTMAP", textmap}, {"ENDMAP", {}}};
+}
+
+// A PWAD holding the given lumps
+inline std::vector<uint8_t> buildWAD(const Lumps &lumps) {
+  Bytes    file;
+  uint32_t offset = 12;
+  Bytes    directory;
+  for (const auto &lump : lumps) {
+    uint32_t size = static_cast<uint32_t>(lump.second.data.size());
+    directory.u32(offset).u32(size).name(lump.first.c_str());
+    offset += size;
+  }
+  file.data = {'P', 'W', 'A', 'D'};
+  file.u32(static_cast<uint32_t>(lumps.size())).u32(offset);
+  for (const auto &lump : lumps) {
+    file.data.insert(file.data.end(), lump.second.data.begin(),
+                     lump.second.data.end());
+  }
+  file.data.insert(file.data.end(), directory.data.begin(),
+                   directory.data.end());
+  return file.data;
+}
+
+#endif  // TESTWAD_HPP